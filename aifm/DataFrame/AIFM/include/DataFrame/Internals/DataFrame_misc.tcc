@@ -184,6 +184,18 @@ DataFrame<I, H>::groupby_functor_<T, F, Ts ...>::operator() (const U &vec)  {
         agg_vec = const_cast<U *>(&vec)->aggregate_min(manager, key_vec);
     } else if constexpr (std::is_same<F, GroupbyMedian>::value) {
         agg_vec = const_cast<U *>(&vec)->aggregate_median(manager, key_vec);
+    } else if constexpr (std::is_same<F, GroupbySum>::value) {
+        agg_vec = const_cast<U *>(&vec)->aggregate(
+            manager, key_vec, far_memory::GenericDataFrameVector::Sum);
+    } else if constexpr (std::is_same<F, GroupbyMean>::value) {
+        agg_vec = const_cast<U *>(&vec)->aggregate(
+            manager, key_vec, far_memory::GenericDataFrameVector::Mean);
+    } else if constexpr (std::is_same<F, GroupbyVar>::value) {
+        agg_vec = const_cast<U *>(&vec)->aggregate(
+            manager, key_vec, far_memory::GenericDataFrameVector::Var);
+    } else if constexpr (std::is_same<F, GroupbyStd>::value) {
+        agg_vec = const_cast<U *>(&vec)->aggregate(
+            manager, key_vec, far_memory::GenericDataFrameVector::Std);
     } else {
         BUG();
     }
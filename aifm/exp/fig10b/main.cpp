@@ -22,6 +22,10 @@ using namespace std;
 
 #define ACCESS_ONCE(x) (*(volatile typeof(x) *)&(x))
 
+#ifndef PIPELINED
+#define PIPELINED 0
+#endif
+
 std::atomic_flag flag;
 std::unique_ptr<std::mt19937> generators[helpers::kNumCPUs];
 __thread uint32_t per_core_req_idx = 0;
@@ -43,7 +47,8 @@ private:
   constexpr static uint32_t kMaxNumMutatorThreads = 400;
   constexpr static uint32_t kNumMutatorThreads = 10;
   constexpr static uint32_t kReqSeqLenPerCore = kNumKVPairs;
-  constexpr static uint32_t kNumConnections = 650;
+  // Protocol v2 pipelines many requests on each connection.
+  constexpr static uint32_t kNumConnections = PIPELINED ? 16 : 650;
   constexpr static uint32_t kMonitorPerIter = 262144;
   constexpr static uint32_t kMinMonitorIntervalUs = 10 * 1000 * 1000;
   constexpr static uint32_t kMaxRunningUs = 200 * 1000 * 1000; // 200 seconds
@@ -218,7 +223,7 @@ public:
     BUG_ON(madvise(all_gen_keys, sizeof(all_gen_keys), MADV_HUGEPAGE) != 0);
     manager.reset(FarMemManagerFactory::build(
         kCacheSize, kNumGCThreads,
-        new TCPDevice(raddr, kNumConnections, kFarMemSize)));
+        new TCPDevice(raddr, kNumConnections, kFarMemSize, PIPELINED)));
     auto hopscotch = std::unique_ptr<GenericConcurrentHopscotch>(
         manager->allocate_concurrent_hopscotch_heap(
             kLocalHashTableNumEntriesShift, kRemoteHashTableNumEntriesShift,
@@ -22,7 +22,12 @@ extern "C" {
 constexpr uint64_t kCacheSize = 22432 * Region::kSize;
 constexpr uint64_t kFarMemSize = 20ULL << 30;
 constexpr uint64_t kNumGCThreads = 15;
-constexpr uint64_t kNumConnections = 600;
+#ifndef PIPELINED
+#define PIPELINED 0
+#endif
+
+// Protocol v2 pipelines many requests on each connection.
+constexpr uint64_t kNumConnections = PIPELINED ? 16 : 600;
 constexpr uint64_t kUncompressedFileSize = 1000000000;
 constexpr uint64_t kUncompressedFileNumBlocks =
     ((kUncompressedFileSize - 1) / snappy::FileBlock::kSize) + 1;
@@ -114,7 +119,7 @@ void fm_compress_files_bench(const string &in_file_path,
 void do_work(netaddr raddr) {
   auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
       kCacheSize, kNumGCThreads,
-      new TCPDevice(raddr, kNumConnections, kFarMemSize)));
+      new TCPDevice(raddr, kNumConnections, kFarMemSize, PIPELINED)));
   for (uint32_t i = 0; i < kNumUncompressedFiles; i++) {
     fm_array_ptrs[i].reset(
         manager->allocate_array_heap<snappy::FileBlock,
@@ -9,6 +9,8 @@ extern "C" {
 #include "deref_scope.hpp"
 #include "device.hpp"
 #include "manager.hpp"
+#include "prefetch_policy.hpp"
+#include "stats.hpp"
 
 #include <algorithm>
 #include <chrono>
@@ -33,6 +35,12 @@ DEFINE_DATA_TYPE(4096);
 #define DELAY_NS_PER_ITER 0
 #endif
 
+// 0: built-in single-stride detection, 1: stride table, 2: delta correlation,
+// 3: next-index callback.
+#ifndef PREFETCH_POLICY
+#define PREFETCH_POLICY 0
+#endif
+
 constexpr uint64_t kCacheSize = 512ULL << 20;
 constexpr uint64_t kFarMemSize = 10ULL << 30;
 constexpr uint64_t kWorkingSetSize = 8ULL << 30;
@@ -81,12 +89,22 @@ void do_work(void *arg) {
           new TCPDevice(raddr, kNumConnections, kFarMemSize)));
   auto fm_array = std::unique_ptr<Array<Data_t, kNumEntries>>(
       manager->allocate_array_heap<Data_t, kNumEntries>());
+#if PREFETCH_POLICY == 1
+  fm_array->set_prefetch_policy(std::make_unique<StrideTablePolicy>());
+#elif PREFETCH_POLICY == 2
+  fm_array->set_prefetch_policy(std::make_unique<DeltaCorrelationPolicy>());
+#elif PREFETCH_POLICY == 3
+  fm_array->set_prefetch_policy(std::make_unique<CallbackPolicy>(
+      [](uint64_t idx) -> std::optional<uint64_t> { return idx + 1; }));
+#endif
 
   // Flush cache.
   read_array_element_api(fm_array.get());
   read_array_element_api(fm_array.get());
 
   std::cout << "delay = " << DELAY_NS_PER_ITER << std::endl;
+  std::cout << "prefetch policy = " << PREFETCH_POLICY << std::endl;
+  auto start_misses = Stats::get_swap_in_objects();
   auto start_ts = chrono::steady_clock::now();
   for (uint64_t i = 0; i < kNumEntries; i++) {
     DerefScope scope;
@@ -99,6 +117,10 @@ void do_work(void *arg) {
   auto time_US =
       chrono::duration_cast<chrono::microseconds>(end_ts - start_ts).count();
   std::cout << time_US << std::endl;
+  std::cout << "miss rate = "
+            << (double)(Stats::get_swap_in_objects() - start_misses) /
+                   kNumEntries
+            << std::endl;
 }
 
 int main(int _argc, char *argv[]) {
@@ -8,6 +8,7 @@ extern "C" {
 #include "device.hpp"
 #include "helpers.hpp"
 #include "manager.hpp"
+#include "stats.hpp"
 
 #include <algorithm>
 #include <array>
@@ -31,6 +32,10 @@ using namespace std;
 
 DEFINE_DATA_TYPE(4096);
 
+#ifndef REGION_PICKER
+#define REGION_PICKER 0
+#endif
+
 constexpr uint64_t kCacheSize = 4ULL << 30;   // 4 GiB.
 constexpr uint64_t kFarMemSize = 20ULL << 30; // 20 GiB.
 constexpr uint64_t kNumEntries = 4
@@ -58,6 +63,10 @@ void flush_cache() {
 }
 
 void do_work(FarMemManager *manager) {
+#if REGION_PICKER == 1
+  manager->set_region_picker(FarMemManager::RegionPicker::kCostBenefit);
+#endif
+  cout << "region picker = " << REGION_PICKER << endl;
   for (uint64_t i = 0; i < kNumEntries; i++) {
     ptrs[i] = std::move(manager->allocate_unique_ptr<Data_t>());
   }
@@ -91,6 +100,14 @@ void do_work(FarMemManager *manager) {
     threads.clear();
   }
 
+  auto wb_bytes = Stats::get_gc_write_back_bytes();
+  auto wb_us = Stats::get_gc_write_back_us();
+  cout << "Evacuated " << Stats::get_gc_write_back_objects() << " objects ("
+       << wb_bytes << " bytes) in " << wb_us << " us, throughput = "
+       << (wb_us ? wb_bytes / wb_us : 0) << " MB/s" << endl;
+  cout << "Mutators waited " << Stats::get_mutator_gc_wait_us()
+       << " us for the GC" << endl;
+
   for (uint64_t i = 0; i < kNumEntries; i++) {
     ptrs[i].free();
   }
@@ -32,6 +32,10 @@ using namespace std;
 
 DEFINE_DATA_TYPE(4096);
 
+#ifndef REGION_PICKER
+#define REGION_PICKER 0
+#endif
+
 constexpr uint64_t kCacheSize = 1500ULL << 20; // 1.5 GiB.
 constexpr uint64_t kFarMemSize = 10ULL << 30;  // 10 GiB.
 constexpr uint64_t kNumEntries = 1
@@ -58,6 +62,10 @@ void flush_cache() {
 }
 
 void do_work(FarMemManager *manager) {
+#if REGION_PICKER == 1
+  manager->set_region_picker(FarMemManager::RegionPicker::kCostBenefit);
+#endif
+  cout << "region picker = " << REGION_PICKER << endl;
   for (uint64_t i = 0; i < kNumEntries; i++) {
     ptrs[i] = std::move(manager->allocate_unique_ptr<Data_t>());
     trash_ptrs[i] = std::move(manager->allocate_unique_ptr<Data_t>());
@@ -94,6 +102,9 @@ void do_work(FarMemManager *manager) {
   }
 
   Stats::print_free_mem_ratio_records();
+  std::cout << "GC wrote back " << Stats::get_gc_write_back_bytes()
+            << " bytes; mutators waited " << Stats::get_mutator_gc_wait_us()
+            << " us for the GC" << std::endl;
   std::cout << "Cleanup..." << std::endl;
   for (uint64_t i = 0; i < kNumEntries; i++) {
     ptrs[i].free();
@@ -8,6 +8,7 @@ extern "C" {
 #include "device.hpp"
 #include "helpers.hpp"
 #include "manager.hpp"
+#include "prefetch_policy.hpp"
 #include "snappy.h"
 #include "stats.hpp"
 #include "zipf.hpp"
@@ -33,6 +34,11 @@ extern "C" {
 
 using namespace far_memory;
 
+// 0: no array prefetching, 1: stride table, 2: delta correlation.
+#ifndef PREFETCH_POLICY
+#define PREFETCH_POLICY 0
+#endif
+
 #define ACCESS_ONCE(x) (*(volatile typeof(x) *)&(x))
 
 namespace far_memory {
@@ -366,7 +372,13 @@ public:
     prepare(hopscotch.get());
     auto array_ptr = std::unique_ptr<AppArray>(
         manager->allocate_array_heap<ArrayEntry, kNumArrayEntries>());
+#if PREFETCH_POLICY == 1
+    array_ptr->set_prefetch_policy(std::make_unique<StrideTablePolicy>());
+#elif PREFETCH_POLICY == 2
+    array_ptr->set_prefetch_policy(std::make_unique<DeltaCorrelationPolicy>());
+#else
     array_ptr->disable_prefetch();
+#endif
     prepare(array_ptr.get());
     std::cout << "Bench..." << std::endl;
     bench(hopscotch.get(), array_ptr.get());
@@ -0,0 +1,17 @@
+#!/bin/bash
+
+source ../../../shared.sh
+
+batch_size_arr=(1 2 4 8 16 32 64 128)
+
+sudo pkill -9 main
+for batch_size in ${batch_size_arr[@]}
+do
+    sed "s/constexpr static uint32_t kBatchSize.*/constexpr static uint32_t kBatchSize = $batch_size;/g" main.cpp -i
+    make clean
+    make -j
+    rerun_local_iokerneld
+    rerun_mem_server
+    run_program ./main 1>log.$batch_size 2>&1
+done
+kill_local_iokerneld
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <limits>
+#include <optional>
 #include <type_traits>
 
 namespace far_memory {
@@ -41,6 +42,65 @@ public:
   T aggregate();
 };
 
+template <typename T> class AggregatorSum : public Aggregator<T> {
+private:
+  T tmp_ = T();
+
+public:
+  void add(DerefScope *scope, T t);
+  T aggregate();
+};
+
+template <typename T> class AggregatorCount : public Aggregator<T> {
+private:
+  uint64_t cnt_ = 0;
+
+public:
+  void add(DerefScope *scope, T t);
+  T aggregate();
+};
+
+template <typename T> class AggregatorMean : public Aggregator<T> {
+private:
+  double sum_ = 0;
+  uint64_t cnt_ = 0;
+
+public:
+  void add(DerefScope *scope, T t);
+  T aggregate();
+};
+
+// Sample variance (or its square root when Std), computed with Welford's
+// algorithm so that it is numerically stable in a single pass.
+template <typename T, bool Std> class AggregatorVar : public Aggregator<T> {
+private:
+  uint64_t cnt_ = 0;
+  double mean_ = 0;
+  double m2_ = 0;
+
+public:
+  void add(DerefScope *scope, T t);
+  T aggregate();
+};
+
+template <typename T> class AggregatorFirst : public Aggregator<T> {
+private:
+  std::optional<T> tmp_;
+
+public:
+  void add(DerefScope *scope, T t);
+  T aggregate();
+};
+
+template <typename T> class AggregatorLast : public Aggregator<T> {
+private:
+  T tmp_;
+
+public:
+  void add(DerefScope *scope, T t);
+  T aggregate();
+};
+
 template <typename T> class DataFrameVector;
 class FarMemManager;
 
@@ -50,6 +50,9 @@ public:
   void disable_prefetch();
   void enable_prefetch();
   void static_prefetch(Index_t start, Index_t step, uint32_t num);
+  // The policy sees flat indices. Passing nullptr restores the default
+  // single-stride detection.
+  void set_prefetch_policy(std::unique_ptr<PrefetchPolicy> policy);
   GenericUniquePtr *at(bool nt, Index_t idx);
 };
 
@@ -93,6 +96,11 @@ public:
   T &at_mut(const DerefScope &scope, Indices... indices) noexcept;
   template <bool Nt = false, typename... Indices>
   T &at_mut_safe(const DerefScope &scope, Indices... indices);
+  // Only [offset, offset + len) of the element is going to be modified, so
+  // that only its dirty cachelines are written back.
+  template <bool Nt = false, typename... Indices>
+  T &at_mut_range(const DerefScope &scope, uint16_t offset, uint16_t len,
+                  Indices... indices) noexcept;
   template <bool Nt = false, typename U, typename... Indices>
   void write(U &&u, Indices... indices);
   template <bool Nt = false, typename U, typename... Indices>
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace far_memory {
+
+// Block-addressed storage under StorageDevice.
+class BlockStore {
+public:
+  virtual ~BlockStore() {}
+  virtual uint32_t get_block_size() const = 0;
+  virtual uint64_t get_num_blocks() const = 0;
+  // buf spans num_blocks * get_block_size() bytes.
+  virtual void read(uint64_t lba, uint32_t num_blocks, uint8_t *buf) = 0;
+  virtual void write(uint64_t lba, uint32_t num_blocks, const uint8_t *buf) = 0;
+};
+
+// The NVMe device that the Shenango runtime drives through SPDK, which
+// requires enable_storage in its config. Requests park the calling uthread
+// until they complete.
+class NVMeBlockStore : public BlockStore {
+public:
+  NVMeBlockStore();
+  NOT_COPYABLE(NVMeBlockStore);
+  NOT_MOVEABLE(NVMeBlockStore);
+  uint32_t get_block_size() const;
+  uint64_t get_num_blocks() const;
+  void read(uint64_t lba, uint32_t num_blocks, uint8_t *buf);
+  void write(uint64_t lba, uint32_t num_blocks, const uint8_t *buf);
+};
+
+// A file that stands in for an NVMe device, e.g., on machines without one.
+// Its requests are plain pread()/pwrite()s, which block the kthread instead of
+// the uthread.
+class FileBlockStore : public BlockStore {
+private:
+  constexpr static uint32_t kBlockSize = 4096;
+
+  int fd_;
+  uint64_t num_blocks_;
+
+public:
+  FileBlockStore(const std::string &path, uint64_t size);
+  ~FileBlockStore();
+  NOT_COPYABLE(FileBlockStore);
+  NOT_MOVEABLE(FileBlockStore);
+  uint32_t get_block_size() const { return kBlockSize; }
+  uint64_t get_num_blocks() const { return num_blocks_; }
+  void read(uint64_t lba, uint32_t num_blocks, uint8_t *buf);
+  void write(uint64_t lba, uint32_t num_blocks, const uint8_t *buf);
+};
+
+} // namespace far_memory
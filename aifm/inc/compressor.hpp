@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+namespace far_memory {
+
+// Block compressor for object data, which emits the raw Snappy format (see
+// snappy/format_description.txt), i.e., a varint of the uncompressed length
+// followed by literals and back-references. The bundled snappy/ is built on
+// top of the far-memory library, so the library carries its own codec instead
+// of linking against it. Inputs are bounded by the maximum object size, so the
+// back-references never need offsets beyond 2 bytes.
+class Compressor {
+private:
+  constexpr static uint32_t kHashTableShift = 12;
+  constexpr static uint32_t kHashTableSize = (1 << kHashTableShift);
+  constexpr static uint32_t kMinMatchLen = 4;
+  // Bytes at the end of the input that are always emitted as a literal, so
+  // that the matcher may load 4 bytes at any position it tries.
+  constexpr static uint32_t kInputMarginBytes = 4;
+  constexpr static uint32_t kMaxLiteralTagLen = 60;
+
+  static uint8_t *emit_literal(uint8_t *op, const uint8_t *literal,
+                               uint32_t len);
+  static uint8_t *emit_copy(uint8_t *op, uint32_t offset, uint32_t len);
+
+public:
+  constexpr static uint32_t kMaxInputLen = (1 << 16) - 1;
+
+  constexpr static uint32_t max_compressed_len(uint32_t len) {
+    return 32 + len + len / 6;
+  }
+  // Compresses [src, src + len) into dst, which must have max_compressed_len()
+  // bytes. Returns the compressed length.
+  static uint32_t compress(const uint8_t *src, uint32_t len, uint8_t *dst);
+  // Decompresses [src, src + len) into dst, which has dst_capacity bytes.
+  // Returns false if the input is corrupted or does not fit in dst.
+  static bool decompress(const uint8_t *src, uint32_t len, uint8_t *dst,
+                         uint32_t dst_capacity, uint32_t *dst_len);
+};
+
+} // namespace far_memory
@@ -4,6 +4,7 @@
 
 #include "cb.hpp"
 #include "deref_scope.hpp"
+#include "device.hpp"
 #include "helpers.hpp"
 #include "pointer.hpp"
 
@@ -14,6 +15,24 @@
 namespace far_memory {
 
 class GenericConcurrentHopscotch {
+public:
+  // A single entry of a multi_get() batch; *val_len is set to 0 if the key
+  // does not exist.
+  struct GetReq {
+    uint8_t key_len;
+    const uint8_t *key;
+    uint16_t *val_len;
+    uint8_t *val;
+  };
+
+  // A single entry of a multi_put() batch.
+  struct PutReq {
+    uint8_t key_len;
+    const uint8_t *key;
+    uint16_t val_len;
+    const uint8_t *val;
+  };
+
 private:
   struct BucketEntry {
     constexpr static uint64_t kBusyPtr = FarMemPtrMeta::kNull + 1;
@@ -65,14 +84,19 @@ private:
   bool _put(uint8_t key_len, const uint8_t *key, uint16_t val_len,
             const uint8_t *val, bool swap_in);
   bool _remove(uint8_t key_len, const uint8_t *key);
+  void _multi_get(uint32_t num_reqs, const GetReq *reqs);
+  uint32_t _multi_put(uint32_t num_reqs, const PutReq *reqs);
+  void prefetch_bucket(uint8_t key_len, const uint8_t *key);
   void process_evac_notifier_stash();
   void do_evac_notifier(EvacNotifierMeta meta);
   void evac_notifier(Object object);
 
 public:
   constexpr static uint32_t kMetadataSize = sizeof(EvacNotifierMeta);
+  constexpr static uint32_t kMaxMultiBatchSize = FarMemDevice::kMaxBatchSize;
 
   ~GenericConcurrentHopscotch();
+  uint8_t get_ds_id() const { return ds_id_; }
   void get(const DerefScope &scope, uint8_t key_len, const uint8_t *key,
            uint16_t *val_len, uint8_t *val);
   void get_tp(uint8_t key_len, const uint8_t *key, uint16_t *val_len,
@@ -83,6 +107,16 @@ public:
               const uint8_t *val);
   bool remove(const DerefScope &scope, uint8_t key_len, const uint8_t *key);
   bool remove_tp(uint8_t key_len, const uint8_t *key);
+  // Batched get()s of distinct keys. The local buckets of every
+  // kMaxMultiBatchSize keys are probed together, and the keys that miss are
+  // fetched from the remote agent in a single batched request.
+  void multi_get(const DerefScope &scope, uint32_t num_reqs,
+                 const GetReq *reqs);
+  void multi_get_tp(uint32_t num_reqs, const GetReq *reqs);
+  // Batched put()s. Returns the number of keys that already existed.
+  uint32_t multi_put(const DerefScope &scope, uint32_t num_reqs,
+                     const PutReq *reqs);
+  uint32_t multi_put_tp(uint32_t num_reqs, const PutReq *reqs);
 };
 
 template <typename K, typename V>
@@ -95,6 +129,8 @@ private:
   std::optional<V> _find(const K &key);
   void _insert(const K &key, const V &value);
   bool _erase(const K &key);
+  void _multi_find(uint32_t num_keys, const K *keys, std::optional<V> *vals);
+  void _multi_insert(uint32_t num_keys, const K *keys, const V *vals);
   ConcurrentHopscotch(uint8_t ds_id, uint32_t local_num_entries_shift,
                       uint32_t remote_num_entries_shift,
                       uint64_t remote_data_size);
@@ -110,6 +146,13 @@ public:
   void insert_tp(const K &key, const V &value);
   bool erase(const DerefScope &scope, const K &key);
   bool erase_tp(const K &key);
+  // Batched find()s and insert()s of distinct keys; see multi_get().
+  void multi_find(const DerefScope &scope, uint32_t num_keys, const K *keys,
+                  std::optional<V> *vals);
+  void multi_find_tp(uint32_t num_keys, const K *keys, std::optional<V> *vals);
+  void multi_insert(const DerefScope &scope, uint32_t num_keys, const K *keys,
+                    const V *vals);
+  void multi_insert_tp(uint32_t num_keys, const K *keys, const V *vals);
 };
 
 } // namespace far_memory
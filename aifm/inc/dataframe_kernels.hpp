@@ -0,0 +1,102 @@
+#pragma once
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace far_memory {
+
+// Kernels of the server-side DataFrame operators, which run over contiguous
+// columns. Every kernel is compiled for AVX-512, AVX2 and plain x86-64, and
+// dispatches at runtime on what the CPU supports, so that the library still
+// builds without -mavx2. Non-arithmetic columns always take the scalar path.
+class DataFrameKernels {
+public:
+  enum Isa : uint8_t { kScalar = 0, kAVX2, kAVX512 };
+
+private:
+  // The reductions keep this many bytes of independent accumulators.
+  constexpr static uint32_t kNumAccumulatorBytes = 64;
+
+  static Isa isa_;
+
+  // Whether the gather instructions can move the elements as 32-bit or 64-bit
+  // integers.
+  template <typename T> constexpr static bool is_gatherable();
+
+  template <typename T>
+  static void gather_scalar(T *dst, const T *src,
+                            const unsigned long long *idx, uint64_t num);
+  template <typename T>
+  static void gather_avx2(T *dst, const T *src, const unsigned long long *idx,
+                          uint64_t num);
+  template <typename T>
+  static void gather_avx512(T *dst, const T *src,
+                            const unsigned long long *idx, uint64_t num);
+  template <typename T, typename Op>
+  static T reduce(const T *src, uint64_t num, T init, Op op);
+  template <typename T, typename Op>
+  static T reduce_avx2(const T *src, uint64_t num, T init, Op op);
+  template <typename T, typename Op>
+  static T reduce_avx512(const T *src, uint64_t num, T init, Op op);
+  template <typename T, typename Op>
+  static T dispatch_reduce(const T *src, uint64_t num, T init, Op op);
+
+public:
+  static Isa get_isa();
+  // Caps the ISA at what the CPU supports, e.g., to benchmark the fallbacks.
+  static void set_isa(Isa isa);
+  // dst[i] = src[idx[i]] for i in [0, num).
+  template <typename T>
+  static void gather(T *dst, const T *src, const unsigned long long *idx,
+                     uint64_t num);
+  // The reductions require num > 0. Float sums are reassociated across
+  // lanes, so they may differ from a sequential sum in the last bits.
+  template <typename T> static T min(const T *src, uint64_t num);
+  template <typename T> static T max(const T *src, uint64_t num);
+  template <typename T> static T sum(const T *src, uint64_t num);
+};
+
+// Open-addressing (linear probing) index from rows to groups of equal rows,
+// used by unique and group-by in place of node-based std::unordered_set/map.
+// A slot is 16 bytes, i.e., a probe sequence mostly stays within a cache
+// line, and the rows are only compared when the full hashes match.
+class FlatGroupIndex {
+private:
+  struct Slot {
+    uint64_t hash;
+    uint64_t group;
+  };
+
+  constexpr static uint64_t kEmpty = std::numeric_limits<uint64_t>::max();
+  constexpr static uint64_t kMinNumSlots = 16;
+  // Grows past this, instead of sizing the table after the number of rows,
+  // which over-allocates when there are few groups.
+  constexpr static uint64_t kMaxInitialNumSlots = 1 << 20;
+
+  std::vector<Slot> slots_;
+  uint32_t shift_;
+  std::vector<unsigned long long> first_rows_;
+
+  uint64_t get_slot_idx(uint64_t hash) const;
+  void grow();
+
+public:
+  FlatGroupIndex(uint64_t num_rows_hint);
+  // Returns the group of row and whether the group is new. equal(other_row)
+  // tells whether row equals other_row, which is the first row of a group
+  // with the same hash.
+  template <typename Equal>
+  std::pair<uint64_t, bool> find_or_insert(uint64_t hash, uint64_t row,
+                                           Equal &&equal);
+  uint64_t size() const;
+  // Indexed by groups, which are numbered in the order of their first rows.
+  const std::vector<unsigned long long> &get_first_rows() const;
+};
+
+} // namespace far_memory
+
+#include "internal/dataframe_kernels.ipp"
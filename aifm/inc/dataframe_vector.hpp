@@ -10,6 +10,7 @@
 #include "reader_writer_lock.hpp"
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <type_traits>
@@ -45,14 +46,69 @@
 #define DISABLE_OFFLOAD_AGGREGATE 0
 #endif
 
+#ifdef DISABLE_OFFLOAD_FILTER
+#define DISABLE_OFFLOAD_FILTER 1
+#else
+#define DISABLE_OFFLOAD_FILTER 0
+#endif
+
 #define DISABLE_OFFLOAD                                                        \
   (DISABLE_OFFLOAD_UNIQUE & DISABLE_OFFLOAD_COPY_DATA_BY_IDX &                 \
    DISABLE_OFFLOAD_SHUFFLE_DATA_BY_IDX & DISABLE_OFFLOAD_ASSIGN &              \
-   DISABLE_OFFLOAD_AGGREGATE)
+   DISABLE_OFFLOAD_AGGREGATE & DISABLE_OFFLOAD_FILTER)
 
 namespace far_memory {
 
 class FarMemManager;
+class GenericDataFrameVector;
+template <typename T> class DataFrameVector;
+
+// Summary of a DataFrameVector chunk, i.e., the bounds of its values and how
+// many values and NaNs (the nulls of floating-point columns) it holds. It is
+// kept in local memory, so that scans rule chunks out without swapping them
+// in. Bounds and counts may be loose after pop_back(), but never too tight.
+template <typename T> struct DataFrameZoneMap {
+  T min = T();
+  T max = T();
+  uint32_t num_values = 0;
+  uint32_t num_nulls = 0;
+  // Cleared by in-place writes, which the map does not follow.
+  bool known = false;
+};
+
+// A comparison or range predicate over a column, which
+// GenericDataFrameVector::filter() evaluates as part of a conjunction.
+class DataFramePredicate {
+public:
+  // Between is inclusive on both ends.
+  enum Cmp : uint8_t { Eq = 0, Ne, Lt, Le, Gt, Ge, Between };
+  // How many of the elements summarized by a zone map satisfy a predicate.
+  enum ZoneMatch : uint8_t { kNone = 0, kSome, kAll };
+
+  // operand_hi is only used by Between.
+  template <typename T>
+  DataFramePredicate(DataFrameVector<T> &col, Cmp cmp, T operand,
+                     T operand_hi = T());
+  // Only relies on operator< and operator==, which is all that the column
+  // types share.
+  template <typename T>
+  static bool test(Cmp cmp, const T &val, const T &operand,
+                   const T &operand_hi);
+  template <typename T>
+  static ZoneMatch test_zone(Cmp cmp, const DataFrameZoneMap<T> &zone,
+                             const T &operand, const T &operand_hi);
+
+private:
+  GenericDataFrameVector *col_;
+  uint8_t dt_id_;
+  Cmp cmp_;
+  // |operand|operand_hi|, both as the column type.
+  std::vector<uint8_t> operands_;
+  // Clears the elements of selected that fail the predicate.
+  std::function<void(uint64_t size, std::vector<bool> *selected)>
+      eval_locally_;
+  friend class GenericDataFrameVector;
+};
 
 class GenericDataFrameVector {
 private:
@@ -64,7 +120,16 @@ private:
     Assign,
     AggregateMax,
     AggregateMin,
-    AggregateMedian
+    AggregateMedian,
+    Filter,
+    AggregateSum,
+    AggregateCount,
+    AggregateMean,
+    AggregateVar,
+    AggregateStd,
+    AggregateFirst,
+    AggregateLast,
+    GroupBy
   };
 
   uint32_t chunk_size_;
@@ -85,8 +150,31 @@ private:
   void expand_no_alloc(uint64_t num);
   void reserve_remote(uint64_t num);
   void cleanup();
+  static OpCode get_aggregate_opcode(uint8_t aggregation);
+  static DataFrameVector<unsigned long long>
+  filter_locally(FarMemManager *manager,
+                 const std::vector<DataFramePredicate> &preds, uint64_t size);
+  static DataFrameVector<unsigned long long>
+  filter_remotely(FarMemManager *manager,
+                  const std::vector<DataFramePredicate> &preds, uint64_t size);
 
 public:
+  // Aggregations of DataFrameVector::aggregate() and group_by(). Var and Std
+  // are of the sample; the arithmetic ones (Sum to Std) need arithmetic
+  // columns.
+  enum Aggregation : uint8_t {
+    Max = 0,
+    Min,
+    Median,
+    Sum,
+    Count,
+    Mean,
+    Var,
+    Std,
+    First,
+    Last
+  };
+
   GenericDataFrameVector(const uint32_t chunk_size, uint32_t chunk_num_entries,
                          uint8_t ds_id, uint8_t dt_id);
   NOT_COPYABLE(GenericDataFrameVector);
@@ -98,6 +186,12 @@ public:
   uint64_t size() const;
   void clear();
   void flush();
+  // Returns the indices of the first size elements of the columns that
+  // satisfy all of preds. Offloaded, it moves only the indices, which are
+  // computed next to the columns.
+  static DataFrameVector<unsigned long long>
+  filter(FarMemManager *manager, const std::vector<DataFramePredicate> &preds,
+         uint64_t size);
 };
 
 template <typename T> class DataFrameVector : public GenericDataFrameVector {
@@ -115,6 +209,13 @@ private:
   constexpr static uint32_t kNumEntriesPerExpansion =
       (kSizePerExpansion - 1) / sizeof(T) + 1;
   constexpr static uint64_t kNumElementsPerScope = 1024;
+  // The external sort of get_sorted_indices() sorts runs of about this many
+  // bytes (of values and indices) in local memory per worker, and then merges
+  // up to kSortMaxMergeFanIn runs per pass.
+  constexpr static uint64_t kSortRunSize = 1 << 20; // 1 MiB.
+  constexpr static uint32_t kSortMaxMergeFanIn = 256;
+  // Blocks that a merge cursor swaps in with one batch once it runs out.
+  constexpr static uint32_t kSortNumReadAheadBlocks = 8;
 
   static Pattern_t induce_fn(Index_t idx_0, Index_t idx_1);
   static Index_t infer_fn(Index_t idx, Pattern_t stride);
@@ -135,8 +236,12 @@ private:
       Prefetcher<decltype(kInduceFn), decltype(kInferFn), decltype(kMappingFn)>>
       prefetcher_;
   bool dynamic_prefetch_enabled_ = true;  
+  // Indexed by chunks, and grown lazily, i.e., chunks beyond it are unknown.
+  std::vector<DataFrameZoneMap<T>> zone_maps_;
 
   friend class FarMemTest;
+  friend class GenericDataFrameVector;
+  template <typename U> friend class DataFrameVector;
   template <typename U> friend class ServerDataFrameVector;
 
   // STL compatible, but slower (since it takes GC sync overhead per
@@ -195,6 +300,7 @@ private:
 
     uint64_t get_idx() const;
     template <bool Nt> void update_on_new_chunk();
+    void invalidate_zone_map() const;
 
   public:
     using difference_type = int64_t;
@@ -223,16 +329,52 @@ private:
   void expand(uint64_t num);
   void expand_no_alloc(uint64_t num);
   void prefetch_record(bool nt, Index_t idx);
+  void update_zone_map(uint64_t chunk_idx, uint64_t chunk_offset, const T &t);
+  void invalidate_zone_map(uint64_t chunk_idx);
   DataFrameVector &lock();
+  // Copy [begin, begin + num) between the chunks and local memory. They
+  // bypass the prefetcher, so uthreads may run them on disjoint chunks
+  // concurrently.
+  template <bool Nt = false>
+  void copy_to_local(uint64_t begin, uint64_t num, T *dst);
+  template <bool Nt = false>
+  void copy_from_local(uint64_t begin, uint64_t num, const T *src);
+  // Swaps in the chunks of [begin, begin + num) with batched reads.
+  void swap_in_range(bool nt, uint64_t begin, uint64_t num);
   template <bool Ascending = true>
   void _get_sorted_indices_counting_sort(
       DataFrameVector<unsigned long long> *indices);
+  template <bool Ascending = true>
+  void _get_sorted_indices_external_sort(
+      FarMemManager *manager, DataFrameVector<unsigned long long> *indices);
+  // Whether (val_0, idx_0) precedes (val_1, idx_1) in the ascending order of
+  // the external sort. NaNs rank above all of the other values, which keeps it
+  // a strict weak ordering.
+  static bool _sort_less(const T &val_0, uint64_t idx_0, const T &val_1,
+                         uint64_t idx_1);
+  // Merges the num_runs sorted runs of run_num_entries elements from begin
+  // into [begin, ...) of merged_vals (unless nullptr) and merged_idxs.
+  template <bool Ascending>
+  static void
+  _merge_sorted_runs(DataFrameVector<T> *vals,
+                     DataFrameVector<unsigned long long> *idxs, uint64_t begin,
+                     uint64_t run_num_entries, uint64_t num_runs,
+                     DataFrameVector<T> *merged_vals,
+                     DataFrameVector<unsigned long long> *merged_idxs);
   template <typename U>
   DataFrameVector<T> aggregate_locally(FarMemManager *manager, const U &key_vec,
                                        OpCode opcode);
   template <typename U>
   DataFrameVector<T> aggregate_remotely(FarMemManager *manager,
                                         const U &key_vec, OpCode opcode);
+  template <typename... Keys>
+  std::pair<DataFrameVector<T>, DataFrameVector<unsigned long long>>
+  group_by_locally(FarMemManager *manager, OpCode opcode,
+                   const DataFrameVector<Keys> &... key_vecs);
+  template <typename... Keys>
+  std::pair<DataFrameVector<T>, DataFrameVector<unsigned long long>>
+  group_by_remotely(FarMemManager *manager, OpCode opcode,
+                    const DataFrameVector<Keys> &... key_vecs);
   DataFrameVector<T> get_col_unique_values_locally(FarMemManager *manager);
   DataFrameVector<T> get_col_unique_values_remotely(FarMemManager *manager);
   DataFrameVector<T>
@@ -301,12 +443,42 @@ public:
   DataFrameVector<T> aggregate_max(FarMemManager *manager, const U &key_vec);
   template <typename U>
   DataFrameVector<T> aggregate_median(FarMemManager *manager, const U &key_vec);
+  // Aggregates the runs of equal keys, i.e., key_vec is sorted.
+  template <typename U>
+  DataFrameVector<T> aggregate(FarMemManager *manager, const U &key_vec,
+                               Aggregation aggregation);
+  // Hash-based group-by over unsorted (possibly multi-column) keys. Returns
+  // the aggregate of every group and the index of its first row, with which
+  // copy_data_by_idx() gathers the keys. Groups are in the order of their
+  // first rows.
+  template <typename... Keys>
+  std::pair<DataFrameVector<T>, DataFrameVector<unsigned long long>>
+  group_by(FarMemManager *manager, Aggregation aggregation,
+           const DataFrameVector<Keys> &... key_vecs);
   void disable_prefetch();
   void enable_prefetch();
   void static_prefetch(Index_t start, Index_t step, uint32_t num);
+  // The policy sees chunk indices. Passing nullptr restores the default
+  // single-stride detection.
+  void set_prefetch_policy(std::unique_ptr<PrefetchPolicy> policy);
+  // indices[i] is the position of the i-th element after a stable sort, or
+  // the reverse of that if !Ascending. NaNs sort after all of the other
+  // values. Integers of up to 2 bytes are counting sorted; others go through an
+  // external merge sort, which bounds the local memory it takes.
   template <bool Ascending = true>
   DataFrameVector<unsigned long long>
   get_sorted_indices(FarMemManager *manager, bool already_sorted_asc);
+  constexpr static uint32_t get_chunk_num_entries();
+  // Rebuilds the zone map from the chunk (i.e., swaps it in) if unknown.
+  const DataFrameZoneMap<T> &get_zone_map(const DerefScope &scope,
+                                          uint64_t chunk_idx);
+  // Calls f(idx, val) on the elements within [lo, hi] in index order, which
+  // only swaps in the chunks whose zone maps overlap the range.
+  template <typename F>
+  void for_each_in_range(const T &lo, const T &hi, F &&f);
+  // The first index whose element is not less than t in an ascending column,
+  // which swaps in a single chunk when the zone maps are known.
+  uint64_t lower_bound(const T &t);
 };
 
 } // namespace far_memory
@@ -3,15 +3,50 @@
 extern "C" {
 #include <runtime/tcp.h>
 }
+#include "sync.h"
+#include "thread.h"
+
 #include "rdma_client.hpp"
+#include "block_store.hpp"
+#include "compressor.hpp"
 #include "helpers.hpp"
+#include "object.hpp"
+#include "region.hpp"
 #include "server.hpp"
+#include "server_hashtable.hpp"
 #include "shared_pool.hpp"
+#include "tcp_channel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 namespace far_memory {
 
+// Handle of an asynchronous device request. It is owned by the caller and,
+// together with the buffers passed when posting the request, must stay alive
+// until the request has completed.
+struct DeviceReqHandle {
+  bool completed;
+  bool is_read;
+  uint8_t ds_id;
+  void *ctx; // Device-specific in-flight state, e.g., the connection used.
+  uint32_t tag;
+  uint16_t *data_len;
+  uint8_t *data_buf;
+};
+
 class FarMemDevice {
 public:
+  // The maximum number of objects in a batch that devices send at once.
+  constexpr static uint32_t kMaxBatchSize = 64;
+
   uint64_t far_mem_size_;
   uint32_t prefetch_win_size_;
 
@@ -25,8 +60,64 @@ public:
   virtual void write_object(uint8_t ds_id, uint8_t obj_id_len,
                             const uint8_t *obj_id, uint16_t data_len,
                             const uint8_t *data_buf) = 0;
+  // Writes only the given extents of the object data in data_buf, whose remote
+  // copy must already exist. Devices that are not able to update an object in
+  // place fall back to writing the whole object, which is the default.
+  virtual void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                                    const uint8_t *obj_id, uint16_t data_len,
+                                    const uint8_t *data_buf,
+                                    uint8_t num_extents,
+                                    const ObjectExtent *extents);
+  // Reads a batch of objects. Devices that are able to coalesce the batch into
+  // fewer round trips override it; the default keeps the reads outstanding at
+  // the same time through post_read_object().
+  virtual void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  // Writes a batch of objects. Devices that are able to coalesce the batch
+  // into fewer round trips override it; the default issues write_object()s.
+  virtual void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  // Copies the data_len bytes of data of an object to another object ID of the
+  // same data structure. Devices whose remote side is able to copy override it,
+  // which saves moving the data back and forth; the default reads the object
+  // into buf, which spans data_len bytes, and writes it back from there.
+  virtual void copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                           const uint8_t *from_obj_id,
+                           const uint8_t *to_obj_id, uint16_t data_len,
+                           uint8_t *buf);
+  // Hints the device that reads and writes will mostly target [buf, buf +
+  // len), which allows it to avoid intermediate copies. Optional.
+  virtual void register_local_buffer(uint8_t *buf, uint64_t len) {}
+  // Hints the device that an object whose remote copy is up to date is being
+  // evicted from the local cache, which allows a device with a local tier to
+  // keep a copy of it. Optional.
+  virtual void cache_clean_object(uint8_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id, uint16_t data_len,
+                                  const uint8_t *data_buf) {}
   virtual bool remove_object(uint64_t ds_id, uint8_t obj_id_len,
                              const uint8_t *obj_id) = 0;
+  // Asynchronous read/write. The default implementation completes the request
+  // synchronously inside post_*(); devices that support multiple outstanding
+  // requests override all three methods.
+  virtual void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                const uint8_t *obj_id, uint16_t *data_len,
+                                uint8_t *data_buf, DeviceReqHandle *handle);
+  virtual void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id, uint16_t data_len,
+                                 const uint8_t *data_buf,
+                                 DeviceReqHandle *handle);
+  // Returns true if the request has completed. May block on devices that are
+  // not able to check for a completion without reaping it.
+  virtual bool poll(DeviceReqHandle *handle);
+  // Blocks until all the requests have completed.
+  void wait(uint32_t num_handles, DeviceReqHandle *const *handles);
+  // How many requests a single uthread may keep outstanding through post_*()
+  // before it has to poll the earlier ones, which is bounded on devices that
+  // tie up a resource per outstanding request.
+  virtual uint32_t get_max_num_outstanding_reqs() const {
+    return kMaxBatchSize;
+  }
+  // Whether poll() may block until the request completes, e.g., TCPDevice
+  // without pipelining.
+  virtual bool is_poll_blocking() const { return false; }
   virtual void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
                          uint8_t *params) = 0;
   virtual void destruct(uint8_t ds_id) = 0;
@@ -47,6 +138,12 @@ public:
                    uint16_t *data_len, uint8_t *data_buf);
   void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
   void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
                  uint8_t *params);
@@ -61,22 +158,33 @@ private:
   constexpr static uint32_t kPrefetchWinSize = 1 << 20;
 
   tcpconn_t *remote_master_;
-  SharedPool<tcpconn_t *> shared_pool_;
-
-  void _read_object(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t obj_id_len,
-                    const uint8_t *obj_id, uint16_t *data_len,
-                    uint8_t *data_buf);
-  void _write_object(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t obj_id_len,
-                     const uint8_t *obj_id, uint16_t data_len,
-                     const uint8_t *data_buf);
-  bool _remove_object(tcpconn_t *remote_slave, uint64_t ds_id,
-                      uint8_t obj_id_len, const uint8_t *obj_id);
-  void _construct(tcpconn_t *remote_slave, uint8_t ds_type, uint8_t ds_id,
-                  uint8_t param_len, uint8_t *params);
-  void _destruct(tcpconn_t *remote_slave, uint8_t ds_id);
-  void _compute(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t opcode,
-                uint16_t input_len, const uint8_t *input_buf,
-                uint16_t *output_len, uint8_t *output_buf);
+  uint32_t num_connections_;
+  // Slave connections of protocol v1 that no request holds. Requests block
+  // until one is returned once all of them are taken.
+  rt::Mutex slaves_mutex_;
+  rt::CondVar slaves_cv_;
+  std::vector<tcpconn_t *> free_slaves_;
+  // Slave connections of protocol v2, which replace the ones in free_slaves_.
+  std::vector<std::unique_ptr<TCPChannel>> channels_;
+
+  tcpconn_t *_pop_slave();
+  void _push_slave(tcpconn_t *remote_slave);
+  void _switch_to_protocol_v2(tcpconn_t *remote_slave);
+  TCPChannel *_get_channel();
+  void _send(const iovec *iov, int iovcnt, uint16_t *resp_len,
+             uint8_t *resp_buf, DeviceReqHandle *handle);
+  bool _recv(DeviceReqHandle *handle, bool block, uint8_t *resp = nullptr);
+  uint8_t _call(const iovec *iov, int iovcnt, uint16_t *resp_len = nullptr,
+                uint8_t *resp_buf = nullptr);
+  void _call_vectored(const iovec *iov, int iovcnt, uint32_t num_resps,
+                      uint16_t *const *resp_lens, uint8_t *const *resp_bufs);
+  void _send_read_object_req(uint8_t ds_id, uint8_t obj_id_len,
+                             const uint8_t *obj_id, uint16_t *data_len,
+                             uint8_t *data_buf, DeviceReqHandle *handle);
+  void _send_write_object_req(uint8_t ds_id, uint8_t obj_id_len,
+                              const uint8_t *obj_id, uint16_t data_len,
+                              const uint8_t *data_buf,
+                              DeviceReqHandle *handle);
 
 public:
   // TCPDevice talks to remote agent via TCP.
@@ -91,6 +199,11 @@ public:
   //     5. construct
   //     6. destruct
   //     7. compute
+  //     8. write_object_extents
+  //     9. protocol_v2
+  //     10. read_objects
+  //     11. write_objects
+  //     12. copy_object
   constexpr static uint32_t kOpcodeSize = 1;
   constexpr static uint32_t kPortSize = 2;
   constexpr static uint32_t kLargeDataSize = 512;
@@ -104,14 +217,47 @@ public:
   constexpr static uint8_t kOpConstruct = 5;
   constexpr static uint8_t kOpDeconstruct = 6;
   constexpr static uint8_t kOpCompute = 7;
+  constexpr static uint8_t kOpWriteObjectExtents = 8;
+  constexpr static uint8_t kOpProtocolV2 = 9;
+  constexpr static uint8_t kOpReadObjects = 10;
+  constexpr static uint8_t kOpWriteObjects = 11;
+  constexpr static uint8_t kOpCopyObject = 12;
 
-  TCPDevice(netaddr raddr, uint32_t num_connections, uint64_t far_mem_size);
+  // With pipelined set, the slave connections speak protocol v2 (see
+  // TCPChannel), so that each of them carries many requests at a time instead
+  // of one.
+  TCPDevice(netaddr raddr, uint32_t num_connections, uint64_t far_mem_size,
+            bool pipelined = false);
   ~TCPDevice();
   void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                    uint16_t *data_len, uint8_t *data_buf);
   void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  // Each batch of up to kMaxBatchSize objects takes a single round trip.
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  // The remote side copies the object, so buf is left untouched.
+  void copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                   const uint8_t *from_obj_id, const uint8_t *to_obj_id,
+                   uint16_t data_len, uint8_t *buf);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  // With protocol v1, each outstanding request holds one connection until it
+  // is polled, so up to num_connections requests are served by the remote side
+  // in parallel, and a uthread may not keep more than that outstanding. With
+  // protocol v2, they share the connections.
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+  uint32_t get_max_num_outstanding_reqs() const;
+  bool is_poll_blocking() const;
   void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
                  uint8_t *params);
   void destruct(uint8_t ds_id);
@@ -123,20 +269,656 @@ public:
 /* RDMADevice only overrides the read and write methods, while reusing other TCP's ops. */
 class RDMADevice : public TCPDevice {
 private:
+  constexpr static uint32_t kCQPollBurstSize = 32;
+  // Bytes read at the front of a KV pair of a remote hashtable, which cover
+  // the header, the value and the key of most of the pairs in one go.
+  constexpr static uint32_t kKVProbeSize = 512;
+  constexpr static uint32_t kMaxOneSidedRetries = 4;
+
+  // Completion state of a queue in the shared CQ mode.
+  struct CompletionWaiter {
+    rt::Spin spin;
+    rt::CondVar cv;
+    bool done = false;
+  };
+
+  // A poller uthread drains one shared CQ, wakes up the uthreads parked on
+  // the completed queues and parks itself once nothing is in flight.
+  struct CQPoller {
+    rt::Thread thread;
+    std::atomic<uint32_t> num_inflight{0};
+    rt::Spin spin;
+    rt::CondVar cv;
+  };
+
   struct rdma_client* client;
   SharedPool<rdma_queue_t *> shared_pool_rdma_queue;
+  bool shared_cq_;
+  bool exit_ = false;
+  std::atomic<int32_t> num_free_queues_{NUM_QUEUES};
+  CachelineAligned(CompletionWaiter) waiters_[NUM_QUEUES];
+  CachelineAligned(CQPoller) pollers_[helpers::kNumCPUs];
+  uint32_t num_pollers_ = 0;
+  // Remote hashtables that live in the registered memory of the server, whose
+  // misses are served by probing their buckets with one-sided reads.
+  bool one_sided_hashtables_[kMaxNumDSIDs] = {};
+  ServerHashTable::RDMALayout hashtable_layouts_[kMaxNumDSIDs];
+
+  rdma_queue_t *_pop_queue();
+  void _push_queue(rdma_queue_t *queue);
+  void _begin_request(rdma_queue_t *queue);
+  void _wait_completion(rdma_queue_t *queue);
+  bool _try_complete(rdma_queue_t *queue);
+  void _cq_poller_fn(uint32_t cq_idx);
   void _rdma_read(uint64_t offset, uint16_t data_len, uint8_t *data_buf);
   void _rdma_write(uint64_t offset, uint16_t data_len, const uint8_t *data_buf);
+  void _rdma_write_batch(uint32_t num, const uint64_t *offsets,
+                         const uint16_t *data_lens,
+                         const uint8_t *const *data_bufs);
+  bool _rdma_hashtable_get(const ServerHashTable::RDMALayout &layout,
+                           uint8_t key_len, const uint8_t *key,
+                           uint16_t *val_len, uint8_t *val);
 
 public:
 
-  RDMADevice(netaddr raddr, uint32_t num_connections, uint64_t far_mem_size);
+  // With shared_cq set, the RDMA queues report to one shared CQ per kthread,
+  // and requesters park instead of spinning on their private CQs.
+  RDMADevice(netaddr raddr, uint32_t num_connections, uint64_t far_mem_size,
+             bool shared_cq = false);
   ~RDMADevice();
 
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  // Reads of a remote hashtable in the registered memory of the server are
+  // served by one-sided RDMA reads, falling back to TCP when they keep racing
+  // with the server.
   void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                    uint16_t *data_len, uint8_t *data_buf);
   void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
+  // The extents of a vanilla object are posted as one RDMA write each.
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  // Vanilla objects are laid out differently in the registered memory than on
+  // the server, so they are copied through buf with one-sided reads and writes.
+  void copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                   const uint8_t *from_obj_id, const uint8_t *to_obj_id,
+                   uint16_t data_len, uint8_t *buf);
+  // Non-vanilla objects are read and written in TCP batches.
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  void register_local_buffer(uint8_t *buf, uint64_t len);
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+};
+
+// Scratch buffers of the devices that stage object data on its way to the
+// device or the storage under them. They are cached per core, as a request may
+// park on the device while holding one.
+class CodecBufferPool {
+public:
+  // Large enough for the worst-case compressed object, and for whatever a
+  // read of a device returns.
+  constexpr static uint32_t kBufSize = std::max<uint32_t>(
+      sizeof(uint8_t) +
+          Compressor::max_compressed_len(Object::kMaxObjectDataSize),
+      std::numeric_limits<uint16_t>::max() + 1);
+
+  CodecBufferPool() = default;
+  ~CodecBufferPool();
+  NOT_COPYABLE(CodecBufferPool);
+  NOT_MOVEABLE(CodecBufferPool);
+  uint8_t *acquire();
+  void release(uint8_t *buf);
+
+private:
+  constexpr static uint32_t kMaxNumCachedBufsPerCPU = 16;
+
+  struct Cache {
+    std::vector<uint8_t *> bufs;
+  };
+
+  CachelineAligned(Cache) caches_[helpers::kNumCPUs];
+};
+
+// Wraps another device, compressing the objects of the data structures that
+// opt in on their way out and decompressing them on their way back. Every
+// object of such a data structure is stored as
+//     |codec (1B)|object data, or its compressed form|
+// and is stored raw whenever compressing it does not pay off; a data
+// structure whose objects keep compressing poorly bypasses the codec for a
+// while. Only data structures whose remote side treats the object data as
+// opaque bytes may opt in, e.g., hashtables; vanilla pointers share one DS ID
+// and live in fixed-size remote slots, so they cannot.
+class CompressedDevice : public FarMemDevice {
+private:
+  enum Codec : uint8_t { kRaw = 0, kSnappy = 1 };
+  constexpr static uint32_t kCodecSize = sizeof(Codec);
+  // An object is stored compressed only below this share of its length.
+  constexpr static uint32_t kMaxStoredPercent = 90;
+  // After that many objects of a data structure in a row failed to compress,
+  // the next kNumBypassedObjects of it are stored raw without trying.
+  constexpr static uint32_t kMaxNumMisses = 4;
+  constexpr static uint32_t kNumBypassedObjects = 256;
+
+  // The counters are shared by the concurrent writers (e.g., the GC
+  // write-back uthreads) of a data structure.
+  struct DSState {
+    bool enabled;
+    std::atomic<uint32_t> num_misses;
+    std::atomic<uint32_t> num_bypassed_left;
+  };
+
+  std::unique_ptr<FarMemDevice> device_;
+  DSState ds_states_[kMaxNumDSIDs] = {};
+  CodecBufferPool bufs_;
+
+  bool enabled(uint8_t ds_id) const {
+    return ACCESS_ONCE(ds_states_[ds_id].enabled);
+  }
+  // Encodes the object data into buf, and returns the stored length.
+  uint16_t encode(uint8_t ds_id, uint16_t data_len, const uint8_t *data_buf,
+                  uint8_t *buf);
+  void decode(const uint8_t *buf, uint16_t stored_len, uint16_t *data_len,
+              uint8_t *data_buf);
+
+public:
+  CompressedDevice(FarMemDevice *device);
+  // Opts the data structure of ds_id in or out; it must not have any objects
+  // in far memory yet.
+  void set_compression(uint8_t ds_id, bool enabled);
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  // Compressed objects are written as a whole.
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  void register_local_buffer(uint8_t *buf, uint64_t len);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  // Requests of compressed data structures complete synchronously.
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+  uint32_t get_max_num_outstanding_reqs() const;
+  bool is_poll_blocking() const;
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+};
+
+// Wraps another device with a pool of compressed objects in local memory,
+// zswap-style. The objects of vanilla pointers that the cache GC evicts land
+// in the pool instead of going to the wrapped device, and swap-ins are served
+// from the pool whenever they hit it, which trades CPU cycles for round trips
+// to the remote agent. The pool is write-back: its dirty objects are written
+// to the wrapped device when they are evicted from it in LRU order. Objects of
+// the other data structures pass through, as their remote sides may compute
+// over them.
+class CompressedCacheDevice : public FarMemDevice {
+private:
+  constexpr static uint32_t kNumShards = 64;
+  // An object is kept compressed only below this share of its length.
+  constexpr static uint32_t kMaxStoredPercent = 90;
+  // Accounted for every object in the pool on top of its data.
+  constexpr static uint32_t kEntryOverhead = 64;
+
+  struct Entry {
+    std::unique_ptr<uint8_t[]> data;
+    uint16_t stored_len;
+    uint16_t data_len;
+    bool compressed;
+    bool dirty;
+    std::list<uint64_t>::iterator lru_iter;
+  };
+
+  struct Shard {
+    rt::Mutex mutex;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::list<uint64_t> lru; // Most recently used first.
+    uint64_t size = 0;
+  };
+
+  std::unique_ptr<FarMemDevice> device_;
+  uint64_t shard_capacity_;
+  std::unique_ptr<Shard[]> shards_;
+  CodecBufferPool bufs_;
+
+  static uint64_t get_obj_id(uint8_t obj_id_len, const uint8_t *obj_id);
+  Shard &get_shard(uint64_t obj_id);
+  // Both are called with the mutex of the shard held.
+  void put(Shard &shard, uint64_t obj_id, uint16_t data_len,
+           const uint8_t *data_buf, bool dirty);
+  void erase(Shard &shard, uint64_t obj_id, bool write_back);
+  bool get(uint64_t obj_id, uint16_t *data_len, uint8_t *data_buf);
+
+public:
+  // The pool holds at most pool_size bytes, e.g., a fraction of the size of
+  // the local cache.
+  CompressedCacheDevice(FarMemDevice *device, uint64_t pool_size);
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  // Objects in the pool absorb their extents as a whole.
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  void register_local_buffer(uint8_t *buf, uint64_t len);
+  void cache_clean_object(uint8_t ds_id, uint8_t obj_id_len,
+                          const uint8_t *obj_id, uint16_t data_len,
+                          const uint8_t *data_buf);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  // Requests of vanilla pointers complete synchronously.
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+  uint32_t get_max_num_outstanding_reqs() const;
+  bool is_poll_blocking() const;
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+};
+
+// Keeps the objects of vanilla pointers on local flash, e.g., when no remote
+// agent is available. The flash is laid out as a log of fixed-size segments:
+// objects are appended to the open segment in local memory as records of
+//     |obj_id (8B)|data_len (2B)|data_buf (data_len B)|
+// so that small objects share blocks, and a full segment is written to the
+// block store at once. The open segment is double-buffered, so that appends go
+// on while the previous one is being written. Overwritten objects leave dead
+// records behind; a segment without live records is reused, and once free
+// segments run short a cleaner uthread cleans the segment with the fewest live
+// bytes, i.e., appends its live records again. Reads fetch only the blocks that
+// cover the record. Other
+// data structures are served by an in-process Server like in FakeDevice, as
+// their servers compute over in-memory state.
+class StorageDevice : public FarMemDevice {
+private:
+  constexpr static uint32_t kPrefetchWinSize = 1 << 20;
+  constexpr static uint32_t kSegmentSize = 1 << 20;
+  constexpr static uint32_t kMaxBlockSize = 4096;
+  constexpr static uint32_t kMinNumFreeSegments = 4;
+  // Free segments that only the cleaner may take, so that it can always make
+  // progress.
+  constexpr static uint32_t kNumReservedSegments = 2;
+  // Share of the far memory size that the log holds on top of it, which keeps
+  // the cleaning cost bounded.
+  constexpr static uint32_t kOverProvisionPercent = 25;
+
+  struct RecordHeader {
+    uint64_t obj_id;
+    uint16_t data_len;
+  } __attribute__((packed));
+
+  static_assert(sizeof(RecordHeader) + Object::kMaxObjectDataSize +
+                    2 * kMaxBlockSize <=
+                CodecBufferPool::kBufSize);
+
+  struct Location {
+    uint32_t segment;
+    uint32_t offset;
+    uint16_t data_len;
+  };
+
+  struct Segment {
+    uint32_t used_bytes;
+    uint32_t live_bytes;
+    // Bumped whenever the segment is freed, so that reads which raced with
+    // its reuse are retried.
+    uint32_t epoch;
+    bool free;
+  };
+
+  // Tracks a read posted through post_read_object().
+  struct InflightRead {
+    std::atomic<bool> done;
+  };
+
+  std::unique_ptr<BlockStore> store_;
+  Server server_;
+  uint32_t block_size_;
+  uint32_t blocks_per_segment_;
+  rt::Mutex mutex_;
+  std::unordered_map<uint64_t, Location> index_;
+  std::vector<Segment> segments_;
+  std::vector<uint32_t> free_segments_;
+  uint32_t open_segment_;
+  std::unique_ptr<uint8_t[]> open_buf_;
+  // The sealed segment that is being written, if any, and its buffer.
+  std::optional<uint32_t> sealing_segment_;
+  std::unique_ptr<uint8_t[]> sealing_buf_;
+  // Signaled when a segment is written or freed.
+  rt::CondVar log_cv_;
+  rt::CondVar cleaner_cv_;
+  bool exit_ = false;
+  rt::Thread cleaner_;
+  CodecBufferPool bufs_;
+
+  static uint32_t get_record_size(uint16_t data_len) {
+    return sizeof(RecordHeader) + data_len;
+  }
+  // All of the below but cleaner_fn() and read_vanilla() are called with
+  // mutex_ held. make_room(), and so append(), seal() and clean() drop it
+  // around block store I/O.
+  void append(uint64_t obj_id, uint16_t data_len, const uint8_t *data_buf);
+  // Seals open segments until the open one fits record_size more bytes.
+  void make_room(uint32_t record_size, bool by_cleaner);
+  void release(const Location &loc);
+  void free_segment(uint32_t segment);
+  void seal();
+  void cleaner_fn();
+  // Cleans the segment with the fewest live bytes, reading it into buf.
+  void clean(uint8_t *buf);
+  void read_vanilla(uint64_t obj_id, uint16_t *data_len, uint8_t *data_buf);
+
+public:
+  // Takes the ownership of store, which must hold the far memory size plus
+  // kOverProvisionPercent of it.
+  StorageDevice(BlockStore *store, uint64_t far_mem_size);
+  ~StorageDevice();
+  NOT_COPYABLE(StorageDevice);
+  NOT_MOVEABLE(StorageDevice);
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  // Reads of vanilla pointers run in their own uthreads, so that many of them
+  // are outstanding on the block store at once. Writes complete
+  // synchronously, as they are buffered in the open segment.
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+};
+
+// Composes several devices into one far memory, e.g., two memory servers, or
+// RDMA in front of local flash, which scales its capacity and bandwidth past a
+// single backend. The devices are passed fastest first.
+// The far memory of vanilla pointers spans all of them: it is placed in
+// chunks, i.e., far-memory regions, which are assigned slots on the devices
+// when first written, and its object IDs are translated to the slots.
+//     kStriped: chunks are spread round-robin over the devices.
+//        kTiered: chunks fill the fastest device with free slots first, and a
+//                 migrator uthread periodically promotes the hottest chunk of
+//                 the slower devices, demoting the coldest chunk of the
+//                 fastest device if needed. Heat is the decayed number of
+//                 reads of a chunk.
+// Every other data structure lives wholly on one device, as its server keeps
+// state there: the one given to place(), or else the next one round-robin.
+class TieredDevice : public FarMemDevice {
+public:
+  enum class Placement { kStriped, kTiered };
+
+private:
+  constexpr static uint64_t kChunkSize = Region::kSize;
+  constexpr static uint32_t kNumLockShards = 64;
+  constexpr static uint32_t kMigrationIntervalUs = 10 * 1000;
+  // Promotions must beat the demoted chunk by this factor, which prevents the
+  // two from ping-ponging.
+  constexpr static uint32_t kMigrationHysteresis = 2;
+  constexpr static uint32_t kMinPromotionHeat = 16;
+  constexpr static uint8_t kUnassigned = std::numeric_limits<uint8_t>::max();
+
+  struct Chunk {
+    uint8_t device = kUnassigned;
+    uint32_t slot;
+    uint32_t heat = 0;
+    // Requests that are routed through the current slot.
+    uint32_t num_inflight = 0;
+    bool migrating = false;
+    // Offset -> data length of the objects written to the chunk, so that the
+    // migrator knows what to copy. Only kept with kTiered.
+    std::map<uint32_t, uint16_t> objs;
+  };
+
+  struct LockShard {
+    rt::Mutex mutex;
+    rt::CondVar cv;
+  };
+
+  std::vector<std::unique_ptr<FarMemDevice>> devices_;
+  Placement placement_;
+  uint64_t num_chunks_;
+  std::unique_ptr<Chunk[]> chunks_;
+  LockShard lock_shards_[kNumLockShards];
+  rt::Spin slots_spin_;
+  std::vector<std::vector<uint32_t>> free_slots_; // Indexed by device.
+  uint8_t ds_devices_[kMaxNumDSIDs];
+  std::atomic<uint32_t> next_ds_device_{0};
+  bool exit_ = false;
+  rt::Thread migrator_;
+  CodecBufferPool bufs_;
+
+  static uint64_t get_far_mem_size(
+      const std::vector<FarMemDevice *> &devices, Placement placement);
+  static uint32_t get_prefetch_win_size(
+      const std::vector<FarMemDevice *> &devices);
+  LockShard &get_lock_shard(uint64_t chunk_idx) {
+    return lock_shards_[chunk_idx % kNumLockShards];
+  }
+  std::optional<uint32_t> allocate_slot(uint8_t device);
+  void free_slot(uint8_t device, uint32_t slot);
+  // Pins the distinct chunks of chunk_idxs, which must be sorted, onto their
+  // devices. A batch pins every chunk once, as it would otherwise hold one pin
+  // of a chunk while it waits for the migration of it to drain the pins.
+  void pin_chunks(uint32_t num, const uint64_t *chunk_idxs);
+  void unpin_chunks(uint32_t num, const uint64_t *chunk_idxs);
+  // Routes a request of the vanilla object obj_id through its pinned chunk.
+  // Writes pass data_len.
+  FarMemDevice *route_pinned(uint64_t obj_id, std::optional<uint16_t> data_len,
+                             uint64_t *local_obj_id);
+  // Routes a request of the vanilla object obj_id through its chunk, which
+  // stays on the returned device until unpin_chunk().
+  FarMemDevice *pin_chunk(uint64_t obj_id, std::optional<uint16_t> data_len,
+                          uint64_t *local_obj_id);
+  void unpin_chunk(uint64_t obj_id);
+  // Sorts and dedups the chunks of the vanilla requests in reqs into
+  // chunk_idxs, and returns their number.
+  template <typename Req>
+  static uint32_t get_batch_chunks(uint32_t num_reqs, const Req *reqs,
+                                   uint64_t *chunk_idxs);
+  FarMemDevice *get_ds_device(uint8_t ds_id) {
+    return devices_[ds_devices_[ds_id]].get();
+  }
+  void migrator_fn();
+  void migrate();
+  void move_chunk(uint64_t chunk_idx, uint8_t to_device);
+
+public:
+  TieredDevice(const std::vector<FarMemDevice *> &devices,
+               Placement placement);
+  ~TieredDevice();
+  NOT_COPYABLE(TieredDevice);
+  NOT_MOVEABLE(TieredDevice);
+  // Places the data structure of ds_id on the given device; must be called
+  // before it is constructed.
+  void place(uint8_t ds_id, uint8_t device);
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  // Batches are split per device, which serve their parts one after another.
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  void register_local_buffer(uint8_t *buf, uint64_t len);
+  void cache_clean_object(uint8_t ds_id, uint8_t obj_id_len,
+                          const uint8_t *obj_id, uint16_t data_len,
+                          const uint8_t *data_buf);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  // Requests of vanilla pointers complete synchronously, as their chunks must
+  // not migrate while they are in flight.
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+  uint32_t get_max_num_outstanding_reqs() const;
+  bool is_poll_blocking() const;
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
+};
+
+// Mirrors far memory on two devices, e.g., two memory servers, so that it
+// survives losing either of them without paying for synchronous replication.
+// Writes are posted to both replicas at once from a private copy of the data,
+// and complete on the first ack; the other replica is tracked in the
+// background. Reads are posted to every replica that is up to date with the
+// object, i.e., has no pending write of it, and complete with whichever
+// responds first, which also cuts the tail latency. The requests that keep
+// going after the ones they belong to have completed are reaped by the later
+// requests of their shard. Control operations, e.g., construct(), go to both
+// replicas synchronously. The replicas must be able to poll() without blocking,
+// e.g., TCPDevice needs to be pipelined.
+// A replica that leaves a request incomplete for longer than the timeout is
+// marked failed: its outstanding requests are abandoned, and it gets no more
+// requests, including the control ones. The control operations themselves are
+// not timed out, though. Losing both replicas is fatal.
+class ReplicatedDevice : public FarMemDevice {
+private:
+  constexpr static uint32_t kNumReplicas = 2;
+  constexpr static uint32_t kNumShards = 64;
+  constexpr static uint64_t kDefaultTimeoutUs = 1000 * 1000;
+
+  struct ReplicaOp {
+    bool is_read;
+    uint64_t key;
+    uint8_t ds_id;
+    uint8_t obj_id_len;
+    uint8_t obj_id[Object::kMaxObjectIDSize];
+    // Set once the request that owns the op has completed.
+    bool acked;
+    uint64_t posted_us;
+    bool posted[kNumReplicas];
+    bool done[kNumReplicas];
+    // Posted to a replica that has failed before completing it.
+    bool abandoned[kNumReplicas];
+    DeviceReqHandle handles[kNumReplicas];
+    uint16_t data_lens[kNumReplicas];
+    // Writes share bufs[0]; reads own one per posted replica.
+    uint8_t *bufs[kNumReplicas];
+    // Where a read delivers its data.
+    uint16_t *data_len;
+    uint8_t *data_buf;
+  };
+
+  struct Shard {
+    rt::Mutex mutex;
+    // The not yet finished write of each object, if any.
+    std::unordered_map<uint64_t, ReplicaOp *> writes;
+    // Acked ops whose lagging replicas are still in flight.
+    std::vector<ReplicaOp *> detached;
+  };
+
+  std::unique_ptr<FarMemDevice> replicas_[kNumReplicas];
+  std::atomic<bool> failed_[kNumReplicas];
+  uint64_t timeout_us_;
+  Shard shards_[kNumShards];
+  CodecBufferPool bufs_;
+
+  static uint64_t get_key(uint8_t ds_id, uint8_t obj_id_len,
+                          const uint8_t *obj_id);
+  Shard &get_shard(uint64_t key) { return shards_[key % kNumShards]; }
+  bool is_alive(uint32_t replica) const { return !failed_[replica].load(); }
+  void fail(uint32_t replica);
+  // All of the below but settle_ds() and settle_all() are called with the
+  // mutex of the shard held, so the replicas must not block in poll().
+  ReplicaOp *new_op(bool is_read, uint8_t ds_id, uint8_t obj_id_len,
+                    const uint8_t *obj_id);
+  void delete_op(ReplicaOp *op);
+  // Returns true once all of the posted replicas have completed or failed.
+  bool progress(ReplicaOp *op);
+  // Posts the read to the live replicas that are up to date with the object.
+  void post_read(Shard &shard, ReplicaOp *op);
+  void retire(Shard &shard, ReplicaOp *op);
+  void reap(Shard &shard);
+  // Waits for the pending write of key, which keeps the writes of an object to
+  // a replica in order.
+  void settle(Shard &shard, uint64_t key);
+  // Waits for the pending writes of the data structure, on all shards.
+  void settle_ds(uint8_t ds_id);
+  // Waits for all of the pending writes, on all shards.
+  void settle_all();
+
+public:
+  ReplicatedDevice(FarMemDevice *primary, FarMemDevice *backup,
+                   uint64_t timeout_us = kDefaultTimeoutUs);
+  ~ReplicatedDevice();
+  NOT_COPYABLE(ReplicatedDevice);
+  NOT_MOVEABLE(ReplicatedDevice);
+  void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                   uint16_t *data_len, uint8_t *data_buf);
+  void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
+                    uint16_t data_len, const uint8_t *data_buf);
+  // Keeps all of the writes outstanding at the same time.
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  void register_local_buffer(uint8_t *buf, uint64_t len);
+  void cache_clean_object(uint8_t ds_id, uint8_t obj_id_len,
+                          const uint8_t *obj_id, uint16_t data_len,
+                          const uint8_t *data_buf);
+  bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle);
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle);
+  bool poll(DeviceReqHandle *handle);
+  uint32_t get_max_num_outstanding_reqs() const;
+  void construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                 uint8_t *params);
+  void destruct(uint8_t ds_id);
+  // Runs on both replicas in parallel, as it may update the data structure;
+  // the output is the primary's, unless the primary has failed.
+  void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+               const uint8_t *input_buf, uint16_t *output_len,
+               uint8_t *output_buf);
 };
 
 } // namespace far_memory
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "helpers.hpp"
+#include "object.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace far_memory {
+
+// Sub-object dirty tracking. It keeps one dirty bit per cacheline of the local
+// cache, which is set by the ranged deref_mut()s of objects whose far-mem
+// pointers are not dirty as a whole. The swap-out of such an object then only
+// writes back the extents covered by its dirty cachelines. The bits of a cache
+// region are cleared when the region is freed.
+class DirtyLines {
+public:
+  constexpr static uint32_t kLineShift = 6;
+  constexpr static uint32_t kLineSize = (1 << kLineShift);
+  // Runs of dirty cachelines beyond this are merged into the last extent.
+  constexpr static uint32_t kMaxNumExtents = 8;
+
+private:
+  constexpr static uint32_t kNumLinesPerWord = 64;
+
+  static uint64_t cache_begin_addr_;
+  static uint64_t cache_end_addr_;
+  static std::unique_ptr<std::atomic<uint64_t>[]> bitmap_;
+
+  static uint64_t line_idx(uint64_t addr);
+  template <typename Fn>
+  static void for_each_word(uint64_t addr, uint32_t len, Fn &&fn);
+
+public:
+  static void init(uint8_t *cache_ptr, uint64_t cache_size);
+  static void destroy();
+  static void mark(uint64_t addr, uint32_t len);
+  static bool test(uint64_t addr, uint32_t len);
+  // Only clears the lines that lie entirely within [addr, addr + len), as the
+  // others are shared with neighboring objects.
+  static void clear(uint64_t addr, uint32_t len);
+  // Carries the dirty lines of the object data at from_data_addr over to its
+  // copy at to_data_addr, whose lines are laid out differently.
+  static void copy(uint64_t from_data_addr, uint64_t to_data_addr,
+                   uint16_t data_len);
+  // Returns the number of dirty extents of the object data at data_addr.
+  static uint32_t get_extents(uint64_t data_addr, uint16_t data_len,
+                              ObjectExtent *extents);
+};
+
+} // namespace far_memory
+
+#include "internal/dirty_lines.ipp"
@@ -4,6 +4,8 @@
 #include "helpers.hpp"
 #include "manager.hpp"
 
+#include <cmath>
+
 namespace far_memory {
 
 template <typename T>
@@ -47,6 +49,103 @@ template <typename T> FORCE_INLINE T AggregatorMedian<T>::aggregate() {
   return ret;
 }
 
+template <typename T>
+FORCE_INLINE void AggregatorSum<T>::add(DerefScope *scope, T t) {
+  if constexpr (std::is_arithmetic_v<T>) {
+    tmp_ += t;
+  } else {
+    BUG();
+  }
+}
+
+template <typename T> FORCE_INLINE T AggregatorSum<T>::aggregate() {
+  auto ret = tmp_;
+  tmp_ = T();
+  return ret;
+}
+
+template <typename T>
+FORCE_INLINE void AggregatorCount<T>::add(DerefScope *scope, T t) {
+  cnt_++;
+}
+
+template <typename T> FORCE_INLINE T AggregatorCount<T>::aggregate() {
+  if constexpr (std::is_arithmetic_v<T>) {
+    auto ret = static_cast<T>(cnt_);
+    cnt_ = 0;
+    return ret;
+  } else {
+    BUG();
+  }
+}
+
+template <typename T>
+FORCE_INLINE void AggregatorMean<T>::add(DerefScope *scope, T t) {
+  if constexpr (std::is_arithmetic_v<T>) {
+    sum_ += t;
+    cnt_++;
+  } else {
+    BUG();
+  }
+}
+
+template <typename T> FORCE_INLINE T AggregatorMean<T>::aggregate() {
+  if constexpr (std::is_arithmetic_v<T>) {
+    auto ret = static_cast<T>(cnt_ ? sum_ / cnt_ : 0);
+    sum_ = 0;
+    cnt_ = 0;
+    return ret;
+  } else {
+    BUG();
+  }
+}
+
+template <typename T, bool Std>
+FORCE_INLINE void AggregatorVar<T, Std>::add(DerefScope *scope, T t) {
+  if constexpr (std::is_arithmetic_v<T>) {
+    double delta = t - mean_;
+    mean_ += delta / ++cnt_;
+    m2_ += delta * (t - mean_);
+  } else {
+    BUG();
+  }
+}
+
+template <typename T, bool Std>
+FORCE_INLINE T AggregatorVar<T, Std>::aggregate() {
+  if constexpr (std::is_arithmetic_v<T>) {
+    double var = (cnt_ > 1) ? m2_ / (cnt_ - 1) : 0;
+    cnt_ = 0;
+    mean_ = 0;
+    m2_ = 0;
+    return static_cast<T>(Std ? std::sqrt(var) : var);
+  } else {
+    BUG();
+  }
+}
+
+template <typename T>
+FORCE_INLINE void AggregatorFirst<T>::add(DerefScope *scope, T t) {
+  if (!tmp_) {
+    tmp_ = t;
+  }
+}
+
+template <typename T> FORCE_INLINE T AggregatorFirst<T>::aggregate() {
+  auto ret = *tmp_;
+  tmp_.reset();
+  return ret;
+}
+
+template <typename T>
+FORCE_INLINE void AggregatorLast<T>::add(DerefScope *scope, T t) {
+  tmp_ = t;
+}
+
+template <typename T> FORCE_INLINE T AggregatorLast<T>::aggregate() {
+  return tmp_;
+}
+
 template <typename T>
 FORCE_INLINE AggregatorMedianLimitedMem<T>::AggregatorMedianLimitedMem(
     FarMemManager *manager)
@@ -85,6 +184,20 @@ AggregatorFactory<T>::build(uint8_t opcode, bool limited_mem,
                ? reinterpret_cast<Aggregator<T> *>(
                      new AggregatorMedianLimitedMem<T>(manager))
                : reinterpret_cast<Aggregator<T> *>(new AggregatorMedian<T>());
+  case GenericDataFrameVector::OpCode::AggregateSum:
+    return new AggregatorSum<T>();
+  case GenericDataFrameVector::OpCode::AggregateCount:
+    return new AggregatorCount<T>();
+  case GenericDataFrameVector::OpCode::AggregateMean:
+    return new AggregatorMean<T>();
+  case GenericDataFrameVector::OpCode::AggregateVar:
+    return new AggregatorVar<T, /* Std = */ false>();
+  case GenericDataFrameVector::OpCode::AggregateStd:
+    return new AggregatorVar<T, /* Std = */ true>();
+  case GenericDataFrameVector::OpCode::AggregateFirst:
+    return new AggregatorFirst<T>();
+  case GenericDataFrameVector::OpCode::AggregateLast:
+    return new AggregatorLast<T>();
   default:
     BUG();
   }
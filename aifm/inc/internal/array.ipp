@@ -20,11 +20,8 @@ FORCE_INLINE GenericArray::Index_t GenericArray::infer_fn(Index_t idx,
 
 FORCE_INLINE GenericUniquePtr *GenericArray::mapping_fn(uint8_t *&state,
                                                         Index_t idx) {
-  auto &ptrs = *reinterpret_cast<std::unique_ptr<GenericUniquePtr[]> *>(state);
-  auto num_items =
-      *reinterpret_cast<uint64_t *>(state + offsetof(GenericArray, kNumItems_) -
-                                    offsetof(GenericArray, ptrs_));
-  return idx < num_items ? &ptrs[idx] : nullptr;
+  auto *array = reinterpret_cast<GenericArray *>(state);
+  return idx < array->kNumItems_ ? &array->ptrs_[idx] : nullptr;
 }
 
 FORCE_INLINE GenericUniquePtr *GenericArray::at(bool nt, Index_t idx) {
@@ -122,6 +119,17 @@ FORCE_INLINE T &Array<T, Dims...>::at_mut(const DerefScope &scope,
   return *(ptr->template deref_mut<Nt>(scope));
 }
 
+template <typename T, uint64_t... Dims>
+template <bool Nt, typename... Indices>
+FORCE_INLINE T &Array<T, Dims...>::at_mut_range(const DerefScope &scope,
+                                                uint16_t offset, uint16_t len,
+                                                Indices... indices) noexcept {
+  assert(offset + len <= sizeof(T));
+  auto idx = get_flat_idx(indices...);
+  auto ptr = reinterpret_cast<UniquePtr<T> *>(GenericArray::at(Nt, idx));
+  return *(ptr->template deref_mut<Nt>(scope, offset, len));
+}
+
 template <typename T, uint64_t... Dims>
 template <bool Nt, typename... Indices>
 FORCE_INLINE T &Array<T, Dims...>::at_mut_safe(const DerefScope &scope,
@@ -2,6 +2,7 @@
 
 #include "hash.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 namespace far_memory {
@@ -69,6 +70,38 @@ FORCE_INLINE bool GenericConcurrentHopscotch::remove_tp(uint8_t key_len,
   return remove(scope, key_len, key);
 }
 
+FORCE_INLINE void
+GenericConcurrentHopscotch::multi_get(const DerefScope &scope,
+                                      uint32_t num_reqs, const GetReq *reqs) {
+  _multi_get(num_reqs, reqs);
+}
+
+FORCE_INLINE void GenericConcurrentHopscotch::multi_get_tp(uint32_t num_reqs,
+                                                           const GetReq *reqs) {
+  DerefScope scope;
+  multi_get(scope, num_reqs, reqs);
+}
+
+FORCE_INLINE uint32_t
+GenericConcurrentHopscotch::multi_put(const DerefScope &scope,
+                                      uint32_t num_reqs, const PutReq *reqs) {
+  return _multi_put(num_reqs, reqs);
+}
+
+FORCE_INLINE uint32_t
+GenericConcurrentHopscotch::multi_put_tp(uint32_t num_reqs,
+                                         const PutReq *reqs) {
+  DerefScope scope;
+  return multi_put(scope, num_reqs, reqs);
+}
+
+FORCE_INLINE void
+GenericConcurrentHopscotch::prefetch_bucket(uint8_t key_len,
+                                            const uint8_t *key) {
+  uint32_t hash = hash_32(reinterpret_cast<const void *>(key), key_len);
+  __builtin_prefetch(buckets_ + (hash & kHashMask_));
+}
+
 FORCE_INLINE void GenericConcurrentHopscotch::process_evac_notifier_stash() {
   if (unlikely(evac_notifier_stash_.size())) {
     EvacNotifierMeta meta;
@@ -200,6 +233,57 @@ FORCE_INLINE bool ConcurrentHopscotch<K, V>::_erase(const K &key) {
   return key_existed;
 }
 
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::_multi_find(
+    uint32_t num_keys, const K *keys, std::optional<V> *vals) {
+  GetReq reqs[kMaxMultiBatchSize];
+  uint16_t val_lens[kMaxMultiBatchSize];
+  V found_vals[kMaxMultiBatchSize];
+  while (num_keys) {
+    auto num = std::min(num_keys, kMaxMultiBatchSize);
+    for (uint32_t i = 0; i < num; i++) {
+      reqs[i] = {.key_len = sizeof(K),
+                 .key = reinterpret_cast<const uint8_t *>(&keys[i]),
+                 .val_len = &val_lens[i],
+                 .val = reinterpret_cast<uint8_t *>(&found_vals[i])};
+    }
+    _multi_get(num, reqs);
+    for (uint32_t i = 0; i < num; i++) {
+      if (val_lens[i] == 0) {
+        vals[i] = std::nullopt;
+      } else {
+        vals[i] = found_vals[i];
+      }
+    }
+    keys += num;
+    vals += num;
+    num_keys -= num;
+  }
+}
+
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::_multi_insert(uint32_t num_keys,
+                                                           const K *keys,
+                                                           const V *vals) {
+  PutReq reqs[kMaxMultiBatchSize];
+  while (num_keys) {
+    auto num = std::min(num_keys, kMaxMultiBatchSize);
+    for (uint32_t i = 0; i < num; i++) {
+      reqs[i] = {.key_len = sizeof(K),
+                 .key = reinterpret_cast<const uint8_t *>(&keys[i]),
+                 .val_len = sizeof(V),
+                 .val = reinterpret_cast<const uint8_t *>(&vals[i])};
+    }
+    auto num_existed = _multi_put(num, reqs);
+    preempt_disable();
+    per_core_size_[get_core_num()].data += num - num_existed;
+    preempt_enable();
+    keys += num;
+    vals += num;
+    num_keys -= num;
+  }
+}
+
 template <typename K, typename V>
 FORCE_INLINE bool ConcurrentHopscotch<K, V>::empty() const {
   return size() == 0;
@@ -249,4 +333,36 @@ FORCE_INLINE bool ConcurrentHopscotch<K, V>::erase_tp(const K &key) {
   DerefScope scope;
   return _erase(key);
 }
+
+template <typename K, typename V>
+FORCE_INLINE void
+ConcurrentHopscotch<K, V>::multi_find(const DerefScope &scope,
+                                      uint32_t num_keys, const K *keys,
+                                      std::optional<V> *vals) {
+  _multi_find(num_keys, keys, vals);
+}
+
+template <typename K, typename V>
+FORCE_INLINE void
+ConcurrentHopscotch<K, V>::multi_find_tp(uint32_t num_keys, const K *keys,
+                                         std::optional<V> *vals) {
+  DerefScope scope;
+  _multi_find(num_keys, keys, vals);
+}
+
+template <typename K, typename V>
+FORCE_INLINE void
+ConcurrentHopscotch<K, V>::multi_insert(const DerefScope &scope,
+                                        uint32_t num_keys, const K *keys,
+                                        const V *vals) {
+  _multi_insert(num_keys, keys, vals);
+}
+
+template <typename K, typename V>
+FORCE_INLINE void ConcurrentHopscotch<K, V>::multi_insert_tp(uint32_t num_keys,
+                                                             const K *keys,
+                                                             const V *vals) {
+  DerefScope scope;
+  _multi_insert(num_keys, keys, vals);
+}
 } // namespace far_memory
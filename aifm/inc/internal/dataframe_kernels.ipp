@@ -0,0 +1,201 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <type_traits>
+
+namespace far_memory {
+
+FORCE_INLINE DataFrameKernels::Isa DataFrameKernels::get_isa() {
+  return isa_;
+}
+
+template <typename T>
+FORCE_INLINE constexpr bool DataFrameKernels::is_gatherable() {
+  return std::is_trivially_copyable_v<T> && (sizeof(T) == 4 || sizeof(T) == 8);
+}
+
+template <typename T>
+FORCE_INLINE void
+DataFrameKernels::gather_scalar(T *dst, const T *src,
+                                const unsigned long long *idx, uint64_t num) {
+  for (uint64_t i = 0; i < num; i++) {
+    dst[i] = src[idx[i]];
+  }
+}
+
+template <typename T>
+__attribute__((target("avx2"))) void
+DataFrameKernels::gather_avx2(T *dst, const T *src,
+                              const unsigned long long *idx, uint64_t num) {
+  uint64_t i = 0;
+  for (; i + 4 <= num; i += 4) {
+    auto vidx =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(idx + i));
+    if constexpr (sizeof(T) == 8) {
+      auto v = _mm256_i64gather_epi64(
+          reinterpret_cast<const long long *>(src), vidx, 8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+    } else {
+      auto v =
+          _mm256_i64gather_epi32(reinterpret_cast<const int *>(src), vidx, 4);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+    }
+  }
+  gather_scalar(dst + i, src, idx + i, num - i);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void
+DataFrameKernels::gather_avx512(T *dst, const T *src,
+                                const unsigned long long *idx, uint64_t num) {
+  uint64_t i = 0;
+  for (; i + 8 <= num; i += 8) {
+    auto vidx = _mm512_loadu_si512(idx + i);
+    if constexpr (sizeof(T) == 8) {
+      auto v = _mm512_i64gather_epi64(vidx, src, 8);
+      _mm512_storeu_si512(dst + i, v);
+    } else {
+      auto v = _mm512_i64gather_epi32(vidx, src, 4);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+    }
+  }
+  gather_scalar(dst + i, src, idx + i, num - i);
+}
+
+template <typename T>
+FORCE_INLINE void DataFrameKernels::gather(T *dst, const T *src,
+                                           const unsigned long long *idx,
+                                           uint64_t num) {
+  if constexpr (is_gatherable<T>()) {
+    switch (isa_) {
+    case kAVX512:
+      return gather_avx512(dst, src, idx, num);
+    case kAVX2:
+      return gather_avx2(dst, src, idx, num);
+    default:
+      break;
+    }
+  }
+  gather_scalar(dst, src, idx, num);
+}
+
+// Keeps a cache line worth of independent accumulators, which the compiler
+// maps onto vector registers of whatever width the caller is compiled for
+// without having to reassociate the (floating-point) operations itself.
+template <typename T, typename Op>
+FORCE_INLINE T DataFrameKernels::reduce(const T *src, uint64_t num, T init,
+                                        Op op) {
+  constexpr uint32_t kNumLanes = kNumAccumulatorBytes / sizeof(T);
+  T lanes[kNumLanes];
+  std::fill(lanes, lanes + kNumLanes, init);
+  uint64_t i = 0;
+  for (; i + kNumLanes <= num; i += kNumLanes) {
+    for (uint32_t j = 0; j < kNumLanes; j++) {
+      lanes[j] = op(lanes[j], src[i + j]);
+    }
+  }
+  auto ret = init;
+  for (uint32_t j = 0; j < kNumLanes; j++) {
+    ret = op(ret, lanes[j]);
+  }
+  for (; i < num; i++) {
+    ret = op(ret, src[i]);
+  }
+  return ret;
+}
+
+template <typename T, typename Op>
+__attribute__((target("avx2"))) T
+DataFrameKernels::reduce_avx2(const T *src, uint64_t num, T init, Op op) {
+  return reduce(src, num, init, op);
+}
+
+template <typename T, typename Op>
+__attribute__((target("avx512f,avx512bw,avx512dq,avx512vl"))) T
+DataFrameKernels::reduce_avx512(const T *src, uint64_t num, T init, Op op) {
+  return reduce(src, num, init, op);
+}
+
+template <typename T, typename Op>
+FORCE_INLINE T DataFrameKernels::dispatch_reduce(const T *src, uint64_t num,
+                                                 T init, Op op) {
+  switch (isa_) {
+  case kAVX512:
+    return reduce_avx512(src, num, init, op);
+  case kAVX2:
+    return reduce_avx2(src, num, init, op);
+  default:
+    return reduce(src, num, init, op);
+  }
+}
+
+template <typename T>
+FORCE_INLINE T DataFrameKernels::min(const T *src, uint64_t num) {
+  assert(num > 0);
+  auto op = [](T a, T b) { return (b < a) ? b : a; };
+  if constexpr (std::is_arithmetic_v<T>) {
+    return dispatch_reduce(src, num, src[0], op);
+  } else {
+    return std::accumulate(src + 1, src + num, src[0], op);
+  }
+}
+
+template <typename T>
+FORCE_INLINE T DataFrameKernels::max(const T *src, uint64_t num) {
+  assert(num > 0);
+  auto op = [](T a, T b) { return (a < b) ? b : a; };
+  if constexpr (std::is_arithmetic_v<T>) {
+    return dispatch_reduce(src, num, src[0], op);
+  } else {
+    return std::accumulate(src + 1, src + num, src[0], op);
+  }
+}
+
+template <typename T>
+FORCE_INLINE T DataFrameKernels::sum(const T *src, uint64_t num) {
+  static_assert(std::is_arithmetic_v<T>);
+  return dispatch_reduce(src, num, T(), [](T a, T b) -> T { return a + b; });
+}
+
+FORCE_INLINE uint64_t FlatGroupIndex::get_slot_idx(uint64_t hash) const {
+  // Fibonacci hashing, as std::hash is the identity for integers.
+  return (hash * 0x9e3779b97f4a7c15ULL) >> shift_;
+}
+
+template <typename Equal>
+FORCE_INLINE std::pair<uint64_t, bool>
+FlatGroupIndex::find_or_insert(uint64_t hash, uint64_t row, Equal &&equal) {
+  auto mask = slots_.size() - 1;
+  for (auto idx = get_slot_idx(hash);; idx = (idx + 1) & mask) {
+    auto &slot = slots_[idx];
+    if (slot.group == kEmpty) {
+      auto group = first_rows_.size();
+      slot.hash = hash;
+      slot.group = group;
+      first_rows_.push_back(row);
+      // Keeps the load factor at most 1/2.
+      if (unlikely(first_rows_.size() * 2 > slots_.size())) {
+        grow();
+      }
+      return std::make_pair(group, true);
+    }
+    if (slot.hash == hash && equal(first_rows_[slot.group])) {
+      return std::make_pair(slot.group, false);
+    }
+  }
+}
+
+FORCE_INLINE uint64_t FlatGroupIndex::size() const {
+  return first_rows_.size();
+}
+
+FORCE_INLINE const std::vector<unsigned long long> &
+FlatGroupIndex::get_first_rows() const {
+  return first_rows_;
+}
+
+} // namespace far_memory
@@ -1,11 +1,19 @@
 #pragma once
 
+#include "thread.h"
+
 #include "aggregator.hpp"
 #include "helpers.hpp"
 #include "manager.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstring>
 #include <ctime>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace far_memory {
@@ -39,8 +47,8 @@ FORCE_INLINE DataFrameVector<T>::DataFrameVector(FarMemManager *manager)
                              get_dataframe_type_id<T>()),
       prefetcher_(new Prefetcher<decltype(kInduceFn), decltype(kInferFn),
                                  decltype(kMappingFn)>(
-          manager->get_device(), reinterpret_cast<uint8_t *>(&lock_),
-          kRealChunkSize)) {}
+          manager->get_device(), manager->get_prefetch_executor(),
+          reinterpret_cast<uint8_t *>(&lock_), kRealChunkSize)) {}
 
 template <typename T>
 FORCE_INLINE DataFrameVector<T>::DataFrameVector(const DataFrameVector &other)
@@ -262,8 +270,8 @@ template <bool Nt>
 FORCE_INLINE void DataFrameVector<T>::FastIterator<Mut>::update_on_new_chunk() {
   if (likely(chunk_ptr_ <= &dataframe_vec_->chunk_ptrs_.back() &&
              chunk_ptr_ >= &dataframe_vec_->chunk_ptrs_.front())) {
-    dataframe_vec_->prefetcher_->add_trace(
-        Nt, chunk_ptr_ - &(dataframe_vec_->chunk_ptrs_.front()));
+    auto chunk_idx = chunk_ptr_ - &(dataframe_vec_->chunk_ptrs_.front());
+    dataframe_vec_->prefetcher_->add_trace(Nt, chunk_idx);
     if constexpr (Mut) {
       data_ptr_begin_ =
           reinterpret_cast<T *>(chunk_ptr_->deref_mut<Nt>(*scope_));
@@ -435,6 +443,9 @@ template <typename T>
 template <bool Mut>
 FORCE_INLINE std::conditional<Mut, T &, const T &>::type
     DataFrameVector<T>::FastIterator<Mut>::operator*() const {
+  if constexpr (Mut) {
+    invalidate_zone_map();
+  }
   return *data_ptr_;
 }
 
@@ -442,9 +453,22 @@ template <typename T>
 template <bool Mut>
 FORCE_INLINE std::conditional<Mut, T *, const T *>::type
     DataFrameVector<T>::FastIterator<Mut>::operator->() const {
+  if constexpr (Mut) {
+    invalidate_zone_map();
+  }
   return data_ptr_;
 }
 
+// On every mutable dereference, as the zone map may be rebuilt between two
+// writes to the same chunk.
+template <typename T>
+template <bool Mut>
+FORCE_INLINE void
+DataFrameVector<T>::FastIterator<Mut>::invalidate_zone_map() const {
+  dataframe_vec_->invalidate_zone_map(chunk_ptr_ -
+                                      &(dataframe_vec_->chunk_ptrs_.front()));
+}
+
 template <typename T>
 FORCE_INLINE DataFrameVector<T> &DataFrameVector<T>::
 operator=(const DataFrameVector &other) {
@@ -455,7 +479,8 @@ operator=(const DataFrameVector &other) {
 template <typename T>
 FORCE_INLINE DataFrameVector<T>::DataFrameVector(DataFrameVector &&other)
     : GenericDataFrameVector(std::move(other.lock())),
-      prefetcher_(std::move(other.prefetcher_)) {
+      prefetcher_(std::move(other.prefetcher_)),
+      zone_maps_(std::move(other.zone_maps_)) {
   prefetcher_->update_state(reinterpret_cast<uint8_t *>(&lock_));
   other.lock_.unlock_writer();
 }
@@ -467,6 +492,7 @@ operator=(DataFrameVector &&other) {
   GenericDataFrameVector::operator=(std::move(other));
   prefetcher_ = std::move(other.prefetcher_);
   prefetcher_->update_state(reinterpret_cast<uint8_t *>(&lock_));
+  zone_maps_ = std::move(other.zone_maps_);
   return *this;
 }
 
@@ -509,9 +535,11 @@ FORCE_INLINE void DataFrameVector<T>::push_back(const DerefScope &scope,
     expand(kNumEntriesPerExpansion);
   }
   assert(chunk_ptrs_.size() >= chunk_idx);
-  auto *raw_mut_ptr = chunk_ptrs_[chunk_idx].template deref_mut<Nt>(scope);
+  auto *raw_mut_ptr = chunk_ptrs_[chunk_idx].template deref_mut<Nt>(
+      scope, chunk_offset * sizeof(T), sizeof(T));
   __builtin_memcpy(reinterpret_cast<T *>(raw_mut_ptr) + chunk_offset, &u,
                    sizeof(u));
+  update_zone_map(chunk_idx, chunk_offset, u);
   prefetch_record(Nt, chunk_idx);
   dirty_ = true;
 }
@@ -534,6 +562,12 @@ template <typename T>
 FORCE_INLINE void DataFrameVector<T>::resize(uint64_t count) {
   if (count > size_) {
     reserve(count);
+    // The new elements are whatever the chunks held.
+    auto end_chunk_idx = (count - 1) / kRealChunkNumEntries + 1;
+    for (auto chunk_idx = get_chunk_stats(size_).first;
+         chunk_idx < std::min(end_chunk_idx, zone_maps_.size()); chunk_idx++) {
+      invalidate_zone_map(chunk_idx);
+    }
     size_ = count;
   }
 }
@@ -607,6 +641,124 @@ DataFrameVector<T>::cfend(DerefScope &scope) const {
   return FastIterator<false>(scope, this, size());
 }
 
+template <typename T>
+FORCE_INLINE void DataFrameVector<T>::update_zone_map(uint64_t chunk_idx,
+                                                      uint64_t chunk_offset,
+                                                      const T &t) {
+  if (unlikely(zone_maps_.size() <= chunk_idx)) {
+    zone_maps_.resize(chunk_ptrs_.size());
+  }
+  auto &zone = zone_maps_[chunk_idx];
+  if (chunk_offset == 0) {
+    // Appending to an empty chunk, which resets its zone map.
+    zone = DataFrameZoneMap<T>();
+    zone.known = true;
+  } else if (!zone.known) {
+    return;
+  }
+  if constexpr (std::is_floating_point_v<T>) {
+    if (std::isnan(t)) {
+      zone.num_nulls++;
+      return;
+    }
+  }
+  if (zone.num_values++ == 0) {
+    zone.min = zone.max = t;
+  } else {
+    if (t < zone.min) {
+      zone.min = t;
+    }
+    if (zone.max < t) {
+      zone.max = t;
+    }
+  }
+}
+
+template <typename T>
+FORCE_INLINE void DataFrameVector<T>::invalidate_zone_map(uint64_t chunk_idx) {
+  if (chunk_idx < zone_maps_.size()) {
+    zone_maps_[chunk_idx].known = false;
+  }
+}
+
+template <typename T>
+FORCE_INLINE constexpr uint32_t DataFrameVector<T>::get_chunk_num_entries() {
+  return kRealChunkNumEntries;
+}
+
+template <typename T>
+FORCE_INLINE const DataFrameZoneMap<T> &
+DataFrameVector<T>::get_zone_map(const DerefScope &scope, uint64_t chunk_idx) {
+  assert(chunk_idx * kRealChunkNumEntries < size_);
+  if (unlikely(zone_maps_.size() <= chunk_idx)) {
+    zone_maps_.resize(chunk_ptrs_.size());
+  }
+  auto &zone = zone_maps_[chunk_idx];
+  if (unlikely(!zone.known)) {
+    auto *data = reinterpret_cast<const T *>(
+        chunk_ptrs_[chunk_idx].deref(scope));
+    auto num_entries = std::min(static_cast<uint64_t>(kRealChunkNumEntries),
+                                size_ - chunk_idx * kRealChunkNumEntries);
+    for (uint64_t i = 0; i < num_entries; i++) {
+      update_zone_map(chunk_idx, i, data[i]);
+    }
+  }
+  return zone;
+}
+
+template <typename T>
+template <typename F>
+FORCE_INLINE void DataFrameVector<T>::for_each_in_range(const T &lo,
+                                                        const T &hi, F &&f) {
+  auto num_chunks = (size_ == 0) ? 0 : (size_ - 1) / kRealChunkNumEntries + 1;
+  for (uint64_t chunk_idx = 0; chunk_idx < num_chunks; chunk_idx++) {
+    DerefScope scope;
+    auto match = DataFramePredicate::test_zone(
+        DataFramePredicate::Between, get_zone_map(scope, chunk_idx), lo, hi);
+    if (match == DataFramePredicate::kNone) {
+      continue;
+    }
+    auto begin = chunk_idx * kRealChunkNumEntries;
+    auto end = std::min(begin + kRealChunkNumEntries, size_);
+    auto *data = reinterpret_cast<const T *>(
+        chunk_ptrs_[chunk_idx].deref(scope));
+    for (auto idx = begin; idx < end; idx++) {
+      const auto &val = data[idx - begin];
+      if (match == DataFramePredicate::kAll ||
+          DataFramePredicate::test(DataFramePredicate::Between, val, lo, hi)) {
+        f(idx, val);
+      }
+    }
+  }
+}
+
+template <typename T>
+FORCE_INLINE uint64_t DataFrameVector<T>::lower_bound(const T &t) {
+  if (size_ == 0) {
+    return 0;
+  }
+  // Finds the first chunk whose max is not less than t.
+  uint64_t lo = 0, hi = (size_ - 1) / kRealChunkNumEntries + 1;
+  while (lo < hi) {
+    auto mid = (lo + hi) / 2;
+    DerefScope scope;
+    const auto &zone = get_zone_map(scope, mid);
+    if (zone.num_values && zone.max < t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo * kRealChunkNumEntries >= size_) {
+    return size_;
+  }
+  DerefScope scope;
+  auto begin = lo * kRealChunkNumEntries;
+  auto end = std::min(begin + kRealChunkNumEntries, size_);
+  auto *data = reinterpret_cast<const T *>(chunk_ptrs_[lo].deref(scope));
+  return begin + (std::lower_bound(data, data + (end - begin), t) - data);
+}
+
 template <typename T>
 FORCE_INLINE void DataFrameVector<T>::prefetch_record(bool nt, Index_t idx) {
   if (unlikely(last_idx_ != idx)) {
@@ -627,7 +779,10 @@ FORCE_INLINE T &DataFrameVector<T>::at_mut(const DerefScope &scope,
     prefetch_record(Nt, chunk_idx);
   }
   dirty_ = true;
-  auto *raw_mut_ptr = chunk_ptrs_[chunk_idx].template deref_mut<Nt>(scope);
+  invalidate_zone_map(chunk_idx);
+  // Only the element gets dirty, rather than its whole chunk.
+  auto *raw_mut_ptr = chunk_ptrs_[chunk_idx].template deref_mut<Nt>(
+      scope, chunk_offset * sizeof(T), sizeof(T));
   return *(reinterpret_cast<T *>(raw_mut_ptr) + chunk_offset);
 }
 
@@ -922,6 +1077,7 @@ DataFrameVector<T>::assign_remotely(const DataFrameVector<T>::Iterator &begin,
   device_->compute(ds_id_, OpCode::Assign, input_len, input_data, &output_len,
                    reinterpret_cast<uint8_t *>(&remote_vec_capacity_));
   size_ = end - begin;
+  zone_maps_.clear();
   expand_no_alloc(remote_vec_capacity_);
 }
 
@@ -946,10 +1102,9 @@ DataFrameVector<T>::get_sorted_indices(FarMemManager *manager,
   if constexpr (sizeof(T) <= 2 && std::is_integral<T>::value) {
     // T is small. Use counting sort.
     _get_sorted_indices_counting_sort<Ascending>(&indices);
-  } else {
-    // T is large. Use radix sort which iteratively invokes counting on its
-    // digits. Not implemented yet.
-    BUG();
+  } else if (!already_sorted_asc) {
+    // T is large. Sort runs that fit in local memory and merge them.
+    _get_sorted_indices_external_sort<Ascending>(manager, &indices);
   }
   return indices;
 }
@@ -994,6 +1149,285 @@ FORCE_INLINE void DataFrameVector<T>::_get_sorted_indices_counting_sort(
   }
 }
 
+template <typename T>
+template <bool Nt>
+FORCE_INLINE void DataFrameVector<T>::copy_to_local(uint64_t begin,
+                                                    uint64_t num, T *dst) {
+  while (num) {
+    auto [chunk_idx, chunk_offset] = get_chunk_stats(begin);
+    auto len = std::min(num, kRealChunkNumEntries - chunk_offset);
+    DerefScope scope;
+    auto *chunk = reinterpret_cast<const T *>(
+        chunk_ptrs_[chunk_idx].template deref<Nt>(scope));
+    memcpy(dst, chunk + chunk_offset, len * sizeof(T));
+    begin += len;
+    dst += len;
+    num -= len;
+  }
+}
+
+template <typename T>
+template <bool Nt>
+FORCE_INLINE void DataFrameVector<T>::copy_from_local(uint64_t begin,
+                                                      uint64_t num,
+                                                      const T *src) {
+  dirty_ = true;
+  while (num) {
+    auto [chunk_idx, chunk_offset] = get_chunk_stats(begin);
+    auto len = std::min(num, kRealChunkNumEntries - chunk_offset);
+    DerefScope scope;
+    auto *chunk = reinterpret_cast<T *>(
+        chunk_ptrs_[chunk_idx].template deref_mut<Nt>(
+            scope, chunk_offset * sizeof(T), len * sizeof(T)));
+    memcpy(chunk + chunk_offset, src, len * sizeof(T));
+    invalidate_zone_map(chunk_idx);
+    begin += len;
+    src += len;
+    num -= len;
+  }
+}
+
+template <typename T>
+FORCE_INLINE void DataFrameVector<T>::swap_in_range(bool nt, uint64_t begin,
+                                                    uint64_t num) {
+  constexpr uint32_t kNumChunksPerBatch = 32;
+  GenericFarMemPtr *ptrs[kNumChunksPerBatch];
+  auto chunk_idx = begin / kRealChunkNumEntries;
+  auto end_chunk_idx = (begin + num - 1) / kRealChunkNumEntries + 1;
+  while (chunk_idx < end_chunk_idx) {
+    uint32_t num_ptrs = 0;
+    while (chunk_idx < end_chunk_idx && num_ptrs < kNumChunksPerBatch) {
+      ptrs[num_ptrs++] = &chunk_ptrs_[chunk_idx++];
+    }
+    DerefScope scope;
+    GenericFarMemPtr::swap_in_batch(nt, num_ptrs, ptrs);
+  }
+}
+
+template <typename T>
+template <bool Ascending>
+FORCE_INLINE void DataFrameVector<T>::_get_sorted_indices_external_sort(
+    FarMemManager *manager, DataFrameVector<unsigned long long> *indices) {
+  if (!size_) {
+    return;
+  }
+  // Runs start at chunk boundaries of both values and indices, so that every
+  // worker writes its own chunks.
+  constexpr uint64_t kRunAlignment = std::max(
+      kRealChunkNumEntries,
+      DataFrameVector<unsigned long long>::kRealChunkNumEntries);
+  constexpr uint64_t kRunNumEntries =
+      std::max(kRunAlignment, kSortRunSize /
+                                  (sizeof(T) + sizeof(unsigned long long)) /
+                                  kRunAlignment * kRunAlignment);
+
+  auto perm = DataFrameVector<unsigned long long>(manager);
+  {
+    auto vals = DataFrameVector<T>(manager);
+    auto idxs = DataFrameVector<unsigned long long>(manager);
+    vals.resize(size_);
+    idxs.resize(size_);
+    auto num_runs = (size_ - 1) / kRunNumEntries + 1;
+
+    // Sorts the runs in parallel. The workers read the chunks directly, since
+    // the prefetcher does not take concurrent accesses.
+    std::atomic<uint64_t> next_run{0};
+    auto num_workers = std::min<uint64_t>(helpers::kNumCPUs, num_runs);
+    std::vector<rt::Thread> workers;
+    for (uint64_t i = 0; i < num_workers; i++) {
+      workers.emplace_back([&] {
+        std::vector<std::pair<T, unsigned long long>> pairs(kRunNumEntries);
+        std::vector<T> run_vals(kRunNumEntries);
+        std::vector<unsigned long long> run_idxs(kRunNumEntries);
+        uint64_t run;
+        while ((run = next_run++) < num_runs) {
+          auto begin = run * kRunNumEntries;
+          auto num = std::min(kRunNumEntries, size_ - begin);
+          copy_to_local(begin, num, run_vals.data());
+          for (uint64_t j = 0; j < num; j++) {
+            pairs[j] = std::make_pair(run_vals[j], begin + j);
+          }
+          std::sort(pairs.begin(), pairs.begin() + num,
+                    [](const auto &a, const auto &b) {
+                      if constexpr (Ascending) {
+                        return _sort_less(a.first, a.second, b.first, b.second);
+                      } else {
+                        return _sort_less(b.first, b.second, a.first, a.second);
+                      }
+                    });
+          for (uint64_t j = 0; j < num; j++) {
+            run_vals[j] = pairs[j].first;
+            run_idxs[j] = pairs[j].second;
+          }
+          vals.copy_from_local(begin, num, run_vals.data());
+          idxs.copy_from_local(begin, num, run_idxs.data());
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.Join();
+    }
+
+    // Merges the runs, with more passes if there are too many of them to
+    // keep a block of each in local memory.
+    auto run_num_entries = kRunNumEntries;
+    auto *src_vals = &vals;
+    auto *src_idxs = &idxs;
+    std::optional<DataFrameVector<T>> merged_vals;
+    std::optional<DataFrameVector<unsigned long long>> merged_idxs;
+    if (num_runs > kSortMaxMergeFanIn) {
+      merged_vals.emplace(manager);
+      merged_idxs.emplace(manager);
+      merged_vals->resize(size_);
+      merged_idxs->resize(size_);
+    }
+    auto *dst_vals = merged_vals ? &*merged_vals : nullptr;
+    auto *dst_idxs = merged_idxs ? &*merged_idxs : nullptr;
+    while (num_runs > kSortMaxMergeFanIn) {
+      for (uint64_t run = 0; run < num_runs; run += kSortMaxMergeFanIn) {
+        _merge_sorted_runs<Ascending>(
+            src_vals, src_idxs, run * run_num_entries, run_num_entries,
+            std::min<uint64_t>(kSortMaxMergeFanIn, num_runs - run), dst_vals,
+            dst_idxs);
+      }
+      std::swap(src_vals, dst_vals);
+      std::swap(src_idxs, dst_idxs);
+      run_num_entries *= kSortMaxMergeFanIn;
+      num_runs = (num_runs - 1) / kSortMaxMergeFanIn + 1;
+    }
+    perm.resize(size_);
+    _merge_sorted_runs<Ascending>(src_vals, src_idxs, 0, run_num_entries,
+                                  num_runs, nullptr, &perm);
+  }
+
+  // perm[i] is the index of the element at position i, i.e., the positions
+  // are scattered to perm.
+  auto positions = DataFrameVector<unsigned long long>(manager);
+  {
+    DerefScope scope;
+    for (unsigned long long i = 0; i < size_; i++) {
+      if (unlikely(i % kNumElementsPerScope == 0)) {
+        scope.renew();
+      }
+      positions.push_back(scope, i);
+    }
+  }
+  *indices = positions.shuffle_data_by_idx(manager, perm);
+}
+
+template <typename T>
+FORCE_INLINE bool DataFrameVector<T>::_sort_less(const T &val_0, uint64_t idx_0,
+                                                 const T &val_1,
+                                                 uint64_t idx_1) {
+  if constexpr (std::is_floating_point_v<T>) {
+    auto nan_0 = std::isnan(val_0);
+    auto nan_1 = std::isnan(val_1);
+    if (unlikely(nan_0 || nan_1)) {
+      return nan_0 != nan_1 ? nan_1 : idx_0 < idx_1;
+    }
+  }
+  return val_0 < val_1 || (!(val_1 < val_0) && idx_0 < idx_1);
+}
+
+template <typename T>
+template <bool Ascending>
+FORCE_INLINE void DataFrameVector<T>::_merge_sorted_runs(
+    DataFrameVector<T> *vals, DataFrameVector<unsigned long long> *idxs,
+    uint64_t begin, uint64_t run_num_entries, uint64_t num_runs,
+    DataFrameVector<T> *merged_vals,
+    DataFrameVector<unsigned long long> *merged_idxs) {
+  constexpr uint64_t kBlockNumEntries = std::max(
+      kRealChunkNumEntries,
+      DataFrameVector<unsigned long long>::kRealChunkNumEntries);
+  struct Cursor {
+    uint64_t begin;
+    uint64_t pos;
+    uint64_t end;
+    uint64_t head;
+    uint64_t len;
+  };
+
+  // Every cursor keeps a block of its run in local memory.
+  auto size = vals->size();
+  std::vector<Cursor> cursors(num_runs);
+  std::vector<T> block_vals(num_runs * kBlockNumEntries);
+  std::vector<unsigned long long> block_idxs(num_runs * kBlockNumEntries);
+  auto refill = [&](uint32_t c) {
+    auto &cursor = cursors[c];
+    if ((cursor.pos - cursor.begin) / kBlockNumEntries %
+            kSortNumReadAheadBlocks ==
+        0) {
+      // Sequential prefetch, which batches the reads of the next blocks.
+      auto num = std::min(cursor.end - cursor.pos,
+                          kBlockNumEntries * kSortNumReadAheadBlocks);
+      vals->swap_in_range(/* nt = */ true, cursor.pos, num);
+      idxs->swap_in_range(/* nt = */ true, cursor.pos, num);
+    }
+    auto num = std::min(cursor.end - cursor.pos, kBlockNumEntries);
+    vals->template copy_to_local</* Nt = */ true>(
+        cursor.pos, num, &block_vals[c * kBlockNumEntries]);
+    idxs->template copy_to_local</* Nt = */ true>(
+        cursor.pos, num, &block_idxs[c * kBlockNumEntries]);
+    cursor.pos += num;
+    cursor.head = 0;
+    cursor.len = num;
+  };
+  // Heads with equal values are ordered by their indices, which are unique.
+  auto greater = [&](uint32_t c_0, uint32_t c_1) {
+    auto &val_0 = block_vals[c_0 * kBlockNumEntries + cursors[c_0].head];
+    auto &val_1 = block_vals[c_1 * kBlockNumEntries + cursors[c_1].head];
+    auto idx_0 = block_idxs[c_0 * kBlockNumEntries + cursors[c_0].head];
+    auto idx_1 = block_idxs[c_1 * kBlockNumEntries + cursors[c_1].head];
+    if constexpr (Ascending) {
+      return _sort_less(val_1, idx_1, val_0, idx_0);
+    } else {
+      return _sort_less(val_0, idx_0, val_1, idx_1);
+    }
+  };
+  std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(greater)> heap(
+      greater);
+  for (uint32_t c = 0; c < num_runs; c++) {
+    auto run_begin = begin + c * run_num_entries;
+    cursors[c].begin = cursors[c].pos = run_begin;
+    cursors[c].end = std::min(run_begin + run_num_entries, size);
+    refill(c);
+    heap.push(c);
+  }
+
+  std::vector<T> out_vals(merged_vals ? kBlockNumEntries : 0);
+  std::vector<unsigned long long> out_idxs(kBlockNumEntries);
+  uint64_t out_pos = begin;
+  uint64_t out_len = 0;
+  auto flush_out = [&] {
+    if (merged_vals) {
+      merged_vals->copy_from_local(out_pos, out_len, out_vals.data());
+    }
+    merged_idxs->copy_from_local(out_pos, out_len, out_idxs.data());
+    out_pos += out_len;
+    out_len = 0;
+  };
+  while (!heap.empty()) {
+    auto c = heap.top();
+    heap.pop();
+    auto &cursor = cursors[c];
+    if (merged_vals) {
+      out_vals[out_len] = block_vals[c * kBlockNumEntries + cursor.head];
+    }
+    out_idxs[out_len] = block_idxs[c * kBlockNumEntries + cursor.head];
+    if (++out_len == kBlockNumEntries) {
+      flush_out();
+    }
+    if (++cursor.head == cursor.len) {
+      if (cursor.pos == cursor.end) {
+        continue;
+      }
+      refill(c);
+    }
+    heap.push(c);
+  }
+  flush_out();
+}
+
 template <typename T>
 template <typename U>
 FORCE_INLINE DataFrameVector<T>
@@ -1060,6 +1494,134 @@ DataFrameVector<T>::aggregate_median(FarMemManager *manager, const U &key_vec) {
   }
 }
 
+template <typename T>
+template <typename U>
+FORCE_INLINE DataFrameVector<T>
+DataFrameVector<T>::aggregate(FarMemManager *manager, const U &key_vec,
+                              Aggregation aggregation) {
+  auto opcode = get_aggregate_opcode(aggregation);
+  if constexpr (DISABLE_OFFLOAD_AGGREGATE) {
+    return aggregate_locally(manager, key_vec, opcode);
+  } else {
+    return aggregate_remotely(manager, key_vec, opcode);
+  }
+}
+
+template <typename T>
+template <typename... Keys>
+FORCE_INLINE std::pair<DataFrameVector<T>, DataFrameVector<unsigned long long>>
+DataFrameVector<T>::group_by(FarMemManager *manager, Aggregation aggregation,
+                             const DataFrameVector<Keys> &... key_vecs) {
+  static_assert(sizeof...(Keys) > 0);
+  BUG_ON(((key_vecs.size() != size_) || ...));
+  auto opcode = get_aggregate_opcode(aggregation);
+  if constexpr (DISABLE_OFFLOAD_AGGREGATE) {
+    return group_by_locally(manager, opcode, key_vecs...);
+  } else {
+    return group_by_remotely(manager, opcode, key_vecs...);
+  }
+}
+
+template <typename T>
+template <typename... Keys>
+std::pair<DataFrameVector<T>, DataFrameVector<unsigned long long>>
+DataFrameVector<T>::group_by_locally(
+    FarMemManager *manager, OpCode opcode,
+    const DataFrameVector<Keys> &... key_vecs) {
+  using Key = std::tuple<Keys...>;
+  auto hash_func = [](const Key &key) -> std::size_t {
+    std::size_t hash = 0;
+    std::apply(
+        [&](const auto &... k) {
+          ((hash ^= std::hash<std::decay_t<decltype(k)>>{}(k) + 0x9e3779b9 +
+                    (hash << 6) + (hash >> 2)),
+           ...);
+        },
+        key);
+    return hash;
+  };
+  std::unordered_map<Key, uint64_t, decltype(hash_func)> groups(0, hash_func);
+  // Medians are kept in local memory per group, as there are far more groups
+  // than DS ids.
+  std::vector<std::unique_ptr<Aggregator<T>>> aggregators;
+  std::vector<unsigned long long> first_rows;
+
+  {
+    DerefScope scope;
+    auto data_it = cfbegin(scope);
+    auto key_its = std::make_tuple(key_vecs.cfbegin(scope)...);
+    for (uint64_t i = 0; i < size_; i++) {
+      if (unlikely(i % kNumElementsPerScope == 0)) {
+        scope.renew();
+        data_it.renew(scope);
+        std::apply([&](auto &... its) { (its.renew(scope), ...); }, key_its);
+      }
+      auto key = std::apply([](auto &... its) { return Key(*its...); },
+                            key_its);
+      auto [group, inserted] = groups.try_emplace(key, aggregators.size());
+      if (inserted) {
+        aggregators.emplace_back(AggregatorFactory<T>::build(
+            opcode, /* limited_mem */ false, nullptr));
+        first_rows.push_back(i);
+      }
+      aggregators[group->second]->add(&scope, *data_it);
+      ++data_it;
+      std::apply([](auto &... its) { (++its, ...); }, key_its);
+    }
+  }
+
+  auto result = DataFrameVector<T>(manager);
+  auto first_idx = DataFrameVector<unsigned long long>(manager);
+  DerefScope scope;
+  for (uint64_t i = 0; i < aggregators.size(); i++) {
+    if (unlikely(i % kNumElementsPerScope == 0)) {
+      scope.renew();
+    }
+    result.push_back(scope, aggregators[i]->aggregate());
+    first_idx.push_back(scope, first_rows[i]);
+  }
+  return std::make_pair(std::move(result), std::move(first_idx));
+}
+
+template <typename T>
+template <typename... Keys>
+std::pair<DataFrameVector<T>, DataFrameVector<unsigned long long>>
+DataFrameVector<T>::group_by_remotely(
+    FarMemManager *manager, OpCode opcode,
+    const DataFrameVector<Keys> &... key_vecs) {
+  (const_cast<DataFrameVector<Keys> *>(&key_vecs)->flush(), ...);
+  flush();
+  auto result = DataFrameVector<T>(manager);
+  auto first_idx = DataFrameVector<unsigned long long>(manager);
+  // Input format:
+  //     |result_ds_id (1B)|first_idx_ds_id (1B)|size (8B)|opcode (1B)|
+  //     |num_keys (1B)|keys|
+  // and every key is
+  //     |key_ds_id (1B)|key_dt_id (1B)|
+  uint8_t input_data[sizeof(result.ds_id_) + sizeof(first_idx.ds_id_) +
+                     sizeof(size_) + 2 + 2 * sizeof...(Keys)];
+  auto *p = input_data;
+  *p++ = result.ds_id_;
+  *p++ = first_idx.ds_id_;
+  __builtin_memcpy(p, &size_, sizeof(size_));
+  p += sizeof(size_);
+  *p++ = opcode;
+  *p++ = sizeof...(Keys);
+  ((*p++ = key_vecs.ds_id_, *p++ = get_dataframe_type_id<Keys>()), ...);
+  uint16_t output_len;
+  uint64_t output_data[4];
+  device_->compute(ds_id_, GroupBy, sizeof(input_data), input_data,
+                   &output_len, reinterpret_cast<uint8_t *>(output_data));
+  assert(output_len == sizeof(output_data));
+  result.size_ = output_data[0];
+  result.remote_vec_capacity_ = output_data[1];
+  result.expand_no_alloc(result.remote_vec_capacity_);
+  first_idx.size_ = output_data[2];
+  first_idx.remote_vec_capacity_ = output_data[3];
+  first_idx.expand_no_alloc(first_idx.remote_vec_capacity_);
+  return std::make_pair(std::move(result), std::move(first_idx));
+}
+
 template <typename T>
 FORCE_INLINE DataFrameVector<T> &DataFrameVector<T>::lock() {
   lock_.lock_writer();
@@ -1083,4 +1645,133 @@ DataFrameVector<T>::static_prefetch(DataFrameVector<T>::Index_t start,
   prefetcher_->static_prefetch(start, step, num);
 }
 
+template <typename T>
+FORCE_INLINE void DataFrameVector<T>::set_prefetch_policy(
+    std::unique_ptr<PrefetchPolicy> policy) {
+  prefetcher_->set_policy(std::move(policy));
+  ACCESS_ONCE(dynamic_prefetch_enabled_) = true;
+}
+
+template <typename T>
+FORCE_INLINE DataFramePredicate::DataFramePredicate(DataFrameVector<T> &col,
+                                                    Cmp cmp, T operand,
+                                                    T operand_hi)
+    : col_(&col), dt_id_(get_dataframe_type_id<T>()), cmp_(cmp),
+      operands_(2 * sizeof(T)) {
+  __builtin_memcpy(operands_.data(), &operand, sizeof(T));
+  __builtin_memcpy(operands_.data() + sizeof(T), &operand_hi, sizeof(T));
+  eval_locally_ = [&col, cmp, operand, operand_hi](
+                      uint64_t size, std::vector<bool> *selected) {
+    constexpr uint64_t kChunkNumEntries =
+        DataFrameVector<T>::get_chunk_num_entries();
+    for (uint64_t begin = 0; begin < size; begin += kChunkNumEntries) {
+      DerefScope scope;
+      auto chunk_idx = begin / kChunkNumEntries;
+      auto end = std::min(begin + kChunkNumEntries, size);
+      // What holds for the whole chunk also holds for the prefix within size.
+      auto match = test_zone(cmp, col.get_zone_map(scope, chunk_idx), operand,
+                             operand_hi);
+      if (match == kAll) {
+        continue;
+      }
+      if (match == kNone) {
+        std::fill(selected->begin() + begin, selected->begin() + end, false);
+        continue;
+      }
+      auto it = col.cfbegin(scope) + begin;
+      for (auto i = begin; i < end; ++i, ++it) {
+        if ((*selected)[i] && !test(cmp, *it, operand, operand_hi)) {
+          (*selected)[i] = false;
+        }
+      }
+    }
+  };
+}
+
+template <typename T>
+FORCE_INLINE DataFramePredicate::ZoneMatch
+DataFramePredicate::test_zone(Cmp cmp, const DataFrameZoneMap<T> &zone,
+                              const T &operand, const T &operand_hi) {
+  if (!zone.known) {
+    return kSome;
+  }
+  // Nulls (NaNs) only satisfy Ne.
+  auto nulls_match = zone.num_nulls ? ((cmp == Ne) ? kAll : kNone) : kAll;
+  if (!zone.num_values) {
+    return zone.num_nulls ? nulls_match : kNone;
+  }
+  bool none, all;
+  const auto &min = zone.min;
+  const auto &max = zone.max;
+  switch (cmp) {
+  case Eq:
+    none = operand < min || max < operand;
+    all = min == operand && max == operand;
+    break;
+  case Ne:
+    none = min == operand && max == operand;
+    all = operand < min || max < operand;
+    break;
+  case Lt:
+    none = !(min < operand);
+    all = max < operand;
+    break;
+  case Le:
+    none = operand < min;
+    all = !(operand < max);
+    break;
+  case Gt:
+    none = !(operand < max);
+    all = operand < min;
+    break;
+  case Ge:
+    none = max < operand;
+    all = !(min < operand);
+    break;
+  case Between:
+    none = operand_hi < min || max < operand;
+    all = !(min < operand) && !(operand_hi < max);
+    break;
+  default:
+    BUG();
+  }
+  if (none && (!zone.num_nulls || nulls_match == kNone)) {
+    return kNone;
+  }
+  if (all && nulls_match == kAll) {
+    return kAll;
+  }
+  return kSome;
+}
+
+template <typename T>
+FORCE_INLINE bool DataFramePredicate::test(Cmp cmp, const T &val,
+                                           const T &operand,
+                                           const T &operand_hi) {
+  if constexpr (std::is_floating_point_v<T>) {
+    // Nulls (NaNs) only satisfy Ne, which test_zone() relies on.
+    if (unlikely(std::isnan(val))) {
+      return cmp == Ne;
+    }
+  }
+  switch (cmp) {
+  case Eq:
+    return val == operand;
+  case Ne:
+    return !(val == operand);
+  case Lt:
+    return val < operand;
+  case Le:
+    return !(operand < val);
+  case Gt:
+    return operand < val;
+  case Ge:
+    return !(val < operand);
+  case Between:
+    return !(val < operand) && !(operand_hi < val);
+  default:
+    BUG();
+  }
+}
+
 } // namespace far_memory
@@ -0,0 +1,48 @@
+#pragma once
+
+namespace far_memory {
+
+FORCE_INLINE uint64_t DirtyLines::line_idx(uint64_t addr) {
+  assert(addr >= cache_begin_addr_ && addr < cache_end_addr_);
+  return (addr - cache_begin_addr_) >> kLineShift;
+}
+
+// Calls fn(word, mask) for each bitmap word covering the lines of
+// [addr, addr + len).
+template <typename Fn>
+FORCE_INLINE void DirtyLines::for_each_word(uint64_t addr, uint32_t len,
+                                            Fn &&fn) {
+  if (unlikely(!len)) {
+    return;
+  }
+  auto first_line = line_idx(addr);
+  auto last_line = line_idx(addr + len - 1);
+  for (auto word_idx = first_line / kNumLinesPerWord;
+       word_idx <= last_line / kNumLinesPerWord; word_idx++) {
+    auto word_first_line = word_idx * kNumLinesPerWord;
+    auto lo = std::max(first_line, word_first_line) - word_first_line;
+    auto hi = std::min(last_line, word_first_line + kNumLinesPerWord - 1) -
+              word_first_line;
+    auto mask = (~static_cast<uint64_t>(0) >> (kNumLinesPerWord - 1 - hi)) &
+                (~static_cast<uint64_t>(0) << lo);
+    fn(bitmap_[word_idx], mask);
+  }
+}
+
+FORCE_INLINE void DirtyLines::mark(uint64_t addr, uint32_t len) {
+  for_each_word(addr, len, [](std::atomic<uint64_t> &word, uint64_t mask) {
+    if ((word.load(std::memory_order_relaxed) & mask) != mask) {
+      word.fetch_or(mask, std::memory_order_relaxed);
+    }
+  });
+}
+
+FORCE_INLINE bool DirtyLines::test(uint64_t addr, uint32_t len) {
+  bool dirty = false;
+  for_each_word(addr, len, [&](std::atomic<uint64_t> &word, uint64_t mask) {
+    dirty |= static_cast<bool>(word.load(std::memory_order_relaxed) & mask);
+  });
+  return dirty;
+}
+
+} // namespace far_memory
@@ -210,6 +210,21 @@ static FORCE_INLINE void tcp_read_until(tcpconn_t *c, void *buf,
   }
 }
 
+// Returns false if the connection gets closed before expect bytes are read.
+static FORCE_INLINE bool tcp_try_read_until(tcpconn_t *c, void *buf,
+                                            size_t expect) {
+  size_t real = 0;
+  while (real < expect) {
+    auto ret =
+        tcp_read(c, reinterpret_cast<uint8_t *>(buf) + real, expect - real);
+    if (unlikely(ret <= 0)) {
+      return false;
+    }
+    real += ret;
+  }
+  return true;
+}
+
 static FORCE_INLINE void tcp_write_until(tcpconn_t *c, const void *buf,
                                          size_t expect) {
   size_t real = tcp_write(c, reinterpret_cast<const uint8_t *>(buf), expect);
@@ -246,6 +261,28 @@ static FORCE_INLINE void tcp_write2_until(tcpconn_t *c, const void *buf_0,
   }
 }
 
+static FORCE_INLINE void tcp_writev_until(tcpconn_t *c, const iovec *iov,
+                                          int iovcnt) {
+  size_t expect = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    expect += iov[i].iov_len;
+  }
+  size_t real = tcp_writev(c, iov, iovcnt);
+  if (unlikely(real != expect)) {
+    // Slow path.
+    for (int i = 0; i < iovcnt; i++) {
+      if (real >= iov[i].iov_len) {
+        real -= iov[i].iov_len;
+        continue;
+      }
+      tcp_write_until(c,
+                      reinterpret_cast<const uint8_t *>(iov[i].iov_base) + real,
+                      iov[i].iov_len - real);
+      real = 0;
+    }
+  }
+}
+
 static FORCE_INLINE constexpr size_t static_log(uint64_t b, uint64_t n) {
   return ((n < b) ? 1 : 1 + static_log(b, n / b));
 }
@@ -4,6 +4,7 @@
 #include "stats.hpp"
 #include "thread.h"
 
+#include <algorithm>
 
 namespace far_memory {
 
@@ -26,6 +27,16 @@ FORCE_INLINE uint32_t FarMemManager::RegionManager::get_num_regions() const {
   return free_regions_.capacity();
 }
 
+FORCE_INLINE uint8_t *
+FarMemManager::RegionManager::get_local_cache_ptr() const {
+  return local_cache_ptr_.get();
+}
+
+FORCE_INLINE uint64_t
+FarMemManager::RegionManager::get_local_cache_size() const {
+  return local_cache_size_;
+}
+
 FORCE_INLINE double FarMemManager::get_free_mem_ratio() const {
   return cache_region_manager_.get_free_region_ratio();
 }
@@ -43,6 +54,10 @@ FORCE_INLINE bool FarMemManager::is_free_cache_high() const {
 }
 
 FORCE_INLINE void FarMemManager::push_cache_free_region(Region &region) {
+  DirtyLines::clear(reinterpret_cast<uint64_t>(
+                        cache_region_manager_.get_local_cache_ptr() +
+                        static_cast<uint64_t>(region.get_idx()) * Region::kSize),
+                    Region::kSize);
   cache_region_manager_.push_free_region(region);
 }
 
@@ -60,6 +75,9 @@ FORCE_INLINE UniquePtr<T> FarMemManager::allocate_unique_ptr(uint8_t ds_id) {
          static_cast<uint8_t>(sizeof(remote_object_addr)),
          reinterpret_cast<const uint8_t *>(&remote_object_addr));
   auto ptr = UniquePtr<T>(local_object_addr);
+  if (ds_id == kVanillaPtrDSID) {
+    track_far_mem_object(remote_object_addr, object_size, &ptr);
+  }
   Region::atomic_inc_ref_cnt(local_object_addr, -1);
   return ptr;
 }
@@ -74,6 +92,9 @@ FORCE_INLINE SharedPtr<T> FarMemManager::allocate_shared_ptr(uint8_t ds_id) {
          static_cast<uint8_t>(sizeof(remote_object_addr)),
          reinterpret_cast<const uint8_t *>(&remote_object_addr));
   auto ptr = SharedPtr<T>(local_object_addr);
+  if (ds_id == kVanillaPtrDSID) {
+    track_far_mem_object(remote_object_addr, object_size, &ptr);
+  }
   Region::atomic_inc_ref_cnt(local_object_addr, -1);
   return ptr;
 }
@@ -134,6 +155,11 @@ FORCE_INLINE void FarMemManager::read_object(uint8_t ds_id, uint8_t obj_id_len,
   device_ptr_->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
 }
 
+FORCE_INLINE void FarMemManager::read_objects(uint32_t num_reqs,
+                                              const ObjectReadReq *reqs) {
+  device_ptr_->read_objects(num_reqs, reqs);
+}
+
 FORCE_INLINE bool FarMemManager::remove_object(uint64_t ds_id,
                                                uint8_t obj_id_len,
                                                const uint8_t *obj_id) {
@@ -179,6 +205,57 @@ FORCE_INLINE void FarMemManager::unlock_object(uint8_t obj_id_len,
   obj_locker_.remove(obj_id_fragment);
 }
 
+// The far-mem GC rewrites the object ID of a (present) vanilla object while
+// holding its lock, so the ID is copied before locking and validated after.
+FORCE_INLINE uint64_t FarMemManager::lock_local_object(Object obj) {
+  while (true) {
+    auto obj_id_fragment =
+        get_obj_id_fragment(obj.get_obj_id_len(), obj.get_obj_id());
+    while (!obj_locker_.try_insert(obj_id_fragment))
+      ;
+    if (likely(get_obj_id_fragment(obj.get_obj_id_len(), obj.get_obj_id()) ==
+               obj_id_fragment)) {
+      return obj_id_fragment;
+    }
+    obj_locker_.remove(obj_id_fragment);
+  }
+}
+
+// The non-blocking version of lock_local_object().
+FORCE_INLINE std::optional<uint64_t>
+FarMemManager::try_lock_local_object(Object obj) {
+  auto obj_id_fragment =
+      get_obj_id_fragment(obj.get_obj_id_len(), obj.get_obj_id());
+  if (!obj_locker_.try_lock(obj_id_fragment)) {
+    return std::nullopt;
+  }
+  if (unlikely(get_obj_id_fragment(obj.get_obj_id_len(), obj.get_obj_id()) !=
+               obj_id_fragment)) {
+    obj_locker_.remove(obj_id_fragment);
+    return std::nullopt;
+  }
+  return obj_id_fragment;
+}
+
+FORCE_INLINE void FarMemManager::unlock_object_id(uint64_t obj_id_fragment) {
+  obj_locker_.remove(obj_id_fragment);
+}
+
+FORCE_INLINE FarMemRegionIndex::Entry *FarMemRegionIndex::find(uint32_t offset) {
+  auto iter = std::lower_bound(
+      entries.begin(), entries.end(), offset,
+      [](const Entry &entry, uint32_t offset) { return entry.offset < offset; });
+  if (iter == entries.end() || iter->offset != offset) {
+    return nullptr;
+  }
+  return &(*iter);
+}
+
+FORCE_INLINE FarMemRegionIndex &
+FarMemManager::far_mem_region_index(uint64_t remote_addr) {
+  return far_mem_region_indices_[remote_addr >> Region::kShift];
+}
+
 FORCE_INLINE void FarMemManager::gc_check() {
   if (unlikely(is_free_cache_low())) {
     Stats::add_free_mem_ratio_record();
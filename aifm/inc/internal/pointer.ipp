@@ -1,5 +1,6 @@
 #pragma once
 
+#include "dirty_lines.hpp"
 #include "helpers.hpp"
 #include "region.hpp"
 
@@ -276,6 +277,19 @@ FORCE_INLINE void *GenericUniquePtr::deref_mut(const DerefScope &scope) {
   return _deref</* Mut = */ true, Nt>();
 }
 
+// Instead of marking the whole object dirty, marks the cachelines of the range
+// in DirtyLines, so that only they get written back. Objects that are already
+// dirty as a whole (e.g., the newly allocated ones) are left as they are.
+template <bool Nt>
+FORCE_INLINE void *GenericUniquePtr::deref_mut(const DerefScope &scope,
+                                               uint16_t offset, uint16_t len) {
+  auto *data = _deref</* Mut = */ false, Nt>();
+  if (likely(data) && !meta().is_dirty()) {
+    DirtyLines::mark(reinterpret_cast<uint64_t>(data) + offset, len);
+  }
+  return data;
+}
+
 template <typename T>
 FORCE_INLINE UniquePtr<T>::UniquePtr(uint64_t object_addr)
     : GenericUniquePtr(object_addr) {}
@@ -303,6 +317,14 @@ FORCE_INLINE T *UniquePtr<T>::deref_mut(const DerefScope &scope) {
   return reinterpret_cast<T *>(GenericUniquePtr::deref_mut<Nt>(scope));
 }
 
+template <typename T>
+template <bool Nt>
+FORCE_INLINE T *UniquePtr<T>::deref_mut(const DerefScope &scope,
+                                        uint16_t offset, uint16_t len) {
+  return reinterpret_cast<T *>(
+      GenericUniquePtr::deref_mut<Nt>(scope, offset, len));
+}
+
 template <typename T> FORCE_INLINE UniquePtr<T>::UniquePtr(UniquePtr &&other) {
   *this = std::move(other);
 }
@@ -329,7 +351,7 @@ FORCE_INLINE void UniquePtr<T>::write(U &&u) {
 
 template <typename T> FORCE_INLINE void UniquePtr<T>::free() {
   if constexpr (std::is_trivially_destructible<T>::value) {
-    if (!meta().is_present()) {
+    if (!meta().is_present() && _free_far_mem()) {
       return;
     }
   }
@@ -2,46 +2,27 @@
 
 #include "device.hpp"
 
+#include <algorithm>
 #include <optional>
 
 namespace far_memory {
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
 FORCE_INLINE Prefetcher<InduceFn, InferFn, MappingFn>::Prefetcher(
-    FarMemDevice *device, uint8_t *state, uint32_t object_data_size)
+    FarMemDevice *device, PrefetchExecutor *executor, uint8_t *state,
+    uint32_t object_data_size)
     : kPrefetchWinSize_(device->get_prefetch_win_size() / (object_data_size)),
-      state_(state), object_data_size_(object_data_size) {
+      executor_(executor), state_(state), object_data_size_(object_data_size) {
   for (auto &trace : traces_) {
     trace.counter = 0;
   }
-  prefetch_threads_.emplace_back([&]() { prefetch_master_fn(); });
-  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
-    auto &status = slave_status_[i].data;
-    status.task = nullptr;
-    status.is_exited = false;
-    wmb();
-    prefetch_threads_.emplace_back([&, i]() { prefetch_slave_fn(i); });
-  }
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
 FORCE_INLINE Prefetcher<InduceFn, InferFn, MappingFn>::~Prefetcher() {
   exit_ = true;
   wmb();
-  while (!ACCESS_ONCE(master_exited)) {
-    cv_prefetch_master_.Signal();
-    thread_yield();
-  }
-  for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
-    auto &status = slave_status_[i].data;
-    while (!ACCESS_ONCE(status.is_exited)) {
-      status.cv.Signal();
-      thread_yield();
-    }
-  }
-  for (auto &thread : prefetch_threads_) {
-    thread.Join();
-  }
+  executor_->cancel(this);
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
@@ -49,115 +30,110 @@ FORCE_INLINE void
 Prefetcher<InduceFn, InferFn, MappingFn>::generate_prefetch_tasks() {
   InferFn inferer;
   MappingFn mapper;
-  for (uint32_t i = 0; i < kGenTasksBurstSize; i++) {
-    if (!num_objs_to_prefetch) {
-      return;
-    }
-    num_objs_to_prefetch--;
-    GenericUniquePtr *task = mapper(state_, next_prefetch_idx_);
-    next_prefetch_idx_ = inferer(next_prefetch_idx_, pattern_);
-    if (!task) {
-      continue;
-    }
-    bool dispatched = false;
-    std::optional<uint32_t> inactive_slave_id = std::nullopt;
-    for (uint32_t i = 0; i < kMaxNumPrefetchSlaveThreads; i++) {
-      auto &status = slave_status_[i].data;
-      if (status.cv.HasWaiters()) {
-        inactive_slave_id = i;
-        continue;
-      }
-      if (ACCESS_ONCE(status.task) == nullptr) {
-        ACCESS_ONCE(status.task) = task;
-        dispatched = true;
-        break;
-      }
+  GenericFarMemPtr *tasks[kGenTasksBurstSize];
+  uint32_t num_tasks = 0;
+  auto budget = executor_->acquire(this, kGenTasksBurstSize,
+                                   object_data_size_);
+  auto guard = helpers::finally([&]() { executor_->release(budget); });
+  for (uint32_t i = 0; i < budget; i++) {
+    GenericUniquePtr *task;
+    if (num_objs_to_prefetch) {
+      num_objs_to_prefetch--;
+      task = mapper(state_, next_prefetch_idx_);
+      next_prefetch_idx_ = inferer(next_prefetch_idx_, pattern_);
+    } else if (num_policy_idxs()) {
+      task = mapper(state_, policy_idxs_[policy_idxs_head_]);
+      policy_idxs_head_ = (policy_idxs_head_ + 1) % kPolicyIdxsSize;
+    } else {
+      break;
     }
-    if (!dispatched) {
-      if (likely(inactive_slave_id)) {
-        auto &status = slave_status_[*inactive_slave_id].data;
-        status.task = task;
-        wmb();
-        status.cv.Signal();
-      } else {
-        DerefScope scope;
-        task->swap_in(nt_);
-      }
+    if (task) {
+      tasks[num_tasks++] = task;
     }
   }
+  if (num_tasks) {
+    DerefScope scope;
+    GenericFarMemPtr::swap_in_batch(nt_, num_tasks, tasks);
+  }
+}
+
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE uint32_t
+Prefetcher<InduceFn, InferFn, MappingFn>::num_policy_idxs() const {
+  return (policy_idxs_tail_ + kPolicyIdxsSize - policy_idxs_head_) %
+         kPolicyIdxsSize;
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
 FORCE_INLINE void
-Prefetcher<InduceFn, InferFn, MappingFn>::prefetch_slave_fn(uint32_t tid) {
-  auto &status = slave_status_[tid].data;
-  GenericUniquePtr **task_ptr = &status.task;
-  bool *is_exited = &status.is_exited;
-  rt::CondVar *cv = &status.cv;
-  cv->Wait();
-
-  while (likely(!ACCESS_ONCE(exit_))) {
-    if (likely(ACCESS_ONCE(*task_ptr))) {
-      GenericUniquePtr *task = *task_ptr;
-      ACCESS_ONCE(*task_ptr) = nullptr;
-      DerefScope scope;
-      task->swap_in(nt_);
+Prefetcher<InduceFn, InferFn, MappingFn>::induce_pattern(bool nt, Index_t idx) {
+  InduceFn inducer;
+  InferFn inferer;
+
+  if (unlikely(idx == last_idx_)) {
+    return;
+  }
+  auto new_pattern = inducer(last_idx_, idx);
+  if (pattern_ != new_pattern) {
+    hit_times_ = num_objs_to_prefetch = 0;
+  } else if (++hit_times_ >= kHitTimesThresh) {
+    if (unlikely(hit_times_ == kHitTimesThresh)) {
+      next_prefetch_idx_ = inferer(idx, pattern_);
+      num_objs_to_prefetch = kPrefetchWinSize_;
     } else {
-      auto start_us = microtime();
-      while (ACCESS_ONCE(*task_ptr) == nullptr &&
-             microtime() - start_us <= kMaxSlaveWaitUs) {
-        cpu_relax();
-      }
-      if (unlikely(ACCESS_ONCE(*task_ptr) == nullptr)) {
-        cv->Wait();
-      }
+      num_objs_to_prefetch++;
     }
   }
-  ACCESS_ONCE(*is_exited) = true;
+  pattern_ = new_pattern;
+  last_idx_ = idx;
+  nt_ = nt;
 }
 
+// Returns false if no policy is set.
 template <typename InduceFn, typename InferFn, typename MappingFn>
-FORCE_INLINE void
-Prefetcher<InduceFn, InferFn, MappingFn>::prefetch_master_fn() {
-  uint64_t local_counter = 0;
-  InduceFn inducer;
-  InferFn inferer;
+FORCE_INLINE bool Prefetcher<InduceFn, InferFn, MappingFn>::run_policy(
+    bool nt, Index_t idx) {
+  Index_t idxs[PrefetchPolicy::kMaxDegree];
+
+  policy_mutex_.Lock();
+  auto guard = helpers::finally([&]() { policy_mutex_.Unlock(); });
+  if (!policy_) {
+    return false;
+  }
+  auto num = policy_->predict(
+      idx, std::min(kPrefetchWinSize_, PrefetchPolicy::kMaxDegree), idxs);
+  for (uint32_t i = 0; i < num; i++) {
+    if (unlikely(num_policy_idxs() == kPolicyIdxsSize - 1)) {
+      // Fall behind the mutator; the rest would not arrive in time anyway.
+      break;
+    }
+    policy_idxs_[policy_idxs_tail_] = idxs[i];
+    policy_idxs_tail_ = (policy_idxs_tail_ + 1) % kPolicyIdxsSize;
+  }
+  nt_ = nt;
+  return true;
+}
 
-  while (likely(!ACCESS_ONCE(exit_))) {
+// Runs on a worker of the shared PrefetchExecutor.
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE bool Prefetcher<InduceFn, InferFn, MappingFn>::run() {
+  for (uint32_t i = 0; i < kIdxTracesSize; i++) {
     auto [counter, idx, nt] = traces_[traces_head_];
-
-    if (likely(local_counter < counter)) {
-      local_counter = counter;
-      traces_head_ = (traces_head_ + 1) % kIdxTracesSize;
-
-      if (unlikely(idx == last_idx_)) {
-        continue;
-      }
-      auto new_pattern = inducer(last_idx_, idx);
-      if (pattern_ != new_pattern) {
-        hit_times_ = num_objs_to_prefetch = 0;
-      } else if (++hit_times_ >= kHitTimesThresh) {
-        if (unlikely(hit_times_ == kHitTimesThresh)) {
-          next_prefetch_idx_ = inferer(idx, pattern_);
-          num_objs_to_prefetch = kPrefetchWinSize_;
-        } else {
-          num_objs_to_prefetch++;
-        }
-      }
-      pattern_ = new_pattern;
-      last_idx_ = idx;
-      if (unlikely(nt_ != nt)) {
-        // nt_ is shared by all slaves. Use the store instruction only when
-        // neccesary to reduce cache traffic.
-        nt_ = nt;
-      }
-    } else if (!num_objs_to_prefetch) {
-      cv_prefetch_master_.Wait();
-      continue;
+    if (local_counter_ >= counter) {
+      break;
+    }
+    local_counter_ = counter;
+    traces_head_ = (traces_head_ + 1) % kIdxTracesSize;
+    if (!run_policy(nt, idx)) {
+      induce_pattern(nt, idx);
     }
-    generate_prefetch_tasks();
   }
-  ACCESS_ONCE(master_exited) = true;
+  if (unlikely(ACCESS_ONCE(exit_))) {
+    return false;
+  }
+  generate_prefetch_tasks();
+  return num_objs_to_prefetch || num_policy_idxs() ||
+         local_counter_ < traces_[traces_head_].counter;
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
@@ -170,9 +146,7 @@ Prefetcher<InduceFn, InferFn, MappingFn>::add_trace(bool nt, Index_t idx) {
   traces_[traces_tail_++] = {
       .counter = ++traces_counter_, .idx = idx, .nt = nt};
   traces_tail_ %= kIdxTracesSize;
-  if (unlikely(cv_prefetch_master_.HasWaiters())) {
-    cv_prefetch_master_.Signal();
-  }
+  executor_->submit(this);
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
@@ -181,6 +155,7 @@ FORCE_INLINE void Prefetcher<InduceFn, InferFn, MappingFn>::static_prefetch(
   next_prefetch_idx_ = start_idx;
   pattern_ = pattern;
   num_objs_to_prefetch = num;
+  executor_->submit(this);
 }
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
@@ -189,4 +164,13 @@ Prefetcher<InduceFn, InferFn, MappingFn>::update_state(uint8_t *state) {
   ACCESS_ONCE(state_) = state;
 }
 
+template <typename InduceFn, typename InferFn, typename MappingFn>
+FORCE_INLINE void Prefetcher<InduceFn, InferFn, MappingFn>::set_policy(
+    std::unique_ptr<PrefetchPolicy> policy) {
+  policy_mutex_.Lock();
+  policy_.swap(policy);
+  policy_mutex_.Unlock();
+  // The previous policy (if any) gets destructed out of the critical section.
+}
+
 } // namespace far_memory
@@ -12,14 +12,20 @@
 namespace far_memory {
 
 class LocalGenericConcurrentHopscotch {
-private:
+public:
+  // The memory layout is public, so that remote clients are able to probe the
+  // hashtable with one-sided reads. The data of a key-value pair is laid out as
+  // |KVDataHeader|val|key|.
 #pragma pack(push, 1)
   struct KVDataHeader {
     uint8_t key_len;
     uint16_t val_len;
+    // Seqlock of in-place value writes, which is odd while one is in progress.
+    // Readers copy the value in between two equal, even versions.
+    uint32_t version;
   };
 #pragma pack(pop)
-  static_assert(sizeof(KVDataHeader) == 3);
+  static_assert(sizeof(KVDataHeader) == 7);
 
 #pragma pack(push, 1)
   struct BucketEntry {
@@ -36,27 +42,43 @@ private:
   static_assert(sizeof(BucketEntry) == 24);
 
   constexpr static uint32_t kNeighborhood = 32;
+
+private:
   constexpr static uint32_t kMaxRetries = 2;
 
   const uint32_t kHashMask_;
   const uint32_t kNumEntries_;
   std::unique_ptr<uint8_t> buckets_mem_;
+  bool external_mem_;
   uint64_t slab_base_addr_;
   Slab slab_;
   BucketEntry *buckets_;
   friend class FarMemTest;
 
   void do_remove(BucketEntry *bucket, BucketEntry *entry);
+  // Writes a pair into a newly allocated slab slot, continuing the version of
+  // the pair that the slot last held.
+  static void write_pair(KVDataHeader *header, uint8_t key_len,
+                         const uint8_t *key, uint16_t val_len,
+                         const uint8_t *val);
 
 public:
+  // With mem set, the buckets and the data are placed in it instead of in
+  // memory of their own; it has to be of get_mem_size() bytes and outlive the
+  // hashtable.
   LocalGenericConcurrentHopscotch(uint32_t num_entries_shift,
-                                  uint64_t data_size);
+                                  uint64_t data_size, uint8_t *mem = nullptr);
   ~LocalGenericConcurrentHopscotch();
+  static uint64_t get_mem_size(uint32_t num_entries_shift, uint64_t data_size);
+  const BucketEntry *get_buckets() const { return buckets_; }
+  uint32_t get_hash_mask() const { return kHashMask_; }
   void get(uint8_t key_len, const uint8_t *key, uint16_t *val_len, uint8_t *val,
            bool remove = false);
   bool put(uint8_t key_len, const uint8_t *key, uint16_t val_len,
            const uint8_t *val);
   bool remove(uint8_t key_len, const uint8_t *key);
+  // Brings the bucket of key into the cache ahead of an access to it.
+  void prefetch_bucket(uint8_t key_len, const uint8_t *key);
 };
 
 template <typename K, typename V>
@@ -6,12 +6,14 @@
 #include "cb.hpp"
 #include "concurrent_hopscotch.hpp"
 #include "device.hpp"
+#include "dirty_lines.hpp"
 #include "helpers.hpp"
 #include "internal/ds_info.hpp"
 #include "list.hpp"
 #include "obj_locker.hpp"
 #include "parallel.hpp"
 #include "pointer.hpp"
+#include "prefetch_executor.hpp"
 #include "queue.hpp"
 #include "region.hpp"
 #include "stack.hpp"
@@ -47,6 +49,39 @@ public:
                    std::vector<Region> *from_regions);
 };
 
+// Dirty objects whose write-back is deferred by a GC slave, so that they can be
+// shipped to the device in one batch (e.g., a doorbell-coalesced RDMA WR list).
+// The batched objects stay locked until the batch is flushed, so the batch must
+// be flushed before blocking on any other object lock.
+struct GCWriteBackBatch {
+  constexpr static uint32_t kMaxNumObjects = 64;
+
+  uint32_t num_objs = 0;
+  ObjectWriteReq reqs[kMaxNumObjects];
+  ObjectExtent extents[kMaxNumObjects][DirtyLines::kMaxNumExtents];
+  GenericFarMemPtr *ptrs[kMaxNumObjects];
+  Object objs[kMaxNumObjects];
+
+  bool is_full() const { return num_objs == kMaxNumObjects; }
+};
+
+// Back-references from a far-mem region to the pointers of the vanilla objects
+// (whose object IDs are their remote addresses) allocated in it. They let the
+// far-mem GC find and relocate the survivors of a sparsely-used region.
+struct FarMemRegionIndex {
+  struct Entry {
+    uint32_t offset;
+    uint32_t size;
+    GenericFarMemPtr *ptr; // nullptr once the object is freed.
+  };
+
+  rt::Spin spin;
+  std::vector<Entry> entries; // Sorted by offset.
+  uint64_t live_bytes = 0;
+
+  Entry *find(uint32_t offset);
+};
+
 class GCParallelWriteBacker : public GCParallelizer {
   void slave_fn(uint32_t tid);
 
@@ -56,6 +91,16 @@ public:
 };
 
 class FarMemManager {
+public:
+  // How the cache GC picks the regions to evacuate.
+  enum class RegionPicker {
+    // In the order that regions were filled up, non-temporal ones first.
+    kRoundRobin,
+    // The regions that free the most space per byte written back, as in
+    // cost-benefit log-structured cleaning.
+    kCostBenefit
+  };
+
 private:
   constexpr static double kFreeCacheAlmostEmptyThresh = 0.03;
   constexpr static double kFreeCacheLowThresh = 0.12;
@@ -64,28 +109,50 @@ private:
   constexpr static uint32_t kMaxNumRegionsPerGCRound = 128;
   constexpr static double kMaxRatioRegionsPerGCRound = 0.1;
   constexpr static double kMinRatioRegionsPerGCRound = 0.03;
+  constexpr static uint32_t kMaxSwapInBatchSize = 16;
+  constexpr static double kFarMemGCLiveRatioThresh = 0.5;
+  constexpr static uint32_t kMaxNumRegionsPerFarMemGCRound = 64;
+  constexpr static uint32_t kNumPrefetchWorkers = 16;
+  // The cost-benefit picker scores this many times the regions it picks.
+  constexpr static uint32_t kNumPickCandidatesPerRegion = 2;
+  constexpr static uint32_t kMaxNumSampledObjectsPerRegion = 64;
+  constexpr static uint32_t kMaxNumPrefetchInflightObjs = 256;
 
   class RegionManager {
   private:
     constexpr static double kPickRegionMaxRetryTimes = 3;
 
     std::unique_ptr<uint8_t> local_cache_ptr_;
+    uint64_t local_cache_size_ = 0;
     CircularBuffer<Region, false> free_regions_;
     CircularBuffer<Region, false> used_regions_;
     CircularBuffer<Region, false> nt_used_regions_;
     rt::Spin region_spin_;
     Region core_local_free_regions_[helpers::kNumCPUs];
     Region core_local_free_nt_regions_[helpers::kNumCPUs];
+    // Indexed by region idx: when the region was filled up and became used.
+    std::unique_ptr<uint64_t[]> used_since_us_;
     friend class FarMemTest;
 
   public:
     RegionManager(uint64_t size, bool is_local);
     void push_free_region(Region &region);
+    std::optional<Region> pop_free_region();
+    void push_used_region(Region &region);
     std::optional<Region> pop_used_region();
+    void pop_used_regions(uint32_t max_num_regions,
+                          std::vector<Region> *popped);
+    void unpop_used_regions(std::vector<Region> *regions);
+    uint64_t get_used_since_us(const Region &region) const;
+    void pick_used_regions(const std::function<bool(const Region &)> &pred,
+                           uint32_t max_num_regions,
+                           std::vector<Region> *picked);
     bool try_refill_core_local_free_region(bool nt, Region *full_region);
     Region &core_local_free_region(bool nt);
     double get_free_region_ratio() const;
     uint32_t get_num_regions() const;
+    uint8_t *get_local_cache_ptr() const;
+    uint64_t get_local_cache_size() const;
   };
 
   RegionManager cache_region_manager_;
@@ -96,16 +163,27 @@ private:
   rt::CondVar mutator_cache_condvar_;
   rt::CondVar mutator_far_mem_condvar_;
   rt::Spin gc_lock_;
+  rt::Spin far_mem_gc_lock_;
+  bool far_mem_gc_active_ = false;
+  Region far_mem_gc_to_region_;
+  std::unique_ptr<FarMemRegionIndex[]> far_mem_region_indices_;
+  std::unique_ptr<uint8_t[]> far_mem_gc_buf_;
   GCParallelMarker parallel_marker_;
   GCParallelWriteBacker parallel_write_backer_;
+  PrefetchExecutor prefetch_executor_;
   std::vector<Region> from_regions_{kMaxNumRegionsPerGCRound};
+  std::vector<Region> pick_candidates_{kNumPickCandidatesPerRegion *
+                                       kMaxNumRegionsPerGCRound};
   int ksched_fd_;
+  RegionPicker region_picker_ = RegionPicker::kRoundRobin;
   std::queue<uint8_t> available_ds_ids_;
   static ObjLocker obj_locker_;
 
   friend class FarMemTest;
   friend class FarMemManagerFactory;
   friend class GenericFarMemPtr;
+  friend class GenericUniquePtr;
+  friend class GenericSharedPtr;
   friend class FarMemPtrMeta;
   friend class GenericArray;
   friend class GCParallelWriteBacker;
@@ -122,16 +200,31 @@ private:
   std::optional<Region> pop_cache_used_region();
   void push_cache_free_region(Region &region);
   void swap_in(bool nt, GenericFarMemPtr *ptr);
-  void swap_out(GenericFarMemPtr *ptr, Object obj);
+  void swap_in_batch(bool nt, uint32_t num_ptrs, GenericFarMemPtr **ptrs);
+  bool swap_out(GenericFarMemPtr *ptr, Object obj,
+                GCWriteBackBatch *batch = nullptr);
+  void finish_swap_out(GenericFarMemPtr *ptr, Object obj);
+  void copy_dirty_lines(Object from, Object to);
+  void flush_write_back_batch(GCWriteBackBatch *batch);
   void launch_gc_master();
   void gc_cache();
-  void gc_far_mem();
+  bool gc_far_mem();
+  bool relocate_far_mem_object(uint64_t obj_id);
   uint64_t allocate_local_object(bool nt, uint16_t object_size);
   std::optional<uint64_t> allocate_local_object_nb(bool nt,
                                                    uint16_t object_size);
   uint64_t allocate_remote_object(bool nt, uint16_t object_size);
   void mutator_wait_for_gc_far_mem();
+  FarMemRegionIndex &far_mem_region_index(uint64_t remote_addr);
+  void track_far_mem_object(uint64_t remote_addr, uint32_t object_size,
+                            GenericFarMemPtr *ptr);
+  void untrack_far_mem_object(uint64_t remote_addr);
+  void retrack_far_mem_object(uint64_t remote_addr, GenericFarMemPtr *from,
+                              GenericFarMemPtr *to);
   void pick_from_regions();
+  void pick_from_regions_round_robin(uint32_t num_regions);
+  void pick_from_regions_cost_benefit(uint32_t num_regions);
+  double region_cost_benefit(const Region &region, uint64_t now_us);
   void mark_fm_ptrs(auto *preempt_guard);
   void wait_mutators_observation();
   void write_back_regions();
@@ -152,6 +245,8 @@ public:
 
   ~FarMemManager();
   FarMemDevice *get_device() const { return device_ptr_.get(); }
+  PrefetchExecutor *get_prefetch_executor() { return &prefetch_executor_; }
+  void set_region_picker(RegionPicker region_picker);
   double get_free_mem_ratio() const;
   bool allocate_generic_unique_ptr_nb(
       GenericUniquePtr *ptr, uint8_t ds_id, uint16_t item_size,
@@ -200,6 +295,7 @@ public:
   void register_copy_notifier(uint8_t ds_id, CopyNotifier notifier);
   void read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                    uint16_t *data_len, uint8_t *data_buf);
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
   void construct(uint8_t ds_type, uint8_t ds_id, uint32_t param_len,
                  uint8_t *params);
@@ -207,6 +303,9 @@ public:
   void mutator_wait_for_gc_cache();
   static void lock_object(uint8_t obj_id_len, const uint8_t *obj_id);
   static void unlock_object(uint8_t obj_id_len, const uint8_t *obj_id);
+  static uint64_t lock_local_object(Object obj);
+  static std::optional<uint64_t> try_lock_local_object(Object obj);
+  static void unlock_object_id(uint64_t obj_id_fragment);
 };
 
 class FarMemManagerFactory {
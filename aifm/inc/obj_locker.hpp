@@ -2,23 +2,70 @@
 
 #include "sync.h"
 
-#include <optional>
-#include <map>
+#include "helpers.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <unordered_set>
 
 namespace far_memory {
 
+// A fixed-size table of in-flight (locked) object IDs. Each bucket is a
+// cacheline of slots that are claimed and released with CAS, so the
+// uncontended path neither allocates nor takes a lock. A thread that finds its
+// object already in flight parks on the wait queue of that slot, and is only
+// woken up when that very slot gets released. The IDs that do not fit in their
+// full buckets go to an unbounded overflow set behind a lock, so a thread may
+// hold any number of locks.
 class ObjLocker {
 private:
-  constexpr static uint32_t kNumMaps = 1024;
+  constexpr static uint32_t kNumBucketsShift = 10;
+  constexpr static uint32_t kNumBuckets = 1 << kNumBucketsShift;
+  constexpr static uint32_t kNumSlotsPerBucket = 8;
+  constexpr static uint64_t kEmpty = ~static_cast<uint64_t>(0);
+
+  struct alignas(64) Bucket {
+    std::atomic<uint64_t> obj_ids[kNumSlotsPerBucket];
+  };
+  static_assert(sizeof(Bucket) == 64);
+
+  // The cold part of a slot, which is only touched on contention and by the
+  // holder when it releases the slot.
+  struct SlotState {
+    std::atomic<bool> held{false};
+    std::atomic<uint32_t> num_waiters{0};
+    rt::Spin spin;
+    rt::CondVar cv;
+  };
+
+  Bucket buckets_[kNumBuckets];
+  SlotState slot_states_[kNumBuckets * kNumSlotsPerBucket];
+  // The number of overflowed IDs of each bucket, which the claimers of its
+  // slots check for.
+  std::atomic<uint32_t> num_overflowed_[kNumBuckets];
+  rt::Spin overflow_spin_;
+  rt::CondVar overflow_cv_;
+  std::unordered_set<uint64_t> overflowed_obj_ids_;
 
-  std::map<uint64_t, bool> maps_[kNumMaps];
-  rt::Spin spins_[kNumMaps];
-  rt::CondVar cvs_[kNumMaps];
+  SlotState &slot_state(uint32_t bucket_idx, uint32_t slot);
+  bool try_claim(uint32_t bucket_idx, uint64_t obj_id, uint32_t *holder_slot);
+  bool try_claim_overflow(uint32_t bucket_idx, uint64_t obj_id,
+                          uint32_t *holder_slot);
+  bool is_overflowed(uint64_t obj_id);
+  void release(uint32_t bucket_idx, uint32_t slot);
+  void wait(uint32_t bucket_idx, uint32_t slot, uint64_t obj_id);
+  void wait_overflow(uint64_t obj_id);
 
 public:
   ObjLocker();
-  uint32_t hash_func(uint64_t obj_id);
+  static uint32_t hash_func(uint64_t obj_id);
+  // Returns true if obj_id is locked by the caller. Otherwise, obj_id has been
+  // in flight, and the caller has waited for (or raced with) its release and
+  // should retry.
   bool try_insert(uint64_t obj_id);
+  // Unlike try_insert(), never waits or yields, so it can be called with
+  // preemption disabled. Returns true if obj_id is locked by the caller.
+  bool try_lock(uint64_t obj_id);
   void remove(uint64_t obj_id);
 };
 }; // namespace far_memory
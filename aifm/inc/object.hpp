@@ -7,6 +7,46 @@ namespace far_memory {
 // Forward declaration.
 template <typename T> class UniquePtr;
 
+// A byte range of object data, relative to the start of the data. Used to
+// write back only the modified parts of an object.
+struct ObjectExtent {
+  uint16_t offset;
+  uint16_t len;
+};
+
+// A single entry of a batched read_objects() call. As in read_object(),
+// *data_len holds the data length on input for vanilla pointers.
+struct ObjectReadReq {
+  uint8_t ds_id;
+  uint8_t obj_id_len;
+  const uint8_t *obj_id;
+  uint16_t *data_len;
+  uint8_t *data_buf;
+};
+
+// A single entry of a batched write_objects() call. With num_extents set, only
+// the extents of the data are written, as in write_object_extents().
+struct ObjectWriteReq {
+  uint8_t ds_id;
+  uint8_t obj_id_len;
+  const uint8_t *obj_id;
+  uint16_t data_len;
+  const uint8_t *data_buf;
+  uint8_t num_extents;
+  const ObjectExtent *extents;
+
+  uint32_t get_num_bytes() const {
+    if (!num_extents) {
+      return data_len;
+    }
+    uint32_t num_bytes = 0;
+    for (uint8_t i = 0; i < num_extents; i++) {
+      num_bytes += extents[i].len;
+    }
+    return num_bytes;
+  }
+};
+
 class Object {
   //
   // Format:
@@ -113,6 +113,8 @@ public:
   void nullify();
   bool is_null() const;
   void swap_in(bool nt);
+  static void swap_in_batch(bool nt, uint32_t num_ptrs,
+                            GenericFarMemPtr **ptrs);
   void flush();
   void move(GenericFarMemPtr &other, uint64_t reset_value);
 };
@@ -126,6 +128,7 @@ protected:
 
   void init(uint64_t object_addr);
   void _free();
+  bool _free_far_mem();
   void evacuate();
 
 public:
@@ -138,6 +141,9 @@ public:
   template <bool Mut, bool Nt> void *_deref();
   template <bool Nt = false> const void *deref(const DerefScope &scope);
   template <bool Nt = false> void *deref_mut(const DerefScope &scope);
+  // Only [offset, offset + len) of the data is going to be modified.
+  template <bool Nt = false>
+  void *deref_mut(const DerefScope &scope, uint16_t offset, uint16_t len);
   void free(bool race = false);
 };
 
@@ -156,6 +162,8 @@ public:
   NOT_COPYABLE(UniquePtr);
   template <bool Nt = false> const T *deref(const DerefScope &scope);
   template <bool Nt = false> T *deref_mut(const DerefScope &scope);
+  template <bool Nt = false>
+  T *deref_mut(const DerefScope &scope, uint16_t offset, uint16_t len);
   template <bool Nt = false> T read();
   template <bool Nt = false, typename U> void write(U &&u);
   void free();
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "sync.h"
+#include "thread.h"
+
+#include "helpers.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace far_memory {
+
+class PrefetchExecutor;
+
+// A source of prefetch work, i.e., the Prefetcher of a container. It is
+// scheduled on the executor whenever it has work, and is never run by two
+// workers at the same time.
+class PrefetchTask {
+private:
+  enum State : uint8_t { kIdle, kQueued, kRunning, kRerun, kCancelled };
+
+  std::atomic<uint8_t> state_{kIdle};
+  // Set if the executor has granted nothing to the current run.
+  bool starved_ = false;
+  friend class PrefetchExecutor;
+
+public:
+  virtual ~PrefetchTask() {}
+  // Runs a bounded burst of prefetching. Returns whether it has more work.
+  virtual bool run() = 0;
+};
+
+// A process-wide pool of prefetch workers owned by FarMemManager, shared by the
+// prefetchers of all containers. Tasks are submitted to the queue of the
+// current core; idle workers steal from the queues of the other cores. The
+// objects that are being prefetched are capped globally, both in number and,
+// optionally, in bandwidth. Tasks that have been granted nothing are parked
+// rather than requeued, until some objects are released or the bandwidth
+// tokens refill.
+class PrefetchExecutor {
+private:
+  constexpr static uint32_t kBandwidthBucketUs = 1000;
+
+  struct alignas(64) TaskQueue {
+    rt::Spin spin;
+    std::deque<PrefetchTask *> tasks;
+  };
+
+  TaskQueue task_queues_[helpers::kNumCPUs];
+  std::atomic<uint64_t> num_queued_tasks_{0};
+  std::atomic<uint32_t> num_sleeping_workers_{0};
+  rt::Spin sleep_spin_;
+  rt::CondVar sleep_cv_;
+  std::vector<rt::Thread> workers_;
+  bool exit_ = false;
+
+  const uint32_t kMaxNumInflightObjs_;
+  std::atomic<uint32_t> num_inflight_objs_{0};
+  // Token bucket in bytes; a zero rate means unlimited bandwidth.
+  uint64_t max_bytes_per_sec_ = 0;
+  uint64_t num_tokens_ = 0;
+  uint64_t last_refill_us_ = 0;
+  // When the tokens of the last denied object will be there.
+  uint64_t refill_us_ = 0;
+  rt::Spin bandwidth_spin_;
+
+  rt::Spin parked_spin_;
+  std::vector<PrefetchTask *> parked_tasks_;
+  std::atomic<uint32_t> num_parked_tasks_{0};
+
+  void enqueue(PrefetchTask *task);
+  PrefetchTask *dequeue();
+  void worker_fn();
+  uint32_t acquire_bandwidth(uint32_t num_objs, uint32_t obj_size);
+  void park(PrefetchTask *task);
+  void unpark();
+  uint64_t get_unpark_delay_us();
+
+public:
+  PrefetchExecutor(uint32_t num_workers, uint32_t max_num_inflight_objs);
+  ~PrefetchExecutor();
+  NOT_COPYABLE(PrefetchExecutor);
+  NOT_MOVEABLE(PrefetchExecutor);
+  // Schedules task to run if it is not queued yet, or to run once more if it
+  // is running.
+  void submit(PrefetchTask *task);
+  // Waits until task is neither queued nor running, and then prevents it from
+  // being scheduled again. Must be called before task gets destructed.
+  void cancel(PrefetchTask *task);
+  // Returns the number of objects (of obj_size bytes, up to num_objs) that
+  // task may prefetch now, which must be released after their swap-ins. If
+  // nothing is granted, task gets parked once its run() returns.
+  uint32_t acquire(PrefetchTask *task, uint32_t num_objs, uint32_t obj_size);
+  void release(uint32_t num_objs);
+  void set_max_bytes_per_sec(uint64_t max_bytes_per_sec);
+};
+
+} // namespace far_memory
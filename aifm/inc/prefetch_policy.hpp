@@ -0,0 +1,104 @@
+#pragma once
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace far_memory {
+
+// Decides what a container prefetches, given the stream of indices it accesses.
+// A policy is owned by the Prefetcher of a single container and is only invoked
+// by its backend prefetch thread, so it does not have to be thread-safe.
+class PrefetchPolicy {
+public:
+  constexpr static uint32_t kMaxDegree = 256;
+
+  virtual ~PrefetchPolicy() {}
+  // Observes the access to idx and stores into idxs the (at most max) indices
+  // that should be prefetched on top of those issued earlier. Returns the
+  // number of stored indices.
+  virtual uint32_t predict(uint64_t idx, uint32_t max, uint64_t *idxs) = 0;
+};
+
+// Tracks multiple independent strided streams, e.g., interleaved sequential
+// scans or the loops of a nest that walk an Array<T, Dims...> along different
+// dimensions. Each stream keeps its own prefetch window.
+class StrideTablePolicy : public PrefetchPolicy {
+private:
+  constexpr static uint32_t kNumStreams = 16;
+  // Number of consecutive stride matches before a stream gets prefetched.
+  constexpr static uint32_t kConfidenceThresh = 2;
+  // An untrained access is attributed to the closest stream within this
+  // distance, or otherwise to the most recently used untrained stream.
+  constexpr static uint64_t kMaxStreamDistance = 64;
+
+  struct Stream {
+    bool valid;
+    bool prefetching;
+    uint64_t last_idx;
+    int64_t stride;
+    uint32_t confidence;
+    uint64_t next_prefetch_idx;
+    uint64_t last_used;
+  };
+
+  Stream streams_[kNumStreams];
+  uint64_t clock_ = 0;
+
+  Stream *find_stream(uint64_t idx);
+
+public:
+  StrideTablePolicy();
+  uint32_t predict(uint64_t idx, uint32_t max, uint64_t *idxs) override;
+};
+
+// Global history buffer with delta correlation (G/DC): the last two index deltas
+// are looked up in the history, and the deltas that followed their previous
+// occurrence are replayed. Captures repeating irregular patterns, e.g., the
+// row jumps of a nested loop or a fixed permutation walked repeatedly.
+class DeltaCorrelationPolicy : public PrefetchPolicy {
+private:
+  constexpr static uint32_t kHistorySize = 256;
+  constexpr static uint32_t kIndexTableSize = 1024;
+  constexpr static uint32_t kIssuedFilterSize = 1024;
+  constexpr static uint32_t kMaxNumReplays = 32;
+
+  uint64_t history_[kHistorySize];
+  uint64_t num_accesses_ = 0;
+  // Maps the hash of a delta pair to the position + 1 where it last ended.
+  uint64_t index_table_[kIndexTableSize];
+  // Direct-mapped set of recently issued indices, to avoid reissuing them.
+  uint64_t issued_filter_[kIssuedFilterSize];
+
+  uint64_t history_at(uint64_t pos) const;
+  int64_t delta_at(uint64_t pos) const;
+  static uint32_t hash_deltas(int64_t delta_0, int64_t delta_1);
+
+public:
+  DeltaCorrelationPolicy();
+  uint32_t predict(uint64_t idx, uint32_t max, uint64_t *idxs) override;
+};
+
+// Follows a user-supplied next-index function, e.g., the links of a
+// pointer-chasing structure that lives in an index-addressed container. The
+// function returns std::nullopt at the end of the chain.
+class CallbackPolicy : public PrefetchPolicy {
+public:
+  using NextIdxFn = std::function<std::optional<uint64_t>(uint64_t)>;
+
+private:
+  NextIdxFn next_idx_fn_;
+  uint64_t last_idx_ = ~static_cast<uint64_t>(0);
+  // The predicted indices that are issued but not yet accessed, in order.
+  uint64_t ahead_[kMaxDegree];
+  uint32_t ahead_head_ = 0;
+  uint32_t num_ahead_ = 0;
+
+public:
+  CallbackPolicy(NextIdxFn next_idx_fn);
+  uint32_t predict(uint64_t idx, uint32_t max, uint64_t *idxs) override;
+};
+
+} // namespace far_memory
@@ -5,8 +5,11 @@
 
 #include "helpers.hpp"
 #include "pointer.hpp"
+#include "prefetch_executor.hpp"
+#include "prefetch_policy.hpp"
 
 #include <functional>
+#include <memory>
 #include <type_traits>
 
 namespace far_memory {
@@ -14,7 +17,7 @@ namespace far_memory {
 class FarMemDevice;
 
 template <typename InduceFn, typename InferFn, typename MappingFn>
-class Prefetcher {
+class Prefetcher : public PrefetchTask {
 private:
   using InduceFnTraits = helpers::FunctionTraits<InduceFn>;
   using InferFnTraits = helpers::FunctionTraits<InferFn>;
@@ -50,25 +53,24 @@ private:
   static_assert(std::is_same<GenericUniquePtr *,
                              typename MappingFnTraits::ResultType>::value);
 
+  // PrefetchPolicy works on flat indices.
+  static_assert(std::is_same<Index_t, uint64_t>::value);
+
   struct Trace {
     uint64_t counter;
     uint64_t idx;
     bool nt;
   };
 
-  struct SlaveStatus {
-    GenericUniquePtr *task;
-    bool is_exited;
-    rt::CondVar cv;
-  };
-
   constexpr static uint32_t kIdxTracesSize = 256;
   constexpr static uint32_t kHitTimesThresh = 8;
-  constexpr static uint32_t kGenTasksBurstSize = 8;
-  constexpr static uint32_t kMaxSlaveWaitUs = 5;
-  constexpr static uint32_t kMaxNumPrefetchSlaveThreads = 16;
+  // Tasks of a burst are swapped in as one batch, i.e., with all their reads
+  // outstanding on the device at the same time.
+  constexpr static uint32_t kGenTasksBurstSize = 16;
+  constexpr static uint32_t kPolicyIdxsSize = 2 * PrefetchPolicy::kMaxDegree;
 
   const uint32_t kPrefetchWinSize_; // In terms of number of objects.
+  PrefetchExecutor *executor_;
   uint8_t *state_;
   Pattern_t pattern_;
   uint32_t object_data_size_;
@@ -81,24 +83,33 @@ private:
   uint32_t traces_head_ = 0;
   uint32_t traces_tail_ = 0;
   uint64_t traces_counter_ = 0;
-  std::vector<rt::Thread> prefetch_threads_;
-  CachelineAligned(SlaveStatus) slave_status_[kMaxNumPrefetchSlaveThreads];
-  rt::CondVar cv_prefetch_master_;
-  bool master_exited = false;
+  uint64_t local_counter_ = 0;
+  // When set, the policy decides what to prefetch instead of the built-in
+  // single-stride detection; static_prefetch() works in either case.
+  std::unique_ptr<PrefetchPolicy> policy_;
+  rt::Mutex policy_mutex_;
+  Index_t policy_idxs_[kPolicyIdxsSize];
+  uint32_t policy_idxs_head_ = 0;
+  uint32_t policy_idxs_tail_ = 0;
   bool exit_ = false;
 
   void generate_prefetch_tasks();
-  void prefetch_master_fn();
-  void prefetch_slave_fn(uint32_t tid);
+  void induce_pattern(bool nt, Index_t idx);
+  bool run_policy(bool nt, Index_t idx);
+  uint32_t num_policy_idxs() const;
 
 public:
-  Prefetcher(FarMemDevice *device, uint8_t *state, uint32_t object_data_size);
+  Prefetcher(FarMemDevice *device, PrefetchExecutor *executor, uint8_t *state,
+             uint32_t object_data_size);
   ~Prefetcher();
+  bool run() override;
   NOT_COPYABLE(Prefetcher);
   NOT_MOVEABLE(Prefetcher);
   void add_trace(bool nt, Index_t idx);
   void static_prefetch(Index_t start_idx, Pattern_t pattern, uint32_t num);
   void update_state(uint8_t *state);
+  // Passing nullptr restores the built-in single-stride detection.
+  void set_policy(std::unique_ptr<PrefetchPolicy> policy);
 };
 } // namespace far_memory
 
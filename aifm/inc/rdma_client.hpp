@@ -11,14 +11,29 @@
 
 #define DEFAULT_RDMA_PORT (20886) // Default port where the RDMA server is listening
 #define NUM_QUEUES (160)          // Number of most possible concurrent calls
+#define MAX_BATCH_WRS (64)        // Max number of chained WRs posted per doorbell
 
 struct rdma_queue;
 typedef struct rdma_queue rdma_queue_t;
 
 struct rdma_client;
 
-struct rdma_client *start_rdma_client();
+/* With num_shared_cqs == 0, every queue owns a private CQ that its user polls.
+ * Otherwise the queues are spread over num_shared_cqs CQs, which have to be
+ * drained through rdma_poll_shared_cq(). */
+struct rdma_client *start_rdma_client(int num_shared_cqs = 0);
 int destroy_client(struct rdma_client *client);
+int rdma_register_cache(struct rdma_client *client, void *buf, size_t len);
 rdma_queue_t *rdma_get_queue(struct rdma_client *client, int idx);
+int rdma_get_queue_idx(rdma_queue_t *queue);
+int rdma_get_queue_cq_idx(rdma_queue_t *queue);
+int rdma_poll_shared_cq(struct rdma_client *client, int cq_idx, rdma_queue_t **queues, int num);
 int rdma_read(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, uint8_t *data_buf);
-int rdma_write(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, const uint8_t *data_buf);
\ No newline at end of file
+int rdma_write(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, const uint8_t *data_buf);
+int rdma_post_read(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, uint8_t *data_buf);
+int rdma_post_write(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, const uint8_t *data_buf);
+int rdma_poll(rdma_queue_t *queue);
+int rdma_post_write_batch(rdma_queue_t *queue, int num, const uint64_t *offsets,
+						  const uint16_t *data_lens, const uint8_t *const *data_bufs);
+int rdma_write_batch(rdma_queue_t *queue, int num, const uint64_t *offsets,
+					 const uint16_t *data_lens, const uint8_t *const *data_bufs);
\ No newline at end of file
@@ -13,4 +13,18 @@
 #include "rdma_client.hpp"
 
 int start_rdma_server();
-int destroy_server();
\ No newline at end of file
+int destroy_server();
+
+/* Bytes at the bottom of the registered buffer that hold the far memory of
+ * vanilla pointers, which the carve-outs never overlap. */
+void rdma_server_set_far_mem_size(size_t size);
+/* Carves len bytes out of the top of the registered buffer for server-side
+ * data structures that the clients access with one-sided reads. Returns NULL
+ * if there is no registered buffer (i.e., no client has connected yet) or the
+ * bytes above the far memory are used up, in which case callers fall back to
+ * private memory. Freed carve-outs are reused in any order. */
+void *rdma_server_alloc(size_t len);
+void rdma_server_free(void *buf, size_t len);
+/* The server address of the registered buffer, from which the clients take
+ * their offsets. */
+uint64_t rdma_server_base_addr();
\ No newline at end of file
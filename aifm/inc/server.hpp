@@ -22,6 +22,17 @@ public:
                    uint16_t *data_len, uint8_t *data_buf);
   void write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
+  void write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *obj_id, uint16_t data_len,
+                            const uint8_t *data_buf, uint8_t num_extents,
+                            const ObjectExtent *extents);
+  // Consecutive requests of the same data structure are handed to it at once.
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
+  // buf holds the data in between, and spans Object::kMaxObjectDataSize bytes.
+  void copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                   const uint8_t *from_obj_id, const uint8_t *to_obj_id,
+                   uint8_t *buf);
   bool remove_object(uint64_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id);
   void compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
                const uint8_t *input_buf, uint16_t *output_len,
@@ -34,6 +34,20 @@ private:
   std::pair<uint64_t, uint64_t>
   _compute_aggregate(uint8_t opcode, uint8_t result_ds, uint8_t key_ds,
                      uint64_t size);
+  void compute_filter(uint16_t input_len, const uint8_t *input_buf,
+                      uint16_t *output_len, uint8_t *output_buf);
+  template <typename U>
+  const uint8_t *_compute_filter(uint8_t col_ds, uint8_t cmp,
+                                 const uint8_t *operands, uint64_t size,
+                                 bool first,
+                                 std::vector<unsigned long long> &result_vec);
+  void compute_group_by(uint16_t input_len, const uint8_t *input_buf,
+                        uint16_t *output_len, uint8_t *output_buf);
+  // Aggregates vec_[i] into result_vec[groups[i]], keeping the per-group state
+  // in flat arrays.
+  void _aggregate_groups(uint8_t opcode, const std::vector<uint64_t> &groups,
+                         const std::vector<unsigned long long> &first_rows,
+                         std::vector<T> &result_vec);
   template <typename U>
   void _compute_unique(uint64_t vec_size, std::vector<U> &unique_vec);
 
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "object.hpp"
+
 #include <cstdint>
+#include <cstring>
+#include <memory>
 
 class ServerDS {
 public:
@@ -9,6 +13,46 @@ public:
                            uint16_t *data_len, uint8_t *data_buf) = 0;
   virtual void write_object(uint8_t obj_id_len, const uint8_t *obj_id,
                             uint16_t data_len, const uint8_t *data_buf) = 0;
+  // Updates the extents of an existing object; only the bytes of data_buf
+  // within the extents are valid. The default is a read-modify-write of the
+  // whole object, which data structures that store objects in place override.
+  virtual void write_object_extents(uint8_t obj_id_len, const uint8_t *obj_id,
+                                    uint16_t data_len, const uint8_t *data_buf,
+                                    uint8_t num_extents,
+                                    const far_memory::ObjectExtent *extents) {
+    std::unique_ptr<uint8_t[]> buf(
+        new uint8_t[far_memory::Object::kMaxObjectDataSize]);
+    uint16_t stored_data_len;
+    read_object(obj_id_len, obj_id, &stored_data_len, buf.get());
+    BUG_ON(stored_data_len != data_len);
+    for (uint8_t i = 0; i < num_extents; i++) {
+      memcpy(buf.get() + extents[i].offset, data_buf + extents[i].offset,
+             extents[i].len);
+    }
+    write_object(obj_id_len, obj_id, data_len, buf.get());
+  }
+  // Batched reads and writes of the objects of reqs, whose ds_id fields are
+  // ignored. The defaults serve the objects one by one, which data structures
+  // override to amortize the per-object costs across the batch.
+  virtual void read_objects(uint32_t num_reqs,
+                            const far_memory::ObjectReadReq *reqs) {
+    for (uint32_t i = 0; i < num_reqs; i++) {
+      auto &req = reqs[i];
+      read_object(req.obj_id_len, req.obj_id, req.data_len, req.data_buf);
+    }
+  }
+  virtual void write_objects(uint32_t num_reqs,
+                             const far_memory::ObjectWriteReq *reqs) {
+    for (uint32_t i = 0; i < num_reqs; i++) {
+      auto &req = reqs[i];
+      if (req.num_extents) {
+        write_object_extents(req.obj_id_len, req.obj_id, req.data_len,
+                             req.data_buf, req.num_extents, req.extents);
+      } else {
+        write_object(req.obj_id_len, req.obj_id, req.data_len, req.data_buf);
+      }
+    }
+  }
   virtual bool remove_object(uint8_t obj_id_len, const uint8_t *obj_id) = 0;
   virtual void compute(uint8_t opcode, uint16_t input_len,
                        const uint8_t *input_buf, uint16_t *output_len,
@@ -10,15 +10,34 @@ namespace far_memory {
 class ServerHashTable : public ServerDS {
 private:
   std::unique_ptr<LocalGenericConcurrentHopscotch> local_hopscotch_;
+  uint8_t *rdma_mem_ = nullptr;
+  uint64_t rdma_mem_size_ = 0;
   friend class ServerHashTableFactory;
 
 public:
+  // Opcodes of compute().
+  //     0. get_rdma_layout: returns the RDMALayout, or nothing if the
+  //        hashtable is not in the registered memory of the RDMA server.
+  constexpr static uint8_t kOpGetRDMALayout = 0;
+
+  // Where the hashtable is in the registered memory of the RDMA server, for
+  // the clients that probe it with one-sided reads. Offsets are relative to
+  // the registered buffer, which starts at base_addr on the server.
+  struct RDMALayout {
+    uint64_t base_addr;
+    uint64_t buckets_offset;
+    uint64_t end_offset;
+    uint32_t hash_mask;
+  };
+
   ServerHashTable(uint32_t param_len, uint8_t *params);
   ~ServerHashTable();
   void read_object(uint8_t obj_id_len, const uint8_t *obj_id,
                    uint16_t *data_len, uint8_t *data_buf);
   void write_object(uint8_t obj_id_len, const uint8_t *obj_id,
                     uint16_t data_len, const uint8_t *data_buf);
+  void read_objects(uint32_t num_reqs, const ObjectReadReq *reqs);
+  void write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs);
   bool remove_object(uint8_t obj_id_len, const uint8_t *obj_id);
   void compute(uint8_t opcode, uint16_t input_len, const uint8_t *input_buf,
                uint16_t *output_len, uint8_t *output_buf);
@@ -87,6 +87,55 @@ public:                                                                        \
   static void finish_measure_write_object_cycles();
   static void reset_measure_write_object_cycles();
   static uint64_t get_elapsed_write_object_cycles();
+
+  // GC evacuation (write-back) accounting.
+  ADD_PER_CORE_STAT(uint64_t, gc_write_back_bytes, true)
+  ADD_PER_CORE_STAT(uint64_t, gc_write_back_objects, true)
+  ADD_STAT(uint64_t, gc_write_back_us, true)
+  // Objects that only had their dirty extents written back.
+  ADD_PER_CORE_STAT(uint64_t, gc_write_back_partial_objects, true)
+  // Time that mutators spend waiting for the cache GC to free space.
+  ADD_STAT(uint64_t, mutator_gc_wait_us, true)
+
+  // Swap-in accounting: objects swapped in on demand by the mutators (i.e.,
+  // cache misses) and in batches by the prefetchers.
+  ADD_PER_CORE_STAT(uint64_t, swap_in_objects, true)
+  ADD_PER_CORE_STAT(uint64_t, batch_swap_in_objects, true)
+
+  // Remote hashtable lookups served by one-sided RDMA reads, and the ones that
+  // kept racing with the server and fell back to TCP.
+  ADD_PER_CORE_STAT(uint64_t, one_sided_hashtable_gets, true)
+  ADD_STAT(uint64_t, one_sided_hashtable_fallbacks, true)
+
+  // Compression accounting (see CompressedDevice): the bytes of the objects
+  // that went through the codec and the bytes stored for them, the objects
+  // that bypassed it, and the cycles spent (de)compressing.
+  ADD_PER_CORE_STAT(uint64_t, compression_raw_bytes, true)
+  ADD_PER_CORE_STAT(uint64_t, compression_stored_bytes, true)
+  ADD_PER_CORE_STAT(uint64_t, compression_bypassed_objects, true)
+  ADD_PER_CORE_STAT(uint64_t, compress_cycles, true)
+  ADD_PER_CORE_STAT(uint64_t, decompress_cycles, true)
+
+  // Compressed local pool accounting (see CompressedCacheDevice).
+  ADD_PER_CORE_STAT(uint64_t, compressed_cache_hits, true)
+  ADD_PER_CORE_STAT(uint64_t, compressed_cache_misses, true)
+  ADD_STAT(uint64_t, compressed_cache_write_backs, true)
+
+  // Log accounting of StorageDevice.
+  ADD_STAT(uint64_t, storage_segment_writes, true)
+  ADD_STAT(uint64_t, storage_cleaned_bytes, true)
+
+  // Migrations between the devices of TieredDevice.
+  ADD_STAT(uint64_t, tier_migrated_chunks, true)
+  ADD_STAT(uint64_t, tier_migrated_bytes, true)
+
+  // Replica requests of ReplicatedDevice that completed in the background.
+  ADD_PER_CORE_STAT(uint64_t, replica_async_completions, true)
+
+  // Far-mem GC accounting.
+  ADD_STAT(uint64_t, far_mem_gc_relocated_bytes, true)
+  ADD_STAT(uint64_t, far_mem_gc_reclaimed_regions, true)
+  ADD_STAT(uint64_t, far_mem_gc_us, true)
 };
 } // namespace far_memory
 
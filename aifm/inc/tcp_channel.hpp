@@ -0,0 +1,86 @@
+#pragma once
+
+extern "C" {
+#include <runtime/tcp.h>
+}
+#include "sync.h"
+#include "thread.h"
+
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace far_memory {
+
+// A connection to the remote agent that speaks protocol v2, i.e., many
+// requests are pipelined on it. Every request is sent in a frame tagged by the
+// requester, and the remote agent echoes the tag in the frame of the response,
+// so that the responses may arrive out of order. A reader uthread routes each
+// response to the requester parked on its tag.
+// Frame format (for both requests and responses):
+//     |Tag (4B)|Len (4B)|v1 request or response (Len B)|
+// All responses are either a single byte, e.g., an ack, or one or more of
+//     |data_len (2B)|data_buf (data_len B)|
+class TCPChannel {
+public:
+  struct FrameHeader {
+    uint32_t tag;
+    uint32_t len;
+  };
+
+  constexpr static uint32_t kMaxNumInflightReqs = 256;
+  constexpr static uint32_t kMaxNumIovecs = 64;
+  constexpr static uint32_t kMaxFrameLen = 1 << 23;
+
+private:
+  struct Slot {
+    rt::Spin spin;
+    rt::CondVar cv;
+    bool done;
+    // Zero for a single-byte response.
+    uint32_t num_resps;
+    uint16_t *const *resp_lens;
+    uint8_t *const *resp_bufs;
+    // Backs resp_lens and resp_bufs for post().
+    uint16_t *resp_len;
+    uint8_t *resp_buf;
+    uint8_t resp;
+  };
+
+  tcpconn_t *remote_slave_;
+  rt::Mutex write_mutex_;
+  CachelineAligned(Slot) slots_[kMaxNumInflightReqs];
+  std::vector<uint32_t> free_tags_;
+  rt::Spin free_tags_spin_;
+  rt::CondVar free_tags_cv_;
+  rt::Thread reader_;
+
+  void reader_fn();
+  uint32_t acquire_tag();
+  void send(uint32_t tag, const iovec *iov, int iovcnt);
+
+public:
+  // remote_slave must have been switched to protocol v2.
+  TCPChannel(tcpconn_t *remote_slave);
+  // All the requests must have been reaped.
+  ~TCPChannel();
+  NOT_COPYABLE(TCPChannel);
+  NOT_MOVEABLE(TCPChannel);
+  // Sends the request gathered from iov, and returns its tag. Its response
+  // goes to [resp_len, resp_buf) if resp_len is set, or else is a single byte.
+  // Blocks while kMaxNumInflightReqs requests are in flight.
+  uint32_t post(const iovec *iov, int iovcnt, uint16_t *resp_len,
+                uint8_t *resp_buf);
+  // Same as post(), but the response consists of num_resps parts, the i-th of
+  // which goes to [resp_lens[i], resp_bufs[i]). Both arrays must stay alive
+  // until the request completes.
+  uint32_t post_vectored(const iovec *iov, int iovcnt, uint32_t num_resps,
+                         uint16_t *const *resp_lens,
+                         uint8_t *const *resp_bufs);
+  // Reaps the request of tag, storing a single-byte response into resp.
+  // Returns false if it has not completed yet and block is not set.
+  bool complete(uint32_t tag, bool block, uint8_t *resp);
+};
+
+} // namespace far_memory
@@ -8,8 +8,8 @@ namespace far_memory {
 GenericArray::GenericArray(FarMemManager *manager, uint32_t item_size,
                            uint64_t num_items)
     : kNumItems_(num_items), kItemSize_(item_size),
-      prefetcher_(manager->get_device(), reinterpret_cast<uint8_t *>(&ptrs_),
-                  item_size) {
+      prefetcher_(manager->get_device(), manager->get_prefetch_executor(),
+                  reinterpret_cast<uint8_t *>(this), item_size) {
   preempt_disable();
   ptrs_.reset(new GenericUniquePtr[num_items]);
   preempt_enable();
@@ -35,4 +35,9 @@ void GenericArray::static_prefetch(Index_t start, Index_t step, uint32_t num) {
   prefetcher_.static_prefetch(start, step, num);
 }
 
+void GenericArray::set_prefetch_policy(std::unique_ptr<PrefetchPolicy> policy) {
+  prefetcher_.set_policy(std::move(policy));
+  ACCESS_ONCE(dynamic_prefetch_enabled_) = true;
+}
+
 } // namespace far_memory
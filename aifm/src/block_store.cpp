@@ -0,0 +1,66 @@
+extern "C" {
+#include <base/assert.h>
+#include <runtime/storage.h>
+}
+
+#include "block_store.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace far_memory {
+
+NVMeBlockStore::NVMeBlockStore() { BUG_ON(!storage_num_blocks()); }
+
+uint32_t NVMeBlockStore::get_block_size() const {
+  return storage_block_size();
+}
+
+uint64_t NVMeBlockStore::get_num_blocks() const {
+  return storage_num_blocks();
+}
+
+void NVMeBlockStore::read(uint64_t lba, uint32_t num_blocks, uint8_t *buf) {
+  BUG_ON(storage_read(buf, lba, num_blocks) != 0);
+}
+
+void NVMeBlockStore::write(uint64_t lba, uint32_t num_blocks,
+                           const uint8_t *buf) {
+  BUG_ON(storage_write(buf, lba, num_blocks) != 0);
+}
+
+FileBlockStore::FileBlockStore(const std::string &path, uint64_t size)
+    : num_blocks_(size / kBlockSize) {
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  BUG_ON(fd_ < 0);
+  BUG_ON(ftruncate(fd_, num_blocks_ * kBlockSize) != 0);
+}
+
+FileBlockStore::~FileBlockStore() { close(fd_); }
+
+void FileBlockStore::read(uint64_t lba, uint32_t num_blocks, uint8_t *buf) {
+  uint64_t len = static_cast<uint64_t>(num_blocks) * kBlockSize;
+  uint64_t off = lba * kBlockSize;
+  while (len) {
+    auto ret = pread(fd_, buf, len, off);
+    BUG_ON(ret <= 0);
+    buf += ret;
+    off += ret;
+    len -= ret;
+  }
+}
+
+void FileBlockStore::write(uint64_t lba, uint32_t num_blocks,
+                           const uint8_t *buf) {
+  uint64_t len = static_cast<uint64_t>(num_blocks) * kBlockSize;
+  uint64_t off = lba * kBlockSize;
+  while (len) {
+    auto ret = pwrite(fd_, buf, len, off);
+    BUG_ON(ret <= 0);
+    buf += ret;
+    off += ret;
+    len -= ret;
+  }
+}
+
+} // namespace far_memory
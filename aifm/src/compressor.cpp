@@ -0,0 +1,212 @@
+#include "compressor.hpp"
+#include "helpers.hpp"
+
+#include <cstring>
+
+namespace far_memory {
+
+namespace {
+
+enum Tag : uint8_t {
+  kLiteral = 0,
+  kCopy1ByteOffset = 1,
+  kCopy2ByteOffset = 2,
+  kCopy4ByteOffset = 3
+};
+
+FORCE_INLINE uint32_t load32(const uint8_t *p) {
+  uint32_t v;
+  __builtin_memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+FORCE_INLINE uint32_t hash(uint32_t bytes, uint32_t shift) {
+  return (bytes * 0x1e35a7bd) >> (32 - shift);
+}
+
+} // namespace
+
+uint8_t *Compressor::emit_literal(uint8_t *op, const uint8_t *literal,
+                                  uint32_t len) {
+  auto n = len - 1;
+  if (n < kMaxLiteralTagLen) {
+    *op++ = kLiteral | (n << 2);
+  } else {
+    auto *tag = op++;
+    uint32_t count = 0;
+    while (n) {
+      *op++ = n & 0xff;
+      n >>= 8;
+      count++;
+    }
+    *tag = kLiteral | ((kMaxLiteralTagLen - 1 + count) << 2);
+  }
+  memcpy(op, literal, len);
+  return op + len;
+}
+
+uint8_t *Compressor::emit_copy(uint8_t *op, uint32_t offset, uint32_t len) {
+  // Copies of 2-byte offsets carry up to 64 bytes; the split keeps the rest
+  // at kMinMatchLen or above.
+  while (len >= 68) {
+    *op++ = kCopy2ByteOffset | (63 << 2);
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    len -= 64;
+  }
+  if (len > 64) {
+    *op++ = kCopy2ByteOffset | (59 << 2);
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    len -= 60;
+  }
+  if (len < 12 && offset < 2048) {
+    *op++ = kCopy1ByteOffset | ((len - 4) << 2) | ((offset >> 8) << 5);
+    *op++ = offset & 0xff;
+  } else {
+    *op++ = kCopy2ByteOffset | ((len - 1) << 2);
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+  }
+  return op;
+}
+
+uint32_t Compressor::compress(const uint8_t *src, uint32_t len, uint8_t *dst) {
+  assert(len <= kMaxInputLen);
+  auto *op = dst;
+  auto n = len;
+  do {
+    *op++ = (n & 0x7f) | ((n > 0x7f) << 7);
+    n >>= 7;
+  } while (n);
+
+  uint32_t next_emit = 0;
+  if (len >= kMinMatchLen + kInputMarginBytes) {
+    uint16_t table[kHashTableSize] = {};
+    auto ip_limit = len - kInputMarginBytes;
+    uint32_t ip = 1;
+    while (ip < ip_limit) {
+      auto bytes = load32(src + ip);
+      auto &slot = table[hash(bytes, kHashTableShift)];
+      uint32_t candidate = slot;
+      slot = ip;
+      if (candidate >= ip || load32(src + candidate) != bytes) {
+        // Skips faster through incompressible data.
+        ip += 1 + ((ip - next_emit) >> 5);
+        continue;
+      }
+      if (ip > next_emit) {
+        op = emit_literal(op, src + next_emit, ip - next_emit);
+      }
+      auto match_len = kMinMatchLen;
+      while (ip + match_len < len &&
+             src[candidate + match_len] == src[ip + match_len]) {
+        match_len++;
+      }
+      op = emit_copy(op, ip - candidate, match_len);
+      ip += match_len;
+      next_emit = ip;
+      if (ip < ip_limit) {
+        table[hash(load32(src + ip - 1), kHashTableShift)] = ip - 1;
+      }
+    }
+  }
+  if (next_emit < len) {
+    op = emit_literal(op, src + next_emit, len - next_emit);
+  }
+  return op - dst;
+}
+
+bool Compressor::decompress(const uint8_t *src, uint32_t len, uint8_t *dst,
+                            uint32_t dst_capacity, uint32_t *dst_len) {
+  const auto *ip = src;
+  const auto *ip_end = src + len;
+  uint32_t expected_len = 0;
+  for (uint32_t shift = 0;; shift += 7) {
+    if (unlikely(ip == ip_end || shift > 28)) {
+      return false;
+    }
+    auto byte = *ip++;
+    expected_len |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  if (unlikely(expected_len > dst_capacity)) {
+    return false;
+  }
+
+  uint32_t op = 0;
+  while (ip < ip_end) {
+    auto tag = *ip++;
+    uint32_t offset;
+    uint32_t n;
+    switch (tag & 0x3) {
+    case kLiteral: {
+      n = (tag >> 2) + 1;
+      if (n > kMaxLiteralTagLen) {
+        auto count = n - kMaxLiteralTagLen;
+        if (unlikely(ip + count > ip_end)) {
+          return false;
+        }
+        n = 0;
+        for (uint32_t i = 0; i < count; i++) {
+          n |= static_cast<uint32_t>(ip[i]) << (8 * i);
+        }
+        n++;
+        ip += count;
+      }
+      if (unlikely(ip + n > ip_end || op + n > expected_len)) {
+        return false;
+      }
+      memcpy(dst + op, ip, n);
+      ip += n;
+      op += n;
+      continue;
+    }
+    case kCopy1ByteOffset:
+      if (unlikely(ip + 1 > ip_end)) {
+        return false;
+      }
+      n = ((tag >> 2) & 0x7) + 4;
+      offset = ((tag >> 5) << 8) | ip[0];
+      ip += 1;
+      break;
+    case kCopy2ByteOffset:
+      if (unlikely(ip + 2 > ip_end)) {
+        return false;
+      }
+      n = (tag >> 2) + 1;
+      offset = ip[0] | (static_cast<uint32_t>(ip[1]) << 8);
+      ip += 2;
+      break;
+    default:
+      if (unlikely(ip + 4 > ip_end)) {
+        return false;
+      }
+      n = (tag >> 2) + 1;
+      offset = load32(ip);
+      ip += 4;
+      break;
+    }
+    if (unlikely(!offset || offset > op || op + n > expected_len)) {
+      return false;
+    }
+    if (offset >= n) {
+      memcpy(dst + op, dst + op - offset, n);
+    } else {
+      // Overlapping copy, which repeats the last offset bytes.
+      for (uint32_t i = 0; i < n; i++) {
+        dst[op + i] = dst[op + i - offset];
+      }
+    }
+    op += n;
+  }
+  if (unlikely(op != expected_len)) {
+    return false;
+  }
+  *dst_len = op;
+  return true;
+}
+
+} // namespace far_memory
@@ -9,6 +9,7 @@ extern "C" {
 #include "helpers.hpp"
 #include "manager.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 namespace far_memory {
@@ -91,6 +92,62 @@ void GenericConcurrentHopscotch::forward_get(uint8_t key_len,
   }
 }
 
+void GenericConcurrentHopscotch::_multi_get(uint32_t num_reqs,
+                                            const GetReq *reqs) {
+  ObjectReadReq misses[kMaxMultiBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxMultiBatchSize);
+    // Overlap the cache misses on the buckets of the batch.
+    for (uint32_t i = 0; i < num; i++) {
+      prefetch_bucket(reqs[i].key_len, reqs[i].key);
+    }
+    uint32_t num_misses = 0;
+    for (uint32_t i = 0; i < num; i++) {
+      auto &req = reqs[i];
+      if (__get(req.key_len, req.key, req.val_len, req.val)) {
+        misses[num_misses++] = {.ds_id = ds_id_,
+                                .obj_id_len = req.key_len,
+                                .obj_id = req.key,
+                                .data_len = req.val_len,
+                                .data_buf = req.val};
+      }
+    }
+    if (num_misses) {
+      // Cannot find the keys locally, so forward them to the remote agent at
+      // once.
+      FarMemManagerFactory::get()->read_objects(num_misses, misses);
+      for (uint32_t i = 0; i < num_misses; i++) {
+        auto &miss = misses[i];
+        if (*miss.data_len) {
+          _put(miss.obj_id_len, miss.obj_id, *miss.data_len, miss.data_buf,
+               /* swap_in = */ true);
+        }
+      }
+    }
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+uint32_t GenericConcurrentHopscotch::_multi_put(uint32_t num_reqs,
+                                                const PutReq *reqs) {
+  uint32_t num_existed = 0;
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxMultiBatchSize);
+    for (uint32_t i = 0; i < num; i++) {
+      prefetch_bucket(reqs[i].key_len, reqs[i].key);
+    }
+    for (uint32_t i = 0; i < num; i++) {
+      auto &req = reqs[i];
+      num_existed += _put(req.key_len, req.key, req.val_len, req.val,
+                          /* swap_in = */ false);
+    }
+    reqs += num;
+    num_reqs -= num;
+  }
+  return num_existed;
+}
+
 FORCE_INLINE void *deref(GenericUniquePtr &ptr, bool mut) {
   if (mut) {
     return ptr._deref<true, false>();
@@ -0,0 +1,50 @@
+#include "dataframe_kernels.hpp"
+
+#include <algorithm>
+
+namespace far_memory {
+
+namespace {
+
+DataFrameKernels::Isa detect_isa() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) {
+    return DataFrameKernels::kAVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return DataFrameKernels::kAVX2;
+  }
+  return DataFrameKernels::kScalar;
+}
+
+} // namespace
+
+DataFrameKernels::Isa DataFrameKernels::isa_ = detect_isa();
+
+void DataFrameKernels::set_isa(Isa isa) { isa_ = std::min(isa, detect_isa()); }
+
+FlatGroupIndex::FlatGroupIndex(uint64_t num_rows_hint) {
+  auto num_slots = helpers::round_up_power_of_two(static_cast<uint32_t>(
+      std::clamp(num_rows_hint * 2, kMinNumSlots, kMaxInitialNumSlots)));
+  slots_.resize(num_slots, Slot{0, kEmpty});
+  shift_ = 64 - helpers::bsr_64(num_slots);
+}
+
+void FlatGroupIndex::grow() {
+  std::vector<Slot> old_slots(slots_.size() * 2, Slot{0, kEmpty});
+  std::swap(slots_, old_slots);
+  shift_--;
+  auto mask = slots_.size() - 1;
+  for (auto &old_slot : old_slots) {
+    if (old_slot.group != kEmpty) {
+      auto idx = get_slot_idx(old_slot.hash);
+      while (slots_[idx].group != kEmpty) {
+        idx = (idx + 1) & mask;
+      }
+      slots_[idx] = old_slot;
+    }
+  }
+}
+
+} // namespace far_memory
@@ -132,4 +132,105 @@ void GenericDataFrameVector::flush() {
   }
 }
 
+GenericDataFrameVector::OpCode
+GenericDataFrameVector::get_aggregate_opcode(uint8_t aggregation) {
+  switch (aggregation) {
+  case Max:
+    return AggregateMax;
+  case Min:
+    return AggregateMin;
+  case Median:
+    return AggregateMedian;
+  case Sum:
+    return AggregateSum;
+  case Count:
+    return AggregateCount;
+  case Mean:
+    return AggregateMean;
+  case Var:
+    return AggregateVar;
+  case Std:
+    return AggregateStd;
+  case First:
+    return AggregateFirst;
+  case Last:
+    return AggregateLast;
+  default:
+    BUG();
+  }
+}
+
+DataFrameVector<unsigned long long>
+GenericDataFrameVector::filter(FarMemManager *manager,
+                               const std::vector<DataFramePredicate> &preds,
+                               uint64_t size) {
+  if constexpr (DISABLE_OFFLOAD_FILTER) {
+    return filter_locally(manager, preds, size);
+  } else {
+    return filter_remotely(manager, preds, size);
+  }
+}
+
+DataFrameVector<unsigned long long> GenericDataFrameVector::filter_locally(
+    FarMemManager *manager, const std::vector<DataFramePredicate> &preds,
+    uint64_t size) {
+  constexpr uint64_t kNumElementsPerScope = 1024;
+  std::vector<bool> selected(size, true);
+  for (auto &pred : preds) {
+    pred.eval_locally_(size, &selected);
+  }
+  auto ret = manager->allocate_dataframe_vector<unsigned long long>();
+  DerefScope scope;
+  uint64_t num_selected = 0;
+  for (unsigned long long i = 0; i < size; i++) {
+    if (selected[i]) {
+      if (unlikely(num_selected++ % kNumElementsPerScope == 0)) {
+        scope.renew();
+      }
+      ret.push_back(scope, i);
+    }
+  }
+  return ret;
+}
+
+DataFrameVector<unsigned long long> GenericDataFrameVector::filter_remotely(
+    FarMemManager *manager, const std::vector<DataFramePredicate> &preds,
+    uint64_t size) {
+  BUG_ON(preds.empty() || preds.size() > std::numeric_limits<uint8_t>::max());
+  for (auto &pred : preds) {
+    // Otherwise the server would read past the end of the column.
+    BUG_ON(size > pred.col_->size());
+    pred.col_->flush();
+  }
+  auto ret = manager->allocate_dataframe_vector<unsigned long long>();
+  // Input format:
+  //     |result_ds_id (1B)|size (8B)|num_preds (1B)|preds|
+  // and every predicate is
+  //     |col_ds_id (1B)|dt_id (1B)|cmp (1B)|operand|operand_hi|
+  std::vector<uint8_t> input_data;
+  input_data.push_back(ret.ds_id_);
+  auto *size_ptr = reinterpret_cast<const uint8_t *>(&size);
+  input_data.insert(input_data.end(), size_ptr, size_ptr + sizeof(size));
+  input_data.push_back(preds.size());
+  for (auto &pred : preds) {
+    input_data.push_back(pred.col_->ds_id_);
+    input_data.push_back(pred.dt_id_);
+    input_data.push_back(pred.cmp_);
+    input_data.insert(input_data.end(), pred.operands_.begin(),
+                      pred.operands_.end());
+  }
+  BUG_ON(input_data.size() > std::numeric_limits<uint16_t>::max());
+  uint16_t output_len;
+  uint64_t output_data[2];
+  auto *col = preds.front().col_;
+  col->device_->compute(col->ds_id_, OpCode::Filter, input_data.size(),
+                        input_data.data(), &output_len,
+                        reinterpret_cast<uint8_t *>(output_data));
+  assert(output_len == sizeof(output_data));
+  ret.size_ = output_data[0];
+  ret.remote_vec_capacity_ = output_data[1];
+  ret.expand_no_alloc(ret.remote_vec_capacity_);
+  return ret;
+}
+
 } // namespace far_memory
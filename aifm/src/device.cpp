@@ -1,19 +1,109 @@
 extern "C" {
 #include <net/ip.h>
+#include <runtime/runtime.h>
 #include <runtime/storage.h>
 }
 
 #include "device.hpp"
+#include "hash.hpp"
+#include "internal/ds_info.hpp"
+#include "local_concurrent_hopscotch.hpp"
 #include "object.hpp"
 #include "stats.hpp"
+#include "tcp_channel.hpp"
 
+#include <algorithm>
 #include <cstring>
+#include <limits>
+#include <memory>
 
 namespace far_memory {
 
 FarMemDevice::FarMemDevice(uint64_t far_mem_size, uint32_t prefetch_win_size)
     : far_mem_size_(far_mem_size), prefetch_win_size_(prefetch_win_size) {}
 
+void FarMemDevice::write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                                        const uint8_t *obj_id,
+                                        uint16_t data_len,
+                                        const uint8_t *data_buf,
+                                        uint8_t num_extents,
+                                        const ObjectExtent *extents) {
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+}
+
+void FarMemDevice::read_objects(uint32_t num_reqs,
+                                const ObjectReadReq *reqs) {
+  DeviceReqHandle handles[kMaxBatchSize];
+  DeviceReqHandle *handle_ptrs[kMaxBatchSize];
+  auto max_num = std::min(kMaxBatchSize, get_max_num_outstanding_reqs());
+  while (num_reqs) {
+    auto num = std::min(num_reqs, max_num);
+    for (uint32_t i = 0; i < num; i++) {
+      auto &req = reqs[i];
+      post_read_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                       req.data_buf, &handles[i]);
+      handle_ptrs[i] = &handles[i];
+    }
+    wait(num, handle_ptrs);
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void FarMemDevice::write_objects(uint32_t num_reqs,
+                                 const ObjectWriteReq *reqs) {
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    auto &req = reqs[i];
+    if (req.num_extents) {
+      write_object_extents(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                           req.data_buf, req.num_extents, req.extents);
+    } else {
+      write_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                   req.data_buf);
+    }
+  }
+}
+
+void FarMemDevice::copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                               const uint8_t *from_obj_id,
+                               const uint8_t *to_obj_id, uint16_t data_len,
+                               uint8_t *buf) {
+  read_object(ds_id, obj_id_len, from_obj_id, &data_len, buf);
+  write_object(ds_id, obj_id_len, to_obj_id, data_len, buf);
+}
+
+void FarMemDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                    const uint8_t *obj_id, uint16_t *data_len,
+                                    uint8_t *data_buf,
+                                    DeviceReqHandle *handle) {
+  read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+void FarMemDevice::post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id, uint16_t data_len,
+                                     const uint8_t *data_buf,
+                                     DeviceReqHandle *handle) {
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+bool FarMemDevice::poll(DeviceReqHandle *handle) { return handle->completed; }
+
+void FarMemDevice::wait(uint32_t num_handles,
+                        DeviceReqHandle *const *handles) {
+  uint32_t num_completed = 0;
+  while (num_completed < num_handles) {
+    num_completed = 0;
+    for (uint32_t i = 0; i < num_handles; i++) {
+      num_completed += poll(handles[i]);
+    }
+    if (num_completed < num_handles) {
+      cpu_relax();
+    }
+  }
+}
+
 FakeDevice::FakeDevice(uint64_t far_mem_size)
     : FarMemDevice(far_mem_size, kPrefetchWinSize), server_() {
   server_.construct(kVanillaPtrDSType, kVanillaPtrDSID, sizeof(far_mem_size),
@@ -34,6 +124,23 @@ void FakeDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
   server_.write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
 }
 
+void FakeDevice::write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                                      const uint8_t *obj_id, uint16_t data_len,
+                                      const uint8_t *data_buf,
+                                      uint8_t num_extents,
+                                      const ObjectExtent *extents) {
+  server_.write_object_extents(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                               num_extents, extents);
+}
+
+void FakeDevice::read_objects(uint32_t num_reqs, const ObjectReadReq *reqs) {
+  server_.read_objects(num_reqs, reqs);
+}
+
+void FakeDevice::write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs) {
+  server_.write_objects(num_reqs, reqs);
+}
+
 bool FakeDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
                                const uint8_t *obj_id) {
   return server_.remove_object(ds_id, obj_id_len, obj_id);
@@ -57,9 +164,9 @@ void FakeDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
 // Response:
 //     |Ack (1B)|
 TCPDevice::TCPDevice(netaddr raddr, uint32_t num_connections,
-                     uint64_t far_mem_size)
+                     uint64_t far_mem_size, bool pipelined)
     : FarMemDevice(far_mem_size, kPrefetchWinSize),
-      shared_pool_(num_connections) {
+      num_connections_(num_connections) {
   // Initialize the master connection.
   netaddr laddr = {.ip = MAKE_IP_ADDR(0, 0, 0, 0), .port = 0};
   BUG_ON(tcp_dial(laddr, raddr, &remote_master_) != 0);
@@ -74,7 +181,12 @@ TCPDevice::TCPDevice(netaddr raddr, uint32_t num_connections,
   tcpconn_t *remote_slave;
   for (uint32_t i = 0; i < num_connections; i++) {
     BUG_ON(tcp_dial(laddr, raddr, &remote_slave) != 0);
-    shared_pool_.push(remote_slave);
+    if (pipelined) {
+      _switch_to_protocol_v2(remote_slave);
+      channels_.emplace_back(std::make_unique<TCPChannel>(remote_slave));
+    } else {
+      free_slaves_.push_back(remote_slave);
+    }
   }
 
   construct(kVanillaPtrDSType, kVanillaPtrDSID, sizeof(far_mem_size),
@@ -92,65 +204,191 @@ TCPDevice::~TCPDevice() {
   uint8_t ack;
   helpers::tcp_read_until(remote_master_, &ack, sizeof(ack));
   tcp_close(remote_master_);
-  shared_pool_.for_each([&](auto remote_slave) { tcp_close(remote_slave); });
+  if (channels_.empty()) {
+    for (auto remote_slave : free_slaves_) {
+      tcp_close(remote_slave);
+    }
+  }
+  channels_.clear();
+}
+
+tcpconn_t *TCPDevice::_pop_slave() {
+  slaves_mutex_.Lock();
+  while (free_slaves_.empty()) {
+    slaves_cv_.Wait(&slaves_mutex_);
+  }
+  auto remote_slave = free_slaves_.back();
+  free_slaves_.pop_back();
+  slaves_mutex_.Unlock();
+  return remote_slave;
+}
+
+void TCPDevice::_push_slave(tcpconn_t *remote_slave) {
+  slaves_mutex_.Lock();
+  free_slaves_.push_back(remote_slave);
+  slaves_cv_.Signal();
+  slaves_mutex_.Unlock();
+}
+
+uint32_t TCPDevice::get_max_num_outstanding_reqs() const {
+  return channels_.empty() ? num_connections_ : kMaxBatchSize;
+}
+
+bool TCPDevice::is_poll_blocking() const { return channels_.empty(); }
+
+// Request:
+//     |Opcode = kOpProtocolV2 (1B)|
+// Response:
+//     |Ack (1B)|
+// From then on, the connection carries v2 frames (see TCPChannel).
+void TCPDevice::_switch_to_protocol_v2(tcpconn_t *remote_slave) {
+  helpers::tcp_write_until(remote_slave, &kOpProtocolV2, kOpcodeSize);
+  uint8_t ack;
+  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+}
+
+// Protocol v1 holds a connection from sending the request until receiving its
+// response; protocol v2 pipelines the request on the channel of the core.
+void TCPDevice::_send(const iovec *iov, int iovcnt, uint16_t *resp_len,
+                      uint8_t *resp_buf, DeviceReqHandle *handle) {
+  handle->completed = false;
+  handle->data_len = resp_len;
+  handle->data_buf = resp_buf;
+  if (channels_.empty()) {
+    auto remote_slave = _pop_slave();
+    helpers::tcp_writev_until(remote_slave, iov, iovcnt);
+    handle->ctx = remote_slave;
+  } else {
+    auto *channel = _get_channel();
+    handle->tag = channel->post(iov, iovcnt, resp_len, resp_buf);
+    handle->ctx = channel;
+  }
+}
+
+// The TCP stack offers no non-blocking way of checking for a response, so a
+// protocol v1 request is always reaped blockingly.
+bool TCPDevice::_recv(DeviceReqHandle *handle, bool block, uint8_t *resp) {
+  uint8_t ack;
+  if (!resp) {
+    resp = &ack;
+  }
+  if (channels_.empty()) {
+    auto remote_slave = reinterpret_cast<tcpconn_t *>(handle->ctx);
+    if (handle->data_len) {
+      helpers::tcp_read_until(remote_slave, handle->data_len,
+                              sizeof(*handle->data_len));
+      if (*handle->data_len) {
+        helpers::tcp_read_until(remote_slave, handle->data_buf,
+                                *handle->data_len);
+      }
+    } else {
+      helpers::tcp_read_until(remote_slave, resp, sizeof(*resp));
+    }
+    _push_slave(remote_slave);
+  } else {
+    auto *channel = reinterpret_cast<TCPChannel *>(handle->ctx);
+    if (!channel->complete(handle->tag, block, resp)) {
+      return false;
+    }
+  }
+  handle->completed = true;
+  return true;
+}
+
+TCPChannel *TCPDevice::_get_channel() {
+  return channels_[get_core_num() % channels_.size()].get();
+}
+
+// Same as _call(), but for requests whose response consists of num_resps
+// parts of |data_len (2B)|data_buf (data_len B)|.
+void TCPDevice::_call_vectored(const iovec *iov, int iovcnt, uint32_t num_resps,
+                               uint16_t *const *resp_lens,
+                               uint8_t *const *resp_bufs) {
+  if (channels_.empty()) {
+    auto remote_slave = _pop_slave();
+    helpers::tcp_writev_until(remote_slave, iov, iovcnt);
+    for (uint32_t i = 0; i < num_resps; i++) {
+      helpers::tcp_read_until(remote_slave, resp_lens[i],
+                              sizeof(*resp_lens[i]));
+      if (*resp_lens[i]) {
+        helpers::tcp_read_until(remote_slave, resp_bufs[i], *resp_lens[i]);
+      }
+    }
+    _push_slave(remote_slave);
+  } else {
+    auto *channel = _get_channel();
+    auto tag =
+        channel->post_vectored(iov, iovcnt, num_resps, resp_lens, resp_bufs);
+    uint8_t resp;
+    channel->complete(tag, /* block = */ true, &resp);
+  }
+}
+
+uint8_t TCPDevice::_call(const iovec *iov, int iovcnt, uint16_t *resp_len,
+                         uint8_t *resp_buf) {
+  DeviceReqHandle handle;
+  uint8_t resp;
+  _send(iov, iovcnt, resp_len, resp_buf, &handle);
+  _recv(&handle, /* block = */ true, &resp);
+  return resp;
 }
 
 void TCPDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
                             const uint8_t *obj_id, uint16_t *data_len,
                             uint8_t *data_buf) {
-  auto remote_slave = shared_pool_.pop();
-  _read_object(remote_slave, ds_id, obj_id_len, obj_id, data_len, data_buf);
-  shared_pool_.push(remote_slave);
+  DeviceReqHandle handle;
+  Stats::start_measure_read_object_cycles();
+  _send_read_object_req(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                        &handle);
+  _recv(&handle, /* block = */ true);
+  Stats::finish_measure_read_object_cycles();
 }
 
 void TCPDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
                              const uint8_t *obj_id, uint16_t data_len,
                              const uint8_t *data_buf) {
-  auto remote_slave = shared_pool_.pop();
-  _write_object(remote_slave, ds_id, obj_id_len, obj_id, data_len, data_buf);
-  shared_pool_.push(remote_slave);
-}
-
-bool TCPDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
-                              const uint8_t *obj_id) {
-  auto remote_slave = shared_pool_.pop();
-  auto ret = _remove_object(remote_slave, ds_id, obj_id_len, obj_id);
-  shared_pool_.push(remote_slave);
-
-  return ret;
+  DeviceReqHandle handle;
+  Stats::start_measure_write_object_cycles();
+  _send_write_object_req(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                         &handle);
+  _recv(&handle, /* block = */ true);
+  Stats::finish_measure_write_object_cycles();
 }
 
-void TCPDevice::construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
-                          uint8_t *params) {
-  auto remote_slave = shared_pool_.pop();
-  _construct(remote_slave, ds_type, ds_id, param_len, params);
-  shared_pool_.push(remote_slave);
+void TCPDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id, uint16_t *data_len,
+                                 uint8_t *data_buf, DeviceReqHandle *handle) {
+  _send_read_object_req(ds_id, obj_id_len, obj_id, data_len, data_buf, handle);
+  handle->is_read = true;
+  handle->ds_id = ds_id;
 }
 
-void TCPDevice::destruct(uint8_t ds_id) {
-  auto remote_slave = shared_pool_.pop();
-  _destruct(remote_slave, ds_id);
-  shared_pool_.push(remote_slave);
+void TCPDevice::post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id, uint16_t data_len,
+                                  const uint8_t *data_buf,
+                                  DeviceReqHandle *handle) {
+  _send_write_object_req(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                         handle);
+  handle->is_read = false;
+  handle->ds_id = ds_id;
 }
 
-void TCPDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
-                        const uint8_t *input_buf, uint16_t *output_len,
-                        uint8_t *output_buf) {
-  auto remote_slave = shared_pool_.pop();
-  _compute(remote_slave, ds_id, opcode, input_len, input_buf, output_len,
-           output_buf);
-  shared_pool_.push(remote_slave);
+// Only blocks with protocol v1.
+bool TCPDevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  return _recv(handle, /* block = */ false);
 }
 
 // Request:
 // |Opcode = KOpReadObject(1B) | ds_id(1B) | obj_id_len(1B) | obj_id |
 // Response:
 // |data_len(2B)|data_buf(data_len B)|
-void TCPDevice::_read_object(tcpconn_t *remote_slave, uint8_t ds_id,
-                             uint8_t obj_id_len, const uint8_t *obj_id,
-                             uint16_t *data_len, uint8_t *data_buf) {
-  Stats::start_measure_read_object_cycles();
-  
+void TCPDevice::_send_read_object_req(uint8_t ds_id, uint8_t obj_id_len,
+                                      const uint8_t *obj_id,
+                                      uint16_t *data_len, uint8_t *data_buf,
+                                      DeviceReqHandle *handle) {
   uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
               Object::kMaxObjectIDSize];
 
@@ -161,16 +399,10 @@ void TCPDevice::_read_object(tcpconn_t *remote_slave, uint8_t ds_id,
   memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize], obj_id,
          obj_id_len);
 
-  helpers::tcp_write_until(remote_slave, req,
-                           kOpcodeSize + Object::kDSIDSize +
-                               Object::kIDLenSize + obj_id_len);
-
-  helpers::tcp_read_until(remote_slave, data_len, sizeof(*data_len));
-  if (*data_len) {
-    helpers::tcp_read_until(remote_slave, data_buf, *data_len);
-  }
-
-  Stats::finish_measure_read_object_cycles();
+  iovec iov = {.iov_base = req,
+               .iov_len = kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+                          obj_id_len};
+  _send(&iov, 1, data_len, data_buf, handle);
 }
 
 // Request:
@@ -178,11 +410,11 @@ void TCPDevice::_read_object(tcpconn_t *remote_slave, uint8_t ds_id,
 // |obj_id(obj_id_len B)|data_buf(data_len)|
 // Response:
 // |Ack (1B)|
-void TCPDevice::_write_object(tcpconn_t *remote_slave, uint8_t ds_id,
-                              uint8_t obj_id_len, const uint8_t *obj_id,
-                              uint16_t data_len, const uint8_t *data_buf) {
-  Stats::start_measure_write_object_cycles();
-
+void TCPDevice::_send_write_object_req(uint8_t ds_id, uint8_t obj_id_len,
+                                       const uint8_t *obj_id,
+                                       uint16_t data_len,
+                                       const uint8_t *data_buf,
+                                       DeviceReqHandle *handle) {
   uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
               Object::kDataLenSize + Object::kMaxObjectIDSize + kLargeDataSize];
 
@@ -196,34 +428,228 @@ void TCPDevice::_write_object(tcpconn_t *remote_slave, uint8_t ds_id,
               Object::kDataLenSize],
          obj_id, obj_id_len);
 
+  iovec iov[2];
+  iov[0] = {.iov_base = req,
+            .iov_len = kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+                       Object::kDataLenSize + obj_id_len};
   if (likely(data_len <= kLargeDataSize)) {
-    memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
-                Object::kDataLenSize + obj_id_len],
-           data_buf, data_len);
-    helpers::tcp_write_until(remote_slave, req,
-                             kOpcodeSize + Object::kDSIDSize +
-                                 Object::kIDLenSize + Object::kDataLenSize +
-                                 obj_id_len + data_len);
+    memcpy(&req[iov[0].iov_len], data_buf, data_len);
+    iov[0].iov_len += data_len;
+    _send(iov, 1, nullptr, nullptr, handle);
   } else {
-    helpers::tcp_write2_until(remote_slave, req,
-                              kOpcodeSize + Object::kDSIDSize +
-                                  Object::kIDLenSize + Object::kDataLenSize +
-                                  obj_id_len,
-                              data_buf, data_len);
+    iov[1] = {.iov_base = const_cast<uint8_t *>(data_buf), .iov_len = data_len};
+    _send(iov, 2, nullptr, nullptr, handle);
   }
+}
 
-  uint8_t ack;
-  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+// Request:
+// |Opcode = kOpWriteObjectExtents (1B)|ds_id(1B)|obj_id_len(1B)|data_len(2B)|
+// |num_extents(1B)|obj_id(obj_id_len B)|extents(num_extents * 4B)|
+// |extent data (the data of each extent, in order)|
+// Response:
+// |Ack (1B)|
+void TCPDevice::write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id, uint16_t data_len,
+                                     const uint8_t *data_buf,
+                                     uint8_t num_extents,
+                                     const ObjectExtent *extents) {
+  constexpr uint32_t kHeaderSize = kOpcodeSize + Object::kDSIDSize +
+                                   Object::kIDLenSize + Object::kDataLenSize +
+                                   sizeof(num_extents);
+  uint8_t req[kHeaderSize + Object::kMaxObjectIDSize +
+              std::numeric_limits<decltype(num_extents)>::max() *
+                  sizeof(ObjectExtent) +
+              kLargeDataSize];
+  uint32_t extents_len = 0;
+  for (uint8_t i = 0; i < num_extents; i++) {
+    extents_len += extents[i].len;
+  }
 
+  Stats::start_measure_write_object_cycles();
+  __builtin_memcpy(&req[0], &kOpWriteObjectExtents,
+                   sizeof(kOpWriteObjectExtents));
+  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize], &obj_id_len,
+                   Object::kIDLenSize);
+  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize],
+                   &data_len, Object::kDataLenSize);
+  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+                        Object::kDataLenSize],
+                   &num_extents, sizeof(num_extents));
+  auto len = kHeaderSize;
+  memcpy(&req[len], obj_id, obj_id_len);
+  len += obj_id_len;
+  memcpy(&req[len], extents, num_extents * sizeof(ObjectExtent));
+  len += num_extents * sizeof(ObjectExtent);
+
+  iovec iov[TCPChannel::kMaxNumIovecs];
+  std::unique_ptr<uint8_t[]> gathered;
+  int iovcnt = 1;
+  if (likely(extents_len <= kLargeDataSize)) {
+    for (uint8_t i = 0; i < num_extents; i++) {
+      memcpy(&req[len], data_buf + extents[i].offset, extents[i].len);
+      len += extents[i].len;
+    }
+  } else if (num_extents < TCPChannel::kMaxNumIovecs) {
+    for (uint8_t i = 0; i < num_extents; i++) {
+      iov[iovcnt++] = {
+          .iov_base = const_cast<uint8_t *>(data_buf + extents[i].offset),
+          .iov_len = extents[i].len};
+    }
+  } else {
+    gathered.reset(new uint8_t[extents_len]);
+    auto *cur = gathered.get();
+    for (uint8_t i = 0; i < num_extents; i++) {
+      memcpy(cur, data_buf + extents[i].offset, extents[i].len);
+      cur += extents[i].len;
+    }
+    iov[iovcnt++] = {.iov_base = gathered.get(), .iov_len = extents_len};
+  }
+  iov[0] = {.iov_base = req, .iov_len = len};
+  _call(iov, iovcnt);
   Stats::finish_measure_write_object_cycles();
 }
 
+// Request:
+// |Opcode = kOpReadObjects (1B)|num_objs(2B)|
+// |entries (for each object, |ds_id(1B)|obj_id_len(1B)|max_data_len(2B)|
+//  obj_id(obj_id_len B)|)|
+// Response:
+// |for each object, |data_len(2B)|data_buf(data_len B)||
+// max_data_len bounds the data length, which is known for vanilla pointers.
+void TCPDevice::read_objects(uint32_t num_reqs, const ObjectReadReq *reqs) {
+  constexpr uint32_t kEntryHeaderSize =
+      Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize;
+  uint8_t req[kOpcodeSize + sizeof(uint16_t) +
+              kMaxBatchSize * (kEntryHeaderSize + Object::kMaxObjectIDSize)];
+  uint16_t *resp_lens[kMaxBatchSize];
+  uint8_t *resp_bufs[kMaxBatchSize];
+
+  while (num_reqs) {
+    uint16_t num_objs = std::min(num_reqs, kMaxBatchSize);
+    __builtin_memcpy(&req[0], &kOpReadObjects, sizeof(kOpReadObjects));
+    __builtin_memcpy(&req[kOpcodeSize], &num_objs, sizeof(num_objs));
+    uint32_t len = kOpcodeSize + sizeof(num_objs);
+    for (uint16_t i = 0; i < num_objs; i++) {
+      auto &r = reqs[i];
+      uint16_t max_data_len = (r.ds_id == kVanillaPtrDSID)
+                                  ? *r.data_len
+                                  : Object::kMaxObjectDataSize;
+      __builtin_memcpy(&req[len], &r.ds_id, Object::kDSIDSize);
+      __builtin_memcpy(&req[len + Object::kDSIDSize], &r.obj_id_len,
+                       Object::kIDLenSize);
+      __builtin_memcpy(&req[len + Object::kDSIDSize + Object::kIDLenSize],
+                       &max_data_len, Object::kDataLenSize);
+      memcpy(&req[len + kEntryHeaderSize], r.obj_id, r.obj_id_len);
+      len += kEntryHeaderSize + r.obj_id_len;
+      resp_lens[i] = r.data_len;
+      resp_bufs[i] = r.data_buf;
+    }
+
+    iovec iov = {.iov_base = req, .iov_len = len};
+    _call_vectored(&iov, 1, num_objs, resp_lens, resp_bufs);
+    reqs += num_objs;
+    num_reqs -= num_objs;
+  }
+}
+
+// Request:
+// |Opcode = kOpWriteObjects (1B)|num_objs(2B)|
+// |entries (for each object, |ds_id(1B)|obj_id_len(1B)|data_len(2B)|
+//  num_extents(1B)|obj_id(obj_id_len B)|extents(num_extents * 4B)|)|
+// |payloads (for each object, its data, or the data of each of its extents)|
+// Response:
+// |Ack (1B)|
+void TCPDevice::write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs) {
+  constexpr uint32_t kEntryHeaderSize = Object::kDSIDSize +
+                                        Object::kIDLenSize +
+                                        Object::kDataLenSize + sizeof(uint8_t);
+  std::vector<uint8_t> entries;
+  iovec iov[TCPChannel::kMaxNumIovecs];
+
+  while (num_reqs) {
+    uint16_t num_objs = 0;
+    int iovcnt = 1;
+    entries.resize(kOpcodeSize + sizeof(num_objs));
+    __builtin_memcpy(&entries[0], &kOpWriteObjects, sizeof(kOpWriteObjects));
+    while (num_objs < std::min(num_reqs, kMaxBatchSize)) {
+      auto &req = reqs[num_objs];
+      // Every piece of the payload takes an iovec; objects with too many
+      // extents are written as a whole instead.
+      uint8_t num_extents = req.num_extents;
+      if (num_extents >= TCPChannel::kMaxNumIovecs) {
+        num_extents = 0;
+      }
+      ObjectExtent whole = {.offset = 0, .len = req.data_len};
+      auto num_pieces = num_extents ? num_extents : 1;
+      auto *pieces = num_extents ? req.extents : &whole;
+      if (iovcnt + num_pieces > static_cast<int>(TCPChannel::kMaxNumIovecs)) {
+        break;
+      }
+
+      auto pos = entries.size();
+      entries.resize(pos + kEntryHeaderSize + req.obj_id_len +
+                     num_extents * sizeof(ObjectExtent));
+      auto *entry = &entries[pos];
+      __builtin_memcpy(entry, &req.ds_id, Object::kDSIDSize);
+      __builtin_memcpy(entry + Object::kDSIDSize, &req.obj_id_len,
+                       Object::kIDLenSize);
+      __builtin_memcpy(entry + Object::kDSIDSize + Object::kIDLenSize,
+                       &req.data_len, Object::kDataLenSize);
+      __builtin_memcpy(entry + Object::kDSIDSize + Object::kIDLenSize +
+                           Object::kDataLenSize,
+                       &num_extents, sizeof(num_extents));
+      memcpy(entry + kEntryHeaderSize, req.obj_id, req.obj_id_len);
+      memcpy(entry + kEntryHeaderSize + req.obj_id_len, req.extents,
+             num_extents * sizeof(ObjectExtent));
+      for (uint8_t i = 0; i < num_pieces; i++) {
+        iov[iovcnt++] = {
+            .iov_base = const_cast<uint8_t *>(req.data_buf + pieces[i].offset),
+            .iov_len = pieces[i].len};
+      }
+      num_objs++;
+    }
+    __builtin_memcpy(&entries[kOpcodeSize], &num_objs, sizeof(num_objs));
+
+    iov[0] = {.iov_base = entries.data(), .iov_len = entries.size()};
+    _call(iov, iovcnt);
+    reqs += num_objs;
+    num_reqs -= num_objs;
+  }
+}
+
+// Request:
+// |Opcode = kOpCopyObject (1B)|ds_id(1B)|obj_id_len(1B)|
+// |from_obj_id(obj_id_len B)|to_obj_id(obj_id_len B)|
+// Response:
+// |Ack (1B)|
+void TCPDevice::copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                            const uint8_t *from_obj_id,
+                            const uint8_t *to_obj_id, uint16_t data_len,
+                            uint8_t *buf) {
+  uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+              2 * Object::kMaxObjectIDSize];
+
+  __builtin_memcpy(&req[0], &kOpCopyObject, sizeof(kOpCopyObject));
+  __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
+  __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize], &obj_id_len,
+                   Object::kIDLenSize);
+  auto *obj_ids = &req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize];
+  memcpy(obj_ids, from_obj_id, obj_id_len);
+  memcpy(obj_ids + obj_id_len, to_obj_id, obj_id_len);
+
+  iovec iov = {.iov_base = req,
+               .iov_len = kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+                          2 * obj_id_len};
+  _call(&iov, 1);
+}
+
 // Request:
 // |Opcode = kOpRemoveObject (1B)|ds_id(1B)|obj_id_len(1B)|obj_id(obj_id_len B)|
 // Response:
 // |exists (1B)|
-bool TCPDevice::_remove_object(tcpconn_t *remote_slave, uint64_t ds_id,
-                               uint8_t obj_id_len, const uint8_t *obj_id) {
+bool TCPDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                              const uint8_t *obj_id) {
 
   uint8_t req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
               Object::kMaxObjectIDSize];
@@ -235,12 +661,10 @@ bool TCPDevice::_remove_object(tcpconn_t *remote_slave, uint64_t ds_id,
   memcpy(&req[kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize], obj_id,
          obj_id_len);
 
-  helpers::tcp_write_until(remote_slave, req,
-                           kOpcodeSize + Object::kDSIDSize +
-                               Object::kIDLenSize + obj_id_len);
-
-  bool exists;
-  helpers::tcp_read_until(remote_slave, &exists, sizeof(exists));
+  iovec iov = {.iov_base = req,
+               .iov_len = kOpcodeSize + Object::kDSIDSize + Object::kIDLenSize +
+                          obj_id_len};
+  bool exists = _call(&iov, 1);
 
   return exists;
 }
@@ -250,8 +674,8 @@ bool TCPDevice::_remove_object(tcpconn_t *remote_slave, uint64_t ds_id,
 // |param_len(1B)|params(param_len B)|
 // Response:
 // |Ack (1B)|
-void TCPDevice::_construct(tcpconn_t *remote_slave, uint8_t ds_type,
-                           uint8_t ds_id, uint8_t param_len, uint8_t *params) {
+void TCPDevice::construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                          uint8_t *params) {
   uint8_t req[kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
               sizeof(param_len) +
               std::numeric_limits<decltype(param_len)>::max()];
@@ -266,28 +690,24 @@ void TCPDevice::_construct(tcpconn_t *remote_slave, uint8_t ds_type,
   memcpy(&req[kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
               sizeof(param_len)],
          params, param_len);
-  helpers::tcp_write_until(remote_slave, req,
-                           kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
-                               sizeof(param_len) + param_len);
-
-  uint8_t ack;
-  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+  iovec iov = {.iov_base = req,
+               .iov_len = kOpcodeSize + sizeof(ds_type) + Object::kDSIDSize +
+                          sizeof(param_len) + param_len};
+  _call(&iov, 1);
 }
 
 // Request:
 // |Opcode = kOpDeconstruct (1B)|ds_id(1B)|
 // Response:
 // |Ack (1B)|
-void TCPDevice::_destruct(tcpconn_t *remote_slave, uint8_t ds_id) {
+void TCPDevice::destruct(uint8_t ds_id) {
   uint8_t req[kOpcodeSize + Object::kDSIDSize];
 
   __builtin_memcpy(&req[0], &kOpDeconstruct, sizeof(kOpDeconstruct));
   __builtin_memcpy(&req[kOpcodeSize], &ds_id, Object::kDSIDSize);
 
-  helpers::tcp_write_until(remote_slave, req, kOpcodeSize + Object::kDSIDSize);
-
-  uint8_t ack;
-  helpers::tcp_read_until(remote_slave, &ack, sizeof(ack));
+  iovec iov = {.iov_base = req, .iov_len = kOpcodeSize + Object::kDSIDSize};
+  _call(&iov, 1);
 }
 
 // Request:
@@ -295,9 +715,9 @@ void TCPDevice::_destruct(tcpconn_t *remote_slave, uint8_t ds_id) {
 // |input_buf(input_len)|
 // Response:
 // |output_len(2B)|output_buf(output_len B)|
-void TCPDevice::_compute(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t opcode,
-                         uint16_t input_len, const uint8_t *input_buf,
-                         uint16_t *output_len, uint8_t *output_buf) {
+void TCPDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+                        const uint8_t *input_buf, uint16_t *output_len,
+                        uint8_t *output_buf) {
   assert(input_len <= kMaxComputeDataLen);
   uint8_t req[kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
               +sizeof(input_len) + kLargeDataSize];
@@ -309,33 +729,32 @@ void TCPDevice::_compute(tcpconn_t *remote_slave, uint8_t ds_id, uint8_t opcode,
   __builtin_memcpy(&req[kOpcodeSize + Object::kDSIDSize + sizeof(opcode)],
                    &input_len, sizeof(input_len));
 
+  iovec iov[2];
+  iov[0] = {.iov_base = req,
+            .iov_len = kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
+                       sizeof(input_len)};
+  int iovcnt = 1;
   if (likely(input_len <= kLargeDataSize)) {
-    memcpy(&req[kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-                sizeof(input_len)],
-           input_buf, input_len);
-    helpers::tcp_write_until(remote_slave, req,
-                             kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-                                 sizeof(input_len) + input_len);
+    memcpy(&req[iov[0].iov_len], input_buf, input_len);
+    iov[0].iov_len += input_len;
   } else {
-    helpers::tcp_write2_until(remote_slave, req,
-                              kOpcodeSize + Object::kDSIDSize + sizeof(opcode) +
-                                  sizeof(input_len),
-                              input_buf, input_len);
-  }
-
-  helpers::tcp_read_until(remote_slave, output_len, sizeof(*output_len));
-  if (*output_len) {
-    assert(*output_len <= kMaxComputeDataLen);
-    helpers::tcp_read_until(remote_slave, output_buf, *output_len);
+    iov[iovcnt++] = {.iov_base = const_cast<uint8_t *>(input_buf),
+                     .iov_len = input_len};
   }
+  _call(iov, iovcnt, output_len, output_buf);
+  assert(*output_len <= kMaxComputeDataLen);
 }
 
 RDMADevice::RDMADevice(netaddr raddr, uint32_t num_connections,
-                     uint64_t far_mem_size)
+                     uint64_t far_mem_size, bool shared_cq)
     : TCPDevice(raddr, num_connections, far_mem_size),
-      shared_pool_rdma_queue(NUM_QUEUES) {
+      shared_pool_rdma_queue(NUM_QUEUES), shared_cq_(shared_cq) {
   /* Prepare RDMA client and connect to server. */
-  auto client = start_rdma_client();
+  if (shared_cq_) {
+    num_pollers_ = std::min(static_cast<uint32_t>(runtime_max_cores()),
+                            static_cast<uint32_t>(helpers::kNumCPUs));
+  }
+  auto client = start_rdma_client(num_pollers_);
   assert(client != NULL);
 
   for (int i = 0; i < NUM_QUEUES; i++) {
@@ -343,12 +762,100 @@ RDMADevice::RDMADevice(netaddr raddr, uint32_t num_connections,
     shared_pool_rdma_queue.push(queue);
   }
   this->client = client;
+
+  for (uint32_t i = 0; i < num_pollers_; i++) {
+    pollers_[i].data.thread = rt::Thread([&, i]() { _cq_poller_fn(i); });
+  }
 }
 
 RDMADevice::~RDMADevice() {
+  ACCESS_ONCE(exit_) = true;
+  for (uint32_t i = 0; i < num_pollers_; i++) {
+    auto &poller = pollers_[i].data;
+    poller.spin.Lock();
+    poller.cv.Signal();
+    poller.spin.Unlock();
+    poller.thread.Join();
+  }
   destroy_client(this->client);
 }
 
+rdma_queue_t *RDMADevice::_pop_queue() {
+  // Requesters park while holding a queue in the shared CQ mode, so more of
+  // them than NUM_QUEUES may be in flight; make the extra ones wait.
+  if (shared_cq_) {
+    while (unlikely(num_free_queues_.fetch_sub(1) <= 0)) {
+      num_free_queues_++;
+      thread_yield();
+    }
+  }
+  return shared_pool_rdma_queue.pop();
+}
+
+void RDMADevice::_push_queue(rdma_queue_t *queue) {
+  shared_pool_rdma_queue.push(queue);
+  if (shared_cq_) {
+    num_free_queues_++;
+  }
+}
+
+void RDMADevice::_begin_request(rdma_queue_t *queue) {
+  auto &poller = pollers_[rdma_get_queue_cq_idx(queue)].data;
+  if (poller.num_inflight++ == 0) {
+    poller.spin.Lock();
+    poller.cv.Signal();
+    poller.spin.Unlock();
+  }
+}
+
+void RDMADevice::_wait_completion(rdma_queue_t *queue) {
+  auto &waiter = waiters_[rdma_get_queue_idx(queue)].data;
+  waiter.spin.Lock();
+  while (!waiter.done) {
+    waiter.cv.Wait(&waiter.spin);
+  }
+  waiter.done = false;
+  waiter.spin.Unlock();
+}
+
+bool RDMADevice::_try_complete(rdma_queue_t *queue) {
+  auto &waiter = waiters_[rdma_get_queue_idx(queue)].data;
+  waiter.spin.Lock();
+  bool done = waiter.done;
+  waiter.done = false;
+  waiter.spin.Unlock();
+  return done;
+}
+
+void RDMADevice::_cq_poller_fn(uint32_t cq_idx) {
+  auto &poller = pollers_[cq_idx].data;
+  rdma_queue_t *queues[kCQPollBurstSize];
+
+  while (likely(!ACCESS_ONCE(exit_))) {
+    auto num = rdma_poll_shared_cq(client, cq_idx, queues, kCQPollBurstSize);
+    BUG_ON(num < 0);
+    for (int i = 0; i < num; i++) {
+      auto &waiter = waiters_[rdma_get_queue_idx(queues[i])].data;
+      waiter.spin.Lock();
+      waiter.done = true;
+      waiter.cv.Signal();
+      waiter.spin.Unlock();
+    }
+    if (num) {
+      poller.num_inflight -= num;
+      continue;
+    }
+    poller.spin.Lock();
+    if (!poller.num_inflight && !ACCESS_ONCE(exit_)) {
+      poller.cv.Wait(&poller.spin);
+      poller.spin.Unlock();
+    } else {
+      poller.spin.Unlock();
+      thread_yield();
+    }
+  }
+}
+
 void RDMADevice::write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                                uint16_t data_len, const uint8_t *data_buf) {
   if (ds_id != kVanillaPtrDSID) {
@@ -360,9 +867,81 @@ void RDMADevice::write_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *
   }
 }
 
+void RDMADevice::write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                                      const uint8_t *obj_id, uint16_t data_len,
+                                      const uint8_t *data_buf,
+                                      uint8_t num_extents,
+                                      const ObjectExtent *extents) {
+  if (ds_id != kVanillaPtrDSID) {
+    TCPDevice::write_object_extents(ds_id, obj_id_len, obj_id, data_len,
+                                    data_buf, num_extents, extents);
+    return;
+  }
+  const uint64_t &offset = *(reinterpret_cast<const uint64_t *>(obj_id));
+  assert(obj_id_len == sizeof(decltype(offset)));
+  uint64_t offsets[MAX_BATCH_WRS];
+  uint16_t data_lens[MAX_BATCH_WRS];
+  const uint8_t *data_bufs[MAX_BATCH_WRS];
+  uint32_t num = 0;
+  for (uint8_t i = 0; i < num_extents; i++) {
+    offsets[num] = offset + extents[i].offset;
+    data_lens[num] = extents[i].len;
+    data_bufs[num] = data_buf + extents[i].offset;
+    if (++num == MAX_BATCH_WRS) {
+      _rdma_write_batch(num, offsets, data_lens, data_bufs);
+      num = 0;
+    }
+  }
+  if (num) {
+    _rdma_write_batch(num, offsets, data_lens, data_bufs);
+  }
+}
+
+void RDMADevice::copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                             const uint8_t *from_obj_id,
+                             const uint8_t *to_obj_id, uint16_t data_len,
+                             uint8_t *buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    TCPDevice::copy_object(ds_id, obj_id_len, from_obj_id, to_obj_id, data_len,
+                           buf);
+  } else {
+    FarMemDevice::copy_object(ds_id, obj_id_len, from_obj_id, to_obj_id,
+                              data_len, buf);
+  }
+}
+
+void RDMADevice::construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                           uint8_t *params) {
+  TCPDevice::construct(ds_type, ds_id, param_len, params);
+  if (ds_type != kHashTableDSType) {
+    return;
+  }
+  uint16_t layout_len;
+  uint8_t layout_buf[sizeof(ServerHashTable::RDMALayout)];
+  compute(ds_id, ServerHashTable::kOpGetRDMALayout, 0, nullptr, &layout_len,
+          layout_buf);
+  if (layout_len == sizeof(ServerHashTable::RDMALayout)) {
+    memcpy(&hashtable_layouts_[ds_id], layout_buf, layout_len);
+    one_sided_hashtables_[ds_id] = true;
+  }
+}
+
+void RDMADevice::destruct(uint8_t ds_id) {
+  one_sided_hashtables_[ds_id] = false;
+  TCPDevice::destruct(ds_id);
+}
+
 void RDMADevice::read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id,
                               uint16_t *data_len, uint8_t *data_buf) {
   if (ds_id != kVanillaPtrDSID) {
+    if (one_sided_hashtables_[ds_id]) {
+      if (_rdma_hashtable_get(hashtable_layouts_[ds_id], obj_id_len, obj_id,
+                              data_len, data_buf)) {
+        Stats::inc_one_sided_hashtable_gets(1);
+        return;
+      }
+      Stats::inc_one_sided_hashtable_fallbacks(1);
+    }
     TCPDevice::read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
   } else {
     const uint64_t &offset = *(reinterpret_cast<const uint64_t *>(obj_id));
@@ -371,30 +950,2118 @@ void RDMADevice::read_object(uint8_t ds_id, uint8_t obj_id_len, const uint8_t *o
   }
 }
 
+void RDMADevice::read_objects(uint32_t num_reqs, const ObjectReadReq *reqs) {
+  ObjectReadReq tcp_reqs[kMaxBatchSize];
+  uint32_t num_tcp_reqs = 0;
+  DeviceReqHandle handles[kMaxBatchSize];
+  DeviceReqHandle *handle_ptrs[kMaxBatchSize];
+  uint32_t num_handles = 0;
+
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    auto &req = reqs[i];
+    if (req.ds_id != kVanillaPtrDSID) {
+      tcp_reqs[num_tcp_reqs++] = req;
+      if (num_tcp_reqs == kMaxBatchSize) {
+        TCPDevice::read_objects(num_tcp_reqs, tcp_reqs);
+        num_tcp_reqs = 0;
+      }
+      continue;
+    }
+    post_read_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                     req.data_buf, &handles[num_handles]);
+    handle_ptrs[num_handles] = &handles[num_handles];
+    if (++num_handles == kMaxBatchSize) {
+      wait(num_handles, handle_ptrs);
+      num_handles = 0;
+    }
+  }
+  if (num_tcp_reqs) {
+    TCPDevice::read_objects(num_tcp_reqs, tcp_reqs);
+  }
+  wait(num_handles, handle_ptrs);
+}
+
+void RDMADevice::write_objects(uint32_t num_reqs,
+                               const ObjectWriteReq *reqs) {
+  uint64_t offsets[MAX_BATCH_WRS];
+  uint16_t data_lens[MAX_BATCH_WRS];
+  const uint8_t *data_bufs[MAX_BATCH_WRS];
+  uint32_t num = 0;
+  ObjectWriteReq tcp_reqs[kMaxBatchSize];
+  uint32_t num_tcp_reqs = 0;
+
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    auto &req = reqs[i];
+    if (req.ds_id != kVanillaPtrDSID) {
+      tcp_reqs[num_tcp_reqs++] = req;
+      if (num_tcp_reqs == kMaxBatchSize) {
+        TCPDevice::write_objects(num_tcp_reqs, tcp_reqs);
+        num_tcp_reqs = 0;
+      }
+      continue;
+    }
+    assert(req.obj_id_len == sizeof(uint64_t));
+    auto offset = *(reinterpret_cast<const uint64_t *>(req.obj_id));
+    // A whole object is written as a single extent.
+    ObjectExtent whole = {.offset = 0, .len = req.data_len};
+    auto num_extents = req.num_extents ? req.num_extents : 1;
+    auto *extents = req.num_extents ? req.extents : &whole;
+    for (uint8_t j = 0; j < num_extents; j++) {
+      offsets[num] = offset + extents[j].offset;
+      data_lens[num] = extents[j].len;
+      data_bufs[num] = req.data_buf + extents[j].offset;
+      if (++num == MAX_BATCH_WRS) {
+        _rdma_write_batch(num, offsets, data_lens, data_bufs);
+        num = 0;
+      }
+    }
+  }
+  if (num) {
+    _rdma_write_batch(num, offsets, data_lens, data_bufs);
+  }
+  if (num_tcp_reqs) {
+    TCPDevice::write_objects(num_tcp_reqs, tcp_reqs);
+  }
+}
+
+void RDMADevice::register_local_buffer(uint8_t *buf, uint64_t len) {
+  if (rdma_register_cache(client, buf, len) != 0) {
+    LOG_PRINTF("%s\n", "Warn: fail to register the local cache, falling back "
+                        "to bounce buffers.");
+  }
+}
+
+void RDMADevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id, uint16_t *data_len,
+                                  uint8_t *data_buf, DeviceReqHandle *handle) {
+  if (ds_id != kVanillaPtrDSID) {
+    TCPDevice::post_read_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                                handle);
+    return;
+  }
+  const uint64_t &offset = *(reinterpret_cast<const uint64_t *>(obj_id));
+  assert(obj_id_len == sizeof(decltype(offset)));
+  auto queue = _pop_queue();
+  if (shared_cq_) {
+    _begin_request(queue);
+  }
+  BUG_ON(rdma_post_read(queue, offset, *data_len, data_buf) != 0);
+  *handle = {.completed = false,
+             .is_read = true,
+             .ds_id = ds_id,
+             .ctx = queue,
+             .data_len = data_len,
+             .data_buf = data_buf};
+}
+
+void RDMADevice::post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                   const uint8_t *obj_id, uint16_t data_len,
+                                   const uint8_t *data_buf,
+                                   DeviceReqHandle *handle) {
+  if (ds_id != kVanillaPtrDSID) {
+    TCPDevice::post_write_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                                 handle);
+    return;
+  }
+  const uint64_t &offset = *(reinterpret_cast<const uint64_t *>(obj_id));
+  assert(obj_id_len == sizeof(decltype(offset)));
+  auto queue = _pop_queue();
+  if (shared_cq_) {
+    _begin_request(queue);
+  }
+  BUG_ON(rdma_post_write(queue, offset, data_len, data_buf) != 0);
+  *handle = {.completed = false,
+             .is_read = false,
+             .ds_id = ds_id,
+             .ctx = queue,
+             .data_len = nullptr,
+             .data_buf = nullptr};
+}
+
+bool RDMADevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  if (handle->ds_id != kVanillaPtrDSID) {
+    return TCPDevice::poll(handle);
+  }
+  auto queue = reinterpret_cast<rdma_queue_t *>(handle->ctx);
+  bool done;
+  if (shared_cq_) {
+    done = _try_complete(queue);
+  } else {
+    auto ret = rdma_poll(queue);
+    BUG_ON(ret < 0);
+    done = ret;
+  }
+  if (done) {
+    _push_queue(queue);
+    handle->completed = true;
+  }
+  return handle->completed;
+}
+
 void RDMADevice::_rdma_read(uint64_t offset, uint16_t data_len, uint8_t *data_buf)
 {
-  auto queue = shared_pool_rdma_queue.pop();
+  auto queue = _pop_queue();
 
   Stats::start_measure_read_object_cycles();
-  if (rdma_read(queue, offset, data_len, data_buf) != 0) {
+  if (shared_cq_) {
+    _begin_request(queue);
+    BUG_ON(rdma_post_read(queue, offset, data_len, data_buf) != 0);
+    _wait_completion(queue);
+  } else if (rdma_read(queue, offset, data_len, data_buf) != 0) {
     printf("rdma_read failed, obj_id: %ld\n", offset);
   }
 
   Stats::finish_measure_read_object_cycles();
-  shared_pool_rdma_queue.push(queue);
+  _push_queue(queue);
+}
+
+// Looks up the key in a remote hashtable with one-sided reads only, i.e., reads
+// the neighborhood of its bucket and then the KV pairs that it points to. The
+// server keeps updating the table meanwhile, so the lookup is validated by
+// reading the neighborhood again: the server bumps the timestamp of the bucket
+// whenever it displaces a pair, and clears (or swaps) the pointer of an entry
+// before reusing its KV pair. Values overwritten in place are guarded by the
+// version of their KV pair. Returns false if the lookup kept racing with the
+// server or read a malformed pair, in which case the caller should ask the
+// server instead.
+bool RDMADevice::_rdma_hashtable_get(const ServerHashTable::RDMALayout &layout,
+                                     uint8_t key_len, const uint8_t *key,
+                                     uint16_t *val_len, uint8_t *val) {
+  using BucketEntry = LocalGenericConcurrentHopscotch::BucketEntry;
+  using KVDataHeader = LocalGenericConcurrentHopscotch::KVDataHeader;
+  constexpr uint32_t kNeighborhood = LocalGenericConcurrentHopscotch::kNeighborhood;
+  constexpr uint16_t kNeighborhoodSize = kNeighborhood * sizeof(BucketEntry);
+
+  uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
+  uint64_t bucket_offset =
+      layout.buckets_offset +
+      static_cast<uint64_t>(hash & layout.hash_mask) * sizeof(BucketEntry);
+  alignas(64) uint8_t neighborhood_buf[kNeighborhoodSize];
+  alignas(64) uint8_t validate_buf[kNeighborhoodSize];
+  alignas(64) uint8_t probe_buf[kKVProbeSize];
+  auto *neighborhood = reinterpret_cast<BucketEntry *>(neighborhood_buf);
+  auto *validate = reinterpret_cast<BucketEntry *>(validate_buf);
+
+  for (uint32_t i = 0; i < kMaxOneSidedRetries; i++) {
+    _rdma_read(bucket_offset, kNeighborhoodSize, neighborhood_buf);
+    bool found = false;
+    bool torn = false;
+    uint32_t found_idx = 0;
+    uint32_t bitmap = neighborhood[0].bitmap;
+    while (bitmap && !found && !torn) {
+      auto idx = helpers::bsf_32(bitmap);
+      bitmap ^= (1 << idx);
+      auto ptr = reinterpret_cast<uint64_t>(neighborhood[idx].ptr);
+      if (ptr <= BucketEntry::kBusyPtr || ptr < layout.base_addr) {
+        continue;
+      }
+      auto kv_offset = ptr - layout.base_addr;
+      if (kv_offset + sizeof(KVDataHeader) > layout.end_offset) {
+        continue;
+      }
+      auto probe_len = static_cast<uint16_t>(
+          std::min<uint64_t>(kKVProbeSize, layout.end_offset - kv_offset));
+      _rdma_read(kv_offset, probe_len, probe_buf);
+      auto *header = reinterpret_cast<const KVDataHeader *>(probe_buf);
+      if (header->key_len != key_len) {
+        continue;
+      }
+      if (header->val_len > Object::kMaxObjectDataSize) {
+        return false;
+      }
+      if (header->version & 1) {
+        torn = true;
+        continue;
+      }
+      uint64_t key_pos = sizeof(KVDataHeader) + header->val_len;
+      if (kv_offset + key_pos + key_len > layout.end_offset) {
+        continue;
+      }
+      if (key_pos + key_len <= probe_len) {
+        if (memcmp(probe_buf + key_pos, key, key_len)) {
+          continue;
+        }
+      } else {
+        uint8_t key_buf[std::numeric_limits<uint8_t>::max()];
+        _rdma_read(kv_offset + key_pos, key_len, key_buf);
+        if (memcmp(key_buf, key, key_len)) {
+          continue;
+        }
+      }
+      *val_len = header->val_len;
+      if (key_pos <= probe_len) {
+        memcpy(val, probe_buf + sizeof(KVDataHeader), *val_len);
+      } else {
+        _rdma_read(kv_offset + sizeof(KVDataHeader), *val_len, val);
+      }
+      // The probe is not atomic either, so the version is always read again.
+      KVDataHeader validate_header;
+      _rdma_read(kv_offset, sizeof(validate_header),
+                 reinterpret_cast<uint8_t *>(&validate_header));
+      if (validate_header.version != header->version) {
+        torn = true;
+        continue;
+      }
+      found = true;
+      found_idx = idx;
+    }
+    if (torn) {
+      continue;
+    }
+
+    _rdma_read(bucket_offset, kNeighborhoodSize, validate_buf);
+    if (validate[0].timestamp != neighborhood[0].timestamp) {
+      continue;
+    }
+    if (found) {
+      if (validate[found_idx].ptr == neighborhood[found_idx].ptr &&
+          (validate[0].bitmap & (1 << found_idx))) {
+        return true;
+      }
+    } else if (validate[0].bitmap == neighborhood[0].bitmap) {
+      *val_len = 0;
+      return true;
+    }
+  }
+  return false;
 }
 
 void RDMADevice::_rdma_write(uint64_t offset, uint16_t data_len, const uint8_t *data_buf)
 {
-  auto queue = shared_pool_rdma_queue.pop();
+  auto queue = _pop_queue();
 
   Stats::start_measure_write_object_cycles();
-  if (rdma_write(queue, offset, data_len, data_buf) != 0) {
+  if (shared_cq_) {
+    _begin_request(queue);
+    BUG_ON(rdma_post_write(queue, offset, data_len, data_buf) != 0);
+    _wait_completion(queue);
+  } else if (rdma_write(queue, offset, data_len, data_buf) != 0) {
     printf("rdma_write failed, obj_id: %ld\n", offset);
   }
   Stats::finish_measure_write_object_cycles();
   
-  shared_pool_rdma_queue.push(queue);
+  _push_queue(queue);
+}
+
+void RDMADevice::_rdma_write_batch(uint32_t num, const uint64_t *offsets,
+                                   const uint16_t *data_lens,
+                                   const uint8_t *const *data_bufs) {
+  auto queue = _pop_queue();
+
+  Stats::start_measure_write_object_cycles();
+  if (shared_cq_) {
+    for (uint32_t i = 0; i < num;) {
+      _begin_request(queue);
+      auto posted = rdma_post_write_batch(queue, num - i, offsets + i,
+                                          data_lens + i, data_bufs + i);
+      BUG_ON(posted < 0);
+      _wait_completion(queue);
+      i += posted;
+    }
+  } else if (rdma_write_batch(queue, num, offsets, data_lens, data_bufs) != 0) {
+    printf("rdma_write_batch failed, num: %d\n", num);
+  }
+  Stats::finish_measure_write_object_cycles();
+
+  _push_queue(queue);
+}
+
+CodecBufferPool::~CodecBufferPool() {
+  for (auto &cache : caches_) {
+    for (auto *buf : cache.data.bufs) {
+      delete[] buf;
+    }
+  }
+}
+
+uint8_t *CodecBufferPool::acquire() {
+  preempt_disable();
+  auto &bufs = caches_[get_core_num()].data.bufs;
+  uint8_t *buf = nullptr;
+  if (likely(!bufs.empty())) {
+    buf = bufs.back();
+    bufs.pop_back();
+  }
+  preempt_enable();
+  return buf ? buf : new uint8_t[kBufSize];
+}
+
+void CodecBufferPool::release(uint8_t *buf) {
+  preempt_disable();
+  auto &bufs = caches_[get_core_num()].data.bufs;
+  if (likely(bufs.size() < kMaxNumCachedBufsPerCPU)) {
+    bufs.push_back(buf);
+    buf = nullptr;
+  }
+  preempt_enable();
+  delete[] buf;
+}
+
+CompressedDevice::CompressedDevice(FarMemDevice *device)
+    : FarMemDevice(device->far_mem_size_, device->prefetch_win_size_),
+      device_(device) {}
+
+void CompressedDevice::set_compression(uint8_t ds_id, bool enabled) {
+  BUG_ON(ds_id == kVanillaPtrDSID && enabled);
+  auto &state = ds_states_[ds_id];
+  state.num_misses = 0;
+  state.num_bypassed_left = 0;
+  ACCESS_ONCE(state.enabled) = enabled;
+}
+
+uint16_t CompressedDevice::encode(uint8_t ds_id, uint16_t data_len,
+                                  const uint8_t *data_buf, uint8_t *buf) {
+  auto &state = ds_states_[ds_id];
+  uint32_t stored_len = 0;
+  // Only takes a bypass that is left, so that racing writers never wrap the
+  // counter around.
+  bool bypassed = false;
+  auto num_bypassed_left = state.num_bypassed_left.load();
+  while (num_bypassed_left && !bypassed) {
+    bypassed = state.num_bypassed_left.compare_exchange_weak(
+        num_bypassed_left, num_bypassed_left - 1);
+  }
+  if (bypassed) {
+    Stats::inc_compression_bypassed_objects(1);
+  } else {
+    unsigned cycles_high_start, cycles_low_start;
+    unsigned cycles_high_end, cycles_low_end;
+    helpers::timer_start(&cycles_high_start, &cycles_low_start);
+    stored_len =
+        kCodecSize + Compressor::compress(data_buf, data_len, buf + kCodecSize);
+    helpers::timer_end(&cycles_high_end, &cycles_low_end);
+    Stats::inc_compress_cycles(
+        helpers::get_elapsed_cycles(cycles_high_start, cycles_low_start,
+                                    cycles_high_end, cycles_low_end));
+    if (stored_len * 100 <= data_len * kMaxStoredPercent) {
+      state.num_misses = 0;
+    } else {
+      stored_len = 0;
+      // Only the writer that reaches the threshold starts the bypass.
+      if (++state.num_misses == kMaxNumMisses) {
+        state.num_misses = 0;
+        state.num_bypassed_left = kNumBypassedObjects;
+      }
+    }
+  }
+
+  if (stored_len) {
+    buf[0] = kSnappy;
+  } else {
+    buf[0] = kRaw;
+    memcpy(buf + kCodecSize, data_buf, data_len);
+    stored_len = kCodecSize + data_len;
+  }
+  Stats::inc_compression_raw_bytes(data_len);
+  Stats::inc_compression_stored_bytes(stored_len);
+  return stored_len;
+}
+
+void CompressedDevice::decode(const uint8_t *buf, uint16_t stored_len,
+                              uint16_t *data_len, uint8_t *data_buf) {
+  if (!stored_len) { // Not found.
+    *data_len = 0;
+    return;
+  }
+  if (buf[0] == kRaw) {
+    *data_len = stored_len - kCodecSize;
+    memcpy(data_buf, buf + kCodecSize, *data_len);
+    return;
+  }
+  BUG_ON(buf[0] != kSnappy);
+  unsigned cycles_high_start, cycles_low_start;
+  unsigned cycles_high_end, cycles_low_end;
+  helpers::timer_start(&cycles_high_start, &cycles_low_start);
+  uint32_t len;
+  BUG_ON(!Compressor::decompress(buf + kCodecSize, stored_len - kCodecSize,
+                                 data_buf, Object::kMaxObjectDataSize, &len));
+  helpers::timer_end(&cycles_high_end, &cycles_low_end);
+  Stats::inc_decompress_cycles(
+      helpers::get_elapsed_cycles(cycles_high_start, cycles_low_start,
+                                  cycles_high_end, cycles_low_end));
+  *data_len = len;
+}
+
+void CompressedDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                   const uint8_t *obj_id, uint16_t *data_len,
+                                   uint8_t *data_buf) {
+  if (!enabled(ds_id)) {
+    device_->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  auto *buf = bufs_.acquire();
+  uint16_t stored_len;
+  device_->read_object(ds_id, obj_id_len, obj_id, &stored_len, buf);
+  decode(buf, stored_len, data_len, data_buf);
+  bufs_.release(buf);
+}
+
+void CompressedDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                    const uint8_t *obj_id, uint16_t data_len,
+                                    const uint8_t *data_buf) {
+  if (!enabled(ds_id)) {
+    device_->write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  auto *buf = bufs_.acquire();
+  auto stored_len = encode(ds_id, data_len, data_buf, buf);
+  device_->write_object(ds_id, obj_id_len, obj_id, stored_len, buf);
+  bufs_.release(buf);
+}
+
+void CompressedDevice::write_object_extents(
+    uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id, uint16_t data_len,
+    const uint8_t *data_buf, uint8_t num_extents, const ObjectExtent *extents) {
+  if (!enabled(ds_id)) {
+    device_->write_object_extents(ds_id, obj_id_len, obj_id, data_len,
+                                  data_buf, num_extents, extents);
+    return;
+  }
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+}
+
+void CompressedDevice::read_objects(uint32_t num_reqs,
+                                    const ObjectReadReq *reqs) {
+  ObjectReadReq inner_reqs[kMaxBatchSize];
+  uint16_t stored_lens[kMaxBatchSize];
+  uint8_t *bufs[kMaxBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxBatchSize);
+    for (uint32_t i = 0; i < num; i++) {
+      inner_reqs[i] = reqs[i];
+      bufs[i] = nullptr;
+      if (enabled(reqs[i].ds_id)) {
+        bufs[i] = bufs_.acquire();
+        inner_reqs[i].data_len = &stored_lens[i];
+        inner_reqs[i].data_buf = bufs[i];
+      }
+    }
+    device_->read_objects(num, inner_reqs);
+    for (uint32_t i = 0; i < num; i++) {
+      if (bufs[i]) {
+        decode(bufs[i], stored_lens[i], reqs[i].data_len, reqs[i].data_buf);
+        bufs_.release(bufs[i]);
+      }
+    }
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void CompressedDevice::write_objects(uint32_t num_reqs,
+                                     const ObjectWriteReq *reqs) {
+  ObjectWriteReq inner_reqs[kMaxBatchSize];
+  uint8_t *bufs[kMaxBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxBatchSize);
+    for (uint32_t i = 0; i < num; i++) {
+      inner_reqs[i] = reqs[i];
+      bufs[i] = nullptr;
+      if (enabled(reqs[i].ds_id)) {
+        bufs[i] = bufs_.acquire();
+        inner_reqs[i].data_len =
+            encode(reqs[i].ds_id, reqs[i].data_len, reqs[i].data_buf, bufs[i]);
+        inner_reqs[i].data_buf = bufs[i];
+        inner_reqs[i].num_extents = 0;
+      }
+    }
+    device_->write_objects(num, inner_reqs);
+    for (uint32_t i = 0; i < num; i++) {
+      if (bufs[i]) {
+        bufs_.release(bufs[i]);
+      }
+    }
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void CompressedDevice::register_local_buffer(uint8_t *buf, uint64_t len) {
+  device_->register_local_buffer(buf, len);
+}
+
+bool CompressedDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id) {
+  return device_->remove_object(ds_id, obj_id_len, obj_id);
+}
+
+void CompressedDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                        const uint8_t *obj_id,
+                                        uint16_t *data_len, uint8_t *data_buf,
+                                        DeviceReqHandle *handle) {
+  if (!enabled(ds_id)) {
+    device_->post_read_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                              handle);
+    return;
+  }
+  read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+void CompressedDevice::post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                         const uint8_t *obj_id,
+                                         uint16_t data_len,
+                                         const uint8_t *data_buf,
+                                         DeviceReqHandle *handle) {
+  if (!enabled(ds_id)) {
+    device_->post_write_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                               handle);
+    return;
+  }
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+bool CompressedDevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  return device_->poll(handle);
+}
+
+uint32_t CompressedDevice::get_max_num_outstanding_reqs() const {
+  return device_->get_max_num_outstanding_reqs();
+}
+
+bool CompressedDevice::is_poll_blocking() const {
+  return device_->is_poll_blocking();
+}
+
+void CompressedDevice::construct(uint8_t ds_type, uint8_t ds_id,
+                                 uint8_t param_len, uint8_t *params) {
+  device_->construct(ds_type, ds_id, param_len, params);
+}
+
+void CompressedDevice::destruct(uint8_t ds_id) {
+  device_->destruct(ds_id);
+  set_compression(ds_id, false);
+}
+
+void CompressedDevice::compute(uint8_t ds_id, uint8_t opcode,
+                               uint16_t input_len, const uint8_t *input_buf,
+                               uint16_t *output_len, uint8_t *output_buf) {
+  device_->compute(ds_id, opcode, input_len, input_buf, output_len,
+                   output_buf);
+}
+
+CompressedCacheDevice::CompressedCacheDevice(FarMemDevice *device,
+                                             uint64_t pool_size)
+    : FarMemDevice(device->far_mem_size_, device->prefetch_win_size_),
+      device_(device), shard_capacity_(pool_size / kNumShards),
+      shards_(new Shard[kNumShards]) {}
+
+uint64_t CompressedCacheDevice::get_obj_id(uint8_t obj_id_len,
+                                           const uint8_t *obj_id) {
+  uint64_t id;
+  assert(obj_id_len == sizeof(id));
+  __builtin_memcpy(&id, obj_id, sizeof(id));
+  return id;
+}
+
+CompressedCacheDevice::Shard &
+CompressedCacheDevice::get_shard(uint64_t obj_id) {
+  return shards_[(obj_id * 0x9e3779b97f4a7c15ULL) >> 58];
+}
+
+void CompressedCacheDevice::put(Shard &shard, uint64_t obj_id,
+                                uint16_t data_len, const uint8_t *data_buf,
+                                bool dirty) {
+  Entry entry = {.stored_len = data_len,
+                 .data_len = data_len,
+                 .compressed = false,
+                 .dirty = dirty};
+  auto *buf = bufs_.acquire();
+  auto compressed_len = Compressor::compress(data_buf, data_len, buf);
+  if (compressed_len * 100 <= data_len * kMaxStoredPercent) {
+    entry.stored_len = compressed_len;
+    entry.compressed = true;
+    data_buf = buf;
+  }
+  entry.data.reset(new uint8_t[entry.stored_len]);
+  memcpy(entry.data.get(), data_buf, entry.stored_len);
+  bufs_.release(buf);
+
+  erase(shard, obj_id, /* write_back = */ false);
+  shard.lru.push_front(obj_id);
+  entry.lru_iter = shard.lru.begin();
+  shard.size += entry.stored_len + kEntryOverhead;
+  shard.entries.emplace(obj_id, std::move(entry));
+  while (shard.size > shard_capacity_) {
+    erase(shard, shard.lru.back(), /* write_back = */ true);
+  }
+}
+
+void CompressedCacheDevice::erase(Shard &shard, uint64_t obj_id,
+                                  bool write_back) {
+  auto iter = shard.entries.find(obj_id);
+  if (iter == shard.entries.end()) {
+    return;
+  }
+  auto &entry = iter->second;
+  if (write_back && entry.dirty) {
+    const uint8_t *data_buf = entry.data.get();
+    uint8_t *buf = nullptr;
+    if (entry.compressed) {
+      buf = bufs_.acquire();
+      uint32_t len;
+      BUG_ON(!Compressor::decompress(entry.data.get(), entry.stored_len, buf,
+                                     entry.data_len, &len));
+      data_buf = buf;
+    }
+    device_->write_object(kVanillaPtrDSID, sizeof(obj_id),
+                          reinterpret_cast<const uint8_t *>(&obj_id),
+                          entry.data_len, data_buf);
+    if (buf) {
+      bufs_.release(buf);
+    }
+    Stats::inc_compressed_cache_write_backs(1);
+  }
+  shard.size -= entry.stored_len + kEntryOverhead;
+  shard.lru.erase(entry.lru_iter);
+  shard.entries.erase(iter);
+}
+
+bool CompressedCacheDevice::get(uint64_t obj_id, uint16_t *data_len,
+                                uint8_t *data_buf) {
+  auto &shard = get_shard(obj_id);
+  shard.mutex.Lock();
+  auto guard = helpers::finally([&]() { shard.mutex.Unlock(); });
+  auto iter = shard.entries.find(obj_id);
+  if (iter == shard.entries.end()) {
+    Stats::inc_compressed_cache_misses(1);
+    return false;
+  }
+  auto &entry = iter->second;
+  if (entry.compressed) {
+    uint32_t len;
+    BUG_ON(!Compressor::decompress(entry.data.get(), entry.stored_len,
+                                   data_buf, entry.data_len, &len));
+  } else {
+    memcpy(data_buf, entry.data.get(), entry.data_len);
+  }
+  *data_len = entry.data_len;
+  shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru_iter);
+  Stats::inc_compressed_cache_hits(1);
+  return true;
+}
+
+void CompressedCacheDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                        const uint8_t *obj_id,
+                                        uint16_t *data_len,
+                                        uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID ||
+      !get(get_obj_id(obj_id_len, obj_id), data_len, data_buf)) {
+    device_->read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  }
+}
+
+void CompressedCacheDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                         const uint8_t *obj_id,
+                                         uint16_t data_len,
+                                         const uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    device_->write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  auto id = get_obj_id(obj_id_len, obj_id);
+  auto &shard = get_shard(id);
+  shard.mutex.Lock();
+  auto guard = helpers::finally([&]() { shard.mutex.Unlock(); });
+  if (unlikely(data_len + kEntryOverhead > shard_capacity_)) {
+    erase(shard, id, /* write_back = */ false);
+    device_->write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  put(shard, id, data_len, data_buf, /* dirty = */ true);
+}
+
+void CompressedCacheDevice::write_object_extents(
+    uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id, uint16_t data_len,
+    const uint8_t *data_buf, uint8_t num_extents, const ObjectExtent *extents) {
+  if (ds_id != kVanillaPtrDSID) {
+    device_->write_object_extents(ds_id, obj_id_len, obj_id, data_len,
+                                  data_buf, num_extents, extents);
+    return;
+  }
+  // The data outside of the extents is up to date as well.
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+}
+
+void CompressedCacheDevice::read_objects(uint32_t num_reqs,
+                                         const ObjectReadReq *reqs) {
+  ObjectReadReq misses[kMaxBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxBatchSize);
+    uint32_t num_misses = 0;
+    for (uint32_t i = 0; i < num; i++) {
+      auto &req = reqs[i];
+      if (req.ds_id != kVanillaPtrDSID ||
+          !get(get_obj_id(req.obj_id_len, req.obj_id), req.data_len,
+               req.data_buf)) {
+        misses[num_misses++] = req;
+      }
+    }
+    if (num_misses) {
+      device_->read_objects(num_misses, misses);
+    }
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void CompressedCacheDevice::write_objects(uint32_t num_reqs,
+                                          const ObjectWriteReq *reqs) {
+  ObjectWriteReq others[kMaxBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxBatchSize);
+    uint32_t num_others = 0;
+    for (uint32_t i = 0; i < num; i++) {
+      auto &req = reqs[i];
+      if (req.ds_id == kVanillaPtrDSID) {
+        write_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                     req.data_buf);
+      } else {
+        others[num_others++] = req;
+      }
+    }
+    if (num_others) {
+      device_->write_objects(num_others, others);
+    }
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void CompressedCacheDevice::register_local_buffer(uint8_t *buf, uint64_t len) {
+  device_->register_local_buffer(buf, len);
+}
+
+void CompressedCacheDevice::cache_clean_object(uint8_t ds_id,
+                                               uint8_t obj_id_len,
+                                               const uint8_t *obj_id,
+                                               uint16_t data_len,
+                                               const uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    device_->cache_clean_object(ds_id, obj_id_len, obj_id, data_len,
+                                data_buf);
+    return;
+  }
+  auto id = get_obj_id(obj_id_len, obj_id);
+  auto &shard = get_shard(id);
+  shard.mutex.Lock();
+  auto guard = helpers::finally([&]() { shard.mutex.Unlock(); });
+  // Objects that are swapped in off the pool stay in it.
+  if (shard.entries.count(id) ||
+      unlikely(data_len + kEntryOverhead > shard_capacity_)) {
+    return;
+  }
+  put(shard, id, data_len, data_buf, /* dirty = */ false);
+}
+
+bool CompressedCacheDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                          const uint8_t *obj_id) {
+  if (ds_id == kVanillaPtrDSID) {
+    auto id = get_obj_id(obj_id_len, obj_id);
+    auto &shard = get_shard(id);
+    shard.mutex.Lock();
+    erase(shard, id, /* write_back = */ false);
+    shard.mutex.Unlock();
+  }
+  return device_->remove_object(ds_id, obj_id_len, obj_id);
+}
+
+void CompressedCacheDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                             const uint8_t *obj_id,
+                                             uint16_t *data_len,
+                                             uint8_t *data_buf,
+                                             DeviceReqHandle *handle) {
+  if (ds_id != kVanillaPtrDSID) {
+    device_->post_read_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                              handle);
+    return;
+  }
+  read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+void CompressedCacheDevice::post_write_object(uint8_t ds_id,
+                                              uint8_t obj_id_len,
+                                              const uint8_t *obj_id,
+                                              uint16_t data_len,
+                                              const uint8_t *data_buf,
+                                              DeviceReqHandle *handle) {
+  if (ds_id != kVanillaPtrDSID) {
+    device_->post_write_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                               handle);
+    return;
+  }
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+bool CompressedCacheDevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  return device_->poll(handle);
+}
+
+uint32_t CompressedCacheDevice::get_max_num_outstanding_reqs() const {
+  return device_->get_max_num_outstanding_reqs();
+}
+
+bool CompressedCacheDevice::is_poll_blocking() const {
+  return device_->is_poll_blocking();
+}
+
+void CompressedCacheDevice::construct(uint8_t ds_type, uint8_t ds_id,
+                                      uint8_t param_len, uint8_t *params) {
+  device_->construct(ds_type, ds_id, param_len, params);
+}
+
+void CompressedCacheDevice::destruct(uint8_t ds_id) {
+  device_->destruct(ds_id);
+}
+
+void CompressedCacheDevice::compute(uint8_t ds_id, uint8_t opcode,
+                                    uint16_t input_len,
+                                    const uint8_t *input_buf,
+                                    uint16_t *output_len,
+                                    uint8_t *output_buf) {
+  device_->compute(ds_id, opcode, input_len, input_buf, output_len,
+                   output_buf);
+}
+
+StorageDevice::StorageDevice(BlockStore *store, uint64_t far_mem_size)
+    : FarMemDevice(far_mem_size, kPrefetchWinSize), store_(store), server_(),
+      block_size_(store->get_block_size()),
+      open_buf_(new uint8_t[kSegmentSize]),
+      sealing_buf_(new uint8_t[kSegmentSize]) {
+  BUG_ON(block_size_ > kMaxBlockSize || kSegmentSize % block_size_);
+  blocks_per_segment_ = kSegmentSize / block_size_;
+  uint64_t num_segments = store_->get_num_blocks() / blocks_per_segment_;
+  BUG_ON(num_segments * kSegmentSize <
+         far_mem_size / 100 * (100 + kOverProvisionPercent) +
+             kMinNumFreeSegments * kSegmentSize);
+  segments_.resize(num_segments);
+  for (uint32_t i = num_segments - 1; i > 0; i--) {
+    segments_[i].free = true;
+    free_segments_.push_back(i);
+  }
+  open_segment_ = 0;
+  cleaner_ = rt::Thread([&]() { cleaner_fn(); });
+}
+
+StorageDevice::~StorageDevice() {
+  mutex_.Lock();
+  exit_ = true;
+  cleaner_cv_.Signal();
+  mutex_.Unlock();
+  cleaner_.Join();
+}
+
+void StorageDevice::append(uint64_t obj_id, uint16_t data_len,
+                           const uint8_t *data_buf) {
+  auto record_size = get_record_size(data_len);
+  make_room(record_size, /* by_cleaner = */ false);
+  auto &segment = segments_[open_segment_];
+  auto offset = segment.used_bytes;
+  RecordHeader header = {.obj_id = obj_id, .data_len = data_len};
+  memcpy(&open_buf_[offset], &header, sizeof(header));
+  memcpy(&open_buf_[offset + sizeof(header)], data_buf, data_len);
+  segment.used_bytes += record_size;
+  segment.live_bytes += record_size;
+
+  Location loc = {
+      .segment = open_segment_, .offset = offset, .data_len = data_len};
+  auto [iter, inserted] = index_.try_emplace(obj_id, loc);
+  if (!inserted) {
+    release(iter->second);
+    iter->second = loc;
+  }
+}
+
+void StorageDevice::make_room(uint32_t record_size, bool by_cleaner) {
+  auto min_num_free = by_cleaner ? 1 : kNumReservedSegments + 1;
+  while (segments_[open_segment_].used_bytes + record_size > kSegmentSize) {
+    if (free_segments_.size() < min_num_free) {
+      // Cleaning a segment takes at most one free segment before freeing it.
+      BUG_ON(by_cleaner);
+      cleaner_cv_.Signal();
+      log_cv_.Wait(&mutex_);
+    } else if (sealing_segment_) {
+      log_cv_.Wait(&mutex_);
+    } else {
+      seal();
+    }
+  }
+}
+
+void StorageDevice::release(const Location &loc) {
+  auto &segment = segments_[loc.segment];
+  segment.live_bytes -= get_record_size(loc.data_len);
+  if (!segment.live_bytes && loc.segment != open_segment_ &&
+      loc.segment != sealing_segment_) {
+    free_segment(loc.segment);
+  }
+}
+
+void StorageDevice::free_segment(uint32_t segment) {
+  auto &s = segments_[segment];
+  s.used_bytes = 0;
+  s.epoch++;
+  s.free = true;
+  free_segments_.push_back(segment);
+  log_cv_.SignalAll();
+}
+
+void StorageDevice::seal() {
+  auto sealed = open_segment_;
+  open_segment_ = free_segments_.back();
+  free_segments_.pop_back();
+  segments_[open_segment_].free = false;
+  if (free_segments_.size() < kMinNumFreeSegments) {
+    cleaner_cv_.Signal();
+  }
+  if (!segments_[sealed].live_bytes) {
+    free_segment(sealed);
+    return;
+  }
+
+  sealing_segment_ = sealed;
+  std::swap(open_buf_, sealing_buf_);
+  auto num_blocks =
+      (segments_[sealed].used_bytes + block_size_ - 1) / block_size_;
+  mutex_.Unlock();
+  store_->write(static_cast<uint64_t>(sealed) * blocks_per_segment_,
+                num_blocks, sealing_buf_.get());
+  mutex_.Lock();
+  Stats::inc_storage_segment_writes(1);
+  sealing_segment_.reset();
+  if (!segments_[sealed].live_bytes) {
+    free_segment(sealed);
+  }
+  log_cv_.SignalAll();
+}
+
+void StorageDevice::cleaner_fn() {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[kSegmentSize]);
+  mutex_.Lock();
+  while (true) {
+    while (!exit_ && free_segments_.size() >= kMinNumFreeSegments) {
+      cleaner_cv_.Wait(&mutex_);
+    }
+    if (exit_) {
+      break;
+    }
+    clean(buf.get());
+  }
+  mutex_.Unlock();
+}
+
+void StorageDevice::clean(uint8_t *buf) {
+  uint32_t victim = open_segment_;
+  for (uint32_t i = 0; i < segments_.size(); i++) {
+    if (!segments_[i].free && i != open_segment_ && i != sealing_segment_ &&
+        (victim == open_segment_ ||
+         segments_[i].live_bytes < segments_[victim].live_bytes)) {
+      victim = i;
+    }
+  }
+  // The log is over-provisioned, so some segment must have dead records.
+  BUG_ON(victim == open_segment_ ||
+         segments_[victim].live_bytes == segments_[victim].used_bytes);
+
+  // The victim may be freed and reused whenever mutex_ is dropped, after which
+  // its records are left alone.
+  auto used_bytes = segments_[victim].used_bytes;
+  auto epoch = segments_[victim].epoch;
+  mutex_.Unlock();
+  store_->read(static_cast<uint64_t>(victim) * blocks_per_segment_,
+               (used_bytes + block_size_ - 1) / block_size_, buf);
+  mutex_.Lock();
+
+  auto is_live = [&](const RecordHeader &header, uint32_t offset) {
+    if (segments_[victim].epoch != epoch) {
+      return false;
+    }
+    auto iter = index_.find(header.obj_id);
+    return iter != index_.end() && iter->second.segment == victim &&
+           iter->second.offset == offset;
+  };
+  for (uint32_t offset = 0; offset < used_bytes;) {
+    RecordHeader header;
+    memcpy(&header, &buf[offset], sizeof(header));
+    auto record_size = get_record_size(header.data_len);
+    if (is_live(header, offset)) {
+      make_room(record_size, /* by_cleaner = */ true);
+      // Checked again, as make_room() may have dropped mutex_.
+      if (is_live(header, offset)) {
+        append(header.obj_id, header.data_len, &buf[offset + sizeof(header)]);
+        Stats::inc_storage_cleaned_bytes(record_size);
+      }
+    }
+    offset += record_size;
+  }
+  // Its last live record has been appended again.
+  BUG_ON(segments_[victim].epoch == epoch);
+}
+
+void StorageDevice::read_vanilla(uint64_t obj_id, uint16_t *data_len,
+                                 uint8_t *data_buf) {
+  while (true) {
+    mutex_.Lock();
+    auto iter = index_.find(obj_id);
+    BUG_ON(iter == index_.end());
+    auto loc = iter->second;
+    *data_len = loc.data_len;
+    if (loc.segment == open_segment_ || loc.segment == sealing_segment_) {
+      auto &buf = (loc.segment == open_segment_) ? open_buf_ : sealing_buf_;
+      memcpy(data_buf, &buf[loc.offset + sizeof(RecordHeader)], loc.data_len);
+      mutex_.Unlock();
+      return;
+    }
+    auto epoch = segments_[loc.segment].epoch;
+    mutex_.Unlock();
+
+    auto first_block = loc.offset / block_size_;
+    auto last_block =
+        (loc.offset + get_record_size(loc.data_len) - 1) / block_size_;
+    auto *buf = bufs_.acquire();
+    store_->read(static_cast<uint64_t>(loc.segment) * blocks_per_segment_ +
+                     first_block,
+                 last_block - first_block + 1, buf);
+    auto *record = buf + loc.offset % block_size_;
+    assert(reinterpret_cast<RecordHeader *>(record)->obj_id == obj_id);
+    memcpy(data_buf, record + sizeof(RecordHeader), loc.data_len);
+    bufs_.release(buf);
+
+    // The record stays in place until its segment is freed and reused.
+    mutex_.Lock();
+    bool valid = (segments_[loc.segment].epoch == epoch);
+    mutex_.Unlock();
+    if (likely(valid)) {
+      return;
+    }
+  }
+}
+
+void StorageDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                const uint8_t *obj_id, uint16_t *data_len,
+                                uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    server_.read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  read_vanilla(*reinterpret_cast<const uint64_t *>(obj_id), data_len,
+               data_buf);
+}
+
+void StorageDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id, uint16_t data_len,
+                                 const uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    server_.write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+    return;
+  }
+  mutex_.Lock();
+  append(*reinterpret_cast<const uint64_t *>(obj_id), data_len, data_buf);
+  mutex_.Unlock();
+}
+
+bool StorageDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id) {
+  if (ds_id != kVanillaPtrDSID) {
+    return server_.remove_object(ds_id, obj_id_len, obj_id);
+  }
+  mutex_.Lock();
+  auto guard = helpers::finally([&]() { mutex_.Unlock(); });
+  auto iter = index_.find(*reinterpret_cast<const uint64_t *>(obj_id));
+  if (iter == index_.end()) {
+    return false;
+  }
+  release(iter->second);
+  index_.erase(iter);
+  return true;
+}
+
+void StorageDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id,
+                                     uint16_t *data_len, uint8_t *data_buf,
+                                     DeviceReqHandle *handle) {
+  if (ds_id != kVanillaPtrDSID) {
+    FarMemDevice::post_read_object(ds_id, obj_id_len, obj_id, data_len,
+                                   data_buf, handle);
+    return;
+  }
+  auto id = *reinterpret_cast<const uint64_t *>(obj_id);
+  auto *inflight = new InflightRead();
+  inflight->done = false;
+  handle->completed = false;
+  handle->is_read = true;
+  handle->ds_id = ds_id;
+  handle->ctx = inflight;
+  handle->data_len = data_len;
+  handle->data_buf = data_buf;
+  rt::Spawn([this, id, data_len, data_buf, inflight]() {
+    read_vanilla(id, data_len, data_buf);
+    inflight->done.store(true, std::memory_order_release);
+  });
+}
+
+bool StorageDevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  auto *inflight = reinterpret_cast<InflightRead *>(handle->ctx);
+  if (!inflight->done.load(std::memory_order_acquire)) {
+    // Lets the reader uthreads run.
+    thread_yield();
+    return false;
+  }
+  delete inflight;
+  handle->completed = true;
+  return true;
+}
+
+void StorageDevice::construct(uint8_t ds_type, uint8_t ds_id,
+                              uint8_t param_len, uint8_t *params) {
+  server_.construct(ds_type, ds_id, param_len, params);
+}
+
+void StorageDevice::destruct(uint8_t ds_id) { server_.destruct(ds_id); }
+
+void StorageDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+                            const uint8_t *input_buf, uint16_t *output_len,
+                            uint8_t *output_buf) {
+  server_.compute(ds_id, opcode, input_len, input_buf, output_len,
+                  output_buf);
+}
+
+uint64_t
+TieredDevice::get_far_mem_size(const std::vector<FarMemDevice *> &devices,
+                               Placement placement) {
+  uint64_t num_slots = 0;
+  for (auto *device : devices) {
+    num_slots += device->get_far_mem_size() / kChunkSize;
+  }
+  // Migrations need one spare slot to swap two chunks through.
+  if (placement == Placement::kTiered) {
+    BUG_ON(!num_slots);
+    num_slots--;
+  }
+  return num_slots * kChunkSize;
+}
+
+uint32_t TieredDevice::get_prefetch_win_size(
+    const std::vector<FarMemDevice *> &devices) {
+  uint32_t prefetch_win_size = std::numeric_limits<uint32_t>::max();
+  for (auto *device : devices) {
+    prefetch_win_size =
+        std::min(prefetch_win_size, device->get_prefetch_win_size());
+  }
+  return prefetch_win_size;
+}
+
+TieredDevice::TieredDevice(const std::vector<FarMemDevice *> &devices,
+                           Placement placement)
+    : FarMemDevice(get_far_mem_size(devices, placement),
+                   get_prefetch_win_size(devices)),
+      placement_(placement), num_chunks_(far_mem_size_ / kChunkSize),
+      chunks_(new Chunk[num_chunks_]), free_slots_(devices.size()) {
+  BUG_ON(devices.empty() || devices.size() >= kUnassigned);
+  for (uint32_t i = 0; i < devices.size(); i++) {
+    devices_.emplace_back(devices[i]);
+    auto num_slots = devices[i]->get_far_mem_size() / kChunkSize;
+    for (uint32_t slot = num_slots; slot-- > 0;) {
+      free_slots_[i].push_back(slot);
+    }
+  }
+  memset(ds_devices_, kUnassigned, sizeof(ds_devices_));
+  ds_devices_[kVanillaPtrDSID] = 0;
+  if (placement_ == Placement::kTiered && devices_.size() > 1) {
+    migrator_ = rt::Thread([&]() { migrator_fn(); });
+  }
+}
+
+TieredDevice::~TieredDevice() {
+  ACCESS_ONCE(exit_) = true;
+  if (placement_ == Placement::kTiered && devices_.size() > 1) {
+    migrator_.Join();
+  }
+}
+
+void TieredDevice::place(uint8_t ds_id, uint8_t device) {
+  BUG_ON(ds_id == kVanillaPtrDSID || device >= devices_.size());
+  ds_devices_[ds_id] = device;
+}
+
+std::optional<uint32_t> TieredDevice::allocate_slot(uint8_t device) {
+  slots_spin_.Lock();
+  auto guard = helpers::finally([&]() { slots_spin_.Unlock(); });
+  auto &slots = free_slots_[device];
+  if (slots.empty()) {
+    return std::nullopt;
+  }
+  auto slot = slots.back();
+  slots.pop_back();
+  return slot;
+}
+
+void TieredDevice::free_slot(uint8_t device, uint32_t slot) {
+  slots_spin_.Lock();
+  free_slots_[device].push_back(slot);
+  slots_spin_.Unlock();
+}
+
+void TieredDevice::pin_chunks(uint32_t num, const uint64_t *chunk_idxs) {
+  for (uint32_t i = 0; i < num; i++) {
+    auto chunk_idx = chunk_idxs[i];
+    assert(chunk_idx < num_chunks_);
+    assert(!i || chunk_idxs[i - 1] < chunk_idx);
+    auto &chunk = chunks_[chunk_idx];
+    auto &shard = get_lock_shard(chunk_idx);
+
+    shard.mutex.Lock();
+    while (unlikely(chunk.migrating)) {
+      shard.cv.Wait(&shard.mutex);
+    }
+    if (unlikely(chunk.device == kUnassigned)) {
+      uint8_t first = (placement_ == Placement::kStriped)
+                          ? chunk_idx % devices_.size()
+                          : 0;
+      for (uint8_t j = 0; j < devices_.size(); j++) {
+        uint8_t device = (first + j) % devices_.size();
+        if (auto slot = allocate_slot(device)) {
+          chunk.device = device;
+          chunk.slot = *slot;
+          break;
+        }
+      }
+      // There are as many slots as chunks.
+      BUG_ON(chunk.device == kUnassigned);
+    }
+    chunk.num_inflight++;
+    shard.mutex.Unlock();
+  }
+}
+
+void TieredDevice::unpin_chunks(uint32_t num, const uint64_t *chunk_idxs) {
+  for (uint32_t i = 0; i < num; i++) {
+    auto chunk_idx = chunk_idxs[i];
+    auto &chunk = chunks_[chunk_idx];
+    auto &shard = get_lock_shard(chunk_idx);
+    shard.mutex.Lock();
+    if (--chunk.num_inflight == 0 && unlikely(chunk.migrating)) {
+      shard.cv.SignalAll();
+    }
+    shard.mutex.Unlock();
+  }
+}
+
+FarMemDevice *TieredDevice::route_pinned(uint64_t obj_id,
+                                         std::optional<uint16_t> data_len,
+                                         uint64_t *local_obj_id) {
+  auto chunk_idx = obj_id / kChunkSize;
+  auto offset = obj_id % kChunkSize;
+  auto &chunk = chunks_[chunk_idx];
+  auto &shard = get_lock_shard(chunk_idx);
+
+  shard.mutex.Lock();
+  // The pin keeps the chunk where it is, even if a migration is pending.
+  assert(chunk.num_inflight);
+  if (data_len) {
+    if (placement_ == Placement::kTiered) {
+      // Drops the objects that the new one overwrites, e.g., freed ones.
+      auto end = offset + Object::kHeaderSize + *data_len + sizeof(obj_id);
+      auto iter = chunk.objs.lower_bound(offset);
+      if (iter != chunk.objs.begin()) {
+        auto prev = std::prev(iter);
+        if (prev->first + Object::kHeaderSize + prev->second +
+                sizeof(obj_id) >
+            offset) {
+          chunk.objs.erase(prev);
+        }
+      }
+      while (iter != chunk.objs.end() && iter->first < end) {
+        iter = chunk.objs.erase(iter);
+      }
+      chunk.objs.emplace(offset, *data_len);
+    }
+  } else {
+    ACCESS_ONCE(chunk.heat)++;
+  }
+  auto *device = devices_[chunk.device].get();
+  *local_obj_id = chunk.slot * kChunkSize + offset;
+  shard.mutex.Unlock();
+  return device;
+}
+
+FarMemDevice *TieredDevice::pin_chunk(uint64_t obj_id,
+                                      std::optional<uint16_t> data_len,
+                                      uint64_t *local_obj_id) {
+  uint64_t chunk_idx = obj_id / kChunkSize;
+  pin_chunks(1, &chunk_idx);
+  return route_pinned(obj_id, data_len, local_obj_id);
+}
+
+void TieredDevice::unpin_chunk(uint64_t obj_id) {
+  uint64_t chunk_idx = obj_id / kChunkSize;
+  unpin_chunks(1, &chunk_idx);
+}
+
+template <typename Req>
+uint32_t TieredDevice::get_batch_chunks(uint32_t num_reqs, const Req *reqs,
+                                        uint64_t *chunk_idxs) {
+  uint32_t num = 0;
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    if (reqs[i].ds_id == kVanillaPtrDSID) {
+      chunk_idxs[num++] =
+          *reinterpret_cast<const uint64_t *>(reqs[i].obj_id) / kChunkSize;
+    }
+  }
+  std::sort(chunk_idxs, chunk_idxs + num);
+  return std::unique(chunk_idxs, chunk_idxs + num) - chunk_idxs;
+}
+
+void TieredDevice::migrator_fn() {
+  while (!ACCESS_ONCE(exit_)) {
+    timer_sleep(kMigrationIntervalUs);
+    migrate();
+    for (uint64_t i = 0; i < num_chunks_; i++) {
+      ACCESS_ONCE(chunks_[i].heat) /= 2;
+    }
+  }
+}
+
+void TieredDevice::migrate() {
+  // The chunk states are read racily, which is fine for picking candidates.
+  std::optional<uint64_t> hottest, coldest;
+  for (uint64_t i = 0; i < num_chunks_; i++) {
+    auto &chunk = chunks_[i];
+    auto device = ACCESS_ONCE(chunk.device);
+    auto heat = ACCESS_ONCE(chunk.heat);
+    if (device == kUnassigned) {
+      continue;
+    }
+    if (device != 0) {
+      if (!hottest || heat > chunks_[*hottest].heat) {
+        hottest = i;
+      }
+    } else if (!coldest || heat < chunks_[*coldest].heat) {
+      coldest = i;
+    }
+  }
+  if (!hottest || chunks_[*hottest].heat < kMinPromotionHeat) {
+    return;
+  }
+
+  slots_spin_.Lock();
+  bool fastest_full = free_slots_[0].empty();
+  slots_spin_.Unlock();
+  if (fastest_full) {
+    if (!coldest || chunks_[*coldest].heat * kMigrationHysteresis >=
+                        chunks_[*hottest].heat) {
+      return;
+    }
+    // The spare slot must be on the slower devices then.
+    std::optional<uint8_t> to_device;
+    slots_spin_.Lock();
+    for (uint8_t i = 1; i < devices_.size(); i++) {
+      if (!free_slots_[i].empty()) {
+        to_device = i;
+        break;
+      }
+    }
+    slots_spin_.Unlock();
+    if (!to_device) {
+      return;
+    }
+    move_chunk(*coldest, *to_device);
+  }
+  move_chunk(*hottest, 0);
+}
+
+void TieredDevice::move_chunk(uint64_t chunk_idx, uint8_t to_device) {
+  auto to_slot = allocate_slot(to_device);
+  if (!to_slot) {
+    return;
+  }
+  auto &chunk = chunks_[chunk_idx];
+  auto &shard = get_lock_shard(chunk_idx);
+  shard.mutex.Lock();
+  chunk.migrating = true;
+  while (chunk.num_inflight) {
+    shard.cv.Wait(&shard.mutex);
+  }
+  auto from_device = chunk.device;
+  auto from_slot = chunk.slot;
+  auto objs = chunk.objs;
+  shard.mutex.Unlock();
+
+  auto *buf = bufs_.acquire();
+  for (auto [offset, data_len] : objs) {
+    uint64_t from_id = from_slot * kChunkSize + offset;
+    uint64_t to_id = *to_slot * kChunkSize + offset;
+    devices_[from_device]->read_object(
+        kVanillaPtrDSID, sizeof(from_id),
+        reinterpret_cast<const uint8_t *>(&from_id), &data_len, buf);
+    devices_[to_device]->write_object(kVanillaPtrDSID, sizeof(to_id),
+                                      reinterpret_cast<const uint8_t *>(&to_id),
+                                      data_len, buf);
+    Stats::inc_tier_migrated_bytes(data_len);
+  }
+  bufs_.release(buf);
+  Stats::inc_tier_migrated_chunks(1);
+
+  shard.mutex.Lock();
+  chunk.device = to_device;
+  chunk.slot = *to_slot;
+  chunk.migrating = false;
+  shard.cv.SignalAll();
+  shard.mutex.Unlock();
+  free_slot(from_device, from_slot);
+}
+
+void TieredDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                               const uint8_t *obj_id, uint16_t *data_len,
+                               uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    get_ds_device(ds_id)->read_object(ds_id, obj_id_len, obj_id, data_len,
+                                      data_buf);
+    return;
+  }
+  auto id = *reinterpret_cast<const uint64_t *>(obj_id);
+  uint64_t local_id;
+  auto *device = pin_chunk(id, std::nullopt, &local_id);
+  device->read_object(ds_id, sizeof(local_id),
+                      reinterpret_cast<const uint8_t *>(&local_id), data_len,
+                      data_buf);
+  unpin_chunk(id);
+}
+
+void TieredDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                const uint8_t *obj_id, uint16_t data_len,
+                                const uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    get_ds_device(ds_id)->write_object(ds_id, obj_id_len, obj_id, data_len,
+                                       data_buf);
+    return;
+  }
+  auto id = *reinterpret_cast<const uint64_t *>(obj_id);
+  uint64_t local_id;
+  auto *device = pin_chunk(id, data_len, &local_id);
+  device->write_object(ds_id, sizeof(local_id),
+                       reinterpret_cast<const uint8_t *>(&local_id), data_len,
+                       data_buf);
+  unpin_chunk(id);
+}
+
+void TieredDevice::write_object_extents(
+    uint8_t ds_id, uint8_t obj_id_len, const uint8_t *obj_id, uint16_t data_len,
+    const uint8_t *data_buf, uint8_t num_extents, const ObjectExtent *extents) {
+  if (ds_id != kVanillaPtrDSID) {
+    get_ds_device(ds_id)->write_object_extents(
+        ds_id, obj_id_len, obj_id, data_len, data_buf, num_extents, extents);
+    return;
+  }
+  auto id = *reinterpret_cast<const uint64_t *>(obj_id);
+  uint64_t local_id;
+  auto *device = pin_chunk(id, data_len, &local_id);
+  device->write_object_extents(ds_id, sizeof(local_id),
+                               reinterpret_cast<const uint8_t *>(&local_id),
+                               data_len, data_buf, num_extents, extents);
+  unpin_chunk(id);
+}
+
+void TieredDevice::read_objects(uint32_t num_reqs, const ObjectReadReq *reqs) {
+  ObjectReadReq routed_reqs[kMaxBatchSize];
+  uint64_t local_ids[kMaxBatchSize];
+  FarMemDevice *devices[kMaxBatchSize];
+  uint64_t chunk_idxs[kMaxBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxBatchSize);
+    auto num_chunks = get_batch_chunks(num, reqs, chunk_idxs);
+    pin_chunks(num_chunks, chunk_idxs);
+    for (uint32_t i = 0; i < num; i++) {
+      routed_reqs[i] = reqs[i];
+      if (reqs[i].ds_id == kVanillaPtrDSID) {
+        auto id = *reinterpret_cast<const uint64_t *>(reqs[i].obj_id);
+        devices[i] = route_pinned(id, std::nullopt, &local_ids[i]);
+        routed_reqs[i].obj_id_len = sizeof(local_ids[i]);
+        routed_reqs[i].obj_id = reinterpret_cast<uint8_t *>(&local_ids[i]);
+      } else {
+        devices[i] = get_ds_device(reqs[i].ds_id);
+      }
+    }
+    for (auto &device : devices_) {
+      ObjectReadReq device_reqs[kMaxBatchSize];
+      uint32_t num_device_reqs = 0;
+      for (uint32_t i = 0; i < num; i++) {
+        if (devices[i] == device.get()) {
+          device_reqs[num_device_reqs++] = routed_reqs[i];
+        }
+      }
+      if (num_device_reqs) {
+        device->read_objects(num_device_reqs, device_reqs);
+      }
+    }
+    unpin_chunks(num_chunks, chunk_idxs);
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void TieredDevice::write_objects(uint32_t num_reqs,
+                                 const ObjectWriteReq *reqs) {
+  ObjectWriteReq routed_reqs[kMaxBatchSize];
+  uint64_t local_ids[kMaxBatchSize];
+  FarMemDevice *devices[kMaxBatchSize];
+  uint64_t chunk_idxs[kMaxBatchSize];
+  while (num_reqs) {
+    auto num = std::min(num_reqs, kMaxBatchSize);
+    auto num_chunks = get_batch_chunks(num, reqs, chunk_idxs);
+    pin_chunks(num_chunks, chunk_idxs);
+    for (uint32_t i = 0; i < num; i++) {
+      routed_reqs[i] = reqs[i];
+      if (reqs[i].ds_id == kVanillaPtrDSID) {
+        auto id = *reinterpret_cast<const uint64_t *>(reqs[i].obj_id);
+        devices[i] = route_pinned(id, reqs[i].data_len, &local_ids[i]);
+        routed_reqs[i].obj_id_len = sizeof(local_ids[i]);
+        routed_reqs[i].obj_id = reinterpret_cast<uint8_t *>(&local_ids[i]);
+      } else {
+        devices[i] = get_ds_device(reqs[i].ds_id);
+      }
+    }
+    for (auto &device : devices_) {
+      ObjectWriteReq device_reqs[kMaxBatchSize];
+      uint32_t num_device_reqs = 0;
+      for (uint32_t i = 0; i < num; i++) {
+        if (devices[i] == device.get()) {
+          device_reqs[num_device_reqs++] = routed_reqs[i];
+        }
+      }
+      if (num_device_reqs) {
+        device->write_objects(num_device_reqs, device_reqs);
+      }
+    }
+    unpin_chunks(num_chunks, chunk_idxs);
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void TieredDevice::register_local_buffer(uint8_t *buf, uint64_t len) {
+  for (auto &device : devices_) {
+    device->register_local_buffer(buf, len);
+  }
+}
+
+void TieredDevice::cache_clean_object(uint8_t ds_id, uint8_t obj_id_len,
+                                      const uint8_t *obj_id, uint16_t data_len,
+                                      const uint8_t *data_buf) {
+  if (ds_id != kVanillaPtrDSID) {
+    get_ds_device(ds_id)->cache_clean_object(ds_id, obj_id_len, obj_id,
+                                             data_len, data_buf);
+    return;
+  }
+  auto id = *reinterpret_cast<const uint64_t *>(obj_id);
+  uint64_t local_id;
+  auto *device = pin_chunk(id, std::nullopt, &local_id);
+  device->cache_clean_object(ds_id, sizeof(local_id),
+                             reinterpret_cast<const uint8_t *>(&local_id),
+                             data_len, data_buf);
+  unpin_chunk(id);
+}
+
+bool TieredDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                 const uint8_t *obj_id) {
+  if (ds_id != kVanillaPtrDSID) {
+    return get_ds_device(ds_id)->remove_object(ds_id, obj_id_len, obj_id);
+  }
+  auto id = *reinterpret_cast<const uint64_t *>(obj_id);
+  uint64_t local_id;
+  auto *device = pin_chunk(id, std::nullopt, &local_id);
+  auto ret = device->remove_object(
+      ds_id, sizeof(local_id), reinterpret_cast<const uint8_t *>(&local_id));
+  unpin_chunk(id);
+  return ret;
+}
+
+void TieredDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                    const uint8_t *obj_id, uint16_t *data_len,
+                                    uint8_t *data_buf,
+                                    DeviceReqHandle *handle) {
+  handle->ds_id = ds_id;
+  if (ds_id != kVanillaPtrDSID) {
+    get_ds_device(ds_id)->post_read_object(ds_id, obj_id_len, obj_id,
+                                           data_len, data_buf, handle);
+    return;
+  }
+  read_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+void TieredDevice::post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id, uint16_t data_len,
+                                     const uint8_t *data_buf,
+                                     DeviceReqHandle *handle) {
+  handle->ds_id = ds_id;
+  if (ds_id != kVanillaPtrDSID) {
+    get_ds_device(ds_id)->post_write_object(ds_id, obj_id_len, obj_id,
+                                            data_len, data_buf, handle);
+    return;
+  }
+  write_object(ds_id, obj_id_len, obj_id, data_len, data_buf);
+  handle->completed = true;
+}
+
+bool TieredDevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  return get_ds_device(handle->ds_id)->poll(handle);
+}
+
+uint32_t TieredDevice::get_max_num_outstanding_reqs() const {
+  auto max_num = kMaxBatchSize;
+  for (auto &device : devices_) {
+    max_num = std::min(max_num, device->get_max_num_outstanding_reqs());
+  }
+  return max_num;
+}
+
+bool TieredDevice::is_poll_blocking() const {
+  return std::any_of(devices_.begin(), devices_.end(),
+                     [](auto &device) { return device->is_poll_blocking(); });
+}
+
+void TieredDevice::construct(uint8_t ds_type, uint8_t ds_id, uint8_t param_len,
+                             uint8_t *params) {
+  if (ds_devices_[ds_id] == kUnassigned) {
+    ds_devices_[ds_id] = next_ds_device_++ % devices_.size();
+  }
+  get_ds_device(ds_id)->construct(ds_type, ds_id, param_len, params);
+}
+
+void TieredDevice::destruct(uint8_t ds_id) {
+  get_ds_device(ds_id)->destruct(ds_id);
+  ds_devices_[ds_id] = kUnassigned;
+}
+
+void TieredDevice::compute(uint8_t ds_id, uint8_t opcode, uint16_t input_len,
+                           const uint8_t *input_buf, uint16_t *output_len,
+                           uint8_t *output_buf) {
+  get_ds_device(ds_id)->compute(ds_id, opcode, input_len, input_buf,
+                                output_len, output_buf);
+}
+
+ReplicatedDevice::ReplicatedDevice(FarMemDevice *primary, FarMemDevice *backup,
+                                   uint64_t timeout_us)
+    : FarMemDevice(
+          std::min(primary->get_far_mem_size(), backup->get_far_mem_size()),
+          std::min(primary->get_prefetch_win_size(),
+                   backup->get_prefetch_win_size())),
+      replicas_{std::unique_ptr<FarMemDevice>(primary),
+                std::unique_ptr<FarMemDevice>(backup)},
+      timeout_us_(timeout_us) {
+  // The replicas are polled with the mutex of a shard held.
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    BUG_ON(replicas_[i]->is_poll_blocking());
+    failed_[i] = false;
+  }
+}
+
+ReplicatedDevice::~ReplicatedDevice() {
+  for (auto &shard : shards_) {
+    shard.mutex.Lock();
+    while (!shard.writes.empty()) {
+      settle(shard, shard.writes.begin()->first);
+    }
+    while (!shard.detached.empty()) {
+      reap(shard);
+      thread_yield();
+    }
+    shard.mutex.Unlock();
+  }
+}
+
+uint64_t ReplicatedDevice::get_key(uint8_t ds_id, uint8_t obj_id_len,
+                                   const uint8_t *obj_id) {
+  // Collisions only cost some false waits.
+  return (static_cast<uint64_t>(ds_id) << 32) | hash_32(obj_id, obj_id_len);
+}
+
+ReplicatedDevice::ReplicaOp *ReplicatedDevice::new_op(bool is_read,
+                                                      uint8_t ds_id,
+                                                      uint8_t obj_id_len,
+                                                      const uint8_t *obj_id) {
+  auto *op = new ReplicaOp();
+  op->is_read = is_read;
+  op->key = get_key(ds_id, obj_id_len, obj_id);
+  op->ds_id = ds_id;
+  op->obj_id_len = obj_id_len;
+  memcpy(op->obj_id, obj_id, obj_id_len);
+  return op;
+}
+
+void ReplicatedDevice::fail(uint32_t replica) {
+  if (failed_[replica].exchange(true)) {
+    return;
+  }
+  LOG_PRINTF("%s%u%s\n", "Warn: replica ", replica,
+             " timed out, marked it failed.");
+  BUG_ON(std::none_of(std::begin(failed_), std::end(failed_),
+                      [](const std::atomic<bool> &failed) { return !failed; }));
+}
+
+void ReplicatedDevice::delete_op(ReplicaOp *op) {
+  // A failed replica may still complete the abandoned request at any time,
+  // writing into the op and its buffers, so they are leaked instead.
+  if (std::any_of(std::begin(op->abandoned), std::end(op->abandoned),
+                  [](bool abandoned) { return abandoned; })) {
+    return;
+  }
+  for (auto *buf : op->bufs) {
+    if (buf) {
+      bufs_.release(buf);
+    }
+  }
+  delete op;
+}
+
+bool ReplicatedDevice::progress(ReplicaOp *op) {
+  bool finished = true;
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (!op->posted[i] || op->done[i] || op->abandoned[i]) {
+      continue;
+    }
+    if (replicas_[i]->poll(&op->handles[i])) {
+      op->done[i] = true;
+      if (op->acked) {
+        Stats::inc_replica_async_completions(1);
+      }
+    } else if (!is_alive(i) || microtime() - op->posted_us > timeout_us_) {
+      fail(i);
+      op->abandoned[i] = true;
+    } else {
+      finished = false;
+    }
+  }
+  return finished;
+}
+
+void ReplicatedDevice::retire(Shard &shard, ReplicaOp *op) {
+  if (!op->is_read) {
+    auto iter = shard.writes.find(op->key);
+    if (iter != shard.writes.end() && iter->second == op) {
+      shard.writes.erase(iter);
+    }
+  }
+}
+
+void ReplicatedDevice::reap(Shard &shard) {
+  auto &detached = shard.detached;
+  for (uint32_t i = 0; i < detached.size();) {
+    auto *op = detached[i];
+    if (progress(op)) {
+      retire(shard, op);
+      delete_op(op);
+      detached[i] = detached.back();
+      detached.pop_back();
+    } else {
+      i++;
+    }
+  }
+}
+
+void ReplicatedDevice::settle(Shard &shard, uint64_t key) {
+  auto iter = shard.writes.find(key);
+  if (iter == shard.writes.end()) {
+    return;
+  }
+  while (!progress(iter->second)) {
+    thread_yield();
+  }
+  // It is deleted by reap() if acked, and by the poll() of its requester
+  // otherwise.
+  shard.writes.erase(iter);
+}
+
+void ReplicatedDevice::settle_ds(uint8_t ds_id) {
+  for (auto &shard : shards_) {
+    shard.mutex.Lock();
+    std::vector<uint64_t> keys;
+    for (auto [key, op] : shard.writes) {
+      if (op->ds_id == ds_id) {
+        keys.push_back(key);
+      }
+    }
+    for (auto key : keys) {
+      settle(shard, key);
+    }
+    shard.mutex.Unlock();
+  }
+}
+
+void ReplicatedDevice::settle_all() {
+  for (auto &shard : shards_) {
+    shard.mutex.Lock();
+    while (!shard.writes.empty()) {
+      settle(shard, shard.writes.begin()->first);
+    }
+    shard.mutex.Unlock();
+  }
+}
+
+void ReplicatedDevice::post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                        const uint8_t *obj_id,
+                                        uint16_t *data_len, uint8_t *data_buf,
+                                        DeviceReqHandle *handle) {
+  auto *op = new_op(/* is_read = */ true, ds_id, obj_id_len, obj_id);
+  op->data_len = data_len;
+  op->data_buf = data_buf;
+  auto &shard = get_shard(op->key);
+  shard.mutex.Lock();
+  auto guard = helpers::finally([&]() { shard.mutex.Unlock(); });
+  reap(shard);
+  post_read(shard, op);
+  handle->completed = false;
+  handle->is_read = true;
+  handle->ds_id = ds_id;
+  handle->ctx = op;
+}
+
+void ReplicatedDevice::post_read(Shard &shard, ReplicaOp *op) {
+  bool up_to_date[kNumReplicas];
+  std::fill(std::begin(up_to_date), std::end(up_to_date), true);
+  auto iter = shard.writes.find(op->key);
+  if (iter != shard.writes.end()) {
+    auto *write = iter->second;
+    if (progress(write)) {
+      shard.writes.erase(iter);
+    } else {
+      std::copy(std::begin(write->done), std::end(write->done), up_to_date);
+    }
+  }
+  // Checked after progress(), which may have found another failed replica.
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    up_to_date[i] = up_to_date[i] && is_alive(i);
+  }
+  if (std::none_of(std::begin(up_to_date), std::end(up_to_date),
+                   [](bool up_to_date) { return up_to_date; })) {
+    settle(shard, op->key);
+    for (uint32_t i = 0; i < kNumReplicas; i++) {
+      up_to_date[i] = is_alive(i);
+    }
+  }
+
+  op->posted_us = microtime();
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (!up_to_date[i]) {
+      continue;
+    }
+    op->posted[i] = true;
+    op->bufs[i] = bufs_.acquire();
+    replicas_[i]->post_read_object(op->ds_id, op->obj_id_len, op->obj_id,
+                                   &op->data_lens[i], op->bufs[i],
+                                   &op->handles[i]);
+  }
+}
+
+void ReplicatedDevice::post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                         const uint8_t *obj_id,
+                                         uint16_t data_len,
+                                         const uint8_t *data_buf,
+                                         DeviceReqHandle *handle) {
+  auto *op = new_op(/* is_read = */ false, ds_id, obj_id_len, obj_id);
+  op->bufs[0] = bufs_.acquire();
+  memcpy(op->bufs[0], data_buf, data_len);
+  auto &shard = get_shard(op->key);
+  shard.mutex.Lock();
+  auto guard = helpers::finally([&]() { shard.mutex.Unlock(); });
+  reap(shard);
+  settle(shard, op->key);
+
+  op->posted_us = microtime();
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (!is_alive(i)) {
+      continue;
+    }
+    op->posted[i] = true;
+    replicas_[i]->post_write_object(ds_id, op->obj_id_len, op->obj_id,
+                                    data_len, op->bufs[0], &op->handles[i]);
+  }
+  shard.writes[op->key] = op;
+  handle->completed = false;
+  handle->is_read = false;
+  handle->ds_id = ds_id;
+  handle->ctx = op;
+}
+
+bool ReplicatedDevice::poll(DeviceReqHandle *handle) {
+  if (handle->completed) {
+    return true;
+  }
+  auto *op = reinterpret_cast<ReplicaOp *>(handle->ctx);
+  auto &shard = get_shard(op->key);
+  shard.mutex.Lock();
+  auto guard = helpers::finally([&]() { shard.mutex.Unlock(); });
+  auto finished = progress(op);
+  auto *first = std::find(std::begin(op->done), std::end(op->done), true);
+  if (first == std::end(op->done)) {
+    if (finished) {
+      // Every replica the read went to has failed, while the rest were behind
+      // on the object; they are caught up first. A write cannot get here, as
+      // it goes to all of the live replicas.
+      BUG_ON(!op->is_read);
+      post_read(shard, op);
+    }
+    return false;
+  }
+  if (op->is_read) {
+    auto i = first - std::begin(op->done);
+    *op->data_len = op->data_lens[i];
+    memcpy(op->data_buf, op->bufs[i], op->data_lens[i]);
+  }
+  op->acked = true;
+  handle->completed = true;
+  if (finished) {
+    retire(shard, op);
+    delete_op(op);
+  } else {
+    shard.detached.push_back(op);
+  }
+  return true;
+}
+
+void ReplicatedDevice::read_object(uint8_t ds_id, uint8_t obj_id_len,
+                                   const uint8_t *obj_id, uint16_t *data_len,
+                                   uint8_t *data_buf) {
+  DeviceReqHandle handle;
+  auto *handle_ptr = &handle;
+  post_read_object(ds_id, obj_id_len, obj_id, data_len, data_buf, &handle);
+  wait(1, &handle_ptr);
+}
+
+void ReplicatedDevice::write_object(uint8_t ds_id, uint8_t obj_id_len,
+                                    const uint8_t *obj_id, uint16_t data_len,
+                                    const uint8_t *data_buf) {
+  DeviceReqHandle handle;
+  auto *handle_ptr = &handle;
+  post_write_object(ds_id, obj_id_len, obj_id, data_len, data_buf, &handle);
+  wait(1, &handle_ptr);
+}
+
+uint32_t ReplicatedDevice::get_max_num_outstanding_reqs() const {
+  // Every request posts one to each replica.
+  auto max_num = kMaxBatchSize;
+  for (auto &replica : replicas_) {
+    max_num = std::min(max_num, replica->get_max_num_outstanding_reqs());
+  }
+  return max_num;
+}
+
+void ReplicatedDevice::write_objects(uint32_t num_reqs,
+                                     const ObjectWriteReq *reqs) {
+  DeviceReqHandle handles[kMaxBatchSize];
+  DeviceReqHandle *handle_ptrs[kMaxBatchSize];
+  auto max_num = std::min(kMaxBatchSize, get_max_num_outstanding_reqs());
+  while (num_reqs) {
+    auto num = std::min(num_reqs, max_num);
+    for (uint32_t i = 0; i < num; i++) {
+      auto &req = reqs[i];
+      // The replicas get whole objects, as there is no way to post extents.
+      post_write_object(req.ds_id, req.obj_id_len, req.obj_id, req.data_len,
+                        req.data_buf, &handles[i]);
+      handle_ptrs[i] = &handles[i];
+    }
+    wait(num, handle_ptrs);
+    reqs += num;
+    num_reqs -= num;
+  }
+}
+
+void ReplicatedDevice::register_local_buffer(uint8_t *buf, uint64_t len) {
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (is_alive(i)) {
+      replicas_[i]->register_local_buffer(buf, len);
+    }
+  }
+}
+
+void ReplicatedDevice::cache_clean_object(uint8_t ds_id, uint8_t obj_id_len,
+                                          const uint8_t *obj_id,
+                                          uint16_t data_len,
+                                          const uint8_t *data_buf) {
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (is_alive(i)) {
+      replicas_[i]->cache_clean_object(ds_id, obj_id_len, obj_id, data_len,
+                                       data_buf);
+    }
+  }
+}
+
+bool ReplicatedDevice::remove_object(uint64_t ds_id, uint8_t obj_id_len,
+                                     const uint8_t *obj_id) {
+  auto key = get_key(ds_id, obj_id_len, obj_id);
+  auto &shard = get_shard(key);
+  shard.mutex.Lock();
+  settle(shard, key);
+  shard.mutex.Unlock();
+  std::optional<bool> ret;
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (is_alive(i)) {
+      auto removed = replicas_[i]->remove_object(ds_id, obj_id_len, obj_id);
+      ret = ret.value_or(removed);
+    }
+  }
+  return *ret;
+}
+
+void ReplicatedDevice::construct(uint8_t ds_type, uint8_t ds_id,
+                                 uint8_t param_len, uint8_t *params) {
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (is_alive(i)) {
+      replicas_[i]->construct(ds_type, ds_id, param_len, params);
+    }
+  }
+}
+
+void ReplicatedDevice::destruct(uint8_t ds_id) {
+  settle_ds(ds_id);
+  for (uint32_t i = 0; i < kNumReplicas; i++) {
+    if (is_alive(i)) {
+      replicas_[i]->destruct(ds_id);
+    }
+  }
+}
+
+void ReplicatedDevice::compute(uint8_t ds_id, uint8_t opcode,
+                               uint16_t input_len, const uint8_t *input_buf,
+                               uint16_t *output_len, uint8_t *output_buf) {
+  // Besides ds_id, the op may read other data structures, e.g., the columns
+  // that Filter and GroupBy take by their IDs.
+  settle_all();
+  if (!is_alive(0) || !is_alive(1)) {
+    auto &replica = replicas_[is_alive(0) ? 0 : 1];
+    replica->compute(ds_id, opcode, input_len, input_buf, output_len,
+                     output_buf);
+    return;
+  }
+  uint16_t backup_output_len;
+  auto *backup_output_buf = bufs_.acquire();
+  rt::Thread backup([&]() {
+    replicas_[1]->compute(ds_id, opcode, input_len, input_buf,
+                          &backup_output_len, backup_output_buf);
+  });
+  replicas_[0]->compute(ds_id, opcode, input_len, input_buf, output_len,
+                        output_buf);
+  backup.Join();
+  bufs_.release(backup_output_buf);
 }
 
 } // namespace far_memory
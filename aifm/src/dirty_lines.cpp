@@ -0,0 +1,96 @@
+#include "dirty_lines.hpp"
+
+#include <algorithm>
+
+namespace far_memory {
+
+uint64_t DirtyLines::cache_begin_addr_;
+uint64_t DirtyLines::cache_end_addr_;
+std::unique_ptr<std::atomic<uint64_t>[]> DirtyLines::bitmap_;
+
+void DirtyLines::init(uint8_t *cache_ptr, uint64_t cache_size) {
+  cache_begin_addr_ = reinterpret_cast<uint64_t>(cache_ptr);
+  cache_end_addr_ = cache_begin_addr_ + cache_size;
+  auto num_lines = cache_size >> kLineShift;
+  auto num_words = (num_lines - 1) / kNumLinesPerWord + 1;
+  bitmap_.reset(new std::atomic<uint64_t>[num_words]);
+  for (uint64_t i = 0; i < num_words; i++) {
+    bitmap_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void DirtyLines::destroy() { bitmap_.reset(); }
+
+void DirtyLines::clear(uint64_t addr, uint32_t len) {
+  auto begin_addr = helpers::align_to(addr, static_cast<uint64_t>(kLineSize));
+  auto end_addr = (addr + len) & ~static_cast<uint64_t>(kLineSize - 1);
+  if (begin_addr >= end_addr) {
+    return;
+  }
+  for_each_word(begin_addr, end_addr - begin_addr,
+                [](std::atomic<uint64_t> &word, uint64_t mask) {
+                  if (word.load(std::memory_order_relaxed) & mask) {
+                    word.fetch_and(~mask, std::memory_order_relaxed);
+                  }
+                });
+}
+
+void DirtyLines::copy(uint64_t from_data_addr, uint64_t to_data_addr,
+                      uint16_t data_len) {
+  ObjectExtent extents[kMaxNumExtents];
+  auto num_extents = get_extents(from_data_addr, data_len, extents);
+  for (uint32_t i = 0; i < num_extents; i++) {
+    mark(to_data_addr + extents[i].offset, extents[i].len);
+  }
+}
+
+uint32_t DirtyLines::get_extents(uint64_t data_addr, uint16_t data_len,
+                                 ObjectExtent *extents) {
+  if (unlikely(!data_len)) {
+    return 0;
+  }
+  auto data_end_addr = data_addr + data_len;
+  auto first_line = line_idx(data_addr);
+  auto last_line = line_idx(data_end_addr - 1);
+  uint32_t num_extents = 0;
+  auto line = first_line;
+  while (line <= last_line) {
+    auto word = bitmap_[line / kNumLinesPerWord].load(std::memory_order_relaxed);
+    auto bit = line % kNumLinesPerWord;
+    word >>= bit;
+    if (!word) {
+      // No dirty lines left in this word.
+      line += kNumLinesPerWord - bit;
+      continue;
+    }
+    line += __builtin_ctzll(word);
+    if (line > last_line) {
+      break;
+    }
+    // Extend the run of dirty lines.
+    auto run_end_line = line;
+    while (run_end_line + 1 <= last_line &&
+           (bitmap_[(run_end_line + 1) / kNumLinesPerWord].load(
+                std::memory_order_relaxed) >>
+            ((run_end_line + 1) % kNumLinesPerWord)) &
+               1) {
+      run_end_line++;
+    }
+    auto run_begin_addr =
+        std::max(cache_begin_addr_ + (line << kLineShift), data_addr);
+    auto run_end_addr = std::min(
+        cache_begin_addr_ + ((run_end_line + 1) << kLineShift), data_end_addr);
+    auto offset = static_cast<uint16_t>(run_begin_addr - data_addr);
+    auto len = static_cast<uint16_t>(run_end_addr - run_begin_addr);
+    if (num_extents < kMaxNumExtents) {
+      extents[num_extents++] = {.offset = offset, .len = len};
+    } else {
+      auto &last = extents[kMaxNumExtents - 1];
+      last.len = offset + len - last.offset;
+    }
+    line = run_end_line + 1;
+  }
+  return num_extents;
+}
+
+} // namespace far_memory
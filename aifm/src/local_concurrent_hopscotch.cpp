@@ -6,12 +6,23 @@
 
 namespace far_memory {
 
+// The buckets take the front of mem, and the data the rest of it.
+static uint64_t get_buckets_mem_size(uint32_t num_entries) {
+  uint64_t size =
+      num_entries * sizeof(LocalGenericConcurrentHopscotch::BucketEntry);
+  return helpers::align_to(size, static_cast<uint64_t>(helpers::kHugepageSize));
+}
+
 LocalGenericConcurrentHopscotch::LocalGenericConcurrentHopscotch(
-    uint32_t num_entries_shift, uint64_t data_size)
+    uint32_t num_entries_shift, uint64_t data_size, uint8_t *mem)
     : kHashMask_((1 << num_entries_shift) - 1),
       kNumEntries_((1 << num_entries_shift) + kNeighborhood),
+      external_mem_(mem),
       slab_base_addr_(
-          reinterpret_cast<uint64_t>(helpers::allocate_hugepage(data_size))),
+          mem ? reinterpret_cast<uint64_t>(mem) +
+                    get_buckets_mem_size(kNumEntries_)
+              : reinterpret_cast<uint64_t>(
+                    helpers::allocate_hugepage(data_size))),
       slab_(reinterpret_cast<uint8_t *>(slab_base_addr_), data_size) {
   // Check overflow.
   BUG_ON(((kHashMask_ + 1) >> num_entries_shift) != 1);
@@ -19,11 +30,22 @@ LocalGenericConcurrentHopscotch::LocalGenericConcurrentHopscotch(
   // Allocate memory for buckets.
   auto size = kNumEntries_ * sizeof(BucketEntry);
   buckets_mem_.reset(
-      reinterpret_cast<uint8_t *>(helpers::allocate_hugepage(size)));
+      mem ? mem : reinterpret_cast<uint8_t *>(helpers::allocate_hugepage(size)));
   buckets_ = new (buckets_mem_.get()) BucketEntry[kNumEntries_];
 }
 
-LocalGenericConcurrentHopscotch::~LocalGenericConcurrentHopscotch() {}
+LocalGenericConcurrentHopscotch::~LocalGenericConcurrentHopscotch() {
+  if (external_mem_) {
+    buckets_mem_.release();
+  }
+}
+
+uint64_t
+LocalGenericConcurrentHopscotch::get_mem_size(uint32_t num_entries_shift,
+                                              uint64_t data_size) {
+  return get_buckets_mem_size((1 << num_entries_shift) + kNeighborhood) +
+         data_size;
+}
 
 void LocalGenericConcurrentHopscotch::do_remove(BucketEntry *bucket,
                                                 BucketEntry *entry) {
@@ -36,6 +58,12 @@ void LocalGenericConcurrentHopscotch::do_remove(BucketEntry *bucket,
   bucket->bitmap ^= (1 << offset);
 }
 
+void LocalGenericConcurrentHopscotch::prefetch_bucket(uint8_t key_len,
+                                                      const uint8_t *key) {
+  uint32_t hash = hash_32(static_cast<const void *>(key), key_len);
+  __builtin_prefetch(buckets_ + (hash & kHashMask_));
+}
+
 void LocalGenericConcurrentHopscotch::get(uint8_t key_len, const uint8_t *key,
                                           uint16_t *val_len, uint8_t *val,
                                           bool remove) {
@@ -119,6 +147,28 @@ remove:
   }
 }
 
+void LocalGenericConcurrentHopscotch::write_pair(KVDataHeader *header,
+                                                 uint8_t key_len,
+                                                 const uint8_t *key,
+                                                 uint16_t val_len,
+                                                 const uint8_t *val) {
+  // A one-sided reader may still be probing the pair that the slot held before
+  // it was freed. Were the version restarted from 0, the reader could match the
+  // versions it read around a copy that raced with the reuse.
+  auto version = ACCESS_ONCE(header->version) | 1;
+  ACCESS_ONCE(header->version) = version;
+  wmb();
+  header->key_len = key_len;
+  header->val_len = val_len;
+  auto *slab_val_ptr = reinterpret_cast<char *>(header) + sizeof(KVDataHeader);
+  memcpy(slab_val_ptr + val_len, key, key_len);
+  memcpy(slab_val_ptr, val, val_len);
+  wmb();
+  ACCESS_ONCE(header->version) = version + 1;
+  // The pair is complete before the caller publishes it.
+  wmb();
+}
+
 bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
                                           uint16_t val_len,
                                           const uint8_t *val) {
@@ -144,19 +194,22 @@ bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
       if (strncmp(slab_val_ptr + header->val_len,
                   reinterpret_cast<const char *>(key), key_len) == 0) {
         if (unlikely(header->val_len != val_len)) {
-          auto old_data_size = sizeof(KVDataHeader) + key_len + header->val_len;
-          slab_.free(reinterpret_cast<uint8_t *>(header), old_data_size);
+          // Writes the pair out of place, and then publishes it.
           auto new_data_size = sizeof(KVDataHeader) + key_len + val_len;
           auto *new_header =
               reinterpret_cast<KVDataHeader *>(slab_.allocate(new_data_size));
           BUG_ON(!new_header);
+          write_pair(new_header, key_len, key, val_len, val);
           entry->ptr = new_header;
-          *new_header = {.key_len = key_len, .val_len = val_len};
-          slab_val_ptr =
-              reinterpret_cast<char *>(new_header) + sizeof(KVDataHeader);
-          memcpy(slab_val_ptr + val_len, key, key_len);
+          auto old_data_size = sizeof(KVDataHeader) + key_len + header->val_len;
+          slab_.free(reinterpret_cast<uint8_t *>(header), old_data_size);
+          return true;
         }
+        ACCESS_ONCE(header->version) = header->version + 1;
+        wmb();
         memcpy(slab_val_ptr, val, val_len);
+        wmb();
+        ACCESS_ONCE(header->version) = header->version + 1;
         return true;
       }
     }
@@ -244,11 +297,7 @@ bool LocalGenericConcurrentHopscotch::put(uint8_t key_len, const uint8_t *key,
   final_entry->ptr = header;
 
   // Write object.
-  *header = {.key_len = key_len, .val_len = val_len};
-  auto *slab_val_ptr = reinterpret_cast<char *>(header) + sizeof(KVDataHeader);
-  memcpy(slab_val_ptr + val_len, key, key_len);
-  memcpy(slab_val_ptr, val, val_len);
-  wmb();
+  write_pair(header, key_len, key, val_len, val);
 
   // Update the bitmap of the final bucket.
   assert((bucket->bitmap & (1 << distance_to_orig_bucket)) == 0);
@@ -56,6 +56,7 @@ FarMemManager::FarMemManager(uint64_t cache_size, uint64_t far_mem_size,
                        &from_regions_),
       parallel_write_backer_(num_gc_threads, kGCSlaveThreadTaskQueueDepth,
                              &from_regions_),
+      prefetch_executor_(kNumPrefetchWorkers, kMaxNumPrefetchInflightObjs),
       num_gc_threads_(num_gc_threads) {
 
   BUG_ON(far_mem_size >= (1ULL << FarMemPtrMeta::kObjectIDBitSize));
@@ -65,6 +66,18 @@ FarMemManager::FarMemManager(uint64_t cache_size, uint64_t far_mem_size,
     LOG_PRINTF("%s\n", "Warn: fail to open /dev/ksched.");
   }
   memset(evac_notifiers_, 0, sizeof(evac_notifiers_));
+  far_mem_region_indices_.reset(new FarMemRegionIndex[
+      helpers::align_to(far_mem_size, Region::kSize) / Region::kSize]);
+  far_mem_gc_buf_.reset(new uint8_t[Object::kMaxObjectDataSize]);
+  // Reserve a far-mem region for far-mem GC to relocate objects into.
+  auto optional_far_mem_gc_to_region = far_mem_region_manager_.pop_free_region();
+  BUG_ON(!optional_far_mem_gc_to_region);
+  far_mem_gc_to_region_ = std::move(*optional_far_mem_gc_to_region);
+  device_ptr_->register_local_buffer(
+      cache_region_manager_.get_local_cache_ptr(),
+      cache_region_manager_.get_local_cache_size());
+  DirtyLines::init(cache_region_manager_.get_local_cache_ptr(),
+                   cache_region_manager_.get_local_cache_size());
 
   for (uint8_t ds_id =
            std::numeric_limits<decltype(available_ds_ids_)::value_type>::min();
@@ -81,6 +94,7 @@ FarMemManager::~FarMemManager() {
   while (ACCESS_ONCE(pending_gcs_)) {
     thread_yield();
   }
+  DirtyLines::destroy();
 }
 
 bool FarMemManager::allocate_generic_unique_ptr_nb(
@@ -103,6 +117,9 @@ bool FarMemManager::allocate_generic_unique_ptr_nb(
     Object(local_object_addr, ds_id, static_cast<uint16_t>(item_size),
            static_cast<uint8_t>(sizeof(remote_object_addr)),
            reinterpret_cast<const uint8_t *>(&remote_object_addr));
+    if (ds_id == kVanillaPtrDSID) {
+      track_far_mem_object(remote_object_addr, object_size, ptr);
+    }
   } else {
     Object(local_object_addr, ds_id, static_cast<uint16_t>(item_size),
            *optional_id_len, *optional_id);
@@ -125,6 +142,9 @@ GenericUniquePtr FarMemManager::allocate_generic_unique_ptr(
     Object(local_object_addr, ds_id, static_cast<uint16_t>(item_size),
            static_cast<uint8_t>(sizeof(remote_object_addr)),
            reinterpret_cast<const uint8_t *>(&remote_object_addr));
+    if (ds_id == kVanillaPtrDSID) {
+      track_far_mem_object(remote_object_addr, object_size, &ptr);
+    }
   } else {
     Object(local_object_addr, ds_id, static_cast<uint16_t>(item_size),
            *optional_id_len, *optional_id);
@@ -140,6 +160,79 @@ void FarMemManager::RegionManager::push_free_region(Region &region) {
   region_spin_.Unlock();
 }
 
+std::optional<Region> FarMemManager::RegionManager::pop_free_region() {
+  Region region;
+  region_spin_.Lock();
+  bool success = free_regions_.pop_front(&region);
+  region_spin_.Unlock();
+  return success ? std::make_optional(std::move(region)) : std::nullopt;
+}
+
+void FarMemManager::RegionManager::push_used_region(Region &region) {
+  region_spin_.Lock();
+  used_since_us_[region.get_idx()] = microtime();
+  BUG_ON(!used_regions_.push_back(region));
+  region_spin_.Unlock();
+}
+
+// Moves up to max_num_regions used regions satisfying pred into picked; the
+// others keep their position in the used list.
+void FarMemManager::RegionManager::pick_used_regions(
+    const std::function<bool(const Region &)> &pred, uint32_t max_num_regions,
+    std::vector<Region> *picked) {
+  Region region;
+  region_spin_.Lock();
+  auto num_used_regions = used_regions_.size();
+  for (uint32_t i = 0; i < num_used_regions; i++) {
+    BUG_ON(!used_regions_.pop_front(&region));
+    if (picked->size() < max_num_regions && pred(region)) {
+      picked->push_back(std::move(region));
+    } else {
+      BUG_ON(!used_regions_.push_back(region));
+    }
+  }
+  region_spin_.Unlock();
+}
+
+// Pops up to max_num_regions GC-able regions from the fronts of the used lists,
+// i.e., the oldest ones, non-temporal ones first.
+void FarMemManager::RegionManager::pop_used_regions(
+    uint32_t max_num_regions, std::vector<Region> *popped) {
+  Region region;
+  region_spin_.Lock();
+  for (auto *regions : {&nt_used_regions_, &used_regions_}) {
+    auto num_regions = regions->size();
+    for (uint32_t i = 0; i < num_regions && popped->size() < max_num_regions;
+         i++) {
+      BUG_ON(!regions->pop_front(&region));
+      if (likely(region.is_gcable())) {
+        popped->push_back(std::move(region));
+      } else {
+        BUG_ON(!regions->push_back(region));
+      }
+    }
+  }
+  region_spin_.Unlock();
+}
+
+// Pushes regions back to the fronts of the used lists they were popped from,
+// keeping their order.
+void FarMemManager::RegionManager::unpop_used_regions(
+    std::vector<Region> *regions) {
+  region_spin_.Lock();
+  for (auto iter = regions->rbegin(); iter != regions->rend(); iter++) {
+    auto &used_regions = iter->is_nt() ? nt_used_regions_ : used_regions_;
+    BUG_ON(!used_regions.push_front(*iter));
+  }
+  region_spin_.Unlock();
+  regions->clear();
+}
+
+uint64_t
+FarMemManager::RegionManager::get_used_since_us(const Region &region) const {
+  return ACCESS_ONCE(used_since_us_[region.get_idx()]);
+}
+
 std::optional<Region> FarMemManager::RegionManager::pop_used_region() {
   Region region;
   region_spin_.Lock();
@@ -180,6 +273,7 @@ bool FarMemManager::RegionManager::try_refill_core_local_free_region(
   bool success = true;
   if (full_region) {
     if (!full_region->is_invalid()) {
+      used_since_us_[full_region->get_idx()] = microtime();
       success =
           (full_region->is_local() &&
            full_region
@@ -229,9 +323,12 @@ FarMemManager::RegionManager::RegionManager(uint64_t size, bool is_local) {
   used_regions_ = std::move(CircularBuffer<Region, false>(free_regions_count));
   nt_used_regions_ =
       std::move(CircularBuffer<Region, false>(free_regions_count));
+  used_since_us_.reset(
+      new uint64_t[static_cast<uint64_t>(free_regions_count)]());
   if (is_local) {
+    local_cache_size_ = free_regions_count * Region::kSize;
     local_cache_ptr_.reset(reinterpret_cast<uint8_t *>(
-        helpers::allocate_hugepage(free_regions_count * Region::kSize)));
+        helpers::allocate_hugepage(local_cache_size_)));
   }
   free_regions_count -= 2 * helpers::kNumSocket1CPUs;
 
@@ -269,40 +366,159 @@ void FarMemManager::swap_in(bool nt, GenericFarMemPtr *ptr) {
   });
 
   auto &meta = ptr->meta();
-  if (likely(!meta.is_present())) {
-    auto obj_addr = allocate_local_object(nt, meta.get_object_size());
-    auto obj = Object(obj_addr);
-    auto ds_id = meta.get_ds_id();
+  if (unlikely(meta != meta_snapshot)) {
+    // Swapped in, or relocated by far-mem GC, in the meantime.
+    guard.reset();
+    swap_in(nt, ptr);
+    return;
+  }
+  auto obj_addr = allocate_local_object(nt, meta.get_object_size());
+  auto obj = Object(obj_addr);
+  auto ds_id = meta.get_ds_id();
+  uint16_t obj_data_len;
+  auto obj_data_addr = reinterpret_cast<uint8_t *>(obj.get_data_addr());
+  /* If a vanillaPtr, we already know its data_len. Load it into the buffer so
+   that the RDMA backend can notice. */
+  if (ds_id == kVanillaPtrDSID) {
+    obj_data_len = meta.get_object_size() - sizeof(obj_id) - 10 /* Header size. */;
+  }
+  device_ptr_->read_object(ds_id, sizeof(obj_id),
+                           reinterpret_cast<uint8_t *>(&obj_id),
+                           &obj_data_len, obj_data_addr);
+  wmb();
+  obj.init(ds_id, obj_data_len, sizeof(obj_id),
+           reinterpret_cast<uint8_t *>(&obj_id));
+  if (!meta.is_shared()) {
+    meta.set_present(obj_addr);
+  } else {
+    reinterpret_cast<GenericSharedPtr *>(ptr)->traverse(
+        [=](GenericFarMemPtr *ptr) { ptr->meta().set_present(obj_addr); });
+  }
+  Region::atomic_inc_ref_cnt(obj_addr, -1);
+  Stats::inc_swap_in_objects(1);
+}
+
+// Swaps in multiple objects with their reads outstanding on the device at the
+// same time. Objects are locked in the order of their IDs so that concurrent
+// batches cannot deadlock against each other, and only the ones being read
+// stay locked across the round trip.
+void FarMemManager::swap_in_batch(bool nt, uint32_t num_ptrs,
+                                  GenericFarMemPtr **ptrs) {
+  assert(preempt_enabled());
+
+  struct SwapInReq {
+    GenericFarMemPtr *ptr;
+    uint64_t obj_id;
+    uint64_t obj_addr;
     uint16_t obj_data_len;
-    auto obj_data_addr = reinterpret_cast<uint8_t *>(obj.get_data_addr());
-    /* If a vanillaPtr, we already know its data_len. Load it into the buffer so
-     that the RDMA backend can notice. */
+    bool posted;
+    bool stale;
+  };
+
+  while (num_ptrs > kMaxSwapInBatchSize) {
+    swap_in_batch(nt, kMaxSwapInBatchSize, ptrs);
+    ptrs += kMaxSwapInBatchSize;
+    num_ptrs -= kMaxSwapInBatchSize;
+  }
+
+  SwapInReq reqs[kMaxSwapInBatchSize];
+  uint32_t num_reqs = 0;
+  for (uint32_t i = 0; i < num_ptrs; i++) {
+    auto meta_snapshot = ptrs[i]->meta();
+    if (meta_snapshot.is_present()) {
+      continue;
+    }
+    reqs[num_reqs].ptr = ptrs[i];
+    reqs[num_reqs].obj_id = meta_snapshot.get_object_id();
+    reqs[num_reqs].posted = false;
+    reqs[num_reqs].stale = false;
+    num_reqs++;
+  }
+  std::sort(reqs, reqs + num_reqs, [](const SwapInReq &a, const SwapInReq &b) {
+    return a.obj_id < b.obj_id;
+  });
+
+  ObjectReadReq read_reqs[kMaxSwapInBatchSize];
+  uint32_t num_read_reqs = 0;
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    auto &req = reqs[i];
+    if (i && req.obj_id == reqs[i - 1].obj_id) {
+      // Duplicated pointer; the lock is already held.
+      continue;
+    }
+    lock_object(sizeof(req.obj_id),
+                reinterpret_cast<const uint8_t *>(&req.obj_id));
+    auto &meta = req.ptr->meta();
+    if (unlikely(meta.is_present() || meta.get_object_id() != req.obj_id)) {
+      // Swapped in, or relocated by far-mem GC (then retried alone), before
+      // being locked. Either way the lock is not held across the round trip.
+      req.stale = !meta.is_present();
+      unlock_object(sizeof(req.obj_id),
+                    reinterpret_cast<const uint8_t *>(&req.obj_id));
+      continue;
+    }
+    auto ds_id = meta.get_ds_id();
+    req.obj_addr = allocate_local_object(nt, meta.get_object_size());
+    auto obj_data_addr =
+        reinterpret_cast<uint8_t *>(Object(req.obj_addr).get_data_addr());
     if (ds_id == kVanillaPtrDSID) {
-      obj_data_len = meta.get_object_size() - sizeof(obj_id) - 10 /* Header size. */;
-    }
-    device_ptr_->read_object(ds_id, sizeof(obj_id),
-                             reinterpret_cast<uint8_t *>(&obj_id),
-                             &obj_data_len, obj_data_addr);
-    wmb();
-    obj.init(ds_id, obj_data_len, sizeof(obj_id),
-             reinterpret_cast<uint8_t *>(&obj_id));
+      req.obj_data_len = meta.get_object_size() - sizeof(req.obj_id) -
+                         Object::kHeaderSize;
+    }
+    read_reqs[num_read_reqs++] = {
+        .ds_id = ds_id,
+        .obj_id_len = sizeof(req.obj_id),
+        .obj_id = reinterpret_cast<const uint8_t *>(&req.obj_id),
+        .data_len = &req.obj_data_len,
+        .data_buf = obj_data_addr};
+    req.posted = true;
+  }
+
+  device_ptr_->read_objects(num_read_reqs, read_reqs);
+  wmb();
+  Stats::inc_batch_swap_in_objects(num_read_reqs);
+
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    auto &req = reqs[i];
+    if (i && req.obj_id == reqs[i - 1].obj_id) {
+      continue;
+    }
+    if (!req.posted) {
+      continue;
+    }
+    auto &meta = req.ptr->meta();
+    auto obj = Object(req.obj_addr);
+    obj.init(meta.get_ds_id(), req.obj_data_len, sizeof(req.obj_id),
+             reinterpret_cast<uint8_t *>(&req.obj_id));
     if (!meta.is_shared()) {
-      meta.set_present(obj_addr);
+      meta.set_present(req.obj_addr);
     } else {
-      reinterpret_cast<GenericSharedPtr *>(ptr)->traverse(
-          [=](GenericFarMemPtr *ptr) { ptr->meta().set_present(obj_addr); });
+      reinterpret_cast<GenericSharedPtr *>(req.ptr)->traverse(
+          [=](GenericFarMemPtr *ptr) {
+            ptr->meta().set_present(req.obj_addr);
+          });
+    }
+    Region::atomic_inc_ref_cnt(req.obj_addr, -1);
+    unlock_object(sizeof(req.obj_id),
+                  reinterpret_cast<const uint8_t *>(&req.obj_id));
+  }
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    if (unlikely(reqs[i].stale)) {
+      swap_in(nt, reqs[i].ptr);
     }
-    Region::atomic_inc_ref_cnt(obj_addr, -1);
   }
 }
 
-void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
+// Returns true if the write-back of obj has been deferred into batch. In that
+// case, the object must stay locked until flush_write_back_batch() is called.
+bool FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj,
+                             GCWriteBackBatch *batch) {
   assert(preempt_enabled());
 
   auto &meta = ptr->meta();
 #ifndef STW_GC
   if (unlikely(!meta.is_evacuation())) {
-    return;
+    return false;
   }
 #endif
 
@@ -337,6 +553,7 @@ void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
         memcpy(reinterpret_cast<void *>(new_local_object_addr),
                reinterpret_cast<void *>(obj.get_addr()), obj_size);
       }
+      copy_dirty_lines(obj, Object(new_local_object_addr));
       if (!meta.is_shared()) {
         meta.gc_copy(new_local_object_addr);
       } else {
@@ -346,30 +563,98 @@ void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
             });
       }
       Region::atomic_inc_ref_cnt(new_local_object_addr, -1);
-      return;
+      return false;
     }
   }
 
   auto obj_id = obj.get_obj_id();
   auto obj_id_len = obj.get_obj_id_len();
-  auto obj_size = obj.size();
   auto ds_id = obj.get_ds_id();
   auto data_ptr = reinterpret_cast<const uint8_t *>(obj.get_data_addr());
 
+  // An object that is not dirty as a whole may still have dirty extents.
+  ObjectExtent extents[DirtyLines::kMaxNumExtents];
+  uint8_t num_extents = 0;
+  if (!dirty) {
+    num_extents = DirtyLines::get_extents(obj.get_data_addr(),
+                                          obj.get_data_len(), extents);
+    if (num_extents && evac_notifiers_[ds_id]) {
+      // Evac notifiers write back whole objects.
+      dirty = true;
+      num_extents = 0;
+    }
+  }
+
+  if (batch && (dirty || num_extents) && !evac_notifiers_[ds_id]) {
+    assert(!batch->is_full());
+    auto idx = batch->num_objs++;
+    std::copy(extents, extents + num_extents, batch->extents[idx]);
+    batch->reqs[idx] = {.ds_id = ds_id,
+                        .obj_id_len = obj_id_len,
+                        .obj_id = obj_id,
+                        .data_len = obj.get_data_len(),
+                        .data_buf = data_ptr,
+                        .num_extents = num_extents,
+                        .extents = batch->extents[idx]};
+    batch->ptrs[idx] = ptr;
+    batch->objs[idx] = obj;
+    return true;
+  }
+
   auto write_object_fn = [&](uint32_t data_len) {
     if (dirty) {
       device_ptr_->write_object(ds_id, obj_id_len, obj_id, data_len, data_ptr);
+      Stats::inc_gc_write_back_bytes(data_len);
+      Stats::inc_gc_write_back_objects(1);
+    } else if (num_extents) {
+      ObjectWriteReq req = {.ds_id = ds_id,
+                            .obj_id_len = obj_id_len,
+                            .obj_id = obj_id,
+                            .data_len = static_cast<uint16_t>(data_len),
+                            .data_buf = data_ptr,
+                            .num_extents = num_extents,
+                            .extents = extents};
+      device_ptr_->write_object_extents(ds_id, obj_id_len, obj_id, data_len,
+                                        data_ptr, num_extents, extents);
+      Stats::inc_gc_write_back_bytes(req.get_num_bytes());
+      Stats::inc_gc_write_back_objects(1);
+      Stats::inc_gc_write_back_partial_objects(1);
+    } else {
+      device_ptr_->cache_clean_object(ds_id, obj_id_len, obj_id, data_len,
+                                      data_ptr);
     }
   };
 
   if (auto evac_notifier = evac_notifiers_[ds_id]) {
     if (evac_notifier(obj, write_object_fn)) { // Ptr removed.
-      return;
+      return false;
     }
   } else {
     write_object_fn(obj.get_data_len());
   }
 
+  finish_swap_out(ptr, obj);
+  return false;
+}
+
+// Carries the dirty lines of obj over to its copy; data structures with copy
+// notifiers may lay the copy out differently, so it then becomes dirty as a
+// whole.
+void FarMemManager::copy_dirty_lines(Object from, Object to) {
+  if (!copy_notifiers_[from.get_ds_id()]) {
+    DirtyLines::copy(from.get_data_addr(), to.get_data_addr(),
+                     from.get_data_len());
+  } else if (DirtyLines::test(from.get_data_addr(), from.get_data_len())) {
+    DirtyLines::mark(to.get_data_addr(), to.get_data_len());
+  }
+}
+
+void FarMemManager::finish_swap_out(GenericFarMemPtr *ptr, Object obj) {
+  auto &meta = ptr->meta();
+  auto obj_id = obj.get_obj_id();
+  auto obj_size = obj.size();
+  auto ds_id = obj.get_ds_id();
+
   if (!meta.is_shared()) {
     meta.gc_wb(ds_id, obj_size, *reinterpret_cast<const uint64_t *>(obj_id));
   } else {
@@ -381,6 +666,24 @@ void FarMemManager::swap_out(GenericFarMemPtr *ptr, Object obj) {
   }
 }
 
+void FarMemManager::flush_write_back_batch(GCWriteBackBatch *batch) {
+  if (!batch->num_objs) {
+    return;
+  }
+  device_ptr_->write_objects(batch->num_objs, batch->reqs);
+  for (uint32_t i = 0; i < batch->num_objs; i++) {
+    auto obj = batch->objs[i];
+    Stats::inc_gc_write_back_bytes(batch->reqs[i].get_num_bytes());
+    if (batch->reqs[i].num_extents) {
+      Stats::inc_gc_write_back_partial_objects(1);
+    }
+    finish_swap_out(batch->ptrs[i], obj);
+    FarMemManager::unlock_object(obj.get_obj_id_len(), obj.get_obj_id());
+  }
+  Stats::inc_gc_write_back_objects(batch->num_objs);
+  batch->num_objs = 0;
+}
+
 /*
   A naive from-region picker according to the simple round-robin order.
  */
@@ -395,6 +698,14 @@ void FarMemManager::pick_from_regions() {
       std::min(kMaxNumRegionsPerGCRound,
                static_cast<uint32_t>(ratio_per_gc_round *
                                      cache_region_manager_.get_num_regions()));
+  if (ACCESS_ONCE(region_picker_) == RegionPicker::kCostBenefit) {
+    pick_from_regions_cost_benefit(num_regions_per_gc_round);
+  } else {
+    pick_from_regions_round_robin(num_regions_per_gc_round);
+  }
+}
+
+void FarMemManager::pick_from_regions_round_robin(uint32_t num_regions) {
   do {
     auto optional_region = pop_cache_used_region();
     if (unlikely(!optional_region)) {
@@ -403,7 +714,118 @@ void FarMemManager::pick_from_regions() {
     preempt_disable();
     from_regions_.push_back(std::move(*optional_region));
     preempt_enable();
-  } while (from_regions_.size() < num_regions_per_gc_round);
+  } while (from_regions_.size() < num_regions);
+}
+
+// Scores the oldest used regions and picks the best ones. The rest go back to
+// the used lists in their original order.
+void FarMemManager::pick_from_regions_cost_benefit(uint32_t num_regions) {
+  preempt_disable();
+  pick_candidates_.clear();
+  cache_region_manager_.pop_used_regions(
+      kNumPickCandidatesPerRegion * num_regions, &pick_candidates_);
+  preempt_enable();
+
+  auto now_us = microtime();
+  std::vector<std::pair<double, uint32_t>> scores;
+  scores.reserve(pick_candidates_.size());
+  for (uint32_t i = 0; i < pick_candidates_.size(); i++) {
+    scores.emplace_back(region_cost_benefit(pick_candidates_[i], now_us), i);
+  }
+  auto num_picked = std::min(num_regions,
+                             static_cast<uint32_t>(pick_candidates_.size()));
+  std::partial_sort(scores.begin(), scores.begin() + num_picked, scores.end(),
+                    [](const auto &a, const auto &b) { return a.first > b.first; });
+  // Picked candidates are left invalid (i.e., moved out) in pick_candidates_.
+  std::sort(scores.begin(), scores.begin() + num_picked,
+            [](const auto &a, const auto &b) { return a.second < b.second; });
+
+  preempt_disable();
+  for (uint32_t i = 0; i < num_picked; i++) {
+    from_regions_.push_back(std::move(pick_candidates_[scores[i].second]));
+  }
+  std::vector<Region> unpicked;
+  unpicked.reserve(pick_candidates_.size() - num_picked);
+  for (auto &region : pick_candidates_) {
+    if (!region.is_invalid()) {
+      unpicked.push_back(std::move(region));
+    }
+  }
+  preempt_enable();
+  cache_region_manager_.unpop_used_regions(&unpicked);
+}
+
+// Estimates the space that evacuating region frees per byte it writes back to
+// far memory, weighted by the age of the region. Live bytes are exact, while
+// the hot (i.e., to be copied back into the cache) and dirty bytes are
+// extrapolated from a sample of objects.
+double FarMemManager::region_cost_benefit(const Region &region,
+                                          uint64_t now_us) {
+  auto for_each_object = [&](auto &&fn) {
+    for (uint8_t i = 0; i < region.get_num_boundaries(); i++) {
+      auto [left, right] = region.get_boundary(i);
+      auto cur = left;
+      while (cur + Object::kHeaderSize < right) {
+        auto obj = Object(cur);
+        auto obj_size = obj.size();
+        if (!obj.is_freed()) {
+          fn(obj, obj_size);
+        }
+        cur += helpers::align_to(obj_size, sizeof(FarMemPtrMeta));
+      }
+    }
+  };
+
+  uint64_t live_bytes = 0;
+  uint64_t num_live_objs = 0;
+  for_each_object([&](Object obj, uint16_t obj_size) {
+    live_bytes += obj_size;
+    num_live_objs++;
+  });
+
+  // Sampled objects are only inspected if they can be locked without waiting,
+  // as the GC master may run with preemption disabled here.
+  auto sample_interval =
+      std::max(static_cast<uint64_t>(1),
+               num_live_objs / kMaxNumSampledObjectsPerRegion);
+  uint64_t live_obj_idx = 0;
+  uint64_t sampled_bytes = 0;
+  uint64_t hot_bytes = 0;
+  uint64_t dirty_bytes = 0;
+  for_each_object([&](Object obj, uint16_t obj_size) {
+    if (live_obj_idx++ % sample_interval) {
+      return;
+    }
+    auto optional_obj_id = try_lock_local_object(obj);
+    if (!optional_obj_id) {
+      return;
+    }
+    if (likely(!obj.is_freed())) {
+      auto &meta =
+          reinterpret_cast<GenericFarMemPtr *>(obj.get_ptr_addr())->meta();
+      sampled_bytes += obj_size;
+      if (meta.is_hot() && !meta.is_nt()) {
+        hot_bytes += obj_size;
+      }
+      if (meta.is_dirty()) {
+        dirty_bytes += obj_size;
+      }
+    }
+    unlock_object_id(*optional_obj_id);
+  });
+
+  double hot_ratio =
+      sampled_bytes ? static_cast<double>(hot_bytes) / sampled_bytes : 0;
+  double dirty_ratio =
+      sampled_bytes ? static_cast<double>(dirty_bytes) / sampled_bytes : 0;
+  double freed_bytes = Region::kSize - hot_ratio * live_bytes;
+  double written_bytes = dirty_ratio * live_bytes;
+  double age_us = now_us - cache_region_manager_.get_used_since_us(region) + 1;
+  return freed_bytes * age_us / (Region::kSize + written_bytes);
+}
+
+void FarMemManager::set_region_picker(RegionPicker region_picker) {
+  ACCESS_ONCE(region_picker_) = region_picker;
 }
 
 GCParallelizer::GCParallelizer(uint32_t num_slaves, uint32_t task_queues_depth,
@@ -428,11 +850,9 @@ void GCParallelMarker::slave_fn(uint32_t tid) {
       while (cur + Object::kHeaderSize < right) {
         auto obj = Object(cur);
         if (!obj.is_freed()) {
-          auto obj_id_len = obj.get_obj_id_len();
-          auto *obj_id = obj.get_obj_id();
-          FarMemManager::lock_object(obj_id_len, obj_id);
+          auto obj_id = FarMemManager::lock_local_object(obj);
           auto guard = helpers::finally(
-              [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+              [&]() { FarMemManager::unlock_object_id(obj_id); });
           if (likely(!obj.is_freed())) {
             auto *ptr =
                 reinterpret_cast<GenericFarMemPtr *>(obj.get_ptr_addr());
@@ -488,6 +908,7 @@ void GCParallelWriteBacker::slave_fn(uint32_t tid) {
   preempt_disable();
   start_gc_us[get_core_num()].c = microtime();
   preempt_enable();
+  GCWriteBackBatch batch;
   while (!slave_can_exit(tid)) {
     GCTask task;
     if (slave_dequeue_task(tid, &task)) {
@@ -497,24 +918,36 @@ void GCParallelWriteBacker::slave_fn(uint32_t tid) {
       while (cur + Object::kHeaderSize < right) {
         auto obj = Object(cur);
         if (!obj.is_freed()) {
-          auto obj_id_len = obj.get_obj_id_len();
-          auto *obj_id = obj.get_obj_id();
-          FarMemManager::lock_object(obj_id_len, obj_id);
-          auto guard = helpers::finally(
-              [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+          // Mutators (e.g., swap_in_batch()) lock objects in a different
+          // order, so never block on a lock while holding the batched ones.
+          auto optional_obj_id = FarMemManager::try_lock_local_object(obj);
+          if (!optional_obj_id) {
+            manager->flush_write_back_batch(&batch);
+            optional_obj_id = FarMemManager::lock_local_object(obj);
+          }
+          auto obj_id = *optional_obj_id;
+          bool deferred = false;
           if (likely(!obj.is_freed())) {
             auto *ptr =
                 reinterpret_cast<GenericFarMemPtr *>(obj.get_ptr_addr());
-            manager->swap_out(ptr, obj);
+            deferred = manager->swap_out(ptr, obj, &batch);
+          }
+          if (!deferred) {
+            FarMemManager::unlock_object_id(obj_id);
+          } else if (batch.is_full()) {
+            manager->flush_write_back_batch(&batch);
           }
         }
         cur += helpers::align_to(obj.size(), sizeof(FarMemPtrMeta));
       }
+      // Do not hold the batched objects' locks across tasks.
+      manager->flush_write_back_batch(&batch);
     }
   }
 }
 
 void FarMemManager::write_back_regions() {
+  auto start_us = microtime();
   Status slaves_status[num_gc_threads_];
   for (uint32_t i = 0; i < num_gc_threads_; i++) {
     slaves_status[i] = GC;
@@ -524,6 +957,7 @@ void FarMemManager::write_back_regions() {
   start_prioritizing(GC);
 #endif
   parallel_write_backer_.execute();
+  Stats::inc_gc_write_back_us(microtime() - start_us);
 }
 
 void FarMemManager::start_prioritizing(Status status) {
@@ -726,7 +1160,12 @@ retry_allocate_far_mem:
     }
     goto retry_allocate_far_mem;
   }
-  return *optional_remote_addr;
+  auto remote_addr = *optional_remote_addr;
+  auto &index = far_mem_region_index(remote_addr);
+  index.spin.Lock();
+  index.live_bytes += helpers::align_to(object_size, sizeof(FarMemPtrMeta));
+  index.spin.Unlock();
+  return remote_addr;
 }
 
 void FarMemManager::mutator_wait_for_gc_cache() {
@@ -744,17 +1183,248 @@ void FarMemManager::mutator_wait_for_gc_cache() {
 #ifdef STW_GC
   launch_gc_master();
 #endif
+  auto start_us = microtime();
   do {
     mutator_cache_condvar_.Wait(&gc_lock_);
   } while (ACCESS_ONCE(almost_empty));
   guard.reset();
+  Stats::inc_mutator_gc_wait_us(microtime() - start_us);
 #ifdef DEBUG
   LOG_PRINTF("%s\n", "Warn: mutator paused due to insufficient memory.");
 #endif
 }
 
 void FarMemManager::mutator_wait_for_gc_far_mem() {
-  LOG_PRINTF("%s\n", "Warn: GCing far mem has not been implemented yet.");
+  assert(preempt_enabled());
+  far_mem_gc_lock_.Lock();
+  if (far_mem_gc_active_) {
+    // Another mutator is collecting far mem; wait for it to finish.
+    do {
+      mutator_far_mem_condvar_.Wait(&far_mem_gc_lock_);
+    } while (far_mem_gc_active_);
+    far_mem_gc_lock_.Unlock();
+    return;
+  }
+  far_mem_gc_active_ = true;
+  far_mem_gc_lock_.Unlock();
+
+  auto start_us = microtime();
+  bool reclaimed = gc_far_mem();
+  Stats::inc_far_mem_gc_us(microtime() - start_us);
+
+  far_mem_gc_lock_.Lock();
+  far_mem_gc_active_ = false;
+  mutator_far_mem_condvar_.SignalAll();
+  far_mem_gc_lock_.Unlock();
+
+  if (unlikely(!reclaimed)) {
+    LOG_PRINTF("%s\n", "Error: runs out of far memory.");
+    exit(-ENOSPC);
+  }
+}
+
+void FarMemManager::track_far_mem_object(uint64_t remote_addr,
+                                         uint32_t object_size,
+                                         GenericFarMemPtr *ptr) {
+  FarMemRegionIndex::Entry entry = {
+      .offset = static_cast<uint32_t>(remote_addr & (Region::kSize - 1)),
+      .size = static_cast<uint32_t>(helpers::align_to(
+          static_cast<uint64_t>(object_size), sizeof(FarMemPtrMeta))),
+      .ptr = ptr};
+  auto &index = far_mem_region_index(remote_addr);
+  index.spin.Lock();
+  // Objects are almost always tracked in their allocation order.
+  auto iter = index.entries.end();
+  while (iter != index.entries.begin() && (iter - 1)->offset > entry.offset) {
+    iter--;
+  }
+  index.entries.insert(iter, entry);
+  index.spin.Unlock();
+}
+
+void FarMemManager::untrack_far_mem_object(uint64_t remote_addr) {
+  auto &index = far_mem_region_index(remote_addr);
+  index.spin.Lock();
+  auto *entry =
+      index.find(static_cast<uint32_t>(remote_addr & (Region::kSize - 1)));
+  if (likely(entry && entry->ptr)) {
+    entry->ptr = nullptr;
+    index.live_bytes -= entry->size;
+  }
+  index.spin.Unlock();
+}
+
+void FarMemManager::retrack_far_mem_object(uint64_t remote_addr,
+                                           GenericFarMemPtr *from,
+                                           GenericFarMemPtr *to) {
+  auto &index = far_mem_region_index(remote_addr);
+  index.spin.Lock();
+  auto *entry =
+      index.find(static_cast<uint32_t>(remote_addr & (Region::kSize - 1)));
+  if (entry && entry->ptr == from) {
+    entry->ptr = to;
+  }
+  index.spin.Unlock();
+}
+
+// Moves a live vanilla object out of its far-mem region into
+// far_mem_gc_to_region_, and then rewrites its object ID, which is stored in
+// the local object if the object is present or in the pointer metadata
+// otherwise. The data is copied on the remote side by devices that support it,
+// e.g., TCPDevice; the others move it through far_mem_gc_buf_. Everyone else
+// touching the object locks it and revalidates the ID afterwards (see swap_in()
+// and lock_local_object()).
+// Returns false if the to-region has run out of space.
+bool FarMemManager::relocate_far_mem_object(uint64_t obj_id) {
+  lock_object(sizeof(obj_id), reinterpret_cast<const uint8_t *>(&obj_id));
+  auto guard = helpers::finally([&]() {
+    unlock_object(sizeof(obj_id), reinterpret_cast<const uint8_t *>(&obj_id));
+  });
+
+  auto &from_index = far_mem_region_index(obj_id);
+  from_index.spin.Lock();
+  auto *entry =
+      from_index.find(static_cast<uint32_t>(obj_id & (Region::kSize - 1)));
+  auto *ptr = entry ? entry->ptr : nullptr;
+  auto size = entry ? entry->size : 0;
+  from_index.spin.Unlock();
+  if (!ptr) {
+    // Freed in the meantime.
+    return true;
+  }
+
+  auto &meta = ptr->meta();
+  bool present = meta.is_present();
+  Object obj;
+  uint8_t ds_id;
+  uint16_t data_len;
+  if (present) {
+    obj = meta.object();
+    if (unlikely(get_obj_id_fragment(obj.get_obj_id_len(),
+                                     obj.get_obj_id()) != obj_id)) {
+      return true;
+    }
+    ds_id = obj.get_ds_id();
+    data_len = obj.get_data_len();
+  } else {
+    if (unlikely(meta.get_object_id() != obj_id)) {
+      return true;
+    }
+    ds_id = meta.get_ds_id();
+    data_len = meta.get_object_size() - Object::kHeaderSize - sizeof(obj_id);
+  }
+
+  auto optional_new_obj_id = far_mem_gc_to_region_.allocate_object(size);
+  if (unlikely(!optional_new_obj_id)) {
+    return false;
+  }
+  auto new_obj_id = *optional_new_obj_id;
+  device_ptr_->copy_object(ds_id, sizeof(obj_id),
+                           reinterpret_cast<const uint8_t *>(&obj_id),
+                           reinterpret_cast<const uint8_t *>(&new_obj_id),
+                           data_len, far_mem_gc_buf_.get());
+
+  if (present) {
+    // A dirty object will be written back to its new location later on.
+    obj.set_obj_id(reinterpret_cast<const uint8_t *>(&new_obj_id),
+                   sizeof(new_obj_id));
+  } else {
+    auto obj_size = meta.get_object_size();
+    if (!meta.is_shared()) {
+      meta.gc_wb(ds_id, obj_size, new_obj_id);
+    } else {
+      reinterpret_cast<GenericSharedPtr *>(ptr)->traverse(
+          [=](GenericFarMemPtr *ptr) {
+            ptr->meta().gc_wb(ds_id, obj_size, new_obj_id);
+          });
+    }
+  }
+
+  auto &to_index = far_mem_region_index(new_obj_id);
+  to_index.spin.Lock();
+  to_index.live_bytes += size;
+  to_index.spin.Unlock();
+  track_far_mem_object(new_obj_id, size, ptr);
+  untrack_far_mem_object(obj_id);
+  Stats::inc_far_mem_gc_relocated_bytes(size);
+  return true;
+}
+
+/*
+  Far-mem GC. Used far-mem regions whose live ratio is below
+  kFarMemGCLiveRatioThresh are compacted by relocating their survivors into
+  far_mem_gc_to_region_, and then go back to the free list. Returns whether the
+  free list is non-empty afterwards.
+ */
+bool FarMemManager::gc_far_mem() {
+  std::vector<Region> from_regions;
+  from_regions.reserve(kMaxNumRegionsPerFarMemGCRound);
+  far_mem_region_manager_.pick_used_regions(
+      [&](const Region &region) {
+        auto &index = far_mem_region_indices_[region.get_idx()];
+        return ACCESS_ONCE(index.live_bytes) <
+               kFarMemGCLiveRatioThresh * Region::kSize;
+      },
+      kMaxNumRegionsPerFarMemGCRound, &from_regions);
+
+  // Retires the current to-region (if any) into the used list, and picks a
+  // free region as the new one.
+  auto refill_to_region_fn = [&]() {
+    auto optional_region = far_mem_region_manager_.pop_free_region();
+    if (!far_mem_gc_to_region_.is_invalid()) {
+      far_mem_region_manager_.push_used_region(far_mem_gc_to_region_);
+    }
+    if (!optional_region) {
+      return false;
+    }
+    far_mem_gc_to_region_ = std::move(*optional_region);
+    return true;
+  };
+
+  bool to_region_exhausted = far_mem_gc_to_region_.is_invalid();
+  std::vector<uint32_t> offsets;
+  for (auto &from_region : from_regions) {
+    auto &index = far_mem_region_indices_[from_region.get_idx()];
+    offsets.clear();
+    index.spin.Lock();
+    for (auto &entry : index.entries) {
+      if (entry.ptr) {
+        offsets.push_back(entry.offset);
+      }
+    }
+    index.spin.Unlock();
+
+    auto region_addr = static_cast<uint64_t>(from_region.get_idx())
+                       << Region::kShift;
+    for (auto offset : offsets) {
+      if (to_region_exhausted) {
+        break;
+      }
+      while (!relocate_far_mem_object(region_addr + offset)) {
+        if (!refill_to_region_fn()) {
+          to_region_exhausted = true;
+          break;
+        }
+      }
+    }
+
+    index.spin.Lock();
+    bool reclaimable = !index.live_bytes;
+    if (reclaimable) {
+      index.entries.clear();
+    }
+    index.spin.Unlock();
+    if (reclaimable) {
+      far_mem_region_manager_.push_free_region(from_region);
+      Stats::inc_far_mem_gc_reclaimed_regions(1);
+      if (to_region_exhausted && refill_to_region_fn()) {
+        to_region_exhausted = false;
+      }
+    } else {
+      far_mem_region_manager_.push_used_region(from_region);
+    }
+  }
+  return far_mem_region_manager_.get_free_region_ratio() > 0;
 }
 
 void FarMemManager::launch_gc_master() {
@@ -802,13 +1472,18 @@ bool FarMemManager::reallocate_generic_unique_ptr_nb(const DerefScope &scope,
   memcpy(reinterpret_cast<char *>(local_object_addr) + Object::kHeaderSize,
          data_buf, new_item_size);
   wmb();
+  uint64_t remote_object_addr;
+  if (old_obj_ds_id == kVanillaPtrDSID) {
+    // Allocated before the pointer is updated, as it may trigger far-mem GC.
+    remote_object_addr = allocate_remote_object(false, new_obj_size);
+  }
   ptr->init(local_object_addr);
   if (old_obj_ds_id == kVanillaPtrDSID) {
-    auto remote_object_addr = allocate_remote_object(false, new_obj_size);
     assert(old_obj_id_len == kVanillaPtrObjectIDSize);
     Object(local_object_addr, old_obj_ds_id,
            static_cast<uint16_t>(new_item_size), kVanillaPtrObjectIDSize,
            reinterpret_cast<const uint8_t *>(&remote_object_addr));
+    track_far_mem_object(remote_object_addr, new_obj_size, ptr);
   } else {
     Object(local_object_addr, old_obj_ds_id,
            static_cast<uint16_t>(new_item_size), old_obj_id_len,
@@ -816,7 +1491,14 @@ bool FarMemManager::reallocate_generic_unique_ptr_nb(const DerefScope &scope,
   }
   wmb();
   // Free old object and update the pointer.
-  old_obj.free();
+  if (old_obj_ds_id == kVanillaPtrDSID) {
+    auto old_obj_id = lock_local_object(old_obj);
+    untrack_far_mem_object(old_obj_id);
+    old_obj.free();
+    unlock_object_id(old_obj_id);
+  } else {
+    old_obj.free();
+  }
   Region::atomic_inc_ref_cnt(local_object_addr, -1);
   return true;
 }
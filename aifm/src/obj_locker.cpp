@@ -1,3 +1,6 @@
+extern "C" {
+#include <runtime/thread.h>
+}
 #include "sync.h"
 
 #include "helpers.hpp"
@@ -6,47 +9,175 @@
 
 namespace far_memory {
 
-ObjLocker::ObjLocker() {}
+ObjLocker::ObjLocker() {
+  for (auto &bucket : buckets_) {
+    for (auto &obj_id : bucket.obj_ids) {
+      obj_id.store(kEmpty, std::memory_order_relaxed);
+    }
+  }
+  for (auto &num_overflowed : num_overflowed_) {
+    num_overflowed.store(0, std::memory_order_relaxed);
+  }
+}
 
+// Mixes all of the bits in, so that the IDs that only differ in their high
+// bytes (e.g., the hashtable keys that share their low bytes) spread across
+// buckets.
 uint32_t ObjLocker::hash_func(uint64_t x) {
-#ifdef USE_UNIFORM_HASH
-  constexpr uint32_t a = 17;
-  constexpr uint32_t b = 47;
-  constexpr uint32_t c = 211;
+  return (x * 0x9e3779b97f4a7c15ULL) >> (64 - kNumBucketsShift);
+}
+
+ObjLocker::SlotState &ObjLocker::slot_state(uint32_t bucket_idx,
+                                            uint32_t slot) {
+  return slot_states_[bucket_idx * kNumSlotsPerBucket + slot];
+}
+
+// Claims a free slot of the bucket for obj_id, or overflows it if the bucket
+// is full. On failure, *holder_slot is the slot where obj_id is in flight, or
+// kNumSlotsPerBucket if it is in flight in the overflow set.
+bool ObjLocker::try_claim(uint32_t bucket_idx, uint64_t obj_id,
+                          uint32_t *holder_slot) {
+  auto &bucket = buckets_[bucket_idx];
+retry:
+  uint32_t free_slot = kNumSlotsPerBucket;
+  for (uint32_t i = 0; i < kNumSlotsPerBucket; i++) {
+    auto cur = bucket.obj_ids[i].load();
+    if (cur == obj_id) {
+      *holder_slot = i;
+      return false;
+    }
+    if (cur == kEmpty && free_slot == kNumSlotsPerBucket) {
+      free_slot = i;
+    }
+  }
+  if (unlikely(free_slot == kNumSlotsPerBucket)) {
+    return try_claim_overflow(bucket_idx, obj_id, holder_slot);
+  }
+  auto expected = kEmpty;
+  if (unlikely(
+          !bucket.obj_ids[free_slot].compare_exchange_strong(expected, obj_id))) {
+    goto retry;
+  }
 
-  auto low = (uint32_t)x;
-  auto high = (uint32_t)(x >> 32);
-  auto val = a * low + b * high + c;
+  // Two threads may have claimed different slots for the same obj_id at the
+  // same time. As all accesses are sequentially consistent, at least one of
+  // them observes the other here and backs off.
+  for (uint32_t i = 0; i < kNumSlotsPerBucket; i++) {
+    if (i != free_slot && unlikely(bucket.obj_ids[i].load() == obj_id)) {
+      release(bucket_idx, free_slot);
+      *holder_slot = i;
+      return false;
+    }
+  }
+  // Pairs with try_claim_overflow(): either the overflowed obj_id is observed
+  // here, or the overflowing claimer observes the slot claimed above.
+  if (unlikely(num_overflowed_[bucket_idx].load()) &&
+      is_overflowed(obj_id)) {
+    release(bucket_idx, free_slot);
+    *holder_slot = kNumSlotsPerBucket;
+    return false;
+  }
+  slot_state(bucket_idx, free_slot).held.store(true);
+  return true;
+}
 
-  return val & (kNumMaps - 1);
-#else
-  return x & (kNumMaps - 1);
-#endif
+bool ObjLocker::try_claim_overflow(uint32_t bucket_idx, uint64_t obj_id,
+                                   uint32_t *holder_slot) {
+  auto &bucket = buckets_[bucket_idx];
+  overflow_spin_.Lock();
+  auto guard = helpers::finally([&]() { overflow_spin_.Unlock(); });
+  // Counted ahead of the scan, see try_claim().
+  num_overflowed_[bucket_idx]++;
+  for (uint32_t i = 0; i < kNumSlotsPerBucket; i++) {
+    if (unlikely(bucket.obj_ids[i].load() == obj_id)) {
+      num_overflowed_[bucket_idx]--;
+      *holder_slot = i;
+      return false;
+    }
+  }
+  if (unlikely(!overflowed_obj_ids_.insert(obj_id).second)) {
+    num_overflowed_[bucket_idx]--;
+    *holder_slot = kNumSlotsPerBucket;
+    return false;
+  }
+  return true;
+}
+
+bool ObjLocker::is_overflowed(uint64_t obj_id) {
+  overflow_spin_.Lock();
+  auto found = overflowed_obj_ids_.count(obj_id);
+  overflow_spin_.Unlock();
+  return found;
+}
+
+void ObjLocker::release(uint32_t bucket_idx, uint32_t slot) {
+  auto &state = slot_state(bucket_idx, slot);
+  state.held.store(false);
+  buckets_[bucket_idx].obj_ids[slot].store(kEmpty);
+  if (unlikely(state.num_waiters.load())) {
+    state.spin.Lock();
+    state.cv.SignalAll();
+    state.spin.Unlock();
+  }
+}
+
+void ObjLocker::wait(uint32_t bucket_idx, uint32_t slot, uint64_t obj_id) {
+  auto &state = slot_state(bucket_idx, slot);
+  state.spin.Lock();
+  state.num_waiters++;
+  // Pairs with release(): either the release is observed here, or the releaser
+  // observes the waiter and signals it.
+  if (buckets_[bucket_idx].obj_ids[slot].load() == obj_id) {
+    state.cv.Wait(&state.spin);
+  }
+  state.num_waiters--;
+  state.spin.Unlock();
+}
+
+void ObjLocker::wait_overflow(uint64_t obj_id) {
+  overflow_spin_.Lock();
+  while (overflowed_obj_ids_.count(obj_id)) {
+    overflow_cv_.Wait(&overflow_spin_);
+  }
+  overflow_spin_.Unlock();
 }
 
 bool ObjLocker::try_insert(uint64_t obj_id) {
-  bool success = true;
-  auto idx = hash_func(obj_id);
-  spins_[idx].Lock();
-  auto guard = helpers::finally([&] { spins_[idx].Unlock(); });
-
-  std::map<uint64_t, bool>::iterator iter;
-  if ((iter = maps_[idx].find(obj_id)) == maps_[idx].end()) {
-    maps_[idx].try_emplace(obj_id);
+  assert(obj_id != kEmpty);
+  auto bucket_idx = hash_func(obj_id);
+  uint32_t holder_slot;
+  if (likely(try_claim(bucket_idx, obj_id, &holder_slot))) {
+    return true;
+  }
+  if (holder_slot == kNumSlotsPerBucket) {
+    wait_overflow(obj_id);
   } else {
-    success = false;
-    cvs_[idx].Wait(&spins_[idx]);
+    wait(bucket_idx, holder_slot, obj_id);
   }
-  return success;
+  return false;
+}
+
+bool ObjLocker::try_lock(uint64_t obj_id) {
+  assert(obj_id != kEmpty);
+  uint32_t holder_slot;
+  return try_claim(hash_func(obj_id), obj_id, &holder_slot);
 }
 
 void ObjLocker::remove(uint64_t obj_id) {
-  auto idx = hash_func(obj_id);
-  spins_[idx].Lock();
-  auto iter = maps_[idx].find(obj_id);
-  assert(iter != maps_[idx].end());
-  cvs_[idx].SignalAll();
-  maps_[idx].erase(iter);
-  spins_[idx].Unlock();
+  auto bucket_idx = hash_func(obj_id);
+  auto &bucket = buckets_[bucket_idx];
+  for (uint32_t i = 0; i < kNumSlotsPerBucket; i++) {
+    // Skip the slot of a concurrent claimer that is about to back off.
+    if (bucket.obj_ids[i].load() == obj_id &&
+        slot_state(bucket_idx, i).held.load()) {
+      release(bucket_idx, i);
+      return;
+    }
+  }
+  overflow_spin_.Lock();
+  BUG_ON(!overflowed_obj_ids_.erase(obj_id));
+  num_overflowed_[bucket_idx]--;
+  overflow_cv_.SignalAll();
+  overflow_spin_.Unlock();
 }
 } // namespace far_memory
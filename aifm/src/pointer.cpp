@@ -58,6 +58,11 @@ void GenericFarMemPtr::swap_in(bool nt) {
   FarMemManagerFactory::get()->swap_in(nt, this);
 }
 
+void GenericFarMemPtr::swap_in_batch(bool nt, uint32_t num_ptrs,
+                                     GenericFarMemPtr **ptrs) {
+  FarMemManagerFactory::get()->swap_in_batch(nt, num_ptrs, ptrs);
+}
+
 bool GenericFarMemPtr::mutator_migrate_object() {
   auto *manager = FarMemManagerFactory::get();
 
@@ -67,11 +72,9 @@ bool GenericFarMemPtr::mutator_migrate_object() {
     return false;
   }
 
-  auto obj_id_len = object.get_obj_id_len();
-  auto *obj_id = object.get_obj_id();
-  FarMemManager::lock_object(obj_id_len, obj_id);
-  auto guard = helpers::finally(
-      [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+  auto obj_id = FarMemManager::lock_local_object(object);
+  auto guard =
+      helpers::finally([&]() { FarMemManager::unlock_object_id(obj_id); });
 
   if (unlikely(!meta().is_present() || !meta().is_evacuation())) {
     return false;
@@ -96,6 +99,7 @@ bool GenericFarMemPtr::mutator_migrate_object() {
     memcpy(reinterpret_cast<void *>(new_local_object_addr),
            reinterpret_cast<void *>(object.get_addr()), object_size);
   }
+  manager->copy_dirty_lines(object, Object(new_local_object_addr));
   Region::atomic_inc_ref_cnt(new_local_object_addr, -1);
 
   if (!meta().is_shared()) {
@@ -113,27 +117,48 @@ bool GenericFarMemPtr::mutator_migrate_object() {
 void GenericFarMemPtr::_flush(bool obj_locked) {
 restart:
   FarMemPtrMeta meta_snapshot = meta();
-  if (unlikely(meta_snapshot.is_present() && meta_snapshot.is_dirty())) {
+  if (unlikely(!meta_snapshot.is_present())) {
+    return;
+  }
+  auto obj = meta_snapshot.object();
+  bool dirty = meta_snapshot.is_dirty();
+  if (unlikely(dirty || DirtyLines::test(obj.get_data_addr(),
+                                         obj.get_data_len()))) {
     auto obj_id_len = sizeof(uint64_t);
-    auto obj = meta_snapshot.object();
     auto obj_id_ptr = obj.get_obj_id();
+    uint64_t obj_id;
 
     auto guard = helpers::finally([&]() {
       if (!obj_locked) {
-        FarMemManager::unlock_object(obj_id_len, obj_id_ptr);
+        FarMemManager::unlock_object_id(obj_id);
       }
     });
 
     if (!obj_locked) {
-      FarMemManager::lock_object(obj_id_len, obj_id_ptr);
+      obj_id = FarMemManager::lock_local_object(obj);
       if (unlikely(meta() != meta_snapshot)) {
         goto restart;
       }
     }
 
-    FarMemManagerFactory::get()->get_device()->write_object(
-        obj.get_ds_id(), obj_id_len, obj_id_ptr, obj.get_data_len(),
-        reinterpret_cast<const uint8_t *>(obj.get_data_addr()));
+    auto *device = FarMemManagerFactory::get()->get_device();
+    auto *data_buf = reinterpret_cast<const uint8_t *>(obj.get_data_addr());
+    ObjectExtent extents[DirtyLines::kMaxNumExtents];
+    uint8_t num_extents = 0;
+    if (!dirty) {
+      num_extents = DirtyLines::get_extents(obj.get_data_addr(),
+                                            obj.get_data_len(), extents);
+    }
+    if (num_extents) {
+      device->write_object_extents(obj.get_ds_id(), obj_id_len, obj_id_ptr,
+                                   obj.get_data_len(), data_buf, num_extents,
+                                   extents);
+    } else {
+      device->write_object(obj.get_ds_id(), obj_id_len, obj_id_ptr,
+                           obj.get_data_len(), data_buf);
+    }
+    // The lines shared with the neighboring objects stay dirty.
+    DirtyLines::clear(obj.get_data_addr(), obj.get_data_len());
     if (!meta_snapshot.is_shared()) {
       meta().clear_dirty();
     } else {
@@ -145,23 +170,23 @@ restart:
 
 void GenericFarMemPtr::move(GenericFarMemPtr &other, uint64_t reset_value) {
 retry:
-  uint8_t other_obj_id_len = sizeof(uint64_t);
-  const uint8_t *other_obj_id_ptr;
   uint64_t other_obj_id;
+  uint8_t other_ds_id;
   FarMemPtrMeta other_meta_snapshot = other.meta();
   bool other_present = other_meta_snapshot.is_present();
   Object other_object;
   if (other_present) {
     other_object = other_meta_snapshot.object();
-    other_obj_id_ptr = other_object.get_obj_id();
+    other_ds_id = other_object.get_ds_id();
+    other_obj_id = FarMemManager::lock_local_object(other_object);
   } else {
+    other_ds_id = other_meta_snapshot.get_ds_id();
     other_obj_id = other_meta_snapshot.get_object_id();
-    other_obj_id_ptr = reinterpret_cast<const uint8_t *>(&other_obj_id);
+    FarMemManager::lock_object(sizeof(other_obj_id),
+                               reinterpret_cast<uint8_t *>(&other_obj_id));
   }
-  FarMemManager::lock_object(other_obj_id_len, other_obj_id_ptr);
-  auto guard = helpers::finally([&]() {
-    FarMemManager::unlock_object(other_obj_id_len, other_obj_id_ptr);
-  });
+  auto guard = helpers::finally(
+      [&]() { FarMemManager::unlock_object_id(other_obj_id); });
 
   if (unlikely(other.meta() != other_meta_snapshot)) {
     goto retry;
@@ -169,6 +194,10 @@ retry:
 
   meta() = other.meta();
   wmb();
+  if (!other_meta_snapshot.is_null() && other_ds_id == kVanillaPtrDSID) {
+    FarMemManagerFactory::get()->retrack_far_mem_object(other_obj_id, &other,
+                                                        this);
+  }
   if (other_present) {
     if (meta().is_shared()) {
       auto *other_ptr = reinterpret_cast<GenericSharedPtr *>(&other);
@@ -190,19 +219,46 @@ void GenericUniquePtr::_free() {
   assert(meta().is_present());
 
   auto obj = object();
-  auto obj_id_len = obj.get_obj_id_len();
-  auto *obj_id = obj.get_obj_id();
-  FarMemManager::lock_object(obj_id_len, obj_id);
-  auto guard = helpers::finally(
-      [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+  auto obj_id = FarMemManager::lock_local_object(obj);
+  auto guard =
+      helpers::finally([&]() { FarMemManager::unlock_object_id(obj_id); });
 
+  if (obj.get_ds_id() == kVanillaPtrDSID) {
+    FarMemManagerFactory::get()->untrack_far_mem_object(obj_id);
+  }
   object().free();
   meta().nullify();
 }
 
+// Frees the remote copy of an absent vanilla object. Returns false if the
+// object has been swapped in meanwhile.
+bool GenericUniquePtr::_free_far_mem() {
+restart:
+  FarMemPtrMeta meta_snapshot = meta();
+  if (meta_snapshot.is_present()) {
+    return false;
+  }
+  if (meta_snapshot.get_ds_id() != kVanillaPtrDSID) {
+    return true;
+  }
+  auto obj_id = meta_snapshot.get_object_id();
+  FarMemManager::lock_object(sizeof(obj_id),
+                             reinterpret_cast<uint8_t *>(&obj_id));
+  auto guard =
+      helpers::finally([&]() { FarMemManager::unlock_object_id(obj_id); });
+  if (unlikely(meta() != meta_snapshot)) {
+    goto restart;
+  }
+  FarMemManagerFactory::get()->untrack_far_mem_object(obj_id);
+  meta().nullify();
+  return true;
+}
+
 void GenericUniquePtr::free(bool race) {
   if (!meta().is_present() && !race) {
-    return;
+    if (_free_far_mem()) {
+      return;
+    }
   }
   auto pin_guard = pin</* Shared */ false>();
   _free();
@@ -213,12 +269,9 @@ restart:
   FarMemPtrMeta meta_snapshot = meta();
   if (meta_snapshot.is_present()) {
     auto obj = meta_snapshot.object();
-    auto obj_id_len = obj.get_obj_id_len();
-    auto *obj_id = obj.get_obj_id();
-
-    FarMemManager::lock_object(obj_id_len, obj_id);
-    auto guard = helpers::finally(
-        [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+    auto obj_id = FarMemManager::lock_local_object(obj);
+    auto guard =
+        helpers::finally([&]() { FarMemManager::unlock_object_id(obj_id); });
 
     if (unlikely(meta() != meta_snapshot)) {
       goto restart;
@@ -226,7 +279,8 @@ restart:
     _flush(/* obj_locked = */ true);
     auto ds_id = obj.get_ds_id();
     auto obj_size = obj.size();
-    meta().gc_wb(ds_id, obj_size, *reinterpret_cast<const uint64_t *>(obj_id));
+    meta().gc_wb(ds_id, obj_size,
+                 *reinterpret_cast<const uint64_t *>(obj.get_obj_id()));
     obj.free();
   }
 }
@@ -236,12 +290,14 @@ void GenericSharedPtr::_free() {
   assert(meta().is_present());
 
   auto obj = object();
-  auto obj_id_len = obj.get_obj_id_len();
-  auto *obj_id = obj.get_obj_id();
-  FarMemManager::lock_object(obj_id_len, obj_id);
-  auto guard = helpers::finally(
-      [&]() { FarMemManager::unlock_object(obj_id_len, obj_id); });
+  auto obj_id = FarMemManager::lock_local_object(obj);
+  auto guard =
+      helpers::finally([&]() { FarMemManager::unlock_object_id(obj_id); });
+  bool vanilla = (obj.get_ds_id() == kVanillaPtrDSID);
   if (next_ptr_ == this) {
+    if (vanilla) {
+      FarMemManagerFactory::get()->untrack_far_mem_object(obj_id);
+    }
     object().free();
   } else {
     auto *ptr = next_ptr_;
@@ -249,6 +305,10 @@ void GenericSharedPtr::_free() {
       ptr = ptr->next_ptr_;
     }
     ptr->next_ptr_ = next_ptr_;
+    if (vanilla) {
+      FarMemManagerFactory::get()->retrack_far_mem_object(obj_id, this,
+                                                          next_ptr_);
+    }
     if (unlikely(object().get_ptr_addr() == reinterpret_cast<uint64_t>(this))) {
       object().set_ptr_addr(reinterpret_cast<uint64_t>(next_ptr_));
     }
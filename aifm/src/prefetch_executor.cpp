@@ -0,0 +1,233 @@
+extern "C" {
+#include <runtime/thread.h>
+#include <runtime/timer.h>
+}
+
+#include "prefetch_executor.hpp"
+
+#include <algorithm>
+
+namespace far_memory {
+
+PrefetchExecutor::PrefetchExecutor(uint32_t num_workers,
+                                   uint32_t max_num_inflight_objs)
+    : kMaxNumInflightObjs_(max_num_inflight_objs) {
+  for (uint32_t i = 0; i < num_workers; i++) {
+    workers_.emplace_back([&]() { worker_fn(); });
+  }
+}
+
+PrefetchExecutor::~PrefetchExecutor() {
+  sleep_spin_.Lock();
+  exit_ = true;
+  sleep_cv_.SignalAll();
+  sleep_spin_.Unlock();
+  for (auto &worker : workers_) {
+    worker.Join();
+  }
+}
+
+void PrefetchExecutor::enqueue(PrefetchTask *task) {
+  // Counted ahead of the push, so that a worker never goes to sleep while the
+  // task is in a queue.
+  num_queued_tasks_++;
+  auto &queue = task_queues_[get_core_num()];
+  queue.spin.Lock();
+  queue.tasks.push_back(task);
+  queue.spin.Unlock();
+  // Pairs with worker_fn(): either the worker observes the task before going
+  // to sleep, or it is observed here as sleeping and gets woken up.
+  if (num_sleeping_workers_.load()) {
+    sleep_spin_.Lock();
+    sleep_cv_.Signal();
+    sleep_spin_.Unlock();
+  }
+}
+
+// Pops a task from the queue of the current core, or steals one from the
+// queues of the other cores.
+PrefetchTask *PrefetchExecutor::dequeue() {
+  if (!num_queued_tasks_.load()) {
+    return nullptr;
+  }
+  auto core_num = get_core_num();
+  for (uint32_t i = 0; i < helpers::kNumCPUs; i++) {
+    auto &queue = task_queues_[(core_num + i) % helpers::kNumCPUs];
+    queue.spin.Lock();
+    if (!queue.tasks.empty()) {
+      auto *task = queue.tasks.front();
+      queue.tasks.pop_front();
+      queue.spin.Unlock();
+      num_queued_tasks_--;
+      return task;
+    }
+    queue.spin.Unlock();
+  }
+  return nullptr;
+}
+
+void PrefetchExecutor::worker_fn() {
+  while (true) {
+    auto *task = dequeue();
+    if (!task) {
+      if (num_parked_tasks_.load() && !ACCESS_ONCE(exit_)) {
+        // Backs up release(), which is what wakes up the tasks that are not
+        // throttled by bandwidth.
+        timer_sleep(get_unpark_delay_us());
+        unpark();
+        continue;
+      }
+      sleep_spin_.Lock();
+      if (exit_) {
+        sleep_spin_.Unlock();
+        break;
+      }
+      num_sleeping_workers_++;
+      while (!num_queued_tasks_.load() && !exit_) {
+        sleep_cv_.Wait(&sleep_spin_);
+      }
+      num_sleeping_workers_--;
+      sleep_spin_.Unlock();
+      continue;
+    }
+
+    task->state_.store(PrefetchTask::kRunning);
+    task->starved_ = false;
+    bool more = task->run();
+    if (more && task->starved_) {
+      task->state_.store(PrefetchTask::kQueued);
+      park(task);
+      continue;
+    }
+    uint8_t expected = PrefetchTask::kRunning;
+    if (more ||
+        !task->state_.compare_exchange_strong(expected, PrefetchTask::kIdle)) {
+      // Either the task has work left, or it has been submitted while running.
+      task->state_.store(PrefetchTask::kQueued);
+      enqueue(task);
+      thread_yield();
+    }
+  }
+}
+
+void PrefetchExecutor::submit(PrefetchTask *task) {
+  auto state = task->state_.load();
+  while (true) {
+    if (state == PrefetchTask::kIdle) {
+      if (task->state_.compare_exchange_weak(state, PrefetchTask::kQueued)) {
+        enqueue(task);
+        return;
+      }
+    } else if (state == PrefetchTask::kRunning) {
+      if (task->state_.compare_exchange_weak(state, PrefetchTask::kRerun)) {
+        return;
+      }
+    } else {
+      return;
+    }
+  }
+}
+
+void PrefetchExecutor::cancel(PrefetchTask *task) {
+  uint8_t expected = PrefetchTask::kIdle;
+  while (!task->state_.compare_exchange_strong(expected,
+                                               PrefetchTask::kCancelled)) {
+    expected = PrefetchTask::kIdle;
+    thread_yield();
+  }
+}
+
+uint32_t PrefetchExecutor::acquire(PrefetchTask *task, uint32_t num_objs,
+                                   uint32_t obj_size) {
+  auto num_inflight_objs = num_inflight_objs_.load();
+  uint32_t granted;
+  do {
+    if (num_inflight_objs >= kMaxNumInflightObjs_) {
+      task->starved_ = true;
+      return 0;
+    }
+    granted = std::min(num_objs, kMaxNumInflightObjs_ - num_inflight_objs);
+  } while (!num_inflight_objs_.compare_exchange_weak(
+      num_inflight_objs, num_inflight_objs + granted));
+
+  auto allowed = acquire_bandwidth(granted, obj_size);
+  if (allowed < granted) {
+    release(granted - allowed);
+  }
+  task->starved_ = !allowed;
+  return allowed;
+}
+
+void PrefetchExecutor::release(uint32_t num_objs) {
+  num_inflight_objs_ -= num_objs;
+  if (num_objs && num_parked_tasks_.load()) {
+    unpark();
+  }
+}
+
+void PrefetchExecutor::park(PrefetchTask *task) {
+  parked_spin_.Lock();
+  parked_tasks_.push_back(task);
+  num_parked_tasks_++;
+  parked_spin_.Unlock();
+}
+
+void PrefetchExecutor::unpark() {
+  std::vector<PrefetchTask *> tasks;
+  parked_spin_.Lock();
+  tasks.swap(parked_tasks_);
+  num_parked_tasks_ = 0;
+  parked_spin_.Unlock();
+  for (auto *task : tasks) {
+    enqueue(task);
+  }
+}
+
+// Until the tokens of the last denied object refill, or a bucket period if no
+// object is waiting for them.
+uint64_t PrefetchExecutor::get_unpark_delay_us() {
+  bandwidth_spin_.Lock();
+  auto now_us = microtime();
+  uint64_t delay_us = kBandwidthBucketUs;
+  if (refill_us_ > now_us) {
+    delay_us = std::min(delay_us, refill_us_ - now_us);
+  }
+  bandwidth_spin_.Unlock();
+  return delay_us;
+}
+
+uint32_t PrefetchExecutor::acquire_bandwidth(uint32_t num_objs,
+                                             uint32_t obj_size) {
+  if (!ACCESS_ONCE(max_bytes_per_sec_)) {
+    return num_objs;
+  }
+  // Tokens are in bytes scaled by 10^6, so that refills of a few microseconds
+  // are not rounded away.
+  uint64_t obj_cost = static_cast<uint64_t>(obj_size) * 1000000;
+  bandwidth_spin_.Lock();
+  auto now_us = microtime();
+  auto elapsed_us =
+      std::min(now_us - last_refill_us_, static_cast<uint64_t>(kBandwidthBucketUs));
+  auto capacity = std::max(max_bytes_per_sec_ * kBandwidthBucketUs, obj_cost);
+  num_tokens_ =
+      std::min(capacity, num_tokens_ + elapsed_us * max_bytes_per_sec_);
+  last_refill_us_ = now_us;
+  auto allowed =
+      static_cast<uint32_t>(std::min<uint64_t>(num_objs, num_tokens_ / obj_cost));
+  num_tokens_ -= allowed * obj_cost;
+  if (!allowed) {
+    refill_us_ = now_us + (obj_cost - num_tokens_) / max_bytes_per_sec_ + 1;
+  }
+  bandwidth_spin_.Unlock();
+  return allowed;
+}
+
+void PrefetchExecutor::set_max_bytes_per_sec(uint64_t max_bytes_per_sec) {
+  bandwidth_spin_.Lock();
+  max_bytes_per_sec_ = max_bytes_per_sec;
+  num_tokens_ = 0;
+  last_refill_us_ = microtime();
+  bandwidth_spin_.Unlock();
+}
+
+} // namespace far_memory
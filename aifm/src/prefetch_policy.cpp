@@ -0,0 +1,221 @@
+#include "prefetch_policy.hpp"
+
+#include <algorithm>
+
+namespace far_memory {
+
+StrideTablePolicy::StrideTablePolicy() {
+  for (auto &stream : streams_) {
+    stream.valid = false;
+  }
+}
+
+StrideTablePolicy::Stream *StrideTablePolicy::find_stream(uint64_t idx) {
+  Stream *closest = nullptr;
+  uint64_t closest_dist = kMaxStreamDistance + 1;
+  for (auto &stream : streams_) {
+    if (!stream.valid) {
+      continue;
+    }
+    if (stream.stride && idx == stream.last_idx + stream.stride) {
+      return &stream;
+    }
+    auto dist = idx > stream.last_idx ? idx - stream.last_idx
+                                      : stream.last_idx - idx;
+    if (dist < closest_dist) {
+      closest_dist = dist;
+      closest = &stream;
+    }
+  }
+  return closest;
+}
+
+uint32_t StrideTablePolicy::predict(uint64_t idx, uint32_t max,
+                                    uint64_t *idxs) {
+  clock_++;
+  auto *stream = find_stream(idx);
+  if (!stream) {
+    // Start a new stream in place of the least recently used one. Its candidate
+    // stride is taken relative to the closest untrained stream, so that streams
+    // with strides beyond kMaxStreamDistance still get trained.
+    Stream *victim = &streams_[0];
+    Stream *ref = nullptr;
+    uint64_t ref_dist = 0;
+    for (auto &s : streams_) {
+      if (!s.valid) {
+        victim = &s;
+        continue;
+      }
+      if (victim->valid && s.last_used < victim->last_used) {
+        victim = &s;
+      }
+      auto dist = idx > s.last_idx ? idx - s.last_idx : s.last_idx - idx;
+      if (!s.confidence && (!ref || dist < ref_dist)) {
+        ref = &s;
+        ref_dist = dist;
+      }
+    }
+    auto stride =
+        ref ? static_cast<int64_t>(idx) - static_cast<int64_t>(ref->last_idx)
+            : 0;
+    *victim = {.valid = true,
+               .prefetching = false,
+               .last_idx = idx,
+               .stride = stride,
+               .confidence = 0,
+               .next_prefetch_idx = 0,
+               .last_used = clock_};
+    return 0;
+  }
+
+  stream->last_used = clock_;
+  if (unlikely(idx == stream->last_idx)) {
+    return 0;
+  }
+  auto stride =
+      static_cast<int64_t>(idx) - static_cast<int64_t>(stream->last_idx);
+  if (stride == stream->stride) {
+    if (stream->confidence < kConfidenceThresh) {
+      stream->confidence++;
+    }
+  } else {
+    stream->stride = stride;
+    stream->confidence = 0;
+    stream->prefetching = false;
+  }
+  stream->last_idx = idx;
+  if (stream->confidence < kConfidenceThresh) {
+    return 0;
+  }
+
+  // Keep the window of the stream max strides ahead of idx, and only issue the
+  // part of it that has not been issued before.
+  if (!stream->prefetching) {
+    stream->next_prefetch_idx = idx + stride;
+    stream->prefetching = true;
+  }
+  auto ahead = (static_cast<int64_t>(stream->next_prefetch_idx) -
+                static_cast<int64_t>(idx)) /
+               stride;
+  if (ahead < 1) {
+    stream->next_prefetch_idx = idx + stride;
+    ahead = 1;
+  }
+  uint32_t num = 0;
+  while (num < max && ahead <= static_cast<int64_t>(max)) {
+    idxs[num++] = stream->next_prefetch_idx;
+    stream->next_prefetch_idx += stride;
+    ahead++;
+  }
+  return num;
+}
+
+DeltaCorrelationPolicy::DeltaCorrelationPolicy() {
+  std::fill(std::begin(index_table_), std::end(index_table_), 0);
+  std::fill(std::begin(issued_filter_), std::end(issued_filter_),
+            ~static_cast<uint64_t>(0));
+}
+
+uint64_t DeltaCorrelationPolicy::history_at(uint64_t pos) const {
+  return history_[pos % kHistorySize];
+}
+
+int64_t DeltaCorrelationPolicy::delta_at(uint64_t pos) const {
+  return static_cast<int64_t>(history_at(pos)) -
+         static_cast<int64_t>(history_at(pos - 1));
+}
+
+uint32_t DeltaCorrelationPolicy::hash_deltas(int64_t delta_0,
+                                             int64_t delta_1) {
+  auto x = static_cast<uint64_t>(delta_0) * 0x9E3779B97F4A7C15ULL ^
+           static_cast<uint64_t>(delta_1);
+  return (x * 0xC2B2AE3D27D4EB4FULL) >> 54;
+}
+
+uint32_t DeltaCorrelationPolicy::predict(uint64_t idx, uint32_t max,
+                                         uint64_t *idxs) {
+  static_assert(kIndexTableSize == (1 << 10));
+  static_assert(kIssuedFilterSize == (1 << 10));
+  if (num_accesses_ && unlikely(idx == history_at(num_accesses_ - 1))) {
+    return 0;
+  }
+  auto pos = num_accesses_++;
+  history_[pos % kHistorySize] = idx;
+  if (pos < 2) {
+    return 0;
+  }
+
+  auto delta_0 = delta_at(pos - 1);
+  auto delta_1 = delta_at(pos);
+  auto &entry = index_table_[hash_deltas(delta_0, delta_1)];
+  auto match = entry;
+  entry = pos + 1;
+  if (!match) {
+    return 0;
+  }
+  auto match_pos = match - 1;
+  // The matched delta pair must still be in the history, and must not be a
+  // hash collision.
+  if (pos - match_pos + 2 >= kHistorySize ||
+      delta_at(match_pos - 1) != delta_0 || delta_at(match_pos) != delta_1) {
+    return 0;
+  }
+
+  // Replay the deltas that followed the previous occurrence; they repeat with
+  // the period between the two occurrences.
+  auto period = pos - match_pos;
+  auto num_replays = std::min(max, kMaxNumReplays);
+  auto pred = idx;
+  uint32_t num = 0;
+  for (uint32_t i = 0; i < num_replays; i++) {
+    pred += delta_at(match_pos + 1 + i % period);
+    auto &issued = issued_filter_[(pred * 0x9E3779B97F4A7C15ULL) >> 54];
+    if (issued != pred) {
+      issued = pred;
+      idxs[num++] = pred;
+    }
+  }
+  return num;
+}
+
+CallbackPolicy::CallbackPolicy(NextIdxFn next_idx_fn)
+    : next_idx_fn_(std::move(next_idx_fn)) {}
+
+uint32_t CallbackPolicy::predict(uint64_t idx, uint32_t max, uint64_t *idxs) {
+  if (unlikely(idx == last_idx_)) {
+    return 0;
+  }
+  last_idx_ = idx;
+  max = std::min(max, kMaxDegree);
+
+  // Consume the issued predictions up to idx; restart the chain from idx if the
+  // access has left it.
+  uint32_t i;
+  for (i = 0; i < num_ahead_; i++) {
+    if (ahead_[(ahead_head_ + i) % kMaxDegree] == idx) {
+      break;
+    }
+  }
+  if (i < num_ahead_) {
+    ahead_head_ = (ahead_head_ + i + 1) % kMaxDegree;
+    num_ahead_ -= i + 1;
+  } else {
+    num_ahead_ = 0;
+  }
+
+  auto cur =
+      num_ahead_ ? ahead_[(ahead_head_ + num_ahead_ - 1) % kMaxDegree] : idx;
+  uint32_t num = 0;
+  while (num_ahead_ < max) {
+    auto next = next_idx_fn_(cur);
+    if (!next) {
+      break;
+    }
+    cur = *next;
+    ahead_[(ahead_head_ + num_ahead_++) % kMaxDegree] = cur;
+    idxs[num++] = cur;
+  }
+  return num;
+}
+
+} // namespace far_memory
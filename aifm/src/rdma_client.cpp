@@ -59,6 +59,10 @@ struct rdma_queue
 	struct ibv_mr *localmr;
 	memregion_t *servermr;
 
+	/* Destination of a posted read that landed in the bounce buffer. */
+	uint8_t *pending_buf;
+	uint16_t pending_len;
+
 	struct rdma_cm_id *cm_id;
 };
 
@@ -70,6 +74,11 @@ struct rdma_client
 	struct rdma_device *rdev; // TODO: move this to queue
 	struct rdma_queue *queues;
 
+	struct ibv_mr *cachemr; /* Local cache registered for zero-copy I/O */
+
+	int num_shared_cqs;
+	struct ibv_cq **shared_cqs;
+
 	struct ibv_comp_channel *comp_channel;
 
 	union
@@ -79,7 +88,8 @@ struct rdma_client
 	};
 };
 
-static int start_client(struct rdma_client **c, const char *sip, int num_connections);
+static int start_client(struct rdma_client **c, const char *sip, int num_connections,
+						int num_shared_cqs);
 static int init_queues(struct rdma_client *client);
 static void stop_queue(struct rdma_queue *q);
 static void free_queue(struct rdma_queue *q);
@@ -92,20 +102,50 @@ static int create_qp(struct rdma_queue *queue);
 static int process_rdma_cm_event(struct rdma_event_channel *echannel,
 								 enum rdma_cm_event_type expected_event,
 								 struct rdma_cm_event **cm_event);
+static int post_rw(struct rdma_queue *q, enum ibv_wr_opcode opcode,
+				   uint64_t offset, uint16_t data_len, const uint8_t *data_buf);
+static struct ibv_mr *get_zcopy_mr(struct rdma_queue *q, const void *buf, size_t len);
 static void die(const char *reason);
 static int parse_ipaddr(struct sockaddr_in *saddr, const char *ip);
 
 /* ====================== APIs ====================== */
-struct rdma_client *start_rdma_client()
+struct rdma_client *start_rdma_client(int num_shared_cqs)
 {
 	struct rdma_client *gclient = NULL;
 	printf("\n* AIFM RDMA BACKEND *\n");
 
-	TEST_NZ(start_client(&gclient, RDMA_SERVER_IP, NUM_QUEUES));
-	printf("%d queues initialized successfully\n\n", NUM_QUEUES);
+	/* Allow overriding the server IP, e.g. to run against a loopback soft-RoCE
+	 (rxe) device when no RDMA NIC is present. */
+	const char *sip = getenv("AIFM_RDMA_SERVER_IP");
+	if (!sip)
+		sip = RDMA_SERVER_IP;
+
+	TEST_NZ(start_client(&gclient, sip, NUM_QUEUES, num_shared_cqs));
+	printf("%d queues initialized successfully", NUM_QUEUES);
+	if (num_shared_cqs)
+		printf(", sharing %d cqs", num_shared_cqs);
+	printf("\n\n");
 	return gclient;
 }
 
+/* Register the local object cache as one MR, so that reads and writes whose
+ * buffers fall into it can DMA straight in and out of object data instead of
+ * going through the per-queue bounce buffer. */
+int rdma_register_cache(struct rdma_client *client, void *buf, size_t len)
+{
+	if (!client->rdev)
+		return -ENODEV;
+
+	client->cachemr = ibv_reg_mr(client->rdev->pd, buf, len, IBV_ACCESS_LOCAL_WRITE);
+	if (!client->cachemr)
+	{
+		printf("failed to register local cache for zero-copy, error: %d\n", -errno);
+		return -errno;
+	}
+	printf("registered %ld bytes of local cache for zero-copy\n", len);
+	return 0;
+}
+
 int rdma_read(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, uint8_t *data_buf)
 {
 	// unsigned total_cycles_low_start = 0, total_cycles_high_start = 0;
@@ -119,11 +159,20 @@ int rdma_read(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, uint8_t *
 	struct ibv_wc wc;
 	struct ibv_sge client_send_sge;
 	struct ibv_send_wr client_send_wr, *bad_client_send_wr = NULL;
+	struct ibv_mr *zcopy_mr = get_zcopy_mr(queue, data_buf, data_len);
 	int ret = -1;
 
-	client_send_sge.addr = (uint64_t)queue->localmr->addr;
+	if (zcopy_mr)
+	{
+		client_send_sge.addr = (uint64_t)data_buf;
+		client_send_sge.lkey = zcopy_mr->lkey;
+	}
+	else
+	{
+		client_send_sge.addr = (uint64_t)queue->localmr->addr;
+		client_send_sge.lkey = queue->localmr->lkey;
+	}
 	client_send_sge.length = (uint32_t)data_len;
-	client_send_sge.lkey = queue->localmr->lkey;
 
 	bzero(&client_send_wr, sizeof(client_send_wr));
 	client_send_wr.sg_list = &client_send_sge;
@@ -161,7 +210,8 @@ int rdma_read(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, uint8_t *
 	// bench_end(polling cq);
 	// bench_start();
 
-	memcpy(data_buf, queue->localmr->addr, data_len);
+	if (!zcopy_mr)
+		memcpy(data_buf, queue->localmr->addr, data_len);
 
 	// bench_end(memcopy);
 	// bench_start();
@@ -192,16 +242,25 @@ int rdma_write(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, const ui
 	struct ibv_wc wc;
 	struct ibv_sge client_send_sge;
 	struct ibv_send_wr client_send_wr, *bad_client_send_wr = NULL;
+	struct ibv_mr *zcopy_mr = get_zcopy_mr(queue, data_buf, data_len);
 	int ret = -1;
 
-	memcpy(queue->localmr->addr, data_buf, data_len);
+	if (zcopy_mr)
+	{
+		client_send_sge.addr = (uint64_t)data_buf;
+		client_send_sge.lkey = zcopy_mr->lkey;
+	}
+	else
+	{
+		memcpy(queue->localmr->addr, data_buf, data_len);
+		client_send_sge.addr = (uint64_t)queue->localmr->addr;
+		client_send_sge.lkey = queue->localmr->lkey;
+	}
 
 	// bench_end(memcopy);
 	// bench_start();
 
-	client_send_sge.addr = (uint64_t)queue->localmr->addr;
 	client_send_sge.length = (uint32_t)data_len;
-	client_send_sge.lkey = queue->localmr->lkey;
 	bzero(&client_send_wr, sizeof(client_send_wr));
 
 	client_send_wr.sg_list = &client_send_sge;
@@ -252,6 +311,145 @@ int rdma_write(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, const ui
 	return 0;
 }
 
+/* Asynchronous counterparts of rdma_read/rdma_write. At most one request may
+ * be outstanding per queue; it completes once rdma_poll() returns 1. */
+int rdma_post_read(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, uint8_t *data_buf)
+{
+	int ret = post_rw(queue, IBV_WR_RDMA_READ, offset, data_len, data_buf);
+
+	if (!ret && !get_zcopy_mr(queue, data_buf, data_len))
+	{
+		queue->pending_buf = data_buf;
+		queue->pending_len = data_len;
+	}
+	return ret;
+}
+
+int rdma_post_write(rdma_queue_t *queue, uint64_t offset, uint16_t data_len, const uint8_t *data_buf)
+{
+	return post_rw(queue, IBV_WR_RDMA_WRITE, offset, data_len, data_buf);
+}
+
+/* Returns 1 if the outstanding request of the queue has completed, 0 if it is
+ * still in flight, and -1 on failure. Never blocks. */
+int rdma_poll(rdma_queue_t *queue)
+{
+	struct ibv_wc wc;
+	int ret;
+
+	ret = ibv_poll_cq(queue->cq, 1, &wc);
+	if (ret == 0)
+		return 0;
+
+	if (ret < 0 || wc.status != IBV_WC_SUCCESS)
+	{
+		fprintf(stderr, "failed status %s (%d) for wr_id %d\n",
+				ibv_wc_status_str(wc.status),
+				wc.status, (int)wc.wr_id);
+		queue->pending_buf = NULL;
+		return -1;
+	}
+
+	if (queue->pending_buf)
+	{
+		memcpy(queue->pending_buf, queue->localmr->addr, queue->pending_len);
+		queue->pending_buf = NULL;
+	}
+	ibv_ack_cq_events(queue->cq, 1);
+	return 1;
+}
+
+/* Post a batch of writes with a single doorbell. Objects outside the
+ * registered cache are staged into the bounce buffer back to back; all of them
+ * are posted as one chained WR list, of which only the last WR is signaled, so
+ * the post costs a single completion. Stops at MAX_BATCH_WRS or when the bounce
+ * buffer is full; returns the number of writes posted, or a negative value on
+ * failure. */
+int rdma_post_write_batch(rdma_queue_t *queue, int num, const uint64_t *offsets,
+						  const uint16_t *data_lens, const uint8_t *const *data_bufs)
+{
+	struct ibv_sge sges[MAX_BATCH_WRS];
+	struct ibv_send_wr wrs[MAX_BATCH_WRS], *bad_wr = NULL;
+	size_t staged = 0;
+	int ret = -1;
+	int n = 0;
+
+	while (n < num && n < MAX_BATCH_WRS)
+	{
+		struct ibv_mr *zcopy_mr = get_zcopy_mr(queue, data_bufs[n], data_lens[n]);
+
+		if (zcopy_mr)
+		{
+			sges[n].addr = (uint64_t)data_bufs[n];
+			sges[n].lkey = zcopy_mr->lkey;
+		}
+		else
+		{
+			uint8_t *staging = (uint8_t *)queue->localmr->addr + staged;
+
+			if (staged + data_lens[n] > BUFFER_SIZE)
+				break;
+			memcpy(staging, data_bufs[n], data_lens[n]);
+			sges[n].addr = (uint64_t)staging;
+			sges[n].lkey = queue->localmr->lkey;
+			staged += data_lens[n];
+		}
+		sges[n].length = (uint32_t)data_lens[n];
+
+		bzero(&wrs[n], sizeof(wrs[n]));
+		wrs[n].wr_id = (uint64_t)queue;
+		wrs[n].sg_list = &sges[n];
+		wrs[n].num_sge = 1;
+		wrs[n].opcode = IBV_WR_RDMA_WRITE;
+		wrs[n].wr.rdma.rkey = queue->servermr->key;
+		wrs[n].wr.rdma.remote_addr = queue->servermr->baseaddr + offsets[n];
+		if (n)
+			wrs[n - 1].next = &wrs[n];
+
+		n++;
+	}
+
+	/* Only the tail is signaled. RC QPs complete WRs in order, so its
+	 completion implies the completion of the whole chain. */
+	wrs[n - 1].send_flags = IBV_SEND_SIGNALED;
+
+	ret = ibv_post_send(queue->qp, &wrs[0], &bad_wr);
+	if (ret)
+	{
+		printf("failed to post rdma write batch, error: %d\n", -errno);
+		return -1;
+	}
+	return n;
+}
+
+/* Synchronous batched write on a queue with a private CQ. Batches larger than
+ * a single post are split into several of them. */
+int rdma_write_batch(rdma_queue_t *queue, int num, const uint64_t *offsets,
+					 const uint16_t *data_lens, const uint8_t *const *data_bufs)
+{
+	int ret;
+	int i = 0;
+
+	while (i < num)
+	{
+		int n = rdma_post_write_batch(queue, num - i, offsets + i, data_lens + i,
+									  data_bufs + i);
+		if (n < 0)
+			return n;
+
+		do
+		{
+			ret = rdma_poll(queue);
+		} while (ret == 0);
+
+		if (ret < 0)
+			return ret;
+		i += n;
+	}
+
+	return 0;
+}
+
 int destroy_client(struct rdma_client *client)
 {
 	printf("start: %s\n", __FUNCTION__);
@@ -268,6 +466,12 @@ int destroy_client(struct rdma_client *client)
 		free(queue->buffer);
 	}
 
+	if (client->cachemr)
+	{
+		ibv_dereg_mr(client->cachemr);
+		client->cachemr = NULL;
+	}
+
 	if (client->rdev)
 	{
 		ibv_dealloc_pd(client->rdev->pd);
@@ -278,6 +482,7 @@ int destroy_client(struct rdma_client *client)
 	ibv_destroy_comp_channel(client->comp_channel);
 	rdma_destroy_event_channel(client->ec);
 
+	free(client->shared_cqs);
 	free(client->queues);
 	free(client);
 	printf("RDMA server cleaned up\n\n");
@@ -289,9 +494,56 @@ rdma_queue_t *rdma_get_queue(struct rdma_client *client, int idx)
 	return &client->queues[idx];
 }
 
+int rdma_get_queue_idx(rdma_queue_t *queue)
+{
+	return queue - queue->client->queues;
+}
+
+/* Index of the shared CQ that the queue reports its completions to. */
+int rdma_get_queue_cq_idx(rdma_queue_t *queue)
+{
+	return rdma_get_queue_idx(queue) % queue->client->num_shared_cqs;
+}
+
+/* Drains up to num completions from a shared CQ without blocking. The queues
+ * whose outstanding request has completed are returned in queues. Returns the
+ * number of them, or -1 on failure. */
+int rdma_poll_shared_cq(struct rdma_client *client, int cq_idx, rdma_queue_t **queues, int num)
+{
+	struct ibv_wc wcs[num];
+	struct ibv_cq *cq = client->shared_cqs[cq_idx];
+	int ret;
+
+	ret = ibv_poll_cq(cq, num, wcs);
+	if (ret <= 0)
+		return ret;
+
+	for (int i = 0; i < ret; i++)
+	{
+		struct rdma_queue *queue = (struct rdma_queue *)wcs[i].wr_id;
+
+		if (wcs[i].status != IBV_WC_SUCCESS)
+		{
+			fprintf(stderr, "failed status %s (%d) for queue %d\n",
+					ibv_wc_status_str(wcs[i].status),
+					wcs[i].status, rdma_get_queue_idx(queue));
+			return -1;
+		}
+		if (queue->pending_buf)
+		{
+			memcpy(queue->pending_buf, queue->localmr->addr, queue->pending_len);
+			queue->pending_buf = NULL;
+		}
+		queues[i] = queue;
+	}
+	ibv_ack_cq_events(cq, ret);
+	return ret;
+}
+
 /* ===================== RDMA Helpers ===================== */
 
-static int start_client(struct rdma_client **c, const char *sip, int num_connections)
+static int start_client(struct rdma_client **c, const char *sip, int num_connections,
+						int num_shared_cqs)
 {
 	struct rdma_client *client;
 
@@ -302,6 +554,13 @@ static int start_client(struct rdma_client **c, const char *sip, int num_connect
 
 	client->num_queues = num_connections;
 
+	if (num_shared_cqs)
+	{
+		client->num_shared_cqs = num_shared_cqs;
+		client->shared_cqs = (struct ibv_cq **)calloc(num_shared_cqs, sizeof(struct ibv_cq *));
+		TEST_Z(client->shared_cqs);
+	}
+
 	client->ec = rdma_create_event_channel();
 	TEST_Z(client->ec);
 
@@ -520,6 +779,20 @@ static int create_queue_ib(struct rdma_queue *q)
 		TEST_Z(q->client->comp_channel);
 	}
 
+	if (q->client->num_shared_cqs)
+	{
+		struct ibv_cq **shared_cq = &q->client->shared_cqs[rdma_get_queue_cq_idx(q)];
+
+		if (!*shared_cq)
+		{
+			*shared_cq = ibv_create_cq(q->cm_id->verbs, CQ_NUM_CQES, NULL,
+									   q->client->comp_channel, 0);
+			TEST_Z(*shared_cq);
+		}
+		q->cq = *shared_cq;
+		return create_qp(q);
+	}
+
 	q->cq = ibv_create_cq(q->cm_id->verbs /* which device*/,
 						  CQ_NUM_CQES /* maximum capacity*/,
 						  NULL /* user context, not used here */,
@@ -632,6 +905,56 @@ static int process_rdma_cm_event(struct rdma_event_channel *echannel,
 
 /* ===================== Utils ==================== */
 
+/* Posts a single signaled read or write without waiting for its completion. */
+static int post_rw(struct rdma_queue *q, enum ibv_wr_opcode opcode,
+				   uint64_t offset, uint16_t data_len, const uint8_t *data_buf)
+{
+	struct ibv_sge sge;
+	struct ibv_send_wr wr, *bad_wr = NULL;
+	struct ibv_mr *zcopy_mr = get_zcopy_mr(q, data_buf, data_len);
+	int ret;
+
+	if (zcopy_mr)
+	{
+		sge.addr = (uint64_t)data_buf;
+		sge.lkey = zcopy_mr->lkey;
+	}
+	else
+	{
+		if (opcode == IBV_WR_RDMA_WRITE)
+			memcpy(q->localmr->addr, data_buf, data_len);
+		sge.addr = (uint64_t)q->localmr->addr;
+		sge.lkey = q->localmr->lkey;
+	}
+	sge.length = (uint32_t)data_len;
+
+	bzero(&wr, sizeof(wr));
+	wr.wr_id = (uint64_t)q;
+	wr.sg_list = &sge;
+	wr.num_sge = 1;
+	wr.opcode = opcode;
+	wr.send_flags = IBV_SEND_SIGNALED;
+	wr.wr.rdma.rkey = q->servermr->key;
+	wr.wr.rdma.remote_addr = q->servermr->baseaddr + offset;
+
+	ret = ibv_post_send(q->qp, &wr, &bad_wr);
+	if (ret)
+		printf("failed to post rdma req, error: %d\n", -errno);
+	return ret;
+}
+
+/* Returns the registered cache MR if [buf, buf + len) lies in it, or NULL if
+ * the transfer has to go through the bounce buffer. */
+static struct ibv_mr *get_zcopy_mr(struct rdma_queue *q, const void *buf, size_t len)
+{
+	struct ibv_mr *mr = q->client->cachemr;
+
+	if (mr && (uint8_t *)buf >= (uint8_t *)mr->addr &&
+		(uint8_t *)buf + len <= (uint8_t *)mr->addr + mr->length)
+		return mr;
+	return NULL;
+}
+
 static void die(const char *reason)
 {
 	fprintf(stderr, "%s - errno: %d\n", reason, errno);
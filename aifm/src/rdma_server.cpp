@@ -2,6 +2,8 @@
 
 #include <rdma/rdma_cma.h>
 
+#include <map>
+
 #define TEST_NZ(x)                                            \
 	do                                                        \
 	{                                                         \
@@ -19,6 +21,11 @@
  server instance. */
 static struct rdma_server *gserver = NULL;
 
+/* Bytes at the bottom of the buffer that hold the far memory of vanilla
+ pointers, see rdma_server_set_far_mem_size(). It is set by the init request,
+ which may come before the server gets started. */
+static size_t far_mem_size = 0;
+
 /* Private data passed over rdma_cm protocol */
 typedef struct
 {
@@ -33,6 +40,7 @@ struct rdma_device
 };
 
 const size_t BUFFER_SIZE = 1024 * 1024 * 1024 * 16l; // 16GB by default
+const size_t CARVE_ALIGNMENT = 4096;
 
 struct queue
 {
@@ -62,6 +70,13 @@ struct rdma_server
 
 	unsigned int queue_ctr;
 
+	/* Bytes carved out of the top of buffer, see rdma_server_alloc(). */
+	size_t carved;
+	/* Freed blocks within the carved bytes, as offset into buffer -> length.
+	 Adjacent blocks are coalesced. */
+	std::map<size_t, size_t> *carve_holes;
+	int carve_lock;
+
 	struct ibv_comp_channel *comp_channel; // Never used on the server side.
 };
 
@@ -152,6 +167,7 @@ int destroy_server()
 	}
 
 	free(gserver->buffer);
+	delete gserver->carve_holes;
 	free(gserver->queues);
 	free(gserver->dev);
 
@@ -160,6 +176,82 @@ int destroy_server()
 	return 0;
 }
 
+void rdma_server_set_far_mem_size(size_t size)
+{
+	far_mem_size = size;
+}
+
+void *rdma_server_alloc(size_t len)
+{
+	void *buf = NULL;
+
+	if (gserver == NULL || gserver->buffer == NULL)
+		return NULL;
+
+	len = (len + CARVE_ALIGNMENT - 1) / CARVE_ALIGNMENT * CARVE_ALIGNMENT;
+	while (__sync_lock_test_and_set(&gserver->carve_lock, 1))
+		;
+	/* First fit among the freed blocks. */
+	auto &holes = *gserver->carve_holes;
+	for (auto it = holes.begin(); it != holes.end(); ++it)
+	{
+		if (it->second < len)
+			continue;
+		buf = (uint8_t *)gserver->buffer + it->first;
+		if (it->second > len)
+			holes[it->first + len] = it->second - len;
+		holes.erase(it);
+		break;
+	}
+	/* The far memory of vanilla pointers grows from the bottom of buffer, so
+	 the carve-outs must stay above it. */
+	if (buf == NULL && far_mem_size <= BUFFER_SIZE &&
+		gserver->carved + len <= BUFFER_SIZE - far_mem_size)
+	{
+		gserver->carved += len;
+		buf = (uint8_t *)gserver->buffer + BUFFER_SIZE - gserver->carved;
+	}
+	__sync_lock_release(&gserver->carve_lock);
+	return buf;
+}
+
+void rdma_server_free(void *buf, size_t len)
+{
+	len = (len + CARVE_ALIGNMENT - 1) / CARVE_ALIGNMENT * CARVE_ALIGNMENT;
+	while (__sync_lock_test_and_set(&gserver->carve_lock, 1))
+		;
+	auto &holes = *gserver->carve_holes;
+	size_t offset = (uint8_t *)buf - (uint8_t *)gserver->buffer;
+	auto next = holes.find(offset + len);
+	if (next != holes.end())
+	{
+		len += next->second;
+		holes.erase(next);
+	}
+	auto prev = holes.lower_bound(offset);
+	if (prev != holes.begin())
+	{
+		--prev;
+		if (prev->first + prev->second == offset)
+		{
+			offset = prev->first;
+			len += prev->second;
+			holes.erase(prev);
+		}
+	}
+	if (offset == BUFFER_SIZE - gserver->carved)
+		/* The lowest block, which goes back to the uncarved bytes. */
+		gserver->carved -= len;
+	else
+		holes[offset] = len;
+	__sync_lock_release(&gserver->carve_lock);
+}
+
+uint64_t rdma_server_base_addr()
+{
+	return (uint64_t)gserver->buffer;
+}
+
 /* ===================== RDMA Helpers ==================== */
 
 static int alloc_server()
@@ -170,6 +262,7 @@ static int alloc_server()
 	memset(gserver, 0, sizeof(struct rdma_server));
 
 	gserver->queue_ctr = 0;
+	gserver->carve_holes = new std::map<size_t, size_t>();
 
 	gserver->ec = (struct rdma_event_channel *)malloc(sizeof(struct rdma_event_channel));
 	TEST_Z(gserver->ec);
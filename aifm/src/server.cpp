@@ -56,6 +56,54 @@ void Server::write_object(uint8_t ds_id, uint8_t obj_id_len,
   ds_ptr->write_object(obj_id_len, obj_id, data_len, data_buf);
 }
 
+void Server::write_object_extents(uint8_t ds_id, uint8_t obj_id_len,
+                                  const uint8_t *obj_id, uint16_t data_len,
+                                  const uint8_t *data_buf, uint8_t num_extents,
+                                  const ObjectExtent *extents) {
+  auto ds_ptr = server_ds_ptrs_[ds_id].get();
+  if (!ds_ptr) {
+    ds_ptr = server_ds_ptrs_[kVanillaPtrDSID].get();
+  }
+  ds_ptr->write_object_extents(obj_id_len, obj_id, data_len, data_buf,
+                               num_extents, extents);
+}
+
+void Server::read_objects(uint32_t num_reqs, const ObjectReadReq *reqs) {
+  uint32_t begin = 0;
+  for (uint32_t i = 1; i <= num_reqs; i++) {
+    if (i == num_reqs || reqs[i].ds_id != reqs[begin].ds_id) {
+      auto ds_ptr = server_ds_ptrs_[reqs[begin].ds_id].get();
+      if (!ds_ptr) {
+        ds_ptr = server_ds_ptrs_[kVanillaPtrDSID].get();
+      }
+      ds_ptr->read_objects(i - begin, reqs + begin);
+      begin = i;
+    }
+  }
+}
+
+void Server::write_objects(uint32_t num_reqs, const ObjectWriteReq *reqs) {
+  uint32_t begin = 0;
+  for (uint32_t i = 1; i <= num_reqs; i++) {
+    if (i == num_reqs || reqs[i].ds_id != reqs[begin].ds_id) {
+      auto ds_ptr = server_ds_ptrs_[reqs[begin].ds_id].get();
+      if (!ds_ptr) {
+        ds_ptr = server_ds_ptrs_[kVanillaPtrDSID].get();
+      }
+      ds_ptr->write_objects(i - begin, reqs + begin);
+      begin = i;
+    }
+  }
+}
+
+void Server::copy_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *from_obj_id, const uint8_t *to_obj_id,
+                         uint8_t *buf) {
+  uint16_t data_len;
+  read_object(ds_id, obj_id_len, from_obj_id, &data_len, buf);
+  write_object(ds_id, obj_id_len, to_obj_id, data_len, buf);
+}
+
 bool Server::remove_object(uint64_t ds_id, uint8_t obj_id_len,
                            const uint8_t *obj_id) {
   auto ds_ptr = server_ds_ptrs_[ds_id].get();
@@ -6,16 +6,78 @@ extern "C" {
 
 #include "../DataFrame/AIFM/include/simple_time.hpp"
 #include "aggregator.hpp"
+#include "dataframe_kernels.hpp"
 #include "dataframe_vector.hpp"
 #include "internal/dataframe_types.hpp"
 #include "server_dataframe_vector.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
-#include <unordered_set>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
 
 namespace far_memory {
 
+namespace {
+
+// Type-erased key column of the hash-based group-by.
+struct GroupByKey {
+  // Mixes the hash of every row into hashes.
+  std::function<void(std::vector<std::size_t> *hashes)> hash;
+  std::function<bool(uint64_t row_a, uint64_t row_b)> equal;
+};
+
+template <typename K> GroupByKey build_group_by_key(uint8_t ds_id) {
+  auto &vec = reinterpret_cast<ServerDataFrameVector<K> *>(
+                  Server::get_server_ds(ds_id))
+                  ->vec_;
+  return GroupByKey{
+      [&vec](std::vector<std::size_t> *hashes) {
+        for (uint64_t i = 0; i < hashes->size(); i++) {
+          auto &hash = (*hashes)[i];
+          hash ^= std::hash<K>{}(vec[i]) + 0x9e3779b9 + (hash << 6) +
+                  (hash >> 2);
+        }
+      },
+      [&vec](uint64_t row_a, uint64_t row_b) {
+        return vec[row_a] == vec[row_b];
+      }};
+}
+
+GroupByKey build_group_by_key(uint8_t dt_id, uint8_t ds_id) {
+  switch (dt_id) {
+  case DataFrameTypeID::Char:
+    return build_group_by_key<char>(ds_id);
+  case DataFrameTypeID::Short:
+    return build_group_by_key<short>(ds_id);
+  case DataFrameTypeID::Int:
+    return build_group_by_key<int>(ds_id);
+  case DataFrameTypeID::UnsignedInt:
+    return build_group_by_key<unsigned int>(ds_id);
+  case DataFrameTypeID::Long:
+    return build_group_by_key<long>(ds_id);
+  case DataFrameTypeID::UnsignedLong:
+    return build_group_by_key<unsigned long>(ds_id);
+  case DataFrameTypeID::LongLong:
+    return build_group_by_key<long long>(ds_id);
+  case DataFrameTypeID::UnsignedLongLong:
+    return build_group_by_key<unsigned long long>(ds_id);
+  case DataFrameTypeID::Float:
+    return build_group_by_key<float>(ds_id);
+  case DataFrameTypeID::Double:
+    return build_group_by_key<double>(ds_id);
+  case DataFrameTypeID::Time:
+    return build_group_by_key<SimpleTime>(ds_id);
+  default:
+    BUG();
+  }
+}
+
+} // namespace
+
 template <typename T> ServerDataFrameVector<T>::ServerDataFrameVector() {}
 
 template <typename T> ServerDataFrameVector<T>::~ServerDataFrameVector() {}
@@ -103,25 +165,15 @@ template <typename T>
 template <typename U>
 void ServerDataFrameVector<T>::_compute_unique(uint64_t vec_size,
                                                std::vector<U> &unique_vec) {
-  auto hash_func = [](std::reference_wrapper<const T> v) -> std::size_t {
-    return (std::hash<T>{}(v.get()));
-  };
-  auto equal_func = [](std::reference_wrapper<const T> lhs,
-                       std::reference_wrapper<const T> rhs) -> bool {
-    return (lhs.get() == rhs.get());
-  };
-  std::unordered_set<typename std::reference_wrapper<T>::type,
-                     decltype(hash_func), decltype(equal_func)>
-      table(vec_size, hash_func, equal_func);
-
-  unique_vec.reserve(vec_size);
+  FlatGroupIndex index(vec_size);
   for (uint64_t i = 0; i < vec_size; i++) {
-    auto citer = vec_[i];
-    const auto insert_ret = table.emplace(std::ref(citer));
-
-    if (insert_ret.second)
-      unique_vec.push_back(citer);
+    index.find_or_insert(std::hash<T>{}(vec_[i]), i,
+                         [&](uint64_t row) { return vec_[row] == vec_[i]; });
   }
+  auto &first_rows = index.get_first_rows();
+  unique_vec.resize(first_rows.size());
+  DataFrameKernels::gather(unique_vec.data(), vec_.data(), first_rows.data(),
+                           first_rows.size());
 }
 
 template <typename T>
@@ -137,10 +189,9 @@ void ServerDataFrameVector<T>::compute_copy_data_by_idx(
   auto &idx_vec = reinterpret_cast<ServerDataFrameVector<unsigned long long> *>(
                       Server::get_server_ds(idx_vec_ds_id))
                       ->vec_;
-  ret_vec.reserve(idx_vec_size);
-  for (uint64_t i = 0; i < idx_vec_size; i++) {
-    ret_vec.push_back(vec_[idx_vec[i]]);
-  }
+  ret_vec.resize(idx_vec_size);
+  DataFrameKernels::gather(ret_vec.data(), vec_.data(), idx_vec.data(),
+                           idx_vec_size);
   *output_len = sizeof(uint64_t);
   *reinterpret_cast<uint64_t *>(output_buf) = ret_vec.capacity();
 }
@@ -268,19 +319,300 @@ ServerDataFrameVector<T>::_compute_aggregate(uint8_t opcode, uint8_t result_ds,
       AggregatorFactory<T>::build(opcode, /* limited_mem */ false, nullptr));
   DerefScope *scope =
       nullptr; // Never used. Just for complying with add()'s interface.
-  Key_t last_key = key_vec[0];
-  for (uint64_t i = 0; i < size; i++) {
-    auto cur_key = key_vec[i];
-    if (last_key != cur_key) {
+  uint64_t run_begin = 0;
+  for (uint64_t i = 1; i <= size; i++) {
+    if (i < size && key_vec[i] == key_vec[run_begin]) {
+      continue;
+    }
+    // Reduces the run of equal keys [run_begin, i).
+    auto *run = vec_.data() + run_begin;
+    auto run_len = i - run_begin;
+    if (opcode == GenericDataFrameVector::OpCode::AggregateMax) {
+      result_vec.push_back(DataFrameKernels::max(run, run_len));
+    } else if (opcode == GenericDataFrameVector::OpCode::AggregateMin) {
+      result_vec.push_back(DataFrameKernels::min(run, run_len));
+    } else if (std::is_arithmetic_v<T> &&
+               opcode == GenericDataFrameVector::OpCode::AggregateSum) {
+      if constexpr (std::is_arithmetic_v<T>) {
+        result_vec.push_back(DataFrameKernels::sum(run, run_len));
+      }
+    } else {
+      for (uint64_t j = 0; j < run_len; j++) {
+        aggregator->add(scope, run[j]);
+      }
       result_vec.push_back(aggregator->aggregate());
-      last_key = cur_key;
     }
-    aggregator->add(scope, vec_[i]);
+    run_begin = i;
   }
-  result_vec.push_back(aggregator->aggregate());
   return std::make_pair(result_vec.size(), result_vec.capacity());
 }
 
+template <typename T>
+void ServerDataFrameVector<T>::compute_group_by(uint16_t input_len,
+                                                const uint8_t *input_buf,
+                                                uint16_t *output_len,
+                                                uint8_t *output_buf) {
+  uint8_t result_ds = input_buf[0];
+  uint8_t first_idx_ds = input_buf[1];
+  uint64_t size = *reinterpret_cast<const uint64_t *>(input_buf + 2);
+  uint8_t opcode = input_buf[2 + sizeof(size)];
+  uint8_t num_keys = input_buf[3 + sizeof(size)];
+  const uint8_t *key_buf = input_buf + 4 + sizeof(size);
+  assert(input_len == 4 + sizeof(size) + 2 * num_keys);
+  auto &result_vec = reinterpret_cast<ServerDataFrameVector<T> *>(
+                         Server::get_server_ds(result_ds))
+                         ->vec_;
+  auto &first_idx_vec =
+      reinterpret_cast<ServerDataFrameVector<unsigned long long> *>(
+          Server::get_server_ds(first_idx_ds))
+          ->vec_;
+
+  // Hashes the keys one column at a time, so that every column is scanned
+  // sequentially and the type dispatch happens once per column.
+  std::vector<GroupByKey> keys;
+  std::vector<std::size_t> hashes(size);
+  for (uint8_t i = 0; i < num_keys; i++) {
+    keys.push_back(build_group_by_key(key_buf[2 * i + 1], key_buf[2 * i]));
+    keys.back().hash(&hashes);
+  }
+  FlatGroupIndex index(size);
+  std::vector<uint64_t> groups(size);
+  for (uint64_t i = 0; i < size; i++) {
+    auto equal = [&](uint64_t row) {
+      return std::all_of(
+          keys.begin(), keys.end(),
+          [&](const GroupByKey &key) { return key.equal(row, i); });
+    };
+    groups[i] = index.find_or_insert(hashes[i], i, equal).first;
+  }
+  auto &first_rows = index.get_first_rows();
+  first_idx_vec.assign(first_rows.begin(), first_rows.end());
+  _aggregate_groups(opcode, groups, first_rows, result_vec);
+  *output_len = 4 * sizeof(uint64_t);
+  auto *output = reinterpret_cast<uint64_t *>(output_buf);
+  output[0] = result_vec.size();
+  output[1] = result_vec.capacity();
+  output[2] = first_idx_vec.size();
+  output[3] = first_idx_vec.capacity();
+}
+
+template <typename T>
+void ServerDataFrameVector<T>::_aggregate_groups(
+    uint8_t opcode, const std::vector<uint64_t> &groups,
+    const std::vector<unsigned long long> &first_rows,
+    std::vector<T> &result_vec) {
+  auto num_groups = first_rows.size();
+  switch (opcode) {
+  case GenericDataFrameVector::OpCode::AggregateMax:
+    result_vec.assign(num_groups, std::numeric_limits<T>::min());
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      result_vec[groups[i]] = std::max(result_vec[groups[i]], vec_[i]);
+    }
+    return;
+  case GenericDataFrameVector::OpCode::AggregateMin:
+    result_vec.assign(num_groups, std::numeric_limits<T>::max());
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      result_vec[groups[i]] = std::min(result_vec[groups[i]], vec_[i]);
+    }
+    return;
+  case GenericDataFrameVector::OpCode::AggregateFirst:
+    result_vec.resize(num_groups);
+    for (uint64_t group = 0; group < num_groups; group++) {
+      result_vec[group] = vec_[first_rows[group]];
+    }
+    return;
+  case GenericDataFrameVector::OpCode::AggregateLast:
+    result_vec.resize(num_groups);
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      result_vec[groups[i]] = vec_[i];
+    }
+    return;
+  case GenericDataFrameVector::OpCode::AggregateMedian: {
+    // Needs all of the values of a group, which is left to the aggregator.
+    std::vector<std::unique_ptr<Aggregator<T>>> aggregators(num_groups);
+    for (auto &aggregator : aggregators) {
+      aggregator.reset(AggregatorFactory<T>::build(
+          opcode, /* limited_mem */ false, nullptr));
+    }
+    DerefScope *scope =
+        nullptr; // Never used. Just for complying with add()'s interface.
+    for (uint64_t i = 0; i < groups.size(); i++) {
+      aggregators[groups[i]]->add(scope, vec_[i]);
+    }
+    result_vec.reserve(num_groups);
+    for (auto &aggregator : aggregators) {
+      result_vec.push_back(aggregator->aggregate());
+    }
+    return;
+  }
+  default:
+    break;
+  }
+
+  if constexpr (std::is_arithmetic_v<T>) {
+    std::vector<uint64_t> cnts(num_groups);
+    switch (opcode) {
+    case GenericDataFrameVector::OpCode::AggregateSum:
+      result_vec.assign(num_groups, T());
+      for (uint64_t i = 0; i < groups.size(); i++) {
+        result_vec[groups[i]] += vec_[i];
+      }
+      return;
+    case GenericDataFrameVector::OpCode::AggregateCount:
+      for (auto group : groups) {
+        cnts[group]++;
+      }
+      result_vec.assign(cnts.begin(), cnts.end());
+      return;
+    case GenericDataFrameVector::OpCode::AggregateMean: {
+      std::vector<double> sums(num_groups);
+      for (uint64_t i = 0; i < groups.size(); i++) {
+        sums[groups[i]] += vec_[i];
+        cnts[groups[i]]++;
+      }
+      result_vec.resize(num_groups);
+      for (uint64_t group = 0; group < num_groups; group++) {
+        result_vec[group] = static_cast<T>(sums[group] / cnts[group]);
+      }
+      return;
+    }
+    case GenericDataFrameVector::OpCode::AggregateVar:
+    case GenericDataFrameVector::OpCode::AggregateStd: {
+      // Welford's algorithm, as AggregatorVar.
+      std::vector<double> means(num_groups);
+      std::vector<double> m2s(num_groups);
+      for (uint64_t i = 0; i < groups.size(); i++) {
+        auto group = groups[i];
+        double delta = vec_[i] - means[group];
+        means[group] += delta / ++cnts[group];
+        m2s[group] += delta * (vec_[i] - means[group]);
+      }
+      bool is_std = (opcode == GenericDataFrameVector::OpCode::AggregateStd);
+      result_vec.resize(num_groups);
+      for (uint64_t group = 0; group < num_groups; group++) {
+        double var = (cnts[group] > 1) ? m2s[group] / (cnts[group] - 1) : 0;
+        result_vec[group] = static_cast<T>(is_std ? std::sqrt(var) : var);
+      }
+      return;
+    }
+    default:
+      break;
+    }
+  }
+  BUG();
+}
+
+template <typename T>
+void ServerDataFrameVector<T>::compute_filter(uint16_t input_len,
+                                              const uint8_t *input_buf,
+                                              uint16_t *output_len,
+                                              uint8_t *output_buf) {
+  const uint8_t *input_end = input_buf + input_len;
+  uint8_t result_ds = input_buf[0];
+  uint64_t size =
+      *reinterpret_cast<const uint64_t *>(input_buf + sizeof(result_ds));
+  uint8_t num_preds = input_buf[sizeof(result_ds) + sizeof(size)];
+  const uint8_t *pred = input_buf + sizeof(result_ds) + sizeof(size) + 1;
+  auto &result_vec =
+      reinterpret_cast<ServerDataFrameVector<unsigned long long> *>(
+          Server::get_server_ds(result_ds))
+          ->vec_;
+  for (uint8_t i = 0; i < num_preds; i++) {
+    uint8_t col_ds = pred[0];
+    uint8_t dt_id = pred[1];
+    uint8_t cmp = pred[2];
+    const uint8_t *operands = pred + 3;
+    bool first = (i == 0);
+    switch (dt_id) {
+    case DataFrameTypeID::Char:
+      pred = _compute_filter<char>(col_ds, cmp, operands, size, first,
+                                   result_vec);
+      break;
+    case DataFrameTypeID::Short:
+      pred = _compute_filter<short>(col_ds, cmp, operands, size, first,
+                                    result_vec);
+      break;
+    case DataFrameTypeID::Int:
+      pred = _compute_filter<int>(col_ds, cmp, operands, size, first,
+                                  result_vec);
+      break;
+    case DataFrameTypeID::UnsignedInt:
+      pred = _compute_filter<unsigned int>(col_ds, cmp, operands, size, first,
+                                           result_vec);
+      break;
+    case DataFrameTypeID::Long:
+      pred = _compute_filter<long>(col_ds, cmp, operands, size, first,
+                                   result_vec);
+      break;
+    case DataFrameTypeID::UnsignedLong:
+      pred = _compute_filter<unsigned long>(col_ds, cmp, operands, size, first,
+                                            result_vec);
+      break;
+    case DataFrameTypeID::LongLong:
+      pred = _compute_filter<long long>(col_ds, cmp, operands, size, first,
+                                        result_vec);
+      break;
+    case DataFrameTypeID::UnsignedLongLong:
+      pred = _compute_filter<unsigned long long>(col_ds, cmp, operands, size,
+                                                 first, result_vec);
+      break;
+    case DataFrameTypeID::Float:
+      pred = _compute_filter<float>(col_ds, cmp, operands, size, first,
+                                    result_vec);
+      break;
+    case DataFrameTypeID::Double:
+      pred = _compute_filter<double>(col_ds, cmp, operands, size, first,
+                                     result_vec);
+      break;
+    case DataFrameTypeID::Time:
+      pred = _compute_filter<SimpleTime>(col_ds, cmp, operands, size, first,
+                                         result_vec);
+      break;
+    default:
+      BUG();
+    }
+    BUG_ON(pred > input_end);
+  }
+  *output_len = 2 * sizeof(uint64_t);
+  *reinterpret_cast<uint64_t *>(output_buf) = result_vec.size();
+  *(reinterpret_cast<uint64_t *>(output_buf) + 1) = result_vec.capacity();
+}
+
+template <typename T>
+template <typename U>
+const uint8_t *ServerDataFrameVector<T>::_compute_filter(
+    uint8_t col_ds, uint8_t cmp, const uint8_t *operands, uint64_t size,
+    bool first, std::vector<unsigned long long> &result_vec) {
+  auto &col_vec = reinterpret_cast<ServerDataFrameVector<U> *>(
+                      Server::get_server_ds(col_ds))
+                      ->vec_;
+  auto predicate_cmp = static_cast<DataFramePredicate::Cmp>(cmp);
+  U operand, operand_hi;
+  __builtin_memcpy(&operand, operands, sizeof(U));
+  __builtin_memcpy(&operand_hi, operands + sizeof(U), sizeof(U));
+  if (first) {
+    // The first predicate scans the whole column.
+    result_vec.reserve(size);
+    for (uint64_t i = 0; i < size; i++) {
+      if (DataFramePredicate::test(predicate_cmp, col_vec[i], operand,
+                                   operand_hi)) {
+        result_vec.push_back(i);
+      }
+    }
+  } else {
+    // The rest only narrow down the indices selected so far.
+    uint64_t num_selected = 0;
+    for (auto idx : result_vec) {
+      if (DataFramePredicate::test(predicate_cmp, col_vec[idx], operand,
+                                   operand_hi)) {
+        result_vec[num_selected++] = idx;
+      }
+    }
+    result_vec.resize(num_selected);
+  }
+  return operands + 2 * sizeof(U);
+}
+
 template <typename T>
 void ServerDataFrameVector<T>::compute(uint8_t opcode, uint16_t input_len,
                                        const uint8_t *input_buf,
@@ -305,8 +637,21 @@ void ServerDataFrameVector<T>::compute(uint8_t opcode, uint16_t input_len,
   case GenericDataFrameVector::OpCode::AggregateMax:
   case GenericDataFrameVector::OpCode::AggregateMin:
   case GenericDataFrameVector::OpCode::AggregateMedian:
+  case GenericDataFrameVector::OpCode::AggregateSum:
+  case GenericDataFrameVector::OpCode::AggregateCount:
+  case GenericDataFrameVector::OpCode::AggregateMean:
+  case GenericDataFrameVector::OpCode::AggregateVar:
+  case GenericDataFrameVector::OpCode::AggregateStd:
+  case GenericDataFrameVector::OpCode::AggregateFirst:
+  case GenericDataFrameVector::OpCode::AggregateLast:
     compute_aggregate(opcode, input_len, input_buf, output_len, output_buf);
     break;
+  case GenericDataFrameVector::OpCode::Filter:
+    compute_filter(input_len, input_buf, output_len, output_buf);
+    break;
+  case GenericDataFrameVector::OpCode::GroupBy:
+    compute_group_by(input_len, input_buf, output_len, output_buf);
+    break;
   default:
     BUG();
   }
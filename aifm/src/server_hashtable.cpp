@@ -1,5 +1,6 @@
 #include "server_hashtable.hpp"
 #include "helpers.hpp"
+#include "rdma_server.hpp"
 
 #include <cstring>
 
@@ -9,11 +10,21 @@ ServerHashTable::ServerHashTable(uint32_t param_len, uint8_t *params) {
   auto remote_num_entries_shift = *reinterpret_cast<uint32_t *>(&params[0]);
   auto remote_data_size =
       *reinterpret_cast<uint64_t *>(&params[sizeof(remote_num_entries_shift)]);
+  // Place the hashtable in the registered memory of the RDMA server if there
+  // is one, so that the clients are able to probe it with one-sided reads.
+  rdma_mem_size_ = LocalGenericConcurrentHopscotch::get_mem_size(
+      remote_num_entries_shift, remote_data_size);
+  rdma_mem_ = static_cast<uint8_t *>(rdma_server_alloc(rdma_mem_size_));
   local_hopscotch_.reset(new LocalGenericConcurrentHopscotch(
-      remote_num_entries_shift, remote_data_size));
+      remote_num_entries_shift, remote_data_size, rdma_mem_));
 }
 
-ServerHashTable::~ServerHashTable() {}
+ServerHashTable::~ServerHashTable() {
+  local_hopscotch_.reset();
+  if (rdma_mem_) {
+    rdma_server_free(rdma_mem_, rdma_mem_size_);
+  }
+}
 
 void ServerHashTable::read_object(uint8_t obj_id_len, const uint8_t *obj_id,
                                   uint16_t *data_len, uint8_t *data_buf) {
@@ -31,6 +42,24 @@ void ServerHashTable::write_object(uint8_t obj_id_len, const uint8_t *obj_id,
   local_hopscotch_->put(obj_id_len, obj_id, data_len, data_buf);
 }
 
+// The buckets of the whole batch are prefetched up front, so that their cache
+// misses overlap instead of being taken one object at a time.
+void ServerHashTable::read_objects(uint32_t num_reqs,
+                                   const ObjectReadReq *reqs) {
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    local_hopscotch_->prefetch_bucket(reqs[i].obj_id_len, reqs[i].obj_id);
+  }
+  ServerDS::read_objects(num_reqs, reqs);
+}
+
+void ServerHashTable::write_objects(uint32_t num_reqs,
+                                    const ObjectWriteReq *reqs) {
+  for (uint32_t i = 0; i < num_reqs; i++) {
+    local_hopscotch_->prefetch_bucket(reqs[i].obj_id_len, reqs[i].obj_id);
+  }
+  ServerDS::write_objects(num_reqs, reqs);
+}
+
 bool ServerHashTable::remove_object(uint8_t obj_id_len, const uint8_t *obj_id) {
   return local_hopscotch_->remove(obj_id_len, obj_id);
 }
@@ -38,7 +67,25 @@ bool ServerHashTable::remove_object(uint8_t obj_id_len, const uint8_t *obj_id) {
 void ServerHashTable::compute(uint8_t opcode, uint16_t input_len,
                               const uint8_t *input_buf, uint16_t *output_len,
                               uint8_t *output_buf) {
-  BUG();
+  BUG_ON(opcode != kOpGetRDMALayout);
+  *output_len = 0;
+#ifndef HASHTABLE_EXCLUSIVE
+  // With HASHTABLE_EXCLUSIVE, reads remove the key-value pairs, which
+  // one-sided reads are not able to.
+  if (rdma_mem_) {
+    auto base_addr = rdma_server_base_addr();
+    auto *layout = reinterpret_cast<RDMALayout *>(output_buf);
+    *layout = {
+        .base_addr = base_addr,
+        .buckets_offset =
+            reinterpret_cast<uint64_t>(local_hopscotch_->get_buckets()) -
+            base_addr,
+        .end_offset =
+            reinterpret_cast<uint64_t>(rdma_mem_) + rdma_mem_size_ - base_addr,
+        .hash_mask = local_hopscotch_->get_hash_mask()};
+    *output_len = sizeof(RDMALayout);
+  }
+#endif
 }
 
 ServerDS *ServerHashTableFactory::build(uint32_t param_len, uint8_t *params) {
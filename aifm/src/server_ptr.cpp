@@ -42,6 +42,23 @@ void ServerPtr::write_object(uint8_t obj_id_len, const uint8_t *obj_id,
   remote_object.set_obj_id_len(obj_id_len);
 }
 
+void ServerPtr::write_object_extents(uint8_t obj_id_len, const uint8_t *obj_id,
+                                     uint16_t data_len, const uint8_t *data_buf,
+                                     uint8_t num_extents,
+                                     const ObjectExtent *extents) {
+  const uint64_t &object_id = *(reinterpret_cast<const uint64_t *>(obj_id));
+  assert(obj_id_len == sizeof(decltype(object_id)));
+  auto remote_object_addr = reinterpret_cast<uint64_t>(buf_.get()) + object_id;
+  Object remote_object(remote_object_addr);
+  assert(remote_object.get_data_len() == data_len);
+  auto *remote_data_buf =
+      reinterpret_cast<uint8_t *>(remote_object.get_data_addr());
+  for (uint8_t i = 0; i < num_extents; i++) {
+    memcpy(remote_data_buf + extents[i].offset, data_buf + extents[i].offset,
+           extents[i].len);
+  }
+}
+
 bool ServerPtr::remove_object(uint8_t obj_id_len, const uint8_t *obj_id) {
   BUG();
 }
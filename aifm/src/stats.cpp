@@ -25,6 +25,32 @@ unsigned Stats::write_object_cycles_high_end_;
 unsigned Stats::write_object_cycles_low_end_;
 #endif
 
+Cacheline Stats::gc_write_back_bytes_[helpers::kNumCPUs];
+Cacheline Stats::gc_write_back_objects_[helpers::kNumCPUs];
+Cacheline Stats::gc_write_back_partial_objects_[helpers::kNumCPUs];
+Cacheline Stats::swap_in_objects_[helpers::kNumCPUs];
+Cacheline Stats::batch_swap_in_objects_[helpers::kNumCPUs];
+Cacheline Stats::one_sided_hashtable_gets_[helpers::kNumCPUs];
+Cacheline Stats::compression_raw_bytes_[helpers::kNumCPUs];
+Cacheline Stats::compression_stored_bytes_[helpers::kNumCPUs];
+Cacheline Stats::compression_bypassed_objects_[helpers::kNumCPUs];
+Cacheline Stats::compress_cycles_[helpers::kNumCPUs];
+Cacheline Stats::decompress_cycles_[helpers::kNumCPUs];
+Cacheline Stats::compressed_cache_hits_[helpers::kNumCPUs];
+Cacheline Stats::compressed_cache_misses_[helpers::kNumCPUs];
+Cacheline Stats::replica_async_completions_[helpers::kNumCPUs];
+uint64_t Stats::gc_write_back_us_;
+uint64_t Stats::mutator_gc_wait_us_;
+uint64_t Stats::one_sided_hashtable_fallbacks_;
+uint64_t Stats::compressed_cache_write_backs_;
+uint64_t Stats::storage_segment_writes_;
+uint64_t Stats::storage_cleaned_bytes_;
+uint64_t Stats::tier_migrated_chunks_;
+uint64_t Stats::tier_migrated_bytes_;
+uint64_t Stats::far_mem_gc_relocated_bytes_;
+uint64_t Stats::far_mem_gc_reclaimed_regions_;
+uint64_t Stats::far_mem_gc_us_;
+
 void Stats::_add_free_mem_ratio_record() {
 #ifdef MONITOR_FREE_MEM_RATIO
   preempt_disable();
@@ -0,0 +1,131 @@
+extern "C" {
+#include <runtime/tcp.h>
+}
+
+#include "tcp_channel.hpp"
+
+#include <sys/socket.h>
+
+namespace far_memory {
+
+TCPChannel::TCPChannel(tcpconn_t *remote_slave) : remote_slave_(remote_slave) {
+  free_tags_.reserve(kMaxNumInflightReqs);
+  for (uint32_t i = kMaxNumInflightReqs; i > 0; i--) {
+    free_tags_.push_back(i - 1);
+  }
+  reader_ = rt::Thread([&]() { reader_fn(); });
+}
+
+TCPChannel::~TCPChannel() {
+  // The remote agent closes its side once it has responded to all the
+  // requests, which stops the reader.
+  tcp_shutdown(remote_slave_, SHUT_WR);
+  reader_.Join();
+  tcp_close(remote_slave_);
+}
+
+void TCPChannel::reader_fn() {
+  FrameHeader header;
+  while (helpers::tcp_try_read_until(remote_slave_, &header, sizeof(header))) {
+    BUG_ON(header.tag >= kMaxNumInflightReqs);
+    auto &slot = slots_[header.tag].data;
+    if (slot.num_resps) {
+      uint32_t len = 0;
+      for (uint32_t i = 0; i < slot.num_resps; i++) {
+        auto *resp_len = slot.resp_lens[i];
+        helpers::tcp_read_until(remote_slave_, resp_len, sizeof(*resp_len));
+        if (*resp_len) {
+          helpers::tcp_read_until(remote_slave_, slot.resp_bufs[i], *resp_len);
+        }
+        len += sizeof(*resp_len) + *resp_len;
+      }
+      BUG_ON(header.len != len);
+    } else {
+      BUG_ON(header.len != sizeof(slot.resp));
+      helpers::tcp_read_until(remote_slave_, &slot.resp, sizeof(slot.resp));
+    }
+    slot.spin.Lock();
+    slot.done = true;
+    slot.cv.Signal();
+    slot.spin.Unlock();
+  }
+}
+
+uint32_t TCPChannel::acquire_tag() {
+  free_tags_spin_.Lock();
+  while (free_tags_.empty()) {
+    free_tags_cv_.Wait(&free_tags_spin_);
+  }
+  auto tag = free_tags_.back();
+  free_tags_.pop_back();
+  free_tags_spin_.Unlock();
+  slots_[tag].data.done = false;
+  return tag;
+}
+
+// The slot of tag must have been set up, as the response may arrive as soon as
+// the request is sent.
+void TCPChannel::send(uint32_t tag, const iovec *iov, int iovcnt) {
+  BUG_ON(iovcnt > static_cast<int>(kMaxNumIovecs));
+  FrameHeader header = {.tag = tag, .len = 0};
+  iovec iovecs[kMaxNumIovecs + 1];
+  iovecs[0] = {.iov_base = &header, .iov_len = sizeof(header)};
+  for (int i = 0; i < iovcnt; i++) {
+    iovecs[i + 1] = iov[i];
+    header.len += iov[i].iov_len;
+  }
+  BUG_ON(header.len > kMaxFrameLen);
+  write_mutex_.Lock();
+  helpers::tcp_writev_until(remote_slave_, iovecs, iovcnt + 1);
+  write_mutex_.Unlock();
+}
+
+uint32_t TCPChannel::post(const iovec *iov, int iovcnt, uint16_t *resp_len,
+                          uint8_t *resp_buf) {
+  auto tag = acquire_tag();
+  auto &slot = slots_[tag].data;
+  slot.resp_len = resp_len;
+  slot.resp_buf = resp_buf;
+  slot.num_resps = resp_len ? 1 : 0;
+  slot.resp_lens = &slot.resp_len;
+  slot.resp_bufs = &slot.resp_buf;
+  send(tag, iov, iovcnt);
+  return tag;
+}
+
+uint32_t TCPChannel::post_vectored(const iovec *iov, int iovcnt,
+                                   uint32_t num_resps,
+                                   uint16_t *const *resp_lens,
+                                   uint8_t *const *resp_bufs) {
+  auto tag = acquire_tag();
+  auto &slot = slots_[tag].data;
+  slot.num_resps = num_resps;
+  slot.resp_lens = resp_lens;
+  slot.resp_bufs = resp_bufs;
+  send(tag, iov, iovcnt);
+  return tag;
+}
+
+bool TCPChannel::complete(uint32_t tag, bool block, uint8_t *resp) {
+  auto &slot = slots_[tag].data;
+  slot.spin.Lock();
+  if (!slot.done) {
+    if (!block) {
+      slot.spin.Unlock();
+      return false;
+    }
+    while (!slot.done) {
+      slot.cv.Wait(&slot.spin);
+    }
+  }
+  slot.spin.Unlock();
+  *resp = slot.resp;
+
+  free_tags_spin_.Lock();
+  free_tags_.push_back(tag);
+  free_tags_cv_.Signal();
+  free_tags_spin_.Unlock();
+  return true;
+}
+
+} // namespace far_memory
@@ -13,6 +13,7 @@ extern "C"
 #include "object.hpp"
 #include "server.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <cstring>
@@ -31,6 +32,104 @@ rt::Thread master_thread;
 rt::Thread rdma_thread;
 Server server;
 
+// The I/O buffer that a request is parsed into and its response is built in,
+// which is large enough for any request or response of protocol v1 (batches
+// that do not fit have their payloads allocated on their own). The buffers
+// are taken off the stacks of the uthreads, which would otherwise hold a
+// couple hundred KB each, one per connection. Protocol v2 reads the frame of a
+// request into frame, and builds the frame of its response there.
+struct IOBuffer
+{
+  constexpr static uint32_t kReqSize =
+      Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize +
+      sizeof(uint8_t) + Object::kMaxObjectIDSize +
+      std::max<uint32_t>(Object::kMaxObjectDataSize,
+                         TCPDevice::kMaxComputeDataLen);
+  constexpr static uint32_t kRespSize =
+      Object::kDataLenSize + std::max<uint32_t>(Object::kMaxObjectDataSize,
+                                                TCPDevice::kMaxComputeDataLen);
+
+  constexpr static uint32_t kFrameSize =
+      sizeof(TCPChannel::FrameHeader) +
+      std::max<uint32_t>(TCPDevice::kOpcodeSize + kReqSize, kRespSize);
+
+  uint8_t req[kReqSize];
+  uint8_t resp[kRespSize];
+  ObjectExtent extents[std::numeric_limits<uint8_t>::max()];
+  uint8_t frame[kFrameSize];
+};
+
+// Preallocated I/O buffers, cached per core. A request holds a buffer of the
+// core that it is served on from the time its opcode arrives until its
+// response is sent, so the buffers in use are bounded by the inflight
+// requests rather than by the connections, and stay warm in the caches of
+// their cores.
+class IOBufferPool
+{
+public:
+  constexpr static uint32_t kNumPreallocatedBuffersPerCPU = 4;
+  constexpr static uint32_t kMaxNumCachedBuffersPerCPU = 64;
+
+  IOBufferPool()
+  {
+    for (auto &cache : caches_)
+    {
+      for (uint32_t i = 0; i < kNumPreallocatedBuffersPerCPU; i++)
+      {
+        cache.data.bufs.push_back(new IOBuffer());
+      }
+    }
+  }
+
+  ~IOBufferPool()
+  {
+    for (auto &cache : caches_)
+    {
+      for (auto *buf : cache.data.bufs)
+      {
+        delete buf;
+      }
+    }
+  }
+
+  IOBuffer *acquire()
+  {
+    preempt_disable();
+    auto &cache = caches_[get_core_num()].data.bufs;
+    IOBuffer *buf = nullptr;
+    if (likely(!cache.empty()))
+    {
+      buf = cache.back();
+      cache.pop_back();
+    }
+    preempt_enable();
+    return buf ? buf : new IOBuffer();
+  }
+
+  void release(IOBuffer *buf)
+  {
+    preempt_disable();
+    auto &cache = caches_[get_core_num()].data.bufs;
+    if (likely(cache.size() < kMaxNumCachedBuffersPerCPU))
+    {
+      cache.push_back(buf);
+      buf = nullptr;
+    }
+    preempt_enable();
+    delete buf;
+  }
+
+private:
+  struct Cache
+  {
+    std::vector<IOBuffer *> bufs;
+  };
+
+  CachelineAligned(Cache) caches_[helpers::kNumCPUs];
+};
+
+IOBufferPool io_buffer_pool;
+
 // Request:
 //     |OpCode = Init (1B)|Far Mem Size (8B)|
 // Response:
@@ -48,6 +147,7 @@ void process_init(tcpconn_t *c)
       static_cast<uint8_t *>(helpers::allocate_hugepage(*far_mem_size));
   BUG_ON(far_mem_ptr == nullptr);
   far_mem.reset(far_mem_ptr);
+  rdma_server_set_far_mem_size(*far_mem_size);
 
   barrier();
   uint8_t ack;
@@ -75,27 +175,98 @@ void process_shutdown(tcpconn_t *c)
   slave_threads.clear();
 }
 
+// A connection of protocol v1, whose requests are served in order, straight
+// off the connection.
+class ConnStream
+{
+public:
+  ConnStream(tcpconn_t *c) : c_(c) {}
+  void read(void *buf, size_t len) { helpers::tcp_read_until(c_, buf, len); }
+  void write(const void *buf, size_t len)
+  {
+    helpers::tcp_write_until(c_, buf, len);
+  }
+
+private:
+  tcpconn_t *c_;
+};
+
+// A request frame of protocol v2, which has been read as a whole behind the
+// room for the frame header. As the request is consumed before any of its
+// response is written, the response frame is built in place of it, and then
+// sent back at once.
+class FrameStream
+{
+public:
+  // Takes the ownership of large_frame, if any, which frame points into.
+  FrameStream(uint32_t tag, uint8_t *frame, uint32_t frame_size,
+              uint32_t req_len, uint8_t *large_frame)
+      : frame_(frame), frame_size_(frame_size), req_len_(req_len),
+        large_frame_(large_frame)
+  {
+    header_.tag = tag;
+    header_.len = 0;
+  }
+  void read(void *buf, size_t len)
+  {
+    BUG_ON(pos_ + len > req_len_);
+    memcpy(buf, frame_ + sizeof(header_) + pos_, len);
+    pos_ += len;
+  }
+  void write(const void *buf, size_t len)
+  {
+    BUG_ON(pos_ != req_len_);
+    auto size = sizeof(header_) + header_.len + len;
+    if (unlikely(size > frame_size_))
+    {
+      // Only the responses of large batches get here.
+      auto new_size = std::max<size_t>(size, 2 * frame_size_);
+      auto *large_frame = new uint8_t[new_size];
+      memcpy(large_frame, frame_, sizeof(header_) + header_.len);
+      large_frame_.reset(large_frame);
+      frame_ = large_frame;
+      frame_size_ = new_size;
+    }
+    memcpy(frame_ + sizeof(header_) + header_.len, buf, len);
+    header_.len += len;
+  }
+  // Returns the response frame, which spans get_frame_len() bytes.
+  const uint8_t *finish()
+  {
+    memcpy(frame_, &header_, sizeof(header_));
+    return frame_;
+  }
+  uint32_t get_frame_len() const { return sizeof(header_) + header_.len; }
+
+private:
+  uint8_t *frame_;
+  uint32_t frame_size_;
+  uint32_t req_len_;
+  uint32_t pos_ = 0;
+  std::unique_ptr<uint8_t[]> large_frame_;
+  TCPChannel::FrameHeader header_;
+};
+
 // Request:
 // |Opcode = KOpReadObject(1B) | ds_id(1B) | obj_id_len(1B) | obj_id |
 // Response:
 // |data_len(2B)|data_buf(data_len B)|
-void process_read_object(tcpconn_t *c)
+template <typename Stream> void process_read_object(Stream *s, IOBuffer *buf)
 {
-  uint8_t
-      req[Object::kDSIDSize + Object::kIDLenSize + Object::kMaxObjectIDSize];
-  uint8_t resp[Object::kDataLenSize + Object::kMaxObjectDataSize];
+  auto *req = buf->req;
+  auto *resp = buf->resp;
 
-  helpers::tcp_read_until(c, req, Object::kDSIDSize + Object::kIDLenSize);
+  s->read(req, Object::kDSIDSize + Object::kIDLenSize);
   auto ds_id = *const_cast<uint8_t *>(&req[0]);
   auto object_id_len = *const_cast<uint8_t *>(&req[Object::kDSIDSize]);
   auto *object_id = &req[Object::kDSIDSize + Object::kIDLenSize];
-  helpers::tcp_read_until(c, object_id, object_id_len);
+  s->read(object_id, object_id_len);
 
-  auto *data_len = reinterpret_cast<uint16_t *>(&resp);
+  auto *data_len = reinterpret_cast<uint16_t *>(resp);
   auto *data_buf = &resp[Object::kDataLenSize];
   server.read_object(ds_id, object_id_len, object_id, data_len, data_buf);
 
-  helpers::tcp_write_until(c, resp, Object::kDataLenSize + *data_len);
+  s->write(resp, Object::kDataLenSize + *data_len);
 }
 
 // Request:
@@ -103,22 +274,19 @@ void process_read_object(tcpconn_t *c)
 // |obj_id(obj_id_len B)|data_buf(data_len)|
 // Response:
 // |Ack (1B)|
-void process_write_object(tcpconn_t *c)
+template <typename Stream> void process_write_object(Stream *s, IOBuffer *buf)
 {
-  uint8_t req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize +
-              Object::kMaxObjectIDSize + Object::kMaxObjectDataSize];
+  auto *req = buf->req;
 
-  helpers::tcp_read_until(
-      c, req, Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize);
+  s->read(req, Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize);
 
   auto ds_id = *const_cast<uint8_t *>(&req[0]);
   auto object_id_len = *const_cast<uint8_t *>(&req[Object::kDSIDSize]);
   auto data_len = *reinterpret_cast<uint16_t *>(
       &req[Object::kDSIDSize + Object::kIDLenSize]);
 
-  helpers::tcp_read_until(
-      c, &req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize],
-      object_id_len + data_len);
+  s->read(&req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize],
+          object_id_len + data_len);
 
   auto *object_id = const_cast<uint8_t *>(
       &req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize]);
@@ -129,30 +297,237 @@ void process_write_object(tcpconn_t *c)
   server.write_object(ds_id, object_id_len, object_id, data_len, data_buf);
 
   uint8_t ack;
-  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  s->write(&ack, sizeof(ack));
+}
+
+// Request:
+// |Opcode = kOpWriteObjectExtents (1B)|ds_id(1B)|obj_id_len(1B)|data_len(2B)|
+// |num_extents(1B)|obj_id(obj_id_len B)|extents(num_extents * 4B)|
+// |extent data (the data of each extent, in order)|
+// Response:
+// |Ack (1B)|
+template <typename Stream>
+void process_write_object_extents(Stream *s, IOBuffer *buf)
+{
+  uint8_t num_extents;
+  auto *req = buf->req;
+  auto *extents = buf->extents;
+  auto *data_buf = buf->resp;
+
+  s->read(req, Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize +
+                   sizeof(num_extents));
+
+  auto ds_id = *const_cast<uint8_t *>(&req[0]);
+  auto object_id_len = *const_cast<uint8_t *>(&req[Object::kDSIDSize]);
+  auto data_len = *reinterpret_cast<uint16_t *>(
+      &req[Object::kDSIDSize + Object::kIDLenSize]);
+  num_extents = *const_cast<uint8_t *>(
+      &req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize]);
+  auto *object_id =
+      &req[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize +
+           sizeof(num_extents)];
+
+  s->read(object_id, object_id_len);
+  s->read(extents, num_extents * sizeof(ObjectExtent));
+  for (uint8_t i = 0; i < num_extents; i++)
+  {
+    BUG_ON(extents[i].offset + extents[i].len > data_len);
+    s->read(&data_buf[extents[i].offset], extents[i].len);
+  }
+
+  server.write_object_extents(ds_id, object_id_len, object_id, data_len,
+                              data_buf, num_extents, extents);
+
+  uint8_t ack;
+  s->write(&ack, sizeof(ack));
+}
+
+// Request:
+// |Opcode = kOpReadObjects (1B)|num_objs(2B)|
+// |entries (for each object, |ds_id(1B)|obj_id_len(1B)|max_data_len(2B)|
+//  obj_id(obj_id_len B)|)|
+// Response:
+// |for each object, |data_len(2B)|data_buf(data_len B)||
+template <typename Stream> void process_read_objects(Stream *s, IOBuffer *buf)
+{
+  constexpr uint32_t kEntryHeaderSize =
+      Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize;
+  static_assert(FarMemDevice::kMaxBatchSize * Object::kMaxObjectIDSize <=
+                IOBuffer::kReqSize);
+  uint16_t num_objs;
+  auto *obj_ids =
+      reinterpret_cast<uint8_t(*)[Object::kMaxObjectIDSize]>(buf->req);
+  uint16_t max_data_lens[FarMemDevice::kMaxBatchSize];
+  uint16_t data_lens[FarMemDevice::kMaxBatchSize];
+  ObjectReadReq reqs[FarMemDevice::kMaxBatchSize];
+
+  s->read(&num_objs, sizeof(num_objs));
+  BUG_ON(num_objs > FarMemDevice::kMaxBatchSize);
+  uint32_t resp_size = 0;
+  for (uint16_t i = 0; i < num_objs; i++)
+  {
+    uint8_t entry[kEntryHeaderSize];
+    s->read(entry, kEntryHeaderSize);
+    reqs[i].ds_id = entry[0];
+    reqs[i].obj_id_len = entry[Object::kDSIDSize];
+    max_data_lens[i] = *reinterpret_cast<uint16_t *>(
+        &entry[Object::kDSIDSize + Object::kIDLenSize]);
+    s->read(obj_ids[i], reqs[i].obj_id_len);
+    reqs[i].obj_id = obj_ids[i];
+    reqs[i].data_len = &data_lens[i];
+    resp_size += Object::kDataLenSize + max_data_lens[i];
+  }
+
+  // Every object is read into a slot of its max_data_len, and the slots are
+  // packed afterwards.
+  std::unique_ptr<uint8_t[]> large_resp;
+  auto *resp = buf->resp;
+  if (resp_size > IOBuffer::kRespSize)
+  {
+    large_resp.reset(new uint8_t[resp_size]);
+    resp = large_resp.get();
+  }
+  uint32_t pos = 0;
+  for (uint16_t i = 0; i < num_objs; i++)
+  {
+    reqs[i].data_buf = &resp[pos + Object::kDataLenSize];
+    pos += Object::kDataLenSize + max_data_lens[i];
+  }
+
+  server.read_objects(num_objs, reqs);
+
+  uint32_t resp_len = 0;
+  for (uint16_t i = 0; i < num_objs; i++)
+  {
+    BUG_ON(data_lens[i] > max_data_lens[i]);
+    memcpy(&resp[resp_len], &data_lens[i], Object::kDataLenSize);
+    memmove(&resp[resp_len + Object::kDataLenSize], reqs[i].data_buf,
+            data_lens[i]);
+    resp_len += Object::kDataLenSize + data_lens[i];
+  }
+  s->write(resp, resp_len);
+}
+
+// Request:
+// |Opcode = kOpWriteObjects (1B)|num_objs(2B)|
+// |entries (for each object, |ds_id(1B)|obj_id_len(1B)|data_len(2B)|
+//  num_extents(1B)|obj_id(obj_id_len B)|extents(num_extents * 4B)|)|
+// |payloads (for each object, its data, or the data of each of its extents)|
+// Response:
+// |Ack (1B)|
+template <typename Stream> void process_write_objects(Stream *s, IOBuffer *buf)
+{
+  constexpr uint32_t kEntryHeaderSize = Object::kDSIDSize +
+                                        Object::kIDLenSize +
+                                        Object::kDataLenSize + sizeof(uint8_t);
+  uint16_t num_objs;
+  auto *obj_ids =
+      reinterpret_cast<uint8_t(*)[Object::kMaxObjectIDSize]>(buf->req);
+  uint32_t extent_idxs[FarMemDevice::kMaxBatchSize];
+  std::vector<ObjectExtent> extents;
+  ObjectWriteReq reqs[FarMemDevice::kMaxBatchSize];
+
+  s->read(&num_objs, sizeof(num_objs));
+  BUG_ON(num_objs > FarMemDevice::kMaxBatchSize);
+  uint32_t data_size = 0;
+  for (uint16_t i = 0; i < num_objs; i++)
+  {
+    uint8_t entry[kEntryHeaderSize];
+    s->read(entry, kEntryHeaderSize);
+    auto &req = reqs[i];
+    req.ds_id = entry[0];
+    req.obj_id_len = entry[Object::kDSIDSize];
+    req.data_len = *reinterpret_cast<uint16_t *>(
+        &entry[Object::kDSIDSize + Object::kIDLenSize]);
+    req.num_extents =
+        entry[Object::kDSIDSize + Object::kIDLenSize + Object::kDataLenSize];
+    s->read(obj_ids[i], req.obj_id_len);
+    req.obj_id = obj_ids[i];
+    extent_idxs[i] = extents.size();
+    if (req.num_extents)
+    {
+      extents.resize(extents.size() + req.num_extents);
+      s->read(&extents[extent_idxs[i]],
+              req.num_extents * sizeof(ObjectExtent));
+    }
+    data_size += req.data_len;
+  }
+
+  std::unique_ptr<uint8_t[]> large_data;
+  auto *data = buf->resp;
+  if (data_size > IOBuffer::kRespSize)
+  {
+    large_data.reset(new uint8_t[data_size]);
+    data = large_data.get();
+  }
+  uint32_t pos = 0;
+  for (uint16_t i = 0; i < num_objs; i++)
+  {
+    auto &req = reqs[i];
+    auto *data_buf = &data[pos];
+    req.data_buf = data_buf;
+    req.extents = extents.data() + extent_idxs[i];
+    if (!req.num_extents)
+    {
+      s->read(data_buf, req.data_len);
+    }
+    for (uint8_t j = 0; j < req.num_extents; j++)
+    {
+      BUG_ON(req.extents[j].offset + req.extents[j].len > req.data_len);
+      s->read(data_buf + req.extents[j].offset, req.extents[j].len);
+    }
+    pos += req.data_len;
+  }
+
+  server.write_objects(num_objs, reqs);
+
+  uint8_t ack;
+  s->write(&ack, sizeof(ack));
+}
+
+// Request:
+// |Opcode = kOpCopyObject (1B)|ds_id(1B)|obj_id_len(1B)|
+// |from_obj_id(obj_id_len B)|to_obj_id(obj_id_len B)|
+// Response:
+// |Ack (1B)|
+template <typename Stream> void process_copy_object(Stream *s, IOBuffer *buf)
+{
+  auto *req = buf->req;
+
+  s->read(req, Object::kDSIDSize + Object::kIDLenSize);
+  auto ds_id = *const_cast<uint8_t *>(&req[0]);
+  auto obj_id_len = *const_cast<uint8_t *>(&req[Object::kDSIDSize]);
+
+  auto *from_obj_id = &req[Object::kDSIDSize + Object::kIDLenSize];
+  auto *to_obj_id = from_obj_id + obj_id_len;
+  s->read(from_obj_id, 2 * obj_id_len);
+
+  // The data stays on this side.
+  server.copy_object(ds_id, obj_id_len, from_obj_id, to_obj_id, buf->resp);
+
+  uint8_t ack;
+  s->write(&ack, sizeof(ack));
 }
 
 // Request:
 // |Opcode = kOpRemoveObject (1B)|ds_id(1B)|obj_id_len(1B)|obj_id(obj_id_len B)|
 // Response:
 // |exists (1B)|
-void process_remove_object(tcpconn_t *c)
+template <typename Stream> void process_remove_object(Stream *s, IOBuffer *buf)
 {
-  uint8_t
-      req[Object::kDSIDSize + Object::kIDLenSize + Object::kMaxObjectIDSize];
+  auto *req = buf->req;
 
-  helpers::tcp_read_until(c, req, Object::kDSIDSize + Object::kIDLenSize);
+  s->read(req, Object::kDSIDSize + Object::kIDLenSize);
   auto ds_id = *const_cast<uint8_t *>(&req[0]);
   auto obj_id_len = *const_cast<uint8_t *>(&req[Object::kDSIDSize]);
 
-  helpers::tcp_read_until(c, &req[Object::kDSIDSize + Object::kIDLenSize],
-                          obj_id_len);
+  s->read(&req[Object::kDSIDSize + Object::kIDLenSize], obj_id_len);
 
   auto *obj_id =
       const_cast<uint8_t *>(&req[Object::kDSIDSize + Object::kIDLenSize]);
   bool exists = server.remove_object(ds_id, obj_id_len, obj_id);
 
-  helpers::tcp_write_until(c, &exists, sizeof(exists));
+  s->write(&exists, sizeof(exists));
 }
 
 // Request:
@@ -160,46 +535,43 @@ void process_remove_object(tcpconn_t *c)
 // |param_len(1B)|params(param_len B)|
 // Response:
 // |Ack (1B)|
-void process_construct(tcpconn_t *c)
+template <typename Stream> void process_construct(Stream *s, IOBuffer *buf)
 {
   uint8_t ds_type;
   uint8_t ds_id;
   uint8_t param_len;
   uint8_t *params;
-  uint8_t req[sizeof(ds_type) + Object::kDSIDSize + sizeof(param_len) +
-              std::numeric_limits<decltype(param_len)>::max()];
+  auto *req = buf->req;
 
-  helpers::tcp_read_until(
-      c, req, sizeof(ds_type) + Object::kDSIDSize + sizeof(param_len));
+  s->read(req, sizeof(ds_type) + Object::kDSIDSize + sizeof(param_len));
   ds_type = *const_cast<uint8_t *>(&req[0]);
   ds_id = *const_cast<uint8_t *>(&req[sizeof(ds_type)]);
   param_len = *const_cast<uint8_t *>(&req[sizeof(ds_type) + Object::kDSIDSize]);
-  helpers::tcp_read_until(
-      c, &req[sizeof(ds_type) + Object::kDSIDSize + sizeof(param_len)],
-      param_len);
+  s->read(&req[sizeof(ds_type) + Object::kDSIDSize + sizeof(param_len)],
+          param_len);
   params = const_cast<uint8_t *>(
       &req[sizeof(ds_type) + Object::kDSIDSize + sizeof(param_len)]);
 
   server.construct(ds_type, ds_id, param_len, params);
 
   uint8_t ack;
-  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  s->write(&ack, sizeof(ack));
 }
 
 // Request:
 // |Opcode = kOpDeconstruct (1B)|ds_id(1B)|
 // Response:
 // |Ack (1B)|
-void process_destruct(tcpconn_t *c)
+template <typename Stream> void process_destruct(Stream *s)
 {
   uint8_t ds_id;
 
-  helpers::tcp_read_until(c, &ds_id, Object::kDSIDSize);
+  s->read(&ds_id, Object::kDSIDSize);
 
   server.destruct(ds_id);
 
   uint8_t ack;
-  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  s->write(&ack, sizeof(ack));
 }
 
 // Request:
@@ -207,15 +579,13 @@ void process_destruct(tcpconn_t *c)
 // |input_buf(input_len)|
 // Response:
 // |output_len(2B)|output_buf(output_len B)|
-void process_compute(tcpconn_t *c)
+template <typename Stream> void process_compute(Stream *s, IOBuffer *buf)
 {
   uint8_t opcode;
   uint16_t input_len;
-  uint8_t req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len) +
-              TCPDevice::kMaxComputeDataLen];
+  auto *req = buf->req;
 
-  helpers::tcp_read_until(
-      c, req, Object::kDSIDSize + sizeof(opcode) + sizeof(input_len));
+  s->read(req, Object::kDSIDSize + sizeof(opcode) + sizeof(input_len));
 
   auto ds_id = *reinterpret_cast<uint8_t *>(&req[0]);
   opcode = *reinterpret_cast<uint8_t *>(&req[Object::kDSIDSize]);
@@ -225,54 +595,157 @@ void process_compute(tcpconn_t *c)
 
   if (input_len)
   {
-    helpers::tcp_read_until(
-        c, &req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len)],
-        input_len);
+    s->read(&req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len)],
+            input_len);
   }
 
   auto *input_buf = const_cast<uint8_t *>(
       &req[Object::kDSIDSize + sizeof(opcode) + sizeof(input_len)]);
 
   uint16_t *output_len;
-  uint8_t resp[sizeof(*output_len) + TCPDevice::kMaxComputeDataLen];
+  auto *resp = buf->resp;
   output_len = reinterpret_cast<uint16_t *>(&resp[0]);
   uint8_t *output_buf = &resp[sizeof(*output_len)];
   server.compute(ds_id, opcode, input_len, input_buf, output_len, output_buf);
 
-  helpers::tcp_write_until(c, resp, sizeof(*output_len) + *output_len);
+  s->write(resp, sizeof(*output_len) + *output_len);
+}
+
+template <typename Stream>
+void process(Stream *s, uint8_t opcode, IOBuffer *buf)
+{
+  switch (opcode)
+  {
+  case TCPDevice::kOpReadObject:
+    process_read_object(s, buf);
+    break;
+  case TCPDevice::kOpWriteObject:
+    process_write_object(s, buf);
+    break;
+  case TCPDevice::kOpWriteObjectExtents:
+    process_write_object_extents(s, buf);
+    break;
+  case TCPDevice::kOpReadObjects:
+    process_read_objects(s, buf);
+    break;
+  case TCPDevice::kOpWriteObjects:
+    process_write_objects(s, buf);
+    break;
+  case TCPDevice::kOpRemoveObject:
+    process_remove_object(s, buf);
+    break;
+  case TCPDevice::kOpCopyObject:
+    process_copy_object(s, buf);
+    break;
+  case TCPDevice::kOpConstruct:
+    process_construct(s, buf);
+    break;
+  case TCPDevice::kOpDeconstruct:
+    process_destruct(s);
+    break;
+  case TCPDevice::kOpCompute:
+    process_compute(s, buf);
+    break;
+  default:
+    BUG();
+  }
+}
+
+// Frame format (for both requests and responses):
+//     |Tag (4B)|Len (4B)|v1 request or response (Len B)|
+// The frames are read off the connection in order, but every request is served
+// by a uthread of its own, so that a slow request does not hold back the ones
+// behind it. Responses are sent back as soon as they are ready. A request holds
+// an I/O buffer from the time its frame is read until its response is sent.
+void serve_pipelined(tcpconn_t *c)
+{
+  rt::Mutex write_mutex;
+  rt::Spin spin;
+  rt::CondVar cv;
+  uint32_t num_inflight = 0;
+
+  TCPChannel::FrameHeader header;
+  while (helpers::tcp_try_read_until(c, &header, sizeof(header)))
+  {
+    BUG_ON(header.len < TCPDevice::kOpcodeSize ||
+           header.len > TCPChannel::kMaxFrameLen);
+    auto *buf = io_buffer_pool.acquire();
+    auto *frame = buf->frame;
+    uint32_t frame_size = IOBuffer::kFrameSize;
+    uint8_t *large_frame = nullptr;
+    if (unlikely(sizeof(header) + header.len > frame_size))
+    {
+      // Only the requests of large batches get here.
+      frame_size = sizeof(header) + header.len;
+      large_frame = new uint8_t[frame_size];
+      frame = large_frame;
+    }
+    helpers::tcp_read_until(c, frame + sizeof(header), header.len);
+
+    spin.Lock();
+    num_inflight++;
+    spin.Unlock();
+    rt::Spawn([&, tag = header.tag, req_len = header.len, buf, frame,
+               frame_size, large_frame]()
+              {
+                FrameStream s(tag, frame, frame_size, req_len, large_frame);
+                uint8_t opcode;
+                s.read(&opcode, TCPDevice::kOpcodeSize);
+                process(&s, opcode, buf);
+                auto *resp = s.finish();
+
+                write_mutex.Lock();
+                helpers::tcp_write_until(c, resp, s.get_frame_len());
+                write_mutex.Unlock();
+                io_buffer_pool.release(buf);
+
+                spin.Lock();
+                if (--num_inflight == 0)
+                {
+                  cv.Signal();
+                }
+                spin.Unlock();
+              });
+  }
+
+  // Wait for the inflight requests, which still use the connection.
+  spin.Lock();
+  while (num_inflight)
+  {
+    cv.Wait(&spin);
+  }
+  spin.Unlock();
+}
+
+// Request:
+//     |Opcode = kOpProtocolV2 (1B)|
+// Response:
+//     |Ack (1B)|
+// From then on, the connection carries v2 frames.
+void process_protocol_v2(tcpconn_t *c)
+{
+  uint8_t ack;
+  helpers::tcp_write_until(c, &ack, sizeof(ack));
+  serve_pipelined(c);
 }
 
 void slave_fn(tcpconn_t *c)
 {
   // Run event loop.
+  ConnStream s(c);
   uint8_t opcode;
   int ret;
   while ((ret = tcp_read(c, &opcode, TCPDevice::kOpcodeSize)) > 0)
   {
     BUG_ON(ret != TCPDevice::kOpcodeSize);
-    switch (opcode)
+    if (opcode == TCPDevice::kOpProtocolV2)
     {
-    case TCPDevice::kOpReadObject:
-      process_read_object(c);
-      break;
-    case TCPDevice::kOpWriteObject:
-      process_write_object(c);
-      break;
-    case TCPDevice::kOpRemoveObject:
-      process_remove_object(c);
-      break;
-    case TCPDevice::kOpConstruct:
-      process_construct(c);
-      break;
-    case TCPDevice::kOpDeconstruct:
-      process_destruct(c);
-      break;
-    case TCPDevice::kOpCompute:
-      process_compute(c);
+      process_protocol_v2(c);
       break;
-    default:
-      BUG();
     }
+    auto *buf = io_buffer_pool.acquire();
+    process(&s, opcode, buf);
+    io_buffer_pool.release(buf);
   }
   tcp_close(c);
 }
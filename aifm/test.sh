@@ -7,7 +7,7 @@ all_passed=1
 function run_single_test {
     echo "Running test $1..."
     rerun_local_iokerneld
-    if [[ $1 == *"tcp"* ]]; then
+    if [[ $1 == *"tcp"* || $1 == *"rdma"* ]]; then
     	rerun_mem_server
     fi
     if run_program ./bin/$1 2>/dev/null | grep -q "Passed"; then
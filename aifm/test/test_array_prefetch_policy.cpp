@@ -0,0 +1,234 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+
+#include "array.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "prefetch_policy.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Checks the predictions of each prefetch policy on the access patterns it
+// targets, and then measures the miss rates of the policies on an array that
+// is four times larger than the cache, for interleaved scans, a column-major
+// nested loop, and a pointer chase.
+
+constexpr uint64_t kCacheSize = 256 * Region::kSize;
+constexpr uint64_t kFarMemSize = 4ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumRows = 512;
+constexpr uint64_t kNumCols = 512;
+constexpr uint64_t kNumEntries = kNumRows * kNumCols;
+constexpr uint32_t kMaxDegree = 32;
+
+struct Data4096 {
+  uint64_t idx;
+  uint8_t padding[4096 - sizeof(uint64_t)];
+};
+
+using Data_t = struct Data4096;
+using AppArray = Array<Data_t, kNumRows, kNumCols>;
+
+std::set<uint64_t> feed(PrefetchPolicy *policy,
+                        const std::vector<uint64_t> &idxs) {
+  std::set<uint64_t> predicted;
+  uint64_t buf[PrefetchPolicy::kMaxDegree];
+  for (auto idx : idxs) {
+    auto num = policy->predict(idx, kMaxDegree, buf);
+    predicted.insert(buf, buf + num);
+  }
+  return predicted;
+}
+
+bool check_stride_table() {
+  // Two interleaved forward scans and a backward one with a large stride.
+  std::vector<uint64_t> idxs;
+  for (uint64_t i = 0; i < 16; i++) {
+    idxs.push_back(i);
+    idxs.push_back(100000 + 2 * i);
+    idxs.push_back(900000 - 1000 * i);
+  }
+  StrideTablePolicy policy;
+  auto predicted = feed(&policy, idxs);
+  for (uint64_t i = 16; i < 16 + kMaxDegree; i++) {
+    if (!predicted.count(i) || !predicted.count(100000 + 2 * i) ||
+        !predicted.count(900000 - 1000 * i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool check_delta_correlation() {
+  // A 2D tile walked row by row: 4 consecutive indices, then a jump.
+  std::vector<uint64_t> idxs;
+  for (uint64_t row = 0; row < 8; row++) {
+    for (uint64_t col = 0; col < 4; col++) {
+      idxs.push_back(row * kNumCols + col);
+    }
+  }
+  DeltaCorrelationPolicy policy;
+  auto predicted = feed(&policy, idxs);
+  for (uint64_t row = 8; row < 12; row++) {
+    for (uint64_t col = 0; col < 4; col++) {
+      if (!predicted.count(row * kNumCols + col)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool check_callback() {
+  std::vector<uint64_t> next(1024);
+  std::iota(next.begin(), next.end(), 1);
+  std::shuffle(next.begin(), next.end(), std::mt19937_64(0));
+  CallbackPolicy policy([&](uint64_t idx) -> std::optional<uint64_t> {
+    if (idx >= next.size()) {
+      return std::nullopt;
+    }
+    return next[idx];
+  });
+  std::vector<uint64_t> chain;
+  uint64_t buf[PrefetchPolicy::kMaxDegree];
+  uint64_t idx = 0;
+  for (uint32_t i = 0; i < 64 && idx < next.size(); i++) {
+    auto num = policy.predict(idx, kMaxDegree, buf);
+    chain.insert(chain.end(), buf, buf + num);
+    idx = next[idx];
+  }
+  // The chain must be issued in order and exactly once.
+  idx = 0;
+  for (auto pred : chain) {
+    if (idx >= next.size() || pred != next[idx]) {
+      return false;
+    }
+    idx = pred;
+  }
+  return chain.size() >= 64;
+}
+
+// Returns whether all entries hold their own index.
+bool run(const char *name, AppArray *array,
+         std::function<std::unique_ptr<PrefetchPolicy>()> policy_builder,
+         const std::vector<uint64_t> &order) {
+  array->set_prefetch_policy(policy_builder ? policy_builder() : nullptr);
+  bool passed = true;
+  auto start_misses = Stats::get_swap_in_objects();
+  auto start_us = microtime();
+  for (auto idx : order) {
+    DerefScope scope;
+    const auto &entry = array->at(scope, idx / kNumCols, idx % kNumCols);
+    passed &= (entry.idx == idx);
+  }
+  auto end_us = microtime();
+  auto misses = Stats::get_swap_in_objects() - start_misses;
+  cout << name << ": miss rate = " << (double)misses / order.size()
+       << ", time = " << end_us - start_us << " us" << endl;
+  return passed;
+}
+
+bool bench(FarMemManager *manager) {
+  auto array = std::unique_ptr<AppArray>(
+      manager->allocate_array_heap<Data_t, kNumRows, kNumCols>());
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    array->at_mut(scope, i / kNumCols, i % kNumCols).idx = i;
+  }
+
+  std::vector<uint64_t> interleaved;
+  for (uint64_t i = 0; i < kNumEntries / 2; i++) {
+    interleaved.push_back(i);
+    interleaved.push_back(kNumEntries / 2 + i);
+  }
+  std::vector<uint64_t> column_major;
+  for (uint64_t col = 0; col < kNumCols; col++) {
+    for (uint64_t row = 0; row < kNumRows; row++) {
+      column_major.push_back(row * kNumCols + col);
+    }
+  }
+  // A single random cycle through all entries.
+  std::vector<uint64_t> next(kNumEntries);
+  std::vector<uint64_t> perm(kNumEntries);
+  std::iota(perm.begin(), perm.end(), 0);
+  std::shuffle(perm.begin() + 1, perm.end(), std::mt19937_64(0));
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    next[perm[i]] = perm[(i + 1) % kNumEntries];
+  }
+  std::vector<uint64_t> chase(perm.begin(), perm.end());
+
+  auto stride_table = [] { return std::make_unique<StrideTablePolicy>(); };
+  auto delta_correlation = [] {
+    return std::make_unique<DeltaCorrelationPolicy>();
+  };
+  auto callback = [&] {
+    return std::make_unique<CallbackPolicy>(
+        [&](uint64_t idx) -> std::optional<uint64_t> { return next[idx]; });
+  };
+
+  bool passed = true;
+  passed &= run("interleaved, default", array.get(), nullptr, interleaved);
+  passed &= run("interleaved, stride table", array.get(), stride_table,
+                interleaved);
+  passed &= run("column major, default", array.get(), nullptr, column_major);
+  passed &= run("column major, stride table", array.get(), stride_table,
+                column_major);
+  passed &= run("column major, delta correlation", array.get(),
+                delta_correlation, column_major);
+  passed &= run("chase, default", array.get(), nullptr, chase);
+  passed &= run("chase, callback", array.get(), callback, chase);
+  array->set_prefetch_policy(nullptr);
+  return passed;
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  bool passed = true;
+  passed &= check_stride_table();
+  passed &= check_delta_correlation();
+  passed &= check_callback();
+  passed &= bench(manager);
+
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
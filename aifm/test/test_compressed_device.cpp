@@ -0,0 +1,133 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "concurrent_hopscotch.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Inserts key-value pairs into a hashtable that opts in to compression, with
+// most of the values swapped out. The first half of the values are
+// compressible text, and the second half are random bytes, which the codec
+// should soon bypass. Reports the far-memory bytes saved and the cycles spent
+// (de)compressing.
+
+constexpr static uint32_t kKeyLen = 16;
+constexpr static uint32_t kValueLen = 1024;
+constexpr static uint32_t kHashTableNumEntriesShift = 17;
+constexpr static uint32_t kHashTableRemoteDataSize =
+    (Object::kHeaderSize + kKeyLen + kValueLen) *
+    (1 << kHashTableNumEntriesShift);
+constexpr static uint32_t kNumKVPairs = 1 << 16;
+
+constexpr static uint64_t kCacheSize = (32ULL << 20);
+constexpr static uint64_t kFarMemSize = (1ULL << 30);
+constexpr static uint32_t kNumGCThreads = 12;
+
+const char *kWords[] = {"far ",    "memory ", "object ", "region ",
+                        "swap ",   "remote ", "cache ",  "pointer "};
+
+struct Key {
+  uint64_t data[kKeyLen / sizeof(uint64_t)];
+};
+
+struct Value {
+  uint8_t data[kValueLen];
+};
+
+void fill_value(uint32_t idx, Value *value) {
+  srand(idx);
+  if (idx < kNumKVPairs / 2) {
+    uint32_t len = 0;
+    while (len < kValueLen) {
+      auto *word = kWords[rand() % (sizeof(kWords) / sizeof(kWords[0]))];
+      auto word_len = std::min<uint32_t>(strlen(word), kValueLen - len);
+      memcpy(&value->data[len], word, word_len);
+      len += word_len;
+    }
+  } else {
+    for (uint32_t i = 0; i < kValueLen; i++) {
+      value->data[i] = rand();
+    }
+  }
+}
+
+Key make_key(uint32_t idx) {
+  Key key = {};
+  key.data[0] = idx;
+  return key;
+}
+
+void do_work(FarMemManager *manager, CompressedDevice *device) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  auto hopscotch = manager->allocate_concurrent_hopscotch<Key, Value>(
+      kHashTableNumEntriesShift, kHashTableNumEntriesShift,
+      kHashTableRemoteDataSize);
+  device->set_compression(hopscotch.get_ds_id(), true);
+
+  Value value;
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    fill_value(i, &value);
+    hopscotch.insert_tp(make_key(i), value);
+  }
+
+  bool passed = true;
+  Value expected;
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    fill_value(i, &expected);
+    auto found = hopscotch.find_tp(make_key(i));
+    passed &= found &&
+              !memcmp(found->data, expected.data, sizeof(expected.data));
+  }
+
+  auto raw_bytes = Stats::get_compression_raw_bytes();
+  auto stored_bytes = Stats::get_compression_stored_bytes();
+  cout << "compressed " << raw_bytes << " bytes into " << stored_bytes
+       << " bytes (saved " << raw_bytes - stored_bytes << " bytes), bypassed "
+       << Stats::get_compression_bypassed_objects() << " objects, "
+       << Stats::get_compress_cycles() << " compress cycles, "
+       << Stats::get_decompress_cycles() << " decompress cycles" << endl;
+  passed &= (raw_bytes > stored_bytes);
+  passed &= (Stats::get_compression_bypassed_objects() > 0);
+
+  for (uint32_t i = 0; i < kNumKVPairs; i++) {
+    passed &= hopscotch.erase_tp(make_key(i));
+  }
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+void _main(void *args) {
+  auto *device = new CompressedDevice(new FakeDevice(kFarMemSize));
+  std::unique_ptr<FarMemManager> manager = std::unique_ptr<FarMemManager>(
+      FarMemManagerFactory::build(kCacheSize, kNumGCThreads, device));
+  do_work(manager.get(), device);
+}
+
+int main(int argc, char **argv) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,183 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "dataframe_kernels.hpp"
+#include "helpers.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Checks the server-side DataFrame kernels against plain loops under every
+// ISA the CPU supports, and benchmarks them on a large column.
+
+constexpr uint64_t kNumCheckEntries = 12345;
+constexpr uint64_t kNumBenchEntries = 64 << 20;
+constexpr uint64_t kNumBenchUniqueValues = 1 << 20;
+constexpr uint32_t kNumBenchRounds = 4;
+
+const char *kIsaNames[] = {"scalar", "avx2", "avx512"};
+
+template <typename T> bool check_kernels(std::mt19937_64 *rng) {
+  for (uint64_t num = 1; num <= kNumCheckEntries; num = num * 3 + 1) {
+    std::vector<T> src(num);
+    std::vector<unsigned long long> idx(num);
+    for (uint64_t i = 0; i < num; i++) {
+      src[i] = static_cast<T>((*rng)() % 200) - static_cast<T>(100);
+      idx[i] = (*rng)() % num;
+    }
+    T min = src[0], max = src[0], sum = T();
+    for (auto val : src) {
+      min = std::min(min, val);
+      max = std::max(max, val);
+      sum += val;
+    }
+
+    for (auto isa : {DataFrameKernels::kScalar, DataFrameKernels::kAVX2,
+                     DataFrameKernels::kAVX512}) {
+      DataFrameKernels::set_isa(isa);
+      std::vector<T> dst(num);
+      DataFrameKernels::gather(dst.data(), src.data(), idx.data(), num);
+      for (uint64_t i = 0; i < num; i++) {
+        if (dst[i] != src[idx[i]]) {
+          return false;
+        }
+      }
+      if (DataFrameKernels::min(src.data(), num) != min ||
+          DataFrameKernels::max(src.data(), num) != max) {
+        return false;
+      }
+      auto kernel_sum = DataFrameKernels::sum(src.data(), num);
+      if constexpr (std::is_floating_point_v<T>) {
+        if (std::abs(kernel_sum - sum) > 1e-3 * (1 + std::abs(sum))) {
+          return false;
+        }
+      } else if (kernel_sum != sum) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool check_flat_group_index(std::mt19937_64 *rng) {
+  std::vector<long long> vec(1 << 20);
+  for (auto &val : vec) {
+    val = (*rng)() % 50000 * 1024;
+  }
+  FlatGroupIndex index(/* num_rows_hint = */ 1);
+  for (uint64_t i = 0; i < vec.size(); i++) {
+    auto [group, inserted] =
+        index.find_or_insert(std::hash<long long>{}(vec[i]), i,
+                             [&](uint64_t row) { return vec[row] == vec[i]; });
+    auto first_row = index.get_first_rows()[group];
+    if (vec[first_row] != vec[i] || inserted != (first_row == i)) {
+      return false;
+    }
+  }
+  std::unordered_set<long long> expected(vec.begin(), vec.end());
+  std::unordered_set<long long> unique;
+  for (auto row : index.get_first_rows()) {
+    unique.insert(vec[row]);
+  }
+  return index.size() == expected.size() && unique == expected;
+}
+
+template <typename F> uint64_t bench_us(F &&f) {
+  auto start_us = microtime();
+  for (uint32_t i = 0; i < kNumBenchRounds; i++) {
+    f();
+  }
+  return (microtime() - start_us) / kNumBenchRounds;
+}
+
+void bench(std::mt19937_64 *rng) {
+  std::vector<double> src(kNumBenchEntries);
+  std::vector<unsigned long long> idx(kNumBenchEntries);
+  std::vector<long long> keys(kNumBenchEntries);
+  for (uint64_t i = 0; i < kNumBenchEntries; i++) {
+    src[i] = (*rng)() % 1000;
+    idx[i] = (*rng)() % kNumBenchEntries;
+    keys[i] = (*rng)() % kNumBenchUniqueValues;
+  }
+  std::vector<double> dst(kNumBenchEntries);
+  double sink = 0;
+
+  for (auto isa : {DataFrameKernels::kScalar, DataFrameKernels::kAVX2,
+                   DataFrameKernels::kAVX512}) {
+    DataFrameKernels::set_isa(isa);
+    if (DataFrameKernels::get_isa() != isa) {
+      continue;
+    }
+    auto gather_us = bench_us([&] {
+      DataFrameKernels::gather(dst.data(), src.data(), idx.data(),
+                               kNumBenchEntries);
+    });
+    auto max_us = bench_us(
+        [&] { sink += DataFrameKernels::max(src.data(), kNumBenchEntries); });
+    auto sum_us = bench_us(
+        [&] { sink += DataFrameKernels::sum(src.data(), kNumBenchEntries); });
+    std::cout << kIsaNames[isa] << ": gather " << gather_us << " us, max "
+              << max_us << " us, sum " << sum_us << " us" << std::endl;
+  }
+
+  auto flat_us = bench_us([&] {
+    FlatGroupIndex index(kNumBenchEntries);
+    for (uint64_t i = 0; i < kNumBenchEntries; i++) {
+      index.find_or_insert(std::hash<long long>{}(keys[i]), i,
+                           [&](uint64_t row) { return keys[row] == keys[i]; });
+    }
+    sink += index.size();
+  });
+  auto stl_us = bench_us([&] {
+    std::unordered_set<long long> set(kNumBenchEntries);
+    for (auto key : keys) {
+      set.insert(key);
+    }
+    sink += set.size();
+  });
+  std::cout << "unique: FlatGroupIndex " << flat_us
+            << " us, std::unordered_set " << stl_us << " us" << std::endl;
+  ACCESS_ONCE(sink);
+}
+
+void _main(void *arg) {
+  std::mt19937_64 rng(0);
+  bool passed = check_kernels<char>(&rng) && check_kernels<short>(&rng) &&
+                check_kernels<int>(&rng) && check_kernels<unsigned int>(&rng) &&
+                check_kernels<long>(&rng) &&
+                check_kernels<unsigned long>(&rng) &&
+                check_kernels<long long>(&rng) &&
+                check_kernels<unsigned long long>(&rng) &&
+                check_kernels<float>(&rng) && check_kernels<double>(&rng) &&
+                check_flat_group_index(&rng);
+  if (passed) {
+    bench(&rng);
+  }
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
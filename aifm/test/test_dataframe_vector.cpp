@@ -6,6 +6,7 @@ extern "C" {}
 #include "helpers.hpp"
 #include "manager.hpp"
 
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -235,6 +236,277 @@ public:
       }
     }
 
+    {
+      int key[] = {1, 1, 1, 3, 3, 4, 4, 5, 5, 5, 5};
+      double data[] = {9, 2, 3, 2, 0, 1, 3, 4, 9, 8, 3};
+      auto key_vec = manager->allocate_dataframe_vector<int>();
+      auto data_vec = manager->allocate_dataframe_vector<double>();
+      {
+        DerefScope scope;
+        for (uint32_t i = 0; i < std::size(key); i++) {
+          key_vec.push_back(scope, key[i]);
+          data_vec.push_back(scope, data[i]);
+        }
+      }
+      // Aggregate by sum
+      // {(1, 14), (3, 2), (4, 4), (5, 24)}
+      auto agg_sum_vec =
+          data_vec.aggregate(manager, key_vec, GenericDataFrameVector::Sum);
+      {
+        DerefScope scope;
+        TEST_ASSERT(agg_sum_vec.size() == 4);
+        TEST_ASSERT(agg_sum_vec.at(scope, 0) == 14);
+        TEST_ASSERT(agg_sum_vec.at(scope, 1) == 2);
+        TEST_ASSERT(agg_sum_vec.at(scope, 2) == 4);
+        TEST_ASSERT(agg_sum_vec.at(scope, 3) == 24);
+      }
+      // Aggregate by var
+      // {(1, 43 / 3), (3, 2), (4, 2), (5, 26 / 3)}
+      auto agg_var_vec =
+          data_vec.aggregate(manager, key_vec, GenericDataFrameVector::Var);
+      {
+        DerefScope scope;
+        TEST_ASSERT(agg_var_vec.size() == 4);
+        TEST_ASSERT(std::abs(agg_var_vec.at(scope, 0) - 43.0 / 3) < 1e-9);
+        TEST_ASSERT(std::abs(agg_var_vec.at(scope, 1) - 2) < 1e-9);
+        TEST_ASSERT(std::abs(agg_var_vec.at(scope, 2) - 2) < 1e-9);
+        TEST_ASSERT(std::abs(agg_var_vec.at(scope, 3) - 26.0 / 3) < 1e-9);
+      }
+    }
+
+    {
+      // Unsorted two-column keys.
+      int key_a[] = {1, 2, 1, 2, 1, 3, 1};
+      char key_b[] = {'x', 'x', 'y', 'x', 'x', 'x', 'y'};
+      long long data[] = {4, 7, 1, 3, 6, 5, 9};
+      auto key_a_vec = manager->allocate_dataframe_vector<int>();
+      auto key_b_vec = manager->allocate_dataframe_vector<char>();
+      auto data_vec = manager->allocate_dataframe_vector<long long>();
+      {
+        DerefScope scope;
+        for (uint32_t i = 0; i < std::size(data); i++) {
+          key_a_vec.push_back(scope, key_a[i]);
+          key_b_vec.push_back(scope, key_b[i]);
+          data_vec.push_back(scope, data[i]);
+        }
+      }
+      // Groups in the order of their first rows
+      // {(1, x), (2, x), (1, y), (3, x)}
+      unsigned long long first_rows[] = {0, 1, 2, 5};
+      long long counts[] = {2, 2, 2, 1};
+      long long means[] = {5, 5, 5, 5};
+      long long lasts[] = {6, 3, 9, 5};
+      auto check = [&](GenericDataFrameVector::Aggregation aggregation,
+                       long long *expected) {
+        auto [agg_vec, first_idx_vec] =
+            data_vec.group_by(manager, aggregation, key_a_vec, key_b_vec);
+        TEST_ASSERT(agg_vec.size() == std::size(first_rows));
+        TEST_ASSERT(first_idx_vec.size() == std::size(first_rows));
+        for (uint32_t i = 0; i < std::size(first_rows); i++) {
+          DerefScope scope;
+          TEST_ASSERT(first_idx_vec.at(scope, i) == first_rows[i]);
+          TEST_ASSERT(agg_vec.at(scope, i) == expected[i]);
+        }
+      };
+      check(GenericDataFrameVector::Count, counts);
+      check(GenericDataFrameVector::Mean, means);
+      check(GenericDataFrameVector::Last, lasts);
+    }
+
+    {
+      int fare[] = {12, 5, 30, 18, 7, 25, 15, 40, 9, 20};
+      double dist[] = {1.5, 0.0, 8.2, 3.1, 0.0, 6.4, 2.0, 0.0, 1.1, 4.5};
+      auto fare_vec = manager->allocate_dataframe_vector<int>();
+      auto dist_vec = manager->allocate_dataframe_vector<double>();
+      {
+        DerefScope scope;
+        for (uint32_t i = 0; i < std::size(fare); i++) {
+          fare_vec.push_back(scope, fare[i]);
+          dist_vec.push_back(scope, dist[i]);
+        }
+      }
+      // fare in [10, 30] and dist != 0.
+      // {0, 3, 5, 6, 9}
+      std::vector<DataFramePredicate> preds;
+      preds.emplace_back(fare_vec, DataFramePredicate::Between, 10, 30);
+      preds.emplace_back(dist_vec, DataFramePredicate::Ne, 0.0);
+      auto idx_vec =
+          GenericDataFrameVector::filter(manager, preds, std::size(fare));
+      unsigned long long expected[] = {0, 3, 5, 6, 9};
+      TEST_ASSERT(idx_vec.size() == std::size(expected));
+      for (uint32_t i = 0; i < std::size(expected); i++) {
+        DerefScope scope;
+        TEST_ASSERT(idx_vec.at(scope, i) == expected[i]);
+      }
+      preds.emplace_back(fare_vec, DataFramePredicate::Gt, 100);
+      TEST_ASSERT(
+          GenericDataFrameVector::filter(manager, preds, std::size(fare))
+              .empty());
+    }
+
+    {
+      // NaNs only satisfy Ne, both in the chunks that the zone maps prune and
+      // in those that get scanned.
+      constexpr auto kNaN = std::numeric_limits<double>::quiet_NaN();
+      double val[] = {1.0, kNaN, 3.0, kNaN, 5.0};
+      auto val_vec = manager->allocate_dataframe_vector<double>();
+      {
+        DerefScope scope;
+        for (uint32_t i = 0; i < std::size(val); i++) {
+          val_vec.push_back(scope, val[i]);
+        }
+      }
+      auto check_filter = [&](DataFramePredicate::Cmp cmp, double operand,
+                              double operand_hi,
+                              std::vector<unsigned long long> expected) {
+        std::vector<DataFramePredicate> preds;
+        preds.emplace_back(val_vec, cmp, operand, operand_hi);
+        auto idx_vec =
+            GenericDataFrameVector::filter(manager, preds, std::size(val));
+        TEST_ASSERT(idx_vec.size() == expected.size());
+        for (uint32_t i = 0; i < expected.size(); i++) {
+          DerefScope scope;
+          TEST_ASSERT(idx_vec.at(scope, i) == expected[i]);
+        }
+      };
+      check_filter(DataFramePredicate::Le, 5.0, 0.0, {0, 2, 4});
+      check_filter(DataFramePredicate::Ge, 0.0, 0.0, {0, 2, 4});
+      check_filter(DataFramePredicate::Between, 0.0, 10.0, {0, 2, 4});
+      check_filter(DataFramePredicate::Ne, 3.0, 0.0, {0, 1, 3, 4});
+
+      // A chunk of NaNs only, which the zone maps prune, and one where they
+      // are mixed with values in range, which gets scanned.
+      auto mixed_vec = manager->allocate_dataframe_vector<double>();
+      auto chunk_num_entries = mixed_vec.get_chunk_num_entries();
+      for (uint64_t i = 0; i < 2 * chunk_num_entries; i++) {
+        DerefScope scope;
+        mixed_vec.push_back(scope, (i < chunk_num_entries || i % 2)
+                                       ? kNaN
+                                       : static_cast<double>(i % 100));
+      }
+      uint64_t num_found = 0;
+      mixed_vec.for_each_in_range(0.0, 100.0, [&](uint64_t idx, double val) {
+        TEST_ASSERT(!std::isnan(val) && idx >= chunk_num_entries);
+        num_found++;
+      });
+      TEST_ASSERT(num_found == chunk_num_entries / 2);
+    }
+
+    {
+      // A time-ordered column, in which every value repeats 3 times.
+      constexpr uint64_t kNumTimestamps = 1 << 20;
+      auto ts_vec = manager->allocate_dataframe_vector<long long>();
+      for (uint64_t i = 0; i < kNumTimestamps; i++) {
+        DerefScope scope;
+        ts_vec.push_back(scope, static_cast<long long>(i / 3));
+      }
+      TEST_ASSERT(ts_vec.lower_bound(0) == 0);
+      TEST_ASSERT(ts_vec.lower_bound(1000) == 3000);
+      TEST_ASSERT(ts_vec.lower_bound(kNumTimestamps) == kNumTimestamps);
+
+      auto check_range = [&](long long lo, long long hi) {
+        uint64_t expected_idx = std::max(lo, 0LL) * 3;
+        ts_vec.for_each_in_range(lo, hi, [&](uint64_t idx, long long val) {
+          TEST_ASSERT(idx == expected_idx++);
+          TEST_ASSERT(val >= lo && val <= hi);
+        });
+        TEST_ASSERT(expected_idx ==
+                    std::min(static_cast<uint64_t>(hi + 1) * 3,
+                             kNumTimestamps));
+      };
+      check_range(5000, 5100);
+      check_range(-10, 10);
+      check_range(kNumTimestamps / 3 - 10, kNumTimestamps);
+
+      // In-place writes invalidate the zone maps, which get rebuilt.
+      {
+        DerefScope scope;
+        ts_vec.at_mut(scope, 0) = -1;
+      }
+      TEST_ASSERT(ts_vec.lower_bound(-1) == 0);
+      TEST_ASSERT(ts_vec.lower_bound(0) == 1);
+      {
+        DerefScope scope;
+        auto it = ts_vec.fbegin(scope) + 9000;
+        *it = 12345;
+      }
+      uint64_t num_found = 0;
+      ts_vec.for_each_in_range(12345, 12345, [&](uint64_t idx, long long val) {
+        TEST_ASSERT(idx == 9000 || (idx >= 12345 * 3 && idx < 12346 * 3));
+        num_found++;
+      });
+      TEST_ASSERT(num_found == 4);
+
+      // The zone map of a chunk gets rebuilt between two writes through the
+      // same iterator.
+      {
+        DerefScope scope;
+        auto it = ts_vec.fbegin(scope) + 6000;
+        auto chunk_idx = 6000 / ts_vec.get_chunk_num_entries();
+        *it = 23456;
+        TEST_ASSERT(ts_vec.get_zone_map(scope, chunk_idx).max == 23456);
+        *it = 34567;
+      }
+      num_found = 0;
+      ts_vec.for_each_in_range(34567, 34567, [&](uint64_t idx, long long val) {
+        TEST_ASSERT(idx == 6000 || (idx >= 34567 * 3 && idx < 34568 * 3));
+        num_found++;
+      });
+      TEST_ASSERT(num_found == 4);
+    }
+
+    {
+      // Enough entries for more runs than a merge pass takes, with ties and
+      // NaNs, which sort last.
+      constexpr uint64_t kNumSortEntries = (1 << 24) + 12345;
+      auto data_vec = manager->allocate_dataframe_vector<double>();
+      auto row_vec = manager->allocate_dataframe_vector<unsigned long long>();
+      for (uint64_t i = 0; i < kNumSortEntries; i++) {
+        DerefScope scope;
+        auto data = i % 101 ? static_cast<double>(i * 7919 % 1000)
+                            : std::numeric_limits<double>::quiet_NaN();
+        data_vec.push_back(scope, data);
+        row_vec.push_back(scope, static_cast<unsigned long long>(i));
+      }
+      auto precedes = [](double data_0, unsigned long long row_0,
+                         double data_1, unsigned long long row_1) {
+        if (std::isnan(data_0) || std::isnan(data_1)) {
+          return std::isnan(data_0) == std::isnan(data_1) ? row_0 < row_1
+                                                          : std::isnan(data_1);
+        }
+        return data_0 < data_1 || (data_0 == data_1 && row_0 < row_1);
+      };
+      auto check_sorted = [&](auto &&sorted_indices, bool ascending) {
+        TEST_ASSERT(sorted_indices.size() == kNumSortEntries);
+        auto sorted_data_vec =
+            data_vec.shuffle_data_by_idx(manager, sorted_indices);
+        auto sorted_row_vec =
+            row_vec.shuffle_data_by_idx(manager, sorted_indices);
+        DerefScope scope;
+        auto data_it = sorted_data_vec.cfbegin(scope);
+        auto row_it = sorted_row_vec.cfbegin(scope);
+        auto prev_data = *data_it;
+        auto prev_row = *row_it;
+        for (uint64_t i = 1; i < kNumSortEntries; i++) {
+          if (unlikely(i % kNumElementsPerScope == 0)) {
+            scope.renew();
+            data_it.renew(scope);
+            row_it.renew(scope);
+          }
+          ++data_it, ++row_it;
+          if (ascending) {
+            TEST_ASSERT(precedes(prev_data, prev_row, *data_it, *row_it));
+          } else {
+            TEST_ASSERT(precedes(*data_it, *row_it, prev_data, prev_row));
+          }
+          prev_data = *data_it;
+          prev_row = *row_it;
+        }
+      };
+      check_sorted(data_vec.get_sorted_indices(manager, false), true);
+      check_sorted(data_vec.get_sorted_indices<false>(manager, false), false);
+    }
+
     cout << "Passed" << endl;
   }
 };
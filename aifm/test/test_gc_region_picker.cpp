@@ -0,0 +1,124 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Runs a hot/cold churn under each evacuation region picker, i.e., a small hot
+// set that keeps getting rewritten while a large cold set is read through, and
+// reports the GC write-back bytes and the mutator stall time of each picker.
+
+constexpr uint64_t kCacheSize = 256 * Region::kSize;
+constexpr uint64_t kFarMemSize = (1ULL << 33); // 8 GB.
+constexpr uint64_t kWorkSetSize = 4 * kCacheSize;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint32_t kNumRounds = 4;
+
+struct Data4096 {
+  uint64_t tag;
+  char padding[4096 - sizeof(uint64_t)];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+constexpr uint64_t kNumHotEntries = kNumEntries / 16;
+constexpr uint64_t kHotInterval = kNumEntries / kNumHotEntries;
+
+bool churn(std::vector<UniquePtr<Data_t>> &vec, uint64_t round) {
+  bool passed = true;
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    auto hot_idx = (i % kNumHotEntries) * kHotInterval;
+    vec[hot_idx].deref_mut(scope)->tag = hot_idx + round;
+    if (i % kHotInterval) {
+      passed &= (vec[i].deref(scope)->tag == i);
+    }
+  }
+  return passed;
+}
+
+bool run(FarMemManager *manager, const char *name,
+         FarMemManager::RegionPicker region_picker,
+         std::vector<UniquePtr<Data_t>> &vec, uint64_t *round) {
+  manager->set_region_picker(region_picker);
+  auto start_wb_bytes = Stats::get_gc_write_back_bytes();
+  auto start_wait_us = Stats::get_mutator_gc_wait_us();
+  auto start_us = microtime();
+  bool passed = true;
+  for (uint32_t i = 0; i < kNumRounds; i++) {
+    passed &= churn(vec, ++(*round));
+  }
+  auto end_us = microtime();
+  cout << name << ": wrote back "
+       << Stats::get_gc_write_back_bytes() - start_wb_bytes
+       << " bytes, mutators waited "
+       << Stats::get_mutator_gc_wait_us() - start_wait_us << " us, time = "
+       << end_us - start_us << " us" << endl;
+  return passed;
+}
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    {
+      DerefScope scope;
+      far_mem_ptr.deref_mut(scope)->tag = i;
+    }
+    vec.emplace_back(std::move(far_mem_ptr));
+  }
+
+  uint64_t round = 0;
+  bool passed = true;
+  passed &= run(manager, "round robin",
+                FarMemManager::RegionPicker::kRoundRobin, vec, &round);
+  passed &= run(manager, "cost benefit",
+                FarMemManager::RegionPicker::kCostBenefit, vec, &round);
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    auto expected = (i % kHotInterval) ? i : i + round;
+    passed &= (vec[i].deref(scope)->tag == expected);
+  }
+
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
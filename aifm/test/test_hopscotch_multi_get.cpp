@@ -0,0 +1,141 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "concurrent_hopscotch.hpp"
+#include "device.hpp"
+#include "helpers.hpp"
+#include "manager.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Inserts and looks up the key-value pairs in batches, with most of the values
+// swapped out, so that multi_find() forwards most of its keys to the remote
+// side. Every other batch is mixed with keys that do not exist.
+
+constexpr static uint32_t kKeyLen = 200;
+constexpr static uint32_t kValueLen = 700;
+constexpr static uint32_t kHashTableNumEntriesShift = 19;
+constexpr static uint32_t kHashTableRemoteDataSize =
+    (Object::kHeaderSize + kKeyLen + kValueLen) *
+    (1 << kHashTableNumEntriesShift);
+constexpr static double kLoadFactor = 0.80;
+constexpr static uint32_t kNumKVPairs =
+    kLoadFactor * (1 << kHashTableNumEntriesShift);
+constexpr static uint32_t kBatchSize = 100;
+
+constexpr static uint64_t kCacheSize = (128ULL << 20);
+constexpr static uint64_t kFarMemSize = (1ULL << 30);
+constexpr static uint32_t kNumGCThreads = 12;
+
+struct Key {
+  char data[kKeyLen];
+  bool operator<(const Key &other) const {
+    return strncmp(data, other.data, kKeyLen) < 0;
+  }
+};
+
+struct Value {
+  char data[kValueLen];
+};
+
+std::map<Key, Value> kvs;
+
+void random_string(char *data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    data[i] = rand() % ('z' - 'a' + 1) + 'a';
+  }
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  auto hopscotch = manager->allocate_concurrent_hopscotch<Key, Value>(
+      kHashTableNumEntriesShift, kHashTableNumEntriesShift,
+      kHashTableRemoteDataSize);
+
+  while (kvs.size() < kNumKVPairs) {
+    Key key;
+    Value value;
+    random_string(key.data, kKeyLen);
+    random_string(value.data, kValueLen);
+    kvs[key] = value;
+  }
+
+  std::vector<Key> keys;
+  std::vector<Value> values;
+  for (auto &[key, value] : kvs) {
+    keys.push_back(key);
+    values.push_back(value);
+  }
+  for (uint32_t i = 0; i < kNumKVPairs; i += kBatchSize) {
+    auto num = std::min(kBatchSize, kNumKVPairs - i);
+    hopscotch.multi_insert_tp(num, &keys[i], &values[i]);
+  }
+  TEST_ASSERT(hopscotch.size() == kNumKVPairs);
+
+  std::vector<Key> batch_keys;
+  std::vector<std::optional<Value>> batch_values(kBatchSize);
+  for (uint32_t i = 0; i < kNumKVPairs; i += kBatchSize) {
+    auto num = std::min(kBatchSize, kNumKVPairs - i);
+    bool mixed = (i / kBatchSize) % 2;
+    batch_keys.assign(keys.begin() + i, keys.begin() + i + num);
+    if (mixed) {
+      for (uint32_t j = 0; j < num; j += 2) {
+        // The generated keys are all lowercase, so this one does not exist.
+        random_string(batch_keys[j].data, kKeyLen);
+        batch_keys[j].data[0] = 'A';
+      }
+    }
+    hopscotch.multi_find_tp(num, batch_keys.data(), batch_values.data());
+    for (uint32_t j = 0; j < num; j++) {
+      if (mixed && j % 2 == 0) {
+        TEST_ASSERT(!batch_values[j]);
+      } else {
+        TEST_ASSERT(batch_values[j]);
+        TEST_ASSERT(strncmp(batch_values[j]->data, values[i + j].data,
+                            kValueLen) == 0);
+      }
+    }
+  }
+
+  for (auto &key : keys) {
+    TEST_ASSERT(hopscotch.erase_tp(key));
+  }
+  TEST_ASSERT(hopscotch.empty());
+
+  std::cout << "Passed" << std::endl;
+}
+
+void _main(void *args) {
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char **argv) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,235 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+#include "thread.h"
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Hammers the object locker with many uthreads: first directly through
+// FarMemManager::lock_object() with hot, bucket-colliding and distinct object
+// IDs, then with every uthread holding more bucket-colliding IDs at once than a
+// bucket has slots, and finally through concurrent swap-ins of the same cold
+// objects.
+
+constexpr uint64_t kCacheSize = 128 * Region::kSize;
+constexpr uint64_t kFarMemSize = (2ULL << 30); // 2 GB
+constexpr uint32_t kNumMutators = 200;
+constexpr uint32_t kNumGCThreads = 12;
+constexpr uint64_t kNumLockOpsPerMutator = 1 << 14;
+constexpr uint32_t kNumHotObjs = 16;
+constexpr uint64_t kNumNestedLockOpsPerMutator = 1 << 10;
+constexpr uint64_t kNumSwapInIterations = 16;
+
+struct Data4096 {
+  uint8_t data[4096];
+};
+
+using Data_t = struct Data4096;
+
+// Returns num_ids object IDs that fall into the same bucket of the locker.
+std::vector<uint64_t> get_colliding_obj_ids(uint32_t num_ids) {
+  std::vector<uint64_t> obj_ids;
+  for (uint64_t obj_id = 0; obj_ids.size() < num_ids; obj_id++) {
+    if (ObjLocker::hash_func(obj_id) == ObjLocker::hash_func(0)) {
+      obj_ids.push_back(obj_id);
+    }
+  }
+  return obj_ids;
+}
+
+// Locks object ID obj_ids[idx_fn(tid, i)]. Returns whether the lock has kept
+// the (non-atomic) per-ID counters consistent.
+bool bench_lock(const char *name, const std::vector<uint64_t> &obj_ids,
+                uint32_t (*idx_fn)(uint32_t tid, uint64_t i)) {
+  std::vector<uint64_t> counters(obj_ids.size());
+  std::vector<rt::Thread> threads;
+  threads.reserve(kNumMutators);
+
+  auto start_us = microtime();
+  for (uint32_t tid = 0; tid < kNumMutators; tid++) {
+    threads.emplace_back(rt::Thread([&, tid] {
+      for (uint64_t i = 0; i < kNumLockOpsPerMutator; i++) {
+        auto idx = idx_fn(tid, i);
+        uint64_t obj_id = obj_ids[idx];
+        FarMemManager::lock_object(sizeof(obj_id),
+                                   reinterpret_cast<uint8_t *>(&obj_id));
+        auto &counter = counters[idx];
+        auto val = ACCESS_ONCE(counter);
+        if (i % 64 == 0) {
+          // Get preempted within the critical section once in a while.
+          thread_yield();
+        }
+        ACCESS_ONCE(counter) = val + 1;
+        FarMemManager::unlock_object(sizeof(obj_id),
+                                     reinterpret_cast<uint8_t *>(&obj_id));
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  auto end_us = microtime();
+
+  uint64_t sum = 0;
+  for (auto counter : counters) {
+    sum += counter;
+  }
+  auto num_ops = kNumLockOpsPerMutator * kNumMutators;
+  cout << name << ": " << num_ops * 1000000 / (end_us - start_us)
+       << " lock ops/s" << endl;
+  return sum == num_ops;
+}
+
+// Every uthread locks all of obj_ids before unlocking any of them, which holds
+// more locks of a bucket at once than it has slots.
+bool bench_nested_lock(const std::vector<uint64_t> &obj_ids) {
+  std::vector<uint64_t> counters(obj_ids.size());
+  std::vector<rt::Thread> threads;
+  threads.reserve(kNumMutators);
+
+  auto start_us = microtime();
+  for (uint32_t tid = 0; tid < kNumMutators; tid++) {
+    threads.emplace_back(rt::Thread([&, tid] {
+      for (uint64_t i = 0; i < kNumNestedLockOpsPerMutator; i++) {
+        // In ID order, as deadlock-free lockers do.
+        for (auto obj_id : obj_ids) {
+          FarMemManager::lock_object(sizeof(obj_id),
+                                     reinterpret_cast<uint8_t *>(&obj_id));
+        }
+        for (uint32_t j = 0; j < obj_ids.size(); j++) {
+          auto &counter = counters[(tid + j) % obj_ids.size()];
+          auto val = ACCESS_ONCE(counter);
+          if (i % 64 == 0) {
+            thread_yield();
+          }
+          ACCESS_ONCE(counter) = val + 1;
+        }
+        for (auto obj_id : obj_ids) {
+          FarMemManager::unlock_object(sizeof(obj_id),
+                                       reinterpret_cast<uint8_t *>(&obj_id));
+        }
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  auto end_us = microtime();
+
+  auto num_ops = kNumNestedLockOpsPerMutator * kNumMutators;
+  cout << "nested: " << num_ops * 1000000 / (end_us - start_us)
+       << " lock sets/s" << endl;
+  return std::all_of(counters.begin(), counters.end(),
+                     [&](uint64_t counter) { return counter == num_ops; });
+}
+
+bool bench_swap_in(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> flush_cache_vec;
+  std::vector<UniquePtr<Data_t>> hot_vec;
+
+  for (uint64_t i = 0; i < kCacheSize / sizeof(Data_t); i++) {
+    flush_cache_vec.push_back(manager->allocate_unique_ptr<Data_t>());
+  }
+  for (uint32_t i = 0; i < kNumHotObjs; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    {
+      DerefScope scope;
+      auto raw_mut_ptr = far_mem_ptr.deref_mut(scope);
+      memset(raw_mut_ptr->data, static_cast<char>(i), sizeof(Data_t));
+    }
+    hot_vec.push_back(std::move(far_mem_ptr));
+  }
+
+  bool passed = true;
+  uint64_t total_us = 0;
+  for (uint64_t i = 0; i < kNumSwapInIterations; i++) {
+    // Flush the cache so that every hot object has to be swapped in again.
+    for (auto &far_mem_ptr : flush_cache_vec) {
+      DerefScope scope;
+      const auto raw_const_ptr = far_mem_ptr.deref(scope);
+      DONT_OPTIMIZE(raw_const_ptr);
+    }
+    std::vector<rt::Thread> threads;
+    threads.reserve(kNumMutators);
+    auto start_us = microtime();
+    for (uint32_t tid = 0; tid < kNumMutators; tid++) {
+      threads.emplace_back(rt::Thread([&, tid] {
+        for (uint32_t j = 0; j < kNumHotObjs; j++) {
+          auto idx = (tid + j) % kNumHotObjs;
+          DerefScope scope;
+          const auto raw_const_ptr = hot_vec[idx].deref(scope);
+          if (raw_const_ptr->data[tid] != static_cast<uint8_t>(idx)) {
+            passed = false;
+          }
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.Join();
+    }
+    total_us += microtime() - start_us;
+  }
+  cout << "swap in: " << kNumSwapInIterations * kNumHotObjs * 1000000 / total_us
+       << " hot objects/s" << endl;
+  return passed;
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  bool passed = true;
+  passed &= bench_lock("hot", {0},
+                       [](uint32_t tid, uint64_t i) -> uint32_t { return 0; });
+  // All IDs fall into the same bucket, which has fewer slots than IDs.
+  auto colliding_obj_ids = get_colliding_obj_ids(kNumHotObjs);
+  passed &= bench_lock("colliding", colliding_obj_ids,
+                       [](uint32_t tid, uint64_t i) -> uint32_t {
+                         return (tid + i) % kNumHotObjs;
+                       });
+  std::vector<uint64_t> distinct_obj_ids(kNumMutators);
+  std::iota(distinct_obj_ids.begin(), distinct_obj_ids.end(), 0);
+  passed &= bench_lock(
+      "distinct", distinct_obj_ids,
+      [](uint32_t tid, uint64_t i) -> uint32_t { return tid; });
+  passed &= bench_nested_lock(colliding_obj_ids);
+  passed &= bench_swap_in(manager);
+
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
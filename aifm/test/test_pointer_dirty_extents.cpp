@@ -0,0 +1,123 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Updates a few bytes of every large object through the ranged deref_mut(),
+// and then checks that the cache GC only writes back the dirty extents, and
+// that the updates survive the swap-out and the swap-in.
+
+constexpr uint64_t kCacheSize = 256 * Region::kSize;
+constexpr uint64_t kFarMemSize = (1ULL << 33); // 8 GB.
+constexpr uint64_t kWorkSetSize = 4 * kCacheSize;
+constexpr uint64_t kNumGCThreads = 12;
+
+struct Data4096 {
+  uint64_t head;
+  char padding[4096 - 2 * sizeof(uint64_t)];
+  uint64_t tail;
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+// Touches every entry, which swaps the whole working set out and in.
+bool scan(std::vector<UniquePtr<Data_t>> &vec, uint64_t head_delta,
+          uint64_t tail_delta) {
+  bool passed = true;
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    const auto *data = vec[i].deref(scope);
+    passed &= (data->head == i + head_delta);
+    passed &= (data->tail == i + tail_delta);
+  }
+  return passed;
+}
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+    {
+      DerefScope scope;
+      auto *data = far_mem_ptr.deref_mut(scope);
+      data->head = data->tail = i;
+    }
+    vec.emplace_back(std::move(far_mem_ptr));
+  }
+  bool passed = scan(vec, 0, 0);
+
+  auto start_wb_bytes = Stats::get_gc_write_back_bytes();
+  auto start_wb_objects = Stats::get_gc_write_back_objects();
+  auto start_partial_objects = Stats::get_gc_write_back_partial_objects();
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    auto *data = vec[i].deref_mut(scope, offsetof(Data_t, head),
+                                  sizeof(Data_t::head));
+    data->head++;
+    data = vec[i].deref_mut(scope, offsetof(Data_t, tail),
+                            sizeof(Data_t::tail));
+    data->tail += 2;
+  }
+  passed &= scan(vec, 1, 2);
+  auto wb_bytes = Stats::get_gc_write_back_bytes() - start_wb_bytes;
+  auto wb_objects = Stats::get_gc_write_back_objects() - start_wb_objects;
+  auto partial_objects =
+      Stats::get_gc_write_back_partial_objects() - start_partial_objects;
+  cout << "wrote back " << wb_objects << " objects (" << partial_objects
+       << " partially), " << wb_bytes << " bytes" << endl;
+  // Each of the two fields may straddle two cachelines, as the object data is
+  // not cacheline aligned.
+  passed &= (partial_objects > 0);
+  passed &= (wb_bytes <= (wb_objects - partial_objects) * sizeof(Data_t) +
+                             partial_objects * 4 * DirtyLines::kLineSize);
+
+  // The whole object gets dirty once again.
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    DerefScope scope;
+    vec[i].deref_mut(scope)->head++;
+  }
+  passed &= scan(vec, 2, 2);
+
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
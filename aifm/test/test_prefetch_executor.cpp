@@ -0,0 +1,144 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+#include "thread.h"
+
+#include "array.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Scans many arrays at the same time, whose prefetchers all share the
+// executor of the manager, and then checks that the executor keeps the
+// prefetching bandwidth under its cap.
+
+constexpr uint64_t kCacheSize = 256 * Region::kSize;
+constexpr uint64_t kFarMemSize = 4ULL << 30;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint32_t kNumArrays = 512;
+constexpr uint64_t kNumEntriesPerArray = 256;
+constexpr uint32_t kNumMutators = 32;
+constexpr uint64_t kMaxBytesPerSec = 64ULL << 20;
+constexpr uint64_t kCappedScanUs = 2 * 1000 * 1000;
+
+struct Data4096 {
+  uint64_t tag;
+  uint8_t padding[4096 - sizeof(uint64_t)];
+};
+
+using Data_t = struct Data4096;
+using AppArray = Array<Data_t, kNumEntriesPerArray>;
+
+uint64_t tag(uint32_t array_idx, uint64_t entry_idx) {
+  return static_cast<uint64_t>(array_idx) * kNumEntriesPerArray + entry_idx;
+}
+
+bool scan(AppArray *array, uint32_t array_idx) {
+  bool passed = true;
+  for (uint64_t i = 0; i < kNumEntriesPerArray; i++) {
+    DerefScope scope;
+    passed &= (array->at(scope, i).tag == tag(array_idx, i));
+  }
+  return passed;
+}
+
+// Scans the arrays with kNumMutators threads, each of them going through its
+// own share of arrays. Stops early once deadline_us (if any) has passed.
+bool scan_all(std::vector<std::unique_ptr<AppArray>> &arrays,
+              uint64_t deadline_us = 0) {
+  std::vector<rt::Thread> threads;
+  bool passed = true;
+  for (uint32_t tid = 0; tid < kNumMutators; tid++) {
+    threads.emplace_back([&, tid]() {
+      for (uint32_t i = tid; i < kNumArrays; i += kNumMutators) {
+        if (deadline_us && microtime() > deadline_us) {
+          break;
+        }
+        if (!scan(arrays[i].get(), i)) {
+          passed = false;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  return passed;
+}
+
+void do_work(FarMemManager *manager) {
+  cout << "Running " << __FILE__ "..." << endl;
+
+  std::vector<std::unique_ptr<AppArray>> arrays;
+  for (uint32_t i = 0; i < kNumArrays; i++) {
+    arrays.emplace_back(
+        manager->allocate_array_heap<Data_t, kNumEntriesPerArray>());
+    for (uint64_t j = 0; j < kNumEntriesPerArray; j++) {
+      DerefScope scope;
+      arrays[i]->at_mut(scope, j).tag = tag(i, j);
+    }
+  }
+
+  bool passed = true;
+  auto start_prefetched = Stats::get_batch_swap_in_objects();
+  auto start_us = microtime();
+  passed &= scan_all(arrays);
+  auto end_us = microtime();
+  cout << "uncapped: " << kNumArrays * kNumEntriesPerArray * 1000000 /
+                              (end_us - start_us)
+       << " entries/s, prefetched "
+       << Stats::get_batch_swap_in_objects() - start_prefetched << " objects"
+       << endl;
+
+  manager->get_prefetch_executor()->set_max_bytes_per_sec(kMaxBytesPerSec);
+  start_prefetched = Stats::get_batch_swap_in_objects();
+  start_us = microtime();
+  passed &= scan_all(arrays, start_us + kCappedScanUs);
+  end_us = microtime();
+  auto prefetched_bytes =
+      (Stats::get_batch_swap_in_objects() - start_prefetched) * sizeof(Data_t);
+  auto bytes_per_sec = prefetched_bytes * 1000000 / (end_us - start_us);
+  cout << "capped: prefetched " << bytes_per_sec << " bytes/s (cap "
+       << kMaxBytesPerSec << " bytes/s)" << endl;
+  // The token bucket only holds a millisecond worth of bytes; allow for some
+  // measurement slack.
+  passed &= (bytes_per_sec <= kMaxBytesPerSec * 11 / 10);
+  manager->get_prefetch_executor()->set_max_bytes_per_sec(0);
+
+  arrays.clear();
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+void _main(void *arg) {
+  auto manager = std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+      kCacheSize, kNumGCThreads, new FakeDevice(kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
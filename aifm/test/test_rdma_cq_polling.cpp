@@ -0,0 +1,117 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+#include "thread.h"
+
+#include "device.hpp"
+#include "helpers.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Compares the RDMA read throughput of the spinning (private CQ) completion
+// mode against the shared CQ mode, where requesters park and per-kthread
+// pollers wake them up. Pass "spin" as the last argument to measure the former;
+// the memory server accepts a single client, so each mode needs its own run.
+
+constexpr static uint64_t kFarMemSize = (1ULL << 32); // 4 GB.
+constexpr static uint64_t kNumConnections = 300;
+constexpr static uint32_t kObjSize = 4096;
+constexpr static uint32_t kNumObjsPerThread = 64;
+constexpr static uint64_t kNumOpsPerRound = 1 << 18;
+constexpr static uint32_t kNumThreadsList[] = {1, 10, 200};
+
+bool bench(RDMADevice *device, uint32_t num_threads) {
+  auto num_ops_per_thread = kNumOpsPerRound / num_threads;
+  std::vector<rt::Thread> threads;
+  bool passed = true;
+
+  auto start_us = microtime();
+  for (uint32_t tid = 0; tid < num_threads; tid++) {
+    threads.emplace_back([&, tid]() {
+      uint8_t buf[kObjSize];
+      auto obj_offset = [&](uint32_t i) -> uint64_t {
+        return (static_cast<uint64_t>(tid) * kNumObjsPerThread + i) * kObjSize;
+      };
+
+      for (uint32_t i = 0; i < kNumObjsPerThread; i++) {
+        auto offset = obj_offset(i);
+        memset(buf, static_cast<uint8_t>(tid + i), kObjSize);
+        device->write_object(kVanillaPtrDSID, sizeof(offset),
+                             reinterpret_cast<const uint8_t *>(&offset),
+                             kObjSize, buf);
+      }
+      for (uint64_t j = 0; j < num_ops_per_thread; j++) {
+        auto i = j % kNumObjsPerThread;
+        auto offset = obj_offset(i);
+        uint16_t data_len = kObjSize;
+        device->read_object(kVanillaPtrDSID, sizeof(offset),
+                            reinterpret_cast<const uint8_t *>(&offset),
+                            &data_len, buf);
+        if (buf[0] != static_cast<uint8_t>(tid + i) ||
+            buf[kObjSize - 1] != static_cast<uint8_t>(tid + i)) {
+          passed = false;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.Join();
+  }
+  auto end_us = microtime();
+
+  auto num_ops = num_ops_per_thread * num_threads;
+  cout << "threads = " << num_threads << ", throughput = "
+       << num_ops * 1000000 / (end_us - start_us) << " ops/s" << endl;
+  return passed;
+}
+
+int argc;
+void _main(void *arg) {
+  cout << "Running " << __FILE__ "..." << endl;
+  char **argv = static_cast<char **>(arg);
+  std::string ip_addr_port(argv[1]);
+  auto raddr = helpers::str_to_netaddr(ip_addr_port);
+  bool shared_cq = !(argc > 2 && strcmp(argv[2], "spin") == 0);
+  cout << "mode = " << (shared_cq ? "shared cq" : "spin") << endl;
+  auto device = std::make_unique<RDMADevice>(raddr, kNumConnections,
+                                             kFarMemSize, shared_cq);
+
+  bool passed = true;
+  for (auto num_threads : kNumThreadsList) {
+    passed &= bench(device.get(), num_threads);
+  }
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+int main(int _argc, char *argv[]) {
+  int ret;
+
+  if (_argc < 3) {
+    std::cerr << "usage: [cfg_file] [ip_addr:port] [spin (optional)]"
+              << std::endl;
+    return -EINVAL;
+  }
+
+  char conf_path[strlen(argv[1]) + 1];
+  strcpy(conf_path, argv[1]);
+  for (int i = 2; i < _argc; i++) {
+    argv[i - 1] = argv[i];
+  }
+  argc = _argc - 1;
+
+  ret = runtime_init(conf_path, _main, argv);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
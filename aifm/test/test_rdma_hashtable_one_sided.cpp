@@ -0,0 +1,111 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "device.hpp"
+#include "internal/ds_info.hpp"
+#include "stats.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Writes many objects of a remote hashtable and reads them back, together with
+// objects that do not exist. The reads are served by probing the remote
+// buckets with one-sided RDMA reads. Set AIFM_RDMA_SERVER_IP to run it against
+// a loopback soft-RoCE (rxe) device.
+
+constexpr static uint64_t kFarMemSize = (1ULL << 30); // 1 GB.
+constexpr static uint64_t kNumConnections = 4;
+constexpr static uint8_t kDSID = 1;
+constexpr static uint32_t kNumEntriesShift = 16;
+constexpr static uint64_t kDataSize = (1ULL << 28);
+constexpr static uint32_t kNumObjs = 10000;
+constexpr static uint32_t kMaxDataLen = 2048;
+
+uint16_t data_len(uint32_t idx) { return 1 + (idx * 37) % kMaxDataLen; }
+
+uint8_t data_byte(uint32_t idx, uint32_t offset) {
+  return static_cast<uint8_t>(idx * 7 + offset);
+}
+
+bool run(FarMemDevice *device) {
+  uint8_t params[sizeof(kNumEntriesShift) + sizeof(kDataSize)];
+  __builtin_memcpy(&params[0], &kNumEntriesShift, sizeof(kNumEntriesShift));
+  __builtin_memcpy(&params[sizeof(kNumEntriesShift)], &kDataSize,
+                   sizeof(kDataSize));
+  device->construct(kHashTableDSType, kDSID, sizeof(params), params);
+
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[Object::kMaxObjectDataSize]);
+  for (uint32_t i = 0; i < kNumObjs; i++) {
+    for (uint32_t j = 0; j < data_len(i); j++) {
+      buf[j] = data_byte(i, j);
+    }
+    device->write_object(kDSID, sizeof(i), reinterpret_cast<uint8_t *>(&i),
+                         data_len(i), buf.get());
+  }
+
+  bool passed = true;
+  auto start_gets = Stats::get_one_sided_hashtable_gets();
+  // The objects in [kNumObjs, 2 * kNumObjs) do not exist.
+  for (uint32_t i = 0; i < 2 * kNumObjs; i++) {
+    uint16_t len;
+    device->read_object(kDSID, sizeof(i), reinterpret_cast<uint8_t *>(&i),
+                        &len, buf.get());
+    if (i >= kNumObjs) {
+      passed &= (len == 0);
+      continue;
+    }
+    passed &= (len == data_len(i));
+    for (uint32_t j = 0; j < data_len(i); j++) {
+      passed &= (buf[j] == data_byte(i, j));
+    }
+  }
+  auto num_gets = Stats::get_one_sided_hashtable_gets() - start_gets;
+  cout << "one-sided gets: " << num_gets << ", fallbacks: "
+       << Stats::get_one_sided_hashtable_fallbacks() << endl;
+  passed &= (num_gets > 0);
+
+  device->destruct(kDSID);
+  return passed;
+}
+
+void _main(void *arg) {
+  cout << "Running " << __FILE__ "..." << endl;
+  char **argv = static_cast<char **>(arg);
+  std::string ip_addr_port(argv[1]);
+  auto raddr = helpers::str_to_netaddr(ip_addr_port);
+
+  std::unique_ptr<FarMemDevice> device(
+      new RDMADevice(raddr, kNumConnections, kFarMemSize));
+  bool passed = run(device.get());
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 3) {
+    std::cerr << "usage: [cfg_file] [ip_addr:port]" << std::endl;
+    return -EINVAL;
+  }
+
+  char conf_path[strlen(argv[1]) + 1];
+  strcpy(conf_path, argv[1]);
+  for (int i = 2; i < argc; i++) {
+    argv[i - 1] = argv[i];
+  }
+
+  ret = runtime_init(conf_path, _main, argv);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,136 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Mirrors far memory on two devices, and updates a working set larger than the
+// local cache a few times, so that every pass reads the previous one back. The
+// primary stops responding after the first pass, and the rest of the passes
+// must be served by the backup alone.
+
+constexpr uint64_t kCacheSize = 64 * Region::kSize;
+constexpr uint64_t kFarMemSize = (1ULL << 30);
+constexpr uint64_t kWorkSetSize = 1 << 28;
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumPasses = 3;
+constexpr uint64_t kKillAfterPass = 0;
+constexpr uint64_t kReplicaTimeoutUs = 10 * 1000;
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+// Drops all of the requests posted after kill(), like a crashed server.
+class KillableDevice : public FakeDevice {
+private:
+  std::atomic<bool> killed_{false};
+
+public:
+  KillableDevice(uint64_t far_mem_size) : FakeDevice(far_mem_size) {}
+  void kill() { killed_ = true; }
+  void post_read_object(uint8_t ds_id, uint8_t obj_id_len,
+                        const uint8_t *obj_id, uint16_t *data_len,
+                        uint8_t *data_buf, DeviceReqHandle *handle) {
+    if (killed_) {
+      handle->completed = false;
+      return;
+    }
+    FakeDevice::post_read_object(ds_id, obj_id_len, obj_id, data_len, data_buf,
+                                 handle);
+  }
+  void post_write_object(uint8_t ds_id, uint8_t obj_id_len,
+                         const uint8_t *obj_id, uint16_t data_len,
+                         const uint8_t *data_buf, DeviceReqHandle *handle) {
+    if (killed_) {
+      handle->completed = false;
+      return;
+    }
+    FakeDevice::post_write_object(ds_id, obj_id_len, obj_id, data_len,
+                                  data_buf, handle);
+  }
+  bool poll(DeviceReqHandle *handle) {
+    return !killed_ && FakeDevice::poll(handle);
+  }
+};
+
+KillableDevice *primary;
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    vec.emplace_back(manager->allocate_unique_ptr<Data_t>());
+  }
+
+  for (uint64_t pass = 0; pass < kNumPasses; pass++) {
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      DerefScope scope;
+      auto raw_mut_ptr = vec[i].deref_mut(scope);
+      if (pass) {
+        for (uint32_t j = 0; j < sizeof(Data_t); j++) {
+          if (raw_mut_ptr->data[j] != static_cast<char>(i + pass - 1)) {
+            goto fail;
+          }
+        }
+      }
+      memset(raw_mut_ptr->data, static_cast<char>(i + pass), sizeof(Data_t));
+    }
+    if (pass == kKillAfterPass) {
+      primary->kill();
+    }
+  }
+
+  cout << "replica requests completed in the background: "
+       << Stats::get_replica_async_completions() << endl;
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+  return;
+}
+
+void _main(void *arg) {
+  primary = new KillableDevice(kFarMemSize);
+  auto *device = new ReplicatedDevice(primary, new FakeDevice(kFarMemSize),
+                                      kReplicaTimeoutUs);
+  auto manager = std::unique_ptr<FarMemManager>(
+      FarMemManagerFactory::build(kCacheSize, kNumGCThreads, device));
+  do_work(manager.get());
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,102 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "block_store.hpp"
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <unistd.h>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Swaps a working set larger than the local cache to a file standing in for
+// an NVMe device, and overwrites it a few times, so that the log has to clean
+// segments to keep up.
+
+constexpr uint64_t kCacheSize = 64 * Region::kSize;
+constexpr uint64_t kFarMemSize = (1ULL << 29); // 512 MB.
+constexpr uint64_t kStoreSize = kFarMemSize / 4 * 5 + (16ULL << 20);
+constexpr uint64_t kWorkSetSize = 3ULL << 27; // 384 MB.
+constexpr uint64_t kNumGCThreads = 12;
+constexpr uint64_t kNumPasses = 4;
+constexpr char kStorePath[] = "/tmp/test_storage_device.img";
+
+struct Data4096 {
+  char data[4096];
+};
+
+using Data_t = struct Data4096;
+
+constexpr uint64_t kNumEntries = kWorkSetSize / sizeof(Data_t);
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec;
+  cout << "Running " << __FILE__ "..." << endl;
+
+  for (uint64_t i = 0; i < kNumEntries; i++) {
+    vec.emplace_back(manager->allocate_unique_ptr<Data_t>());
+  }
+
+  for (uint64_t pass = 0; pass < kNumPasses; pass++) {
+    for (uint64_t i = 0; i < kNumEntries; i++) {
+      DerefScope scope;
+      auto raw_mut_ptr = vec[i].deref_mut(scope);
+      if (pass) {
+        for (uint32_t j = 0; j < sizeof(Data_t); j++) {
+          if (raw_mut_ptr->data[j] != static_cast<char>(i + pass - 1)) {
+            goto fail;
+          }
+        }
+      }
+      memset(raw_mut_ptr->data, static_cast<char>(i + pass), sizeof(Data_t));
+    }
+  }
+
+  cout << "segment writes " << Stats::get_storage_segment_writes()
+       << ", cleaned bytes " << Stats::get_storage_cleaned_bytes() << endl;
+  if (!Stats::get_storage_cleaned_bytes()) {
+    goto fail;
+  }
+
+  cout << "Passed" << endl;
+  return;
+
+fail:
+  cout << "Failed" << endl;
+  return;
+}
+
+void _main(void *arg) {
+  auto *device = new StorageDevice(new FileBlockStore(kStorePath, kStoreSize),
+                                   kFarMemSize);
+  auto manager = std::unique_ptr<FarMemManager>(
+      FarMemManagerFactory::build(kCacheSize, kNumGCThreads, device));
+  do_work(manager.get());
+  unlink(kStorePath);
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 2) {
+    std::cerr << "usage: [cfg_file]" << std::endl;
+    return -EINVAL;
+  }
+
+  ret = runtime_init(argv[1], _main, NULL);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
@@ -0,0 +1,137 @@
+extern "C" {
+#include <runtime/runtime.h>
+}
+
+#include "device.hpp"
+#include "internal/ds_info.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Writes and reads back many objects of a remote hashtable through the batched
+// opcodes, over connections of both protocol v1 and v2. The batches are longer
+// than FarMemDevice::kMaxBatchSize, and some of the writes only carry extents.
+
+constexpr static uint64_t kFarMemSize = (1ULL << 30); // 1 GB.
+constexpr static uint64_t kNumConnections = 4;
+constexpr static uint8_t kDSID = 1;
+constexpr static uint32_t kNumEntriesShift = 16;
+constexpr static uint64_t kDataSize = (1ULL << 28);
+constexpr static uint32_t kNumObjs = 1000;
+constexpr static uint32_t kMaxDataLen = 2048;
+constexpr static uint8_t kNumExtents = 100;
+
+uint16_t data_len(uint32_t idx) { return 1 + (idx * 37) % kMaxDataLen; }
+
+uint8_t data_byte(uint32_t idx, uint32_t offset, uint32_t round) {
+  return static_cast<uint8_t>(idx * 7 + offset + round);
+}
+
+bool run(FarMemDevice *device) {
+  uint8_t params[sizeof(kNumEntriesShift) + sizeof(kDataSize)];
+  __builtin_memcpy(&params[0], &kNumEntriesShift, sizeof(kNumEntriesShift));
+  __builtin_memcpy(&params[sizeof(kNumEntriesShift)], &kDataSize,
+                   sizeof(kDataSize));
+  device->construct(kHashTableDSType, kDSID, sizeof(params), params);
+
+  std::vector<uint32_t> obj_ids(kNumObjs);
+  std::vector<std::unique_ptr<uint8_t[]>> bufs;
+  std::vector<ObjectWriteReq> write_reqs(kNumObjs);
+  for (uint32_t i = 0; i < kNumObjs; i++) {
+    obj_ids[i] = i;
+    bufs.emplace_back(new uint8_t[kMaxDataLen]);
+    for (uint32_t j = 0; j < data_len(i); j++) {
+      bufs[i][j] = data_byte(i, j, 0);
+    }
+    write_reqs[i] = {.ds_id = kDSID,
+                     .obj_id_len = sizeof(obj_ids[i]),
+                     .obj_id = reinterpret_cast<uint8_t *>(&obj_ids[i]),
+                     .data_len = data_len(i),
+                     .data_buf = bufs[i].get(),
+                     .num_extents = 0,
+                     .extents = nullptr};
+  }
+  device->write_objects(kNumObjs, write_reqs.data());
+
+  // Rewrite every other byte at the front of the even objects; an object with
+  // more extents than a batch has iovecs for gets written as a whole.
+  std::vector<std::vector<ObjectExtent>> extents(kNumObjs);
+  for (uint32_t i = 0; i < kNumObjs; i += 2) {
+    auto num_extents =
+        std::min<uint32_t>((i % 4) ? 4 : kNumExtents, data_len(i) / 2);
+    for (uint32_t j = 0; j < num_extents; j++) {
+      extents[i].push_back({.offset = static_cast<uint16_t>(j * 2), .len = 1});
+      bufs[i][j * 2] = data_byte(i, j * 2, 1);
+    }
+    write_reqs[i].num_extents = num_extents;
+    write_reqs[i].extents = extents[i].data();
+  }
+  device->write_objects(kNumObjs, write_reqs.data());
+
+  std::vector<uint16_t> data_lens(kNumObjs);
+  std::vector<std::unique_ptr<uint8_t[]>> read_bufs;
+  std::vector<ObjectReadReq> read_reqs(kNumObjs);
+  for (uint32_t i = 0; i < kNumObjs; i++) {
+    read_bufs.emplace_back(new uint8_t[Object::kMaxObjectDataSize]);
+    read_reqs[i] = {.ds_id = kDSID,
+                    .obj_id_len = sizeof(obj_ids[i]),
+                    .obj_id = reinterpret_cast<uint8_t *>(&obj_ids[i]),
+                    .data_len = &data_lens[i],
+                    .data_buf = read_bufs[i].get()};
+  }
+  device->read_objects(kNumObjs, read_reqs.data());
+
+  bool passed = true;
+  for (uint32_t i = 0; i < kNumObjs; i++) {
+    passed &= (data_lens[i] == data_len(i));
+    passed &= !memcmp(read_bufs[i].get(), bufs[i].get(), data_len(i));
+  }
+
+  device->destruct(kDSID);
+  return passed;
+}
+
+void _main(void *arg) {
+  cout << "Running " << __FILE__ "..." << endl;
+  char **argv = static_cast<char **>(arg);
+  std::string ip_addr_port(argv[1]);
+  auto raddr = helpers::str_to_netaddr(ip_addr_port);
+
+  bool passed = true;
+  for (bool pipelined : {false, true}) {
+    std::unique_ptr<FarMemDevice> device(
+        new TCPDevice(raddr, kNumConnections, kFarMemSize, pipelined));
+    passed &= run(device.get());
+  }
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+int main(int argc, char *argv[]) {
+  int ret;
+
+  if (argc < 3) {
+    std::cerr << "usage: [cfg_file] [ip_addr:port]" << std::endl;
+    return -EINVAL;
+  }
+
+  char conf_path[strlen(argv[1]) + 1];
+  strcpy(conf_path, argv[1]);
+  for (int i = 2; i < argc; i++) {
+    argv[i - 1] = argv[i];
+  }
+
+  ret = runtime_init(conf_path, _main, argv);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}
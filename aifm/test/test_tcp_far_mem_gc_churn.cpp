@@ -0,0 +1,127 @@
+extern "C" {
+#include <runtime/runtime.h>
+#include <runtime/timer.h>
+}
+
+#include "deref_scope.hpp"
+#include "device.hpp"
+#include "manager.hpp"
+#include "stats.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace far_memory;
+using namespace std;
+
+// Keeps a small live set while churning through many times more far memory
+// than the device has, which only works if far-mem GC reclaims the freed
+// objects and compacts the regions pinned by long-lived survivors.
+
+constexpr static uint64_t kCacheSize = 128 * Region::kSize;
+constexpr static uint64_t kFarMemSize = 512 * Region::kSize;
+constexpr static uint64_t kLiveSetSize = 192 * Region::kSize;
+constexpr static uint64_t kChurnSize = 8 * kFarMemSize;
+constexpr static uint64_t kNumGCThreads = 12;
+constexpr static uint64_t kNumConnections = 300;
+
+struct Data4096 {
+  uint64_t tag;
+  char padding[4096 - 2 * sizeof(uint64_t)];
+  uint64_t tail_tag;
+};
+
+using Data_t = struct Data4096;
+
+constexpr static uint64_t kNumLiveObjs = kLiveSetSize / sizeof(Data_t);
+constexpr static uint64_t kNumChurnOps = kChurnSize / sizeof(Data_t);
+
+bool check(UniquePtr<Data_t> &ptr, uint64_t tag) {
+  DerefScope scope;
+  auto raw_const_ptr = ptr.deref(scope);
+  return raw_const_ptr->tag == tag && raw_const_ptr->tail_tag == tag;
+}
+
+void assign(FarMemManager *manager, UniquePtr<Data_t> *ptr, uint64_t tag) {
+  auto far_mem_ptr = manager->allocate_unique_ptr<Data_t>();
+  {
+    DerefScope scope;
+    auto raw_mut_ptr = far_mem_ptr.deref_mut(scope);
+    raw_mut_ptr->tag = raw_mut_ptr->tail_tag = tag;
+  }
+  *ptr = std::move(far_mem_ptr);
+}
+
+void do_work(FarMemManager *manager) {
+  std::vector<UniquePtr<Data_t>> vec(kNumLiveObjs);
+  std::vector<uint64_t> tags(kNumLiveObjs);
+  std::mt19937_64 rng(0);
+
+  for (uint64_t i = 0; i < kNumLiveObjs; i++) {
+    assign(manager, &vec[i], i);
+    tags[i] = i;
+  }
+
+  bool passed = true;
+  auto start_us = microtime();
+  for (uint64_t i = kNumLiveObjs; passed && i < kNumChurnOps; i++) {
+    auto idx = rng() % kNumLiveObjs;
+    passed &= check(vec[idx], tags[idx]);
+    vec[idx].free();
+    assign(manager, &vec[idx], i);
+    tags[idx] = i;
+  }
+  auto end_us = microtime();
+
+  for (uint64_t i = 0; passed && i < kNumLiveObjs; i++) {
+    passed &= check(vec[i], tags[i]);
+  }
+
+  cout << "Allocated " << kChurnSize / kFarMemSize
+       << "x the far memory size in " << end_us - start_us << " us" << endl;
+  cout << "Far-mem GC reclaimed " << Stats::get_far_mem_gc_reclaimed_regions()
+       << " regions, relocated " << Stats::get_far_mem_gc_relocated_bytes()
+       << " bytes in " << Stats::get_far_mem_gc_us() << " us" << endl;
+  cout << (passed ? "Passed" : "Failed") << endl;
+}
+
+int argc;
+void _main(void *arg) {
+  cout << "Running " << __FILE__ "..." << endl;
+  char **argv = static_cast<char **>(arg);
+  std::string ip_addr_port(argv[1]);
+  auto raddr = helpers::str_to_netaddr(ip_addr_port);
+  std::unique_ptr<FarMemManager> manager =
+      std::unique_ptr<FarMemManager>(FarMemManagerFactory::build(
+          kCacheSize, kNumGCThreads,
+          new TCPDevice(raddr, kNumConnections, kFarMemSize)));
+  do_work(manager.get());
+}
+
+int main(int _argc, char *argv[]) {
+  int ret;
+
+  if (_argc < 3) {
+    std::cerr << "usage: [cfg_file] [ip_addr:port]" << std::endl;
+    return -EINVAL;
+  }
+
+  char conf_path[strlen(argv[1]) + 1];
+  strcpy(conf_path, argv[1]);
+  for (int i = 2; i < _argc; i++) {
+    argv[i - 1] = argv[i];
+  }
+  argc = _argc - 1;
+
+  ret = runtime_init(conf_path, _main, argv);
+  if (ret) {
+    std::cerr << "failed to start runtime" << std::endl;
+    return ret;
+  }
+
+  return 0;
+}